@@ -20,6 +20,7 @@
 #include "IndexedDatabase.h"
 #include "IndexedDatabaseInlines.h"
 #include "mozilla/BasicEvents.h"
+#include "mozilla/BufferList.h"
 #include "mozilla/CycleCollectedJSRuntime.h"
 #include "mozilla/Maybe.h"
 #include "mozilla/TypeTraits.h"
@@ -68,6 +69,7 @@
 namespace mozilla {
 
 using ipc::PrincipalInfo;
+using ipc::Shmem;
 
 namespace dom {
 
@@ -1273,6 +1275,41 @@ void DispatchFileHandleSuccessEvent(FileHandleResultHelper* aResultHelper) {
   MOZ_ASSERT(fileHandle->IsOpen() || fileHandle->IsAborted());
 }
 
+// Never frees anything, the memory handed to a BufferList using this policy is
+// owned elsewhere.
+class NonOwningAllocPolicy : public InfallibleAllocPolicy {
+ public:
+  template <typename T>
+  void free_(T* aPtr, size_t aNumElems = 0) {}
+};
+
+// Makes aData borrow the memory of aShmem, so the structured clone reader can
+// decode it in place. aShmem must outlive aData.
+bool BorrowShmemData(const Shmem& aShmem, JSStructuredCloneData& aData) {
+  const size_t dataSize = aShmem.Size<char>();
+  MOZ_ASSERT(dataSize);
+  MOZ_ASSERT(!(dataSize % sizeof(uint64_t)));
+
+  BufferList<NonOwningAllocPolicy> owner(0, 0, dataSize);
+  if (NS_WARN_IF(
+          !owner.WriteBytesZeroCopy(aShmem.get<char>(), dataSize, dataSize))) {
+    return false;
+  }
+
+  auto iter = owner.Iter();
+
+  bool success;
+  JSStructuredCloneData::BufferList borrowed =
+      owner.Borrow<js::SystemAllocPolicy>(iter, dataSize, &success);
+  if (NS_WARN_IF(!success)) {
+    return false;
+  }
+
+  aData = JSStructuredCloneData(std::move(borrowed),
+                                JS::StructuredCloneScope::DifferentProcess);
+  return true;
+}
+
 }  // namespace
 
 /*******************************************************************************
@@ -2661,6 +2698,34 @@ void BackgroundRequestChild::HandleResponse(
   DispatchSuccessEvent(&helper);
 }
 
+void BackgroundRequestChild::HandleResponse(
+    const SharedCloneGetResponse& aResponse) {
+  AssertIsOnOwningThread();
+
+  // XXX Fix this somehow...
+  auto& shmem = const_cast<Shmem&>(aResponse.data());
+
+  StructuredCloneReadInfo cloneReadInfo;
+  if (NS_WARN_IF(!BorrowShmemData(shmem, cloneReadInfo.mData))) {
+    DeallocShmem(shmem);
+    HandleResponse(NS_ERROR_OUT_OF_MEMORY);
+    return;
+  }
+
+  DeserializeStructuredCloneFiles(mTransaction->Database(), aResponse.files(),
+                                  GetNextModuleSet(cloneReadInfo),
+                                  cloneReadInfo.mFiles);
+
+  ResultHelper helper(mRequest, mTransaction, &cloneReadInfo);
+
+  DispatchSuccessEvent(&helper);
+
+  // The value has been decoded by now, drop the borrowed data before the
+  // memory goes away.
+  cloneReadInfo.mData.Clear();
+  DeallocShmem(shmem);
+}
+
 void BackgroundRequestChild::HandleResponse(
     const nsTArray<SerializedStructuredCloneReadInfo>& aResponse) {
   AssertIsOnOwningThread();
@@ -2844,6 +2909,10 @@ mozilla::ipc::IPCResult BackgroundRequestChild::Recv__delete__(
         HandleResponse(aResponse.get_ObjectStorePutResponse().key());
         break;
 
+      case RequestResponse::TObjectStorePutAllResponse:
+        HandleResponse(aResponse.get_ObjectStorePutAllResponse().keys());
+        break;
+
       case RequestResponse::TObjectStoreGetResponse:
         HandleResponse(aResponse.get_ObjectStoreGetResponse().cloneInfo());
         break;
@@ -2892,6 +2961,10 @@ mozilla::ipc::IPCResult BackgroundRequestChild::Recv__delete__(
         HandleResponse(aResponse.get_IndexCountResponse().count());
         break;
 
+      case RequestResponse::TSharedCloneGetResponse:
+        HandleResponse(aResponse.get_SharedCloneGetResponse());
+        break;
+
       default:
         MOZ_CRASH("Unknown response type!");
     }
@@ -3249,6 +3322,7 @@ BackgroundCursorChild::BackgroundCursorChild(IDBRequest* aRequest,
       mIndex(nullptr),
       mCursor(nullptr),
       mStrongRequest(aRequest),
+      mPreloadCache(mTransaction->WriteRequestCount()),
       mDirection(aDirection) {
   MOZ_ASSERT(aObjectStore);
   aObjectStore->AssertIsOnOwningThread();
@@ -3266,6 +3340,7 @@ BackgroundCursorChild::BackgroundCursorChild(IDBRequest* aRequest,
       mIndex(aIndex),
       mCursor(nullptr),
       mStrongRequest(aRequest),
+      mPreloadCache(mTransaction->WriteRequestCount()),
       mDirection(aDirection) {
   MOZ_ASSERT(aIndex);
   aIndex->AssertIsOnOwningThread();
@@ -3295,7 +3370,71 @@ void BackgroundCursorChild::SendContinueInternal(
 
   mTransaction->OnNewRequest();
 
-  MOZ_ALWAYS_TRUE(PBackgroundIDBCursorChild::SendContinue(aParams));
+  if (!mPreloadCache.IsEmpty() && ConsumeCachedResponses(aParams)) {
+    nsCOMPtr<nsIRunnable> continueRunnable = new DelayedActionRunnable(
+        this, &BackgroundCursorChild::CompleteContinueRequestFromCache);
+    MOZ_ALWAYS_SUCCEEDS(this->GetActorEventTarget()->Dispatch(
+        continueRunnable.forget(), NS_DISPATCH_NORMAL));
+    return;
+  }
+
+  const Key currentKey = mPreloadCache.OnRequestSent(
+      mTransaction->WriteRequestCount(), mCursor->CurrentKey());
+
+  MOZ_ALWAYS_TRUE(
+      PBackgroundIDBCursorChild::SendContinue(aParams, currentKey));
+}
+
+bool BackgroundCursorChild::ConsumeCachedResponses(
+    const CursorRequestParams& aParams) {
+  AssertIsOnOwningThread();
+  MOZ_ASSERT(mObjectStore);
+  MOZ_ASSERT(!mPreloadCache.IsEmpty());
+
+  const uint64_t writeRequestCount = mTransaction->WriteRequestCount();
+
+  switch (aParams.type()) {
+    case CursorRequestParams::TContinueParams: {
+      const bool isNext = mDirection == IDBCursor::NEXT ||
+                          mDirection == IDBCursor::NEXT_UNIQUE;
+
+      return mPreloadCache.ConsumeContinue(
+          writeRequestCount, aParams.get_ContinueParams().key(), isNext);
+    }
+
+    case CursorRequestParams::TAdvanceParams:
+      return mPreloadCache.ConsumeAdvance(
+          writeRequestCount, aParams.get_AdvanceParams().count());
+
+    case CursorRequestParams::TContinuePrimaryKeyParams:
+      // Only index cursors support continuePrimaryKey().
+      MOZ_CRASH("Object store cursors should never get here!");
+
+    default:
+      MOZ_CRASH("Should never get here!");
+  }
+}
+
+void BackgroundCursorChild::CompleteContinueRequestFromCache() {
+  AssertIsOnOwningThread();
+  MOZ_ASSERT(mRequest);
+  MOZ_ASSERT(mTransaction);
+  MOZ_ASSERT(mCursor);
+  MOZ_ASSERT(mStrongCursor);
+  MOZ_ASSERT(!mPreloadCache.IsEmpty());
+
+  RefPtr<IDBCursor> cursor;
+  mStrongCursor.swap(cursor);
+
+  RefPtr<IDBTransaction> transaction = mTransaction;
+
+  CachedResponse response = mPreloadCache.PopFront();
+  mCursor->Reset(std::move(response.mKey), std::move(response.mCloneInfo));
+
+  ResultHelper helper(mRequest, mTransaction, mCursor);
+  DispatchSuccessEvent(&helper);
+
+  transaction->OnRequestFinished(/* aActorDestroyedNormally */ true);
 }
 
 void BackgroundCursorChild::SendDeleteMeInternal() {
@@ -3335,6 +3474,8 @@ void BackgroundCursorChild::HandleResponse(const void_t& aResponse) {
   MOZ_ASSERT(!mStrongRequest);
   MOZ_ASSERT(!mStrongCursor);
 
+  mPreloadCache.OnResponse(mTransaction->WriteRequestCount(), 0);
+
   if (mCursor) {
     mCursor->Reset();
   }
@@ -3358,14 +3499,26 @@ void BackgroundCursorChild::HandleResponse(
   MOZ_ASSERT(mObjectStore);
   MOZ_ASSERT(!mStrongRequest);
   MOZ_ASSERT(!mStrongCursor);
-
-  MOZ_ASSERT(aResponses.Length() == 1);
+  MOZ_ASSERT(!aResponses.IsEmpty());
 
   // XXX Fix this somehow...
   auto& responses =
       const_cast<nsTArray<ObjectStoreCursorResponse>&>(aResponses);
 
-  for (ObjectStoreCursorResponse& response : responses) {
+  // Records read before a write request in this transaction was processed by
+  // the parent may be stale, only the requested one is guaranteed not to be.
+  const bool keepExtraResponses = mPreloadCache.OnResponse(
+      mTransaction->WriteRequestCount(), responses.Length());
+
+  RefPtr<IDBCursor> newCursor;
+
+  for (uint32_t index = 0; index < responses.Length(); index++) {
+    ObjectStoreCursorResponse& response = responses[index];
+
+    if (index && !keepExtraResponses) {
+      break;
+    }
+
     StructuredCloneReadInfo cloneReadInfo(std::move(response.cloneInfo()));
     cloneReadInfo.mDatabase = mTransaction->Database();
 
@@ -3373,9 +3526,10 @@ void BackgroundCursorChild::HandleResponse(
                                     response.cloneInfo().files(), nullptr,
                                     cloneReadInfo.mFiles);
 
-    RefPtr<IDBCursor> newCursor;
-
-    if (mCursor) {
+    if (index) {
+      mPreloadCache.Push(
+          CachedResponse{std::move(response.key()), std::move(cloneReadInfo)});
+    } else if (mCursor) {
       mCursor->Reset(std::move(response.key()), std::move(cloneReadInfo));
     } else {
       newCursor = IDBCursor::Create(this, std::move(response.key()),
@@ -7,7 +7,9 @@
 #ifndef mozilla_dom_indexeddb_actorschild_h__
 #define mozilla_dom_indexeddb_actorschild_h__
 
+#include "CursorPreloadCache.h"
 #include "IDBTransaction.h"
+#include "IndexedDatabase.h"
 #include "js/RootingAPI.h"
 #include "mozilla/Attributes.h"
 #include "mozilla/dom/indexedDB/PBackgroundIDBCursorChild.h"
@@ -602,6 +604,8 @@ class BackgroundRequestChild final : public BackgroundRequestChildBase,
 
   void HandleResponse(const SerializedStructuredCloneReadInfo& aResponse);
 
+  void HandleResponse(const SharedCloneGetResponse& aResponse);
+
   void HandleResponse(
       const nsTArray<SerializedStructuredCloneReadInfo>& aResponse);
 
@@ -630,6 +634,11 @@ class BackgroundCursorChild final : public PBackgroundIDBCursorChild {
 
   class DelayedActionRunnable;
 
+  struct CachedResponse {
+    Key mKey;
+    StructuredCloneReadInfo mCloneInfo;
+  };
+
   IDBRequest* mRequest;
   IDBTransaction* mTransaction;
   IDBObjectStore* mObjectStore;
@@ -640,6 +649,10 @@ class BackgroundCursorChild final : public PBackgroundIDBCursorChild {
   RefPtr<IDBRequest> mStrongRequest;
   RefPtr<IDBCursor> mStrongCursor;
 
+  // Records the parent sent along with the requested one. They are used to
+  // answer continue() and advance() without a round trip to the parent.
+  CursorPreloadCache<CachedResponse> mPreloadCache;
+
   Direction mDirection;
 
   NS_DECL_OWNINGTHREAD
@@ -700,6 +713,10 @@ class BackgroundCursorChild final : public PBackgroundIDBCursorChild {
 
   void HandleResponse(const IndexKeyCursorResponse& aResponse);
 
+  bool ConsumeCachedResponses(const CursorRequestParams& aParams);
+
+  void CompleteContinueRequestFromCache();
+
   // IPDL methods are only called by IPDL.
   virtual void ActorDestroy(ActorDestroyReason aWhy) override;
 
@@ -707,7 +724,8 @@ class BackgroundCursorChild final : public PBackgroundIDBCursorChild {
       const CursorResponse& aResponse) override;
 
   // Force callers to use SendContinueInternal.
-  bool SendContinue(const CursorRequestParams& aParams) = delete;
+  bool SendContinue(const CursorRequestParams& aParams,
+                    const Key& aCurrentKey) = delete;
 
   bool SendDeleteMe() = delete;
 };
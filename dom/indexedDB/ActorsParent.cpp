@@ -8,6 +8,8 @@
 
 #include <algorithm>
 #include <stdint.h>  // UINTPTR_MAX, uintptr_t
+#include "AutoIncrementKeyGenerator.h"
+#include "CursorPreloadCache.h"
 #include "FileInfo.h"
 #include "FileManager.h"
 #include "IDBObjectStore.h"
@@ -69,6 +71,7 @@
 #include "mozilla/ipc/PBackgroundParent.h"
 #include "mozilla/Scoped.h"
 #include "mozilla/storage/Variant.h"
+#include "mozilla/ThreadLocal.h"
 #include "nsAutoPtr.h"
 #include "nsCharSeparatedTokenizer.h"
 #include "nsClassHashtable.h"
@@ -112,6 +115,7 @@
 #include "ProfilerHelpers.h"
 #include "prsystem.h"
 #include "prtime.h"
+#include "ReaderConnectionSet.h"
 #include "ReportInternalError.h"
 #include "snappy/snappy.h"
 
@@ -231,6 +235,14 @@ const uint32_t kMaxIdleConnectionThreadCount = 2;
 static_assert(kMaxConnectionThreadCount >= kMaxIdleConnectionThreadCount,
               "Idle thread limit must be less than total thread limit!");
 
+// The maximum number of extra connections (each with its own thread) that a
+// single database may open to run readonly transactions in parallel. The
+// actual limit is further reduced on machines with few cores.
+const uint32_t kMaxReaderConnectionCount = 4;
+
+static_assert(kMaxConnectionThreadCount > kMaxReaderConnectionCount,
+              "Reader connections must leave room for other databases!");
+
 // The length of time that database connections will be held open after all
 // transactions have completed before doing idle maintenance.
 const uint32_t kConnectionIdleMaintenanceMS = 2 * 1000;  // 2 seconds
@@ -246,6 +258,10 @@ const uint32_t kConnectionThreadIdleMS = 30 * 1000;  // 30 seconds
 
 const uint32_t kFileCopyBufferSize = 32768;
 
+// Cursors stop preloading records once the structured clone data of the
+// records collected for a single response exceeds this size.
+const size_t kMaxCursorPreloadSize = 1024 * 1024;  // 1MB
+
 #define JOURNAL_DIRECTORY_NAME "journals"
 
 const char kFileManagerDirectoryNameSuffix[] = ".files";
@@ -4030,6 +4046,36 @@ nsresult SetJournalMode(mozIStorageConnection* aConnection) {
   return NS_OK;
 }
 
+nsresult IsInWALMode(mozIStorageConnection* aConnection, bool* aWALMode) {
+  MOZ_ASSERT(!NS_IsMainThread());
+  MOZ_ASSERT(aConnection);
+  MOZ_ASSERT(aWALMode);
+
+  nsCOMPtr<mozIStorageStatement> stmt;
+  nsresult rv = aConnection->CreateStatement(
+      NS_LITERAL_CSTRING("PRAGMA journal_mode;"), getter_AddRefs(stmt));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  bool hasResult;
+  rv = stmt->ExecuteStep(&hasResult);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  MOZ_ASSERT(hasResult);
+
+  nsCString journalMode;
+  rv = stmt->GetUTF8String(0, journalMode);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  *aWALMode = journalMode.EqualsLiteral("wal");
+  return NS_OK;
+}
+
 template <class FileOrURLType>
 struct StorageOpenTraits;
 
@@ -4702,6 +4748,10 @@ class DatabaseConnection final {
 
   void FinishWriteTransaction();
 
+  nsresult RestartReadTransaction();
+
+  void EndReadTransaction();
+
   nsresult StartSavepoint();
 
   nsresult ReleaseSavepoint();
@@ -4910,11 +4960,17 @@ class ConnectionPool final {
   struct IdleDatabaseInfo;
   struct IdleResource;
   struct IdleThreadInfo;
+  struct ReaderInfo;
+  class ReaderRunnable;
   struct ThreadInfo;
   class ThreadRunnable;
   class TransactionInfo;
   struct TransactionInfoPair;
 
+  // Set on a connection thread while it is serving as a reader for some
+  // database, null otherwise.
+  static MOZ_THREAD_LOCAL(ReaderInfo*) sCurrentReaderInfo;
+
   // This mutex guards mDatabases, see below.
   Mutex mDatabasesMutex;
 
@@ -4936,6 +4992,7 @@ class ConnectionPool final {
 
   uint64_t mNextTransactionId;
   uint32_t mTotalThreadCount;
+  const uint32_t mMaxReaderCount;
   bool mShutdownRequested;
   bool mShutdownComplete;
 
@@ -4946,6 +5003,10 @@ class ConnectionPool final {
     NS_ASSERT_OWNINGTHREAD(ConnectionPool);
   }
 
+  static bool IsOnReaderThread() { return !!sCurrentReaderInfo.get(); }
+
+  static DatabaseConnection* GetReaderConnection();
+
   nsresult GetOrCreateConnection(const Database* aDatabase,
                                  DatabaseConnection** aConnection);
 
@@ -4987,15 +5048,26 @@ class ConnectionPool final {
 
   void ShutdownIdleThreads();
 
+  bool TakeIdleOrNewThread(ThreadInfo& aThreadInfo);
+
+  void RecycleThread(ThreadInfo& aThreadInfo);
+
   bool ScheduleTransaction(TransactionInfo* aTransactionInfo,
                            bool aFromQueuedTransactions);
 
+  ReaderInfo* SelectReader(DatabaseInfo* aDatabaseInfo);
+
   void NoteFinishedTransaction(uint64_t aTransactionId);
 
   void ScheduleQueuedTransactions(ThreadInfo& aThreadInfo);
 
+  void NoteIdleReader(ReaderInfo* aReaderInfo);
+
   void NoteIdleDatabase(DatabaseInfo* aDatabaseInfo);
 
+  void NoteClosedConnection(DatabaseInfo* aDatabaseInfo,
+                            ReaderInfo* aReaderInfo);
+
   void NoteClosedDatabase(DatabaseInfo* aDatabaseInfo);
 
   bool MaybeFireCallback(DatabasesCompleteCallback* aCallback);
@@ -5004,6 +5076,10 @@ class ConnectionPool final {
 
   void CloseDatabase(DatabaseInfo* aDatabaseInfo);
 
+  void CloseReader(ReaderInfo* aReaderInfo);
+
+  void CloseReaders(DatabaseInfo* aDatabaseInfo);
+
   bool CloseDatabaseWhenIdleInternal(const nsACString& aDatabaseId);
 };
 
@@ -5035,9 +5111,13 @@ class ConnectionPool::IdleConnectionRunnable final : public ConnectionRunnable {
 
 class ConnectionPool::CloseConnectionRunnable final
     : public ConnectionRunnable {
+  // Null when closing the database's main connection.
+  ReaderInfo* mReaderInfo;
+
  public:
-  explicit CloseConnectionRunnable(DatabaseInfo* aDatabaseInfo)
-      : ConnectionRunnable(aDatabaseInfo) {}
+  explicit CloseConnectionRunnable(DatabaseInfo* aDatabaseInfo,
+                                   ReaderInfo* aReaderInfo = nullptr)
+      : ConnectionRunnable(aDatabaseInfo), mReaderInfo(aReaderInfo) {}
 
   NS_INLINE_DECL_REFCOUNTING_INHERITED(CloseConnectionRunnable,
                                        ConnectionRunnable)
@@ -5070,8 +5150,17 @@ struct ConnectionPool::DatabaseInfo final {
   nsTArray<TransactionInfo*> mScheduledWriteTransactions;
   TransactionInfo* mRunningWriteTransaction;
   ThreadInfo mThreadInfo;
+  ReaderConnectionSet<ReaderInfo> mReaders;
   uint32_t mReadTransactionCount;
   uint32_t mWriteTransactionCount;
+  // Transactions currently running on mThreadInfo, as opposed to a reader.
+  uint32_t mRunningTransactionCount;
+  // Includes both the main connection and any readers being closed.
+  uint32_t mClosingConnectionCount;
+  // Set on the connection thread once the main connection is known to be in
+  // WAL mode. Readers could block the main connection's writes otherwise, so
+  // all transactions then run on the main connection.
+  Atomic<bool> mReadersAllowed;
   bool mNeedsCheckpoint;
   bool mIdle;
   bool mCloseOnIdle;
@@ -5099,6 +5188,42 @@ struct ConnectionPool::DatabaseInfo final {
   DatabaseInfo& operator=(const DatabaseInfo&) = delete;
 };
 
+// An extra connection used to run readonly transactions while the main
+// connection is busy. Readers never write, so readwrite transactions keep their
+// ordering on the main connection and readers only need a fresh WAL snapshot at
+// the start of each transaction.
+struct ConnectionPool::ReaderInfo final {
+  friend class DefaultDelete<ReaderInfo>;
+
+  DatabaseInfo* mDatabaseInfo;
+  // Only touched on the reader's connection thread.
+  RefPtr<DatabaseConnection> mConnection;
+  ThreadInfo mThreadInfo;
+
+  explicit ReaderInfo(DatabaseInfo* aDatabaseInfo);
+
+ private:
+  ~ReaderInfo();
+
+  ReaderInfo(const ReaderInfo&) = delete;
+  ReaderInfo& operator=(const ReaderInfo&) = delete;
+};
+
+class ConnectionPool::ReaderRunnable final : public Runnable {
+  ReaderInfo* mReaderInfo;
+  const bool mBeginTransaction;
+
+ public:
+  ReaderRunnable(ReaderInfo* aReaderInfo, bool aBeginTransaction);
+
+  NS_INLINE_DECL_REFCOUNTING_INHERITED(ReaderRunnable, Runnable)
+
+ private:
+  ~ReaderRunnable() override = default;
+
+  NS_DECL_NSIRUNNABLE
+};
+
 struct ConnectionPool::DatabasesCompleteCallback final {
   friend class nsAutoPtr<DatabasesCompleteCallback>;
 
@@ -5244,6 +5369,8 @@ class ConnectionPool::TransactionInfo final {
   const nsTArray<nsString> mObjectStoreNames;
   nsTHashtable<nsPtrHashKey<TransactionInfo>> mBlockedOn;
   nsTArray<nsCOMPtr<nsIRunnable>> mQueuedRunnables;
+  // Null when running on the database's main connection.
+  ReaderInfo* mReaderInfo;
   const bool mIsWriteTransaction;
   bool mRunning;
 
@@ -5727,7 +5854,12 @@ class Database final
 
   void AssertIsOnConnectionThread() const {
 #ifdef DEBUG
-    if (mConnection) {
+    if (ConnectionPool::IsOnReaderThread()) {
+      if (DatabaseConnection* connection =
+              ConnectionPool::GetReaderConnection()) {
+        connection->AssertIsOnConnectionThread();
+      }
+    } else if (mConnection) {
       MOZ_ASSERT(mConnection);
       mConnection->AssertIsOnConnectionThread();
     } else {
@@ -5825,6 +5957,12 @@ class Database final
   nsresult EnsureConnection();
 
   DatabaseConnection* GetConnection() const {
+    // Readonly transactions may be running on one of the pool's reader
+    // connections rather than on mConnection.
+    if (ConnectionPool::IsOnReaderThread()) {
+      return ConnectionPool::GetReaderConnection();
+    }
+
 #ifdef DEBUG
     if (mConnection) {
       mConnection->AssertIsOnConnectionThread();
@@ -7159,6 +7297,11 @@ class NormalTransactionOp : public TransactionDatabaseOperationBase,
 
   virtual nsresult GetPreprocessParams(PreprocessParams& aParams);
 
+  // Copies the structured clone data of a large value into shared memory so
+  // that it can be sent with a SharedCloneGetResponse. Returns false if the
+  // value should be sent inline.
+  bool ShareCloneData(const StructuredCloneReadInfo& aInfo, Shmem* aShmem);
+
   // Subclasses use this override to set the IPDL response value.
   virtual void GetResponse(RequestResponse& aResponse,
                            size_t* aResponseSize) = 0;
@@ -7182,25 +7325,26 @@ class ObjectStoreAddOrPutRequestOp final : public NormalTransactionOp {
 
   typedef mozilla::dom::quota::PersistenceType PersistenceType;
 
+  struct RecordInfo;
   struct StoredFileInfo;
   class SCInputStream;
 
-  const ObjectStoreAddPutParams mParams;
+  // A single record for add() and put(), one per value for putAll(). This is
+  // never resized after construction since SCInputStream points into it.
+  nsTArray<RecordInfo> mRecords;
+  int64_t mObjectStoreId;
   Maybe<UniqueIndexTable> mUniqueIndexTable;
 
   // This must be non-const so that we can update the mNextAutoIncrementId field
   // if we are modifying an autoIncrement objectStore.
   RefPtr<FullObjectStoreMetadata> mMetadata;
 
-  FallibleTArray<StoredFileInfo> mStoredFileInfos;
-
-  Key mResponse;
   const nsCString mGroup;
   const nsCString mOrigin;
   const PersistenceType mPersistenceType;
   const bool mOverwrite;
+  const bool mPutAll;
   bool mObjectStoreMayHaveIndexes;
-  bool mDataOverThreshold;
 
  private:
   // Only created by TransactionBase.
@@ -7209,10 +7353,17 @@ class ObjectStoreAddOrPutRequestOp final : public NormalTransactionOp {
 
   ~ObjectStoreAddOrPutRequestOp() override = default;
 
-  nsresult RemoveOldIndexDataValues(DatabaseConnection* aConnection);
+  nsresult RemoveOldIndexDataValues(DatabaseConnection* aConnection,
+                                    const Key& aKey);
+
+  nsresult AddOrPutRecord(DatabaseConnection* aConnection,
+                          RecordInfo& aRecord, bool aObjectStoreHasIndexes,
+                          AutoIncrementKeyGenerator& aKeyGenerator);
 
   bool Init(TransactionBase* aTransaction) override;
 
+  bool InitStoredFileInfos(TransactionBase* aTransaction, RecordInfo& aRecord);
+
   nsresult DoDatabaseWork(DatabaseConnection* aConnection) override;
 
   void GetResponse(RequestResponse& aResponse, size_t* aResponseSize) override;
@@ -7275,6 +7426,16 @@ struct ObjectStoreAddOrPutRequestOp::StoredFileInfo final {
   }
 };
 
+struct ObjectStoreAddOrPutRequestOp::RecordInfo final {
+  ObjectStoreAddPutParams mParams;
+  FallibleTArray<StoredFileInfo> mStoredFileInfos;
+  // The final key, only set once the record has been written.
+  Key mKey;
+  bool mDataOverThreshold;
+
+  RecordInfo() : mDataOverThreshold(false) {}
+};
+
 class ObjectStoreAddOrPutRequestOp::SCInputStream final
     : public nsIInputStream {
   const JSStructuredCloneData& mData;
@@ -7440,6 +7601,9 @@ class IndexGetRequestOp final : public IndexRequestOpBase {
 
   ~IndexGetRequestOp() override = default;
 
+  template <typename T>
+  nsresult ConvertResponse(StructuredCloneReadInfo& aInfo, T& aResult);
+
   nsresult DoDatabaseWork(DatabaseConnection* aConnection) override;
 
   void GetResponse(RequestResponse& aResponse, size_t* aResponseSize) override;
@@ -7513,6 +7677,10 @@ class Cursor final : public PBackgroundIDBCursorParent {
   const int64_t mObjectStoreId;
   const int64_t mIndexId;
 
+  // The number of records sent to the child in addition to the one that was
+  // requested. Only object store cursors preload records.
+  const uint32_t mMaxExtraCount;
+
   nsCString mContinueQuery;
   nsCString mContinueToQuery;
   nsCString mContinuePrimaryKeyQuery;
@@ -7561,8 +7729,8 @@ class Cursor final : public PBackgroundIDBCursorParent {
 
   mozilla::ipc::IPCResult RecvDeleteMe() override;
 
-  mozilla::ipc::IPCResult RecvContinue(
-      const CursorRequestParams& aParams) override;
+  mozilla::ipc::IPCResult RecvContinue(const CursorRequestParams& aParams,
+                                       const Key& aCurrentKey) override;
 
   bool IsLocaleAware() const { return !mLocale.IsEmpty(); }
 };
@@ -7599,6 +7767,8 @@ class Cursor::CursorOpBase : public TransactionDatabaseOperationBase {
 
   nsresult PopulateResponseFromStatement(
       DatabaseConnection::CachedStatement& aStmt, bool aInitializeResponse);
+
+  nsresult PopulateExtraResponses(DatabaseConnection::CachedStatement& aStmt);
 };
 
 class Cursor::OpenOp final : public Cursor::CursorOpBase {
@@ -9517,6 +9687,57 @@ void DatabaseConnection::FinishWriteTransaction() {
   mInReadTransaction = true;
 }
 
+nsresult DatabaseConnection::RestartReadTransaction() {
+  AssertIsOnConnectionThread();
+  MOZ_ASSERT(mStorageConnection);
+  MOZ_ASSERT(!mInWriteTransaction);
+
+  AUTO_PROFILER_LABEL("DatabaseConnection::RestartReadTransaction", DOM);
+
+  // SQLite only takes the WAL snapshot when the first statement runs, so
+  // restarting the transaction here makes the next reader see everything that
+  // has been committed up to this point.
+  EndReadTransaction();
+
+  CachedStatement stmt;
+  nsresult rv = GetCachedStatement(NS_LITERAL_CSTRING("BEGIN;"), &stmt);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  rv = stmt->Execute();
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  mInReadTransaction = true;
+
+  return NS_OK;
+}
+
+void DatabaseConnection::EndReadTransaction() {
+  AssertIsOnConnectionThread();
+  MOZ_ASSERT(mStorageConnection);
+  MOZ_ASSERT(!mInWriteTransaction);
+
+  if (!mInReadTransaction) {
+    return;
+  }
+
+  CachedStatement stmt;
+  nsresult rv = GetCachedStatement(NS_LITERAL_CSTRING("ROLLBACK;"), &stmt);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return;
+  }
+
+  // This releases the WAL read lock so that checkpoints aren't held back by an
+  // idle reader. It's possible that it could fail, but that isn't a problem
+  // here.
+  Unused << stmt->Execute();
+
+  mInReadTransaction = false;
+}
+
 nsresult DatabaseConnection::StartSavepoint() {
   AssertIsOnConnectionThread();
   MOZ_ASSERT(mStorageConnection);
@@ -10630,16 +10851,36 @@ nsresult DatabaseConnection::UpdateRefcountFunction::DatabaseUpdateFunction::
  * ConnectionPool implementation
  ******************************************************************************/
 
+MOZ_THREAD_LOCAL(ConnectionPool::ReaderInfo*)
+ConnectionPool::sCurrentReaderInfo;
+
 ConnectionPool::ConnectionPool()
     : mDatabasesMutex("ConnectionPool::mDatabasesMutex"),
       mIdleTimer(NS_NewTimer()),
       mNextTransactionId(0),
       mTotalThreadCount(0),
+      // Leave one core for the main connection. PR_GetNumberOfProcessors()
+      // can return -1 on error, in which case no readers are used.
+      mMaxReaderCount(std::min(
+          uint32_t(std::max(int32_t(PR_GetNumberOfProcessors()) - 1, 0)),
+          kMaxReaderConnectionCount)),
       mShutdownRequested(false),
       mShutdownComplete(false) {
   AssertIsOnOwningThread();
   AssertIsOnBackgroundThread();
   MOZ_ASSERT(mIdleTimer);
+
+  MOZ_ALWAYS_TRUE(sCurrentReaderInfo.init());
+}
+
+// static
+DatabaseConnection* ConnectionPool::GetReaderConnection() {
+  MOZ_ASSERT(!IsOnBackgroundThread());
+
+  ReaderInfo* readerInfo = sCurrentReaderInfo.get();
+  MOZ_ASSERT(readerInfo);
+
+  return readerInfo->mConnection;
 }
 
 ConnectionPool::~ConnectionPool() {
@@ -10734,9 +10975,15 @@ nsresult ConnectionPool::GetOrCreateConnection(
 
   MOZ_ASSERT(dbInfo);
 
-  RefPtr<DatabaseConnection> connection = dbInfo->mConnection;
+  ReaderInfo* readerInfo = sCurrentReaderInfo.get();
+  MOZ_ASSERT_IF(readerInfo, readerInfo->mDatabaseInfo == dbInfo);
+
+  RefPtr<DatabaseConnection>& connectionSlot =
+      readerInfo ? readerInfo->mConnection : dbInfo->mConnection;
+
+  RefPtr<DatabaseConnection> connection = connectionSlot;
   if (!connection) {
-    MOZ_ASSERT(!dbInfo->mDEBUGConnectionThread);
+    MOZ_ASSERT_IF(!readerInfo, !dbInfo->mDEBUGConnectionThread);
 
     nsCOMPtr<mozIStorageConnection> storageConnection;
     nsresult rv = GetStorageConnection(aDatabase->FilePath(), aDatabase->Type(),
@@ -10755,18 +11002,39 @@ nsresult ConnectionPool::GetOrCreateConnection(
       return rv;
     }
 
-    dbInfo->mConnection = connection;
+    // SetJournalMode() falls back to a rollback journal when WAL mode can't be
+    // enabled, and readers would then hold locks that block the writes.
+    bool walMode;
+    rv = IsInWALMode(storageConnection, &walMode);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+
+    if (!readerInfo) {
+      dbInfo->mReadersAllowed = walMode;
+    } else if (NS_WARN_IF(!walMode)) {
+      // The journal mode is stored in the database, so it changed since the
+      // main connection was opened. Let this transaction finish here but
+      // don't open any more readers.
+      dbInfo->mReadersAllowed = false;
+    }
+
+    connectionSlot = connection;
 
-    IDB_DEBUG_LOG(("ConnectionPool created connection 0x%p for '%s'",
-                   dbInfo->mConnection.get(),
+    IDB_DEBUG_LOG(("ConnectionPool created %s connection 0x%p for '%s'",
+                   readerInfo ? "reader" : "main", connection.get(),
                    NS_ConvertUTF16toUTF8(aDatabase->FilePath()).get()));
 
 #ifdef DEBUG
-    dbInfo->mDEBUGConnectionThread = GetCurrentPhysicalThread();
+    if (!readerInfo) {
+      dbInfo->mDEBUGConnectionThread = GetCurrentPhysicalThread();
+    }
 #endif
   }
 
-  dbInfo->AssertIsOnConnectionThread();
+  if (!readerInfo) {
+    dbInfo->AssertIsOnConnectionThread();
+  }
 
   connection.forget(aConnection);
   return NS_OK;
@@ -10878,14 +11146,20 @@ void ConnectionPool::Dispatch(uint64_t aTransactionId, nsIRunnable* aRunnable) {
   if (transactionInfo->mRunning) {
     DatabaseInfo* dbInfo = transactionInfo->mDatabaseInfo;
     MOZ_ASSERT(dbInfo);
-    MOZ_ASSERT(dbInfo->mThreadInfo.mThread);
-    MOZ_ASSERT(dbInfo->mThreadInfo.mRunnable);
     MOZ_ASSERT(!dbInfo->mClosing);
     MOZ_ASSERT_IF(transactionInfo->mIsWriteTransaction,
                   dbInfo->mRunningWriteTransaction == transactionInfo);
+    MOZ_ASSERT_IF(transactionInfo->mIsWriteTransaction,
+                  !transactionInfo->mReaderInfo);
+
+    ThreadInfo& threadInfo = transactionInfo->mReaderInfo
+                                 ? transactionInfo->mReaderInfo->mThreadInfo
+                                 : dbInfo->mThreadInfo;
+    MOZ_ASSERT(threadInfo.mThread);
+    MOZ_ASSERT(threadInfo.mRunnable);
 
     MOZ_ALWAYS_SUCCEEDS(
-        dbInfo->mThreadInfo.mThread->Dispatch(aRunnable, NS_DISPATCH_NORMAL));
+        threadInfo.mThread->Dispatch(aRunnable, NS_DISPATCH_NORMAL));
   } else {
     transactionInfo->mQueuedRunnables.AppendElement(aRunnable);
   }
@@ -11135,6 +11409,80 @@ void ConnectionPool::ShutdownIdleThreads() {
   }
 }
 
+bool ConnectionPool::TakeIdleOrNewThread(ThreadInfo& aThreadInfo) {
+  AssertIsOnOwningThread();
+  MOZ_ASSERT(!aThreadInfo.mThread);
+  MOZ_ASSERT(!aThreadInfo.mRunnable);
+
+  if (!mIdleThreads.IsEmpty()) {
+    const uint32_t lastIndex = mIdleThreads.Length() - 1;
+
+    ThreadInfo& threadInfo = mIdleThreads[lastIndex].mThreadInfo;
+
+    aThreadInfo.mRunnable.swap(threadInfo.mRunnable);
+    aThreadInfo.mThread.swap(threadInfo.mThread);
+
+    mIdleThreads.RemoveElementAt(lastIndex);
+
+    AdjustIdleTimer();
+    return true;
+  }
+
+  if (mTotalThreadCount >= kMaxConnectionThreadCount) {
+    return false;
+  }
+
+  // This will set the thread up with the profiler.
+  RefPtr<ThreadRunnable> runnable = new ThreadRunnable();
+
+  nsCOMPtr<nsIThread> newThread;
+  nsresult rv = NS_NewNamedThread(runnable->GetThreadName(),
+                                  getter_AddRefs(newThread), runnable);
+  if (NS_FAILED(rv)) {
+    NS_WARNING("Failed to make new thread!");
+    return false;
+  }
+
+  newThread->SetNameForWakeupTelemetry(NS_LITERAL_CSTRING("IndexedDB (all)"));
+  MOZ_ASSERT(newThread);
+
+  IDB_DEBUG_LOG(("ConnectionPool created thread %" PRIu32,
+                 runnable->SerialNumber()));
+
+  aThreadInfo.mThread.swap(newThread);
+  aThreadInfo.mRunnable.swap(runnable);
+
+  mTotalThreadCount++;
+  return true;
+}
+
+void ConnectionPool::RecycleThread(ThreadInfo& aThreadInfo) {
+  AssertIsOnOwningThread();
+  MOZ_ASSERT(aThreadInfo.mThread);
+  MOZ_ASSERT(aThreadInfo.mRunnable);
+
+  if (!mQueuedTransactions.IsEmpty()) {
+    // Give the thread to another database.
+    ScheduleQueuedTransactions(aThreadInfo);
+  } else if (mShutdownRequested) {
+    ShutdownThread(aThreadInfo);
+  } else {
+    MOZ_ASSERT(!mIdleThreads.Contains(aThreadInfo));
+
+    mIdleThreads.InsertElementSorted(aThreadInfo);
+
+    aThreadInfo.mRunnable = nullptr;
+    aThreadInfo.mThread = nullptr;
+
+    if (mIdleThreads.Length() > kMaxIdleConnectionThreadCount) {
+      ShutdownThread(mIdleThreads[0].mThreadInfo);
+      mIdleThreads.RemoveElementAt(0);
+    }
+
+    AdjustIdleTimer();
+  }
+}
+
 bool ConnectionPool::ScheduleTransaction(TransactionInfo* aTransactionInfo,
                                          bool aFromQueuedTransactions) {
   AssertIsOnOwningThread();
@@ -11159,33 +11507,9 @@ bool ConnectionPool::ScheduleTransaction(TransactionInfo* aTransactionInfo,
   if (!dbInfo->mThreadInfo.mThread) {
     MOZ_ASSERT(!dbInfo->mThreadInfo.mRunnable);
 
-    if (mIdleThreads.IsEmpty()) {
-      bool created = false;
-
-      if (mTotalThreadCount < kMaxConnectionThreadCount) {
-        // This will set the thread up with the profiler.
-        RefPtr<ThreadRunnable> runnable = new ThreadRunnable();
-
-        nsCOMPtr<nsIThread> newThread;
-        nsresult rv = NS_NewNamedThread(runnable->GetThreadName(),
-                                        getter_AddRefs(newThread), runnable);
-        if (NS_SUCCEEDED(rv)) {
-          newThread->SetNameForWakeupTelemetry(
-              NS_LITERAL_CSTRING("IndexedDB (all)"));
-          MOZ_ASSERT(newThread);
-
-          IDB_DEBUG_LOG(("ConnectionPool created thread %" PRIu32,
-                         runnable->SerialNumber()));
-
-          dbInfo->mThreadInfo.mThread.swap(newThread);
-          dbInfo->mThreadInfo.mRunnable.swap(runnable);
-
-          mTotalThreadCount++;
-          created = true;
-        } else {
-          NS_WARNING("Failed to make new thread!");
-        }
-      } else if (!mDatabasesPerformingIdleMaintenance.IsEmpty()) {
+    if (!TakeIdleOrNewThread(dbInfo->mThreadInfo)) {
+      if (mTotalThreadCount >= kMaxConnectionThreadCount &&
+          !mDatabasesPerformingIdleMaintenance.IsEmpty()) {
         // We need a thread right now so force all idle processing to stop by
         // posting a dummy runnable to each thread that might be doing idle
         // maintenance.
@@ -11202,24 +11526,11 @@ bool ConnectionPool::ScheduleTransaction(TransactionInfo* aTransactionInfo,
         }
       }
 
-      if (!created) {
-        if (!aFromQueuedTransactions) {
-          MOZ_ASSERT(!mQueuedTransactions.Contains(aTransactionInfo));
-          mQueuedTransactions.AppendElement(aTransactionInfo);
-        }
-        return false;
+      if (!aFromQueuedTransactions) {
+        MOZ_ASSERT(!mQueuedTransactions.Contains(aTransactionInfo));
+        mQueuedTransactions.AppendElement(aTransactionInfo);
       }
-    } else {
-      const uint32_t lastIndex = mIdleThreads.Length() - 1;
-
-      ThreadInfo& threadInfo = mIdleThreads[lastIndex].mThreadInfo;
-
-      dbInfo->mThreadInfo.mRunnable.swap(threadInfo.mRunnable);
-      dbInfo->mThreadInfo.mThread.swap(threadInfo.mThread);
-
-      mIdleThreads.RemoveElementAt(lastIndex);
-
-      AdjustIdleTimer();
+      return false;
     }
   }
 
@@ -11244,6 +11555,33 @@ bool ConnectionPool::ScheduleTransaction(TransactionInfo* aTransactionInfo,
   MOZ_ASSERT(!aTransactionInfo->mRunning);
   aTransactionInfo->mRunning = true;
 
+  MOZ_ASSERT(!aTransactionInfo->mReaderInfo);
+
+  if (!aTransactionInfo->mIsWriteTransaction) {
+    aTransactionInfo->mReaderInfo = SelectReader(dbInfo);
+  }
+
+  nsIThread* thread;
+
+  if (ReaderInfo* readerInfo = aTransactionInfo->mReaderInfo) {
+    MOZ_ASSERT(readerInfo->mThreadInfo.mThread);
+    MOZ_ASSERT(readerInfo->mThreadInfo.mRunnable);
+
+    thread = readerInfo->mThreadInfo.mThread;
+
+    // Every transaction needs a fresh snapshot so that it sees the writes
+    // that committed before it was unblocked.
+    nsCOMPtr<nsIRunnable> runnable =
+        new ReaderRunnable(readerInfo, /* aBeginTransaction */ true);
+
+    MOZ_ALWAYS_SUCCEEDS(
+        thread->Dispatch(runnable.forget(), NS_DISPATCH_NORMAL));
+  } else {
+    dbInfo->mRunningTransactionCount++;
+
+    thread = dbInfo->mThreadInfo.mThread;
+  }
+
   nsTArray<nsCOMPtr<nsIRunnable>>& queuedRunnables =
       aTransactionInfo->mQueuedRunnables;
 
@@ -11253,8 +11591,8 @@ bool ConnectionPool::ScheduleTransaction(TransactionInfo* aTransactionInfo,
       nsCOMPtr<nsIRunnable> runnable;
       queuedRunnables[index].swap(runnable);
 
-      MOZ_ALWAYS_SUCCEEDS(dbInfo->mThreadInfo.mThread->Dispatch(
-          runnable.forget(), NS_DISPATCH_NORMAL));
+      MOZ_ALWAYS_SUCCEEDS(
+          thread->Dispatch(runnable.forget(), NS_DISPATCH_NORMAL));
     }
 
     queuedRunnables.Clear();
@@ -11263,6 +11601,40 @@ bool ConnectionPool::ScheduleTransaction(TransactionInfo* aTransactionInfo,
   return true;
 }
 
+ConnectionPool::ReaderInfo* ConnectionPool::SelectReader(
+    DatabaseInfo* aDatabaseInfo) {
+  AssertIsOnOwningThread();
+  MOZ_ASSERT(aDatabaseInfo);
+  MOZ_ASSERT(!aDatabaseInfo->mClosing);
+
+  // Prefer the main connection whenever it's free, readers only help when
+  // several readonly transactions are running at the same time.
+  if (!aDatabaseInfo->mRunningTransactionCount ||
+      !aDatabaseInfo->mReadersAllowed) {
+    return nullptr;
+  }
+
+  // Busy readers are never shared, the transaction waits for the main
+  // connection instead if no other reader can be opened.
+  if (ReaderInfo* readerInfo = aDatabaseInfo->mReaders.UseIdleReader()) {
+    return readerInfo;
+  }
+
+  // Don't take threads away from databases that are still waiting for one.
+  if (!aDatabaseInfo->mReaders.CanAddReader() ||
+      !mQueuedTransactions.IsEmpty()) {
+    return nullptr;
+  }
+
+  auto readerInfo = MakeUnique<ReaderInfo>(aDatabaseInfo);
+
+  if (!TakeIdleOrNewThread(readerInfo->mThreadInfo)) {
+    return nullptr;
+  }
+
+  return aDatabaseInfo->mReaders.AddReader(std::move(readerInfo));
+}
+
 void ConnectionPool::NoteFinishedTransaction(uint64_t aTransactionId) {
   AssertIsOnOwningThread();
 
@@ -11281,6 +11653,14 @@ void ConnectionPool::NoteFinishedTransaction(uint64_t aTransactionId) {
   MOZ_ASSERT(dbInfo->mThreadInfo.mThread);
   MOZ_ASSERT(dbInfo->mThreadInfo.mRunnable);
 
+  ReaderInfo* readerInfo = transactionInfo->mReaderInfo;
+  if (readerInfo) {
+    dbInfo->mReaders.NoteIdle(readerInfo);
+  } else {
+    MOZ_ASSERT(dbInfo->mRunningTransactionCount);
+    dbInfo->mRunningTransactionCount--;
+  }
+
   // Schedule the next write transaction if there are any queued.
   if (dbInfo->mRunningWriteTransaction == transactionInfo) {
     MOZ_ASSERT(transactionInfo->mIsWriteTransaction);
@@ -11339,6 +11719,8 @@ void ConnectionPool::NoteFinishedTransaction(uint64_t aTransactionId) {
     dbInfo->mIdle = true;
 
     NoteIdleDatabase(dbInfo);
+  } else if (readerInfo) {
+    NoteIdleReader(readerInfo);
   }
 }
 
@@ -11371,6 +11753,27 @@ void ConnectionPool::ScheduleQueuedTransactions(ThreadInfo& aThreadInfo) {
   AdjustIdleTimer();
 }
 
+void ConnectionPool::NoteIdleReader(ReaderInfo* aReaderInfo) {
+  AssertIsOnOwningThread();
+  MOZ_ASSERT(aReaderInfo);
+
+  AUTO_PROFILER_LABEL("ConnectionPool::NoteIdleReader", DOM);
+
+  if (mShutdownRequested || !mQueuedTransactions.IsEmpty()) {
+    // Let another database use this thread.
+    CloseReader(aReaderInfo);
+    return;
+  }
+
+  // Keep the connection around for the next burst of readonly transactions
+  // but don't let it pin an old snapshot in the meantime.
+  nsCOMPtr<nsIRunnable> runnable =
+      new ReaderRunnable(aReaderInfo, /* aBeginTransaction */ false);
+
+  MOZ_ALWAYS_SUCCEEDS(aReaderInfo->mThreadInfo.mThread->Dispatch(
+      runnable.forget(), NS_DISPATCH_NORMAL));
+}
+
 void ConnectionPool::NoteIdleDatabase(DatabaseInfo* aDatabaseInfo) {
   AssertIsOnOwningThread();
   MOZ_ASSERT(aDatabaseInfo);
@@ -11381,6 +11784,9 @@ void ConnectionPool::NoteIdleDatabase(DatabaseInfo* aDatabaseInfo) {
 
   AUTO_PROFILER_LABEL("ConnectionPool::NoteIdleDatabase", DOM);
 
+  // Readers are only worth their threads while the database is busy.
+  CloseReaders(aDatabaseInfo);
+
   const bool otherDatabasesWaiting = !mQueuedTransactions.IsEmpty();
 
   if (mShutdownRequested || otherDatabasesWaiting ||
@@ -11407,10 +11813,30 @@ void ConnectionPool::NoteIdleDatabase(DatabaseInfo* aDatabaseInfo) {
   AdjustIdleTimer();
 }
 
+void ConnectionPool::NoteClosedConnection(DatabaseInfo* aDatabaseInfo,
+                                          ReaderInfo* aReaderInfo) {
+  AssertIsOnOwningThread();
+  MOZ_ASSERT(aDatabaseInfo);
+  MOZ_ASSERT(aDatabaseInfo->mClosingConnectionCount);
+
+  if (aReaderInfo) {
+    MOZ_ASSERT(!aReaderInfo->mThreadInfo.mThread);
+
+    aDatabaseInfo->mReaders.Remove(aReaderInfo);
+  }
+
+  // The database can't go away until all of its connections have been closed.
+  if (!--aDatabaseInfo->mClosingConnectionCount && aDatabaseInfo->mClosing) {
+    NoteClosedDatabase(aDatabaseInfo);
+  }
+}
+
 void ConnectionPool::NoteClosedDatabase(DatabaseInfo* aDatabaseInfo) {
   AssertIsOnOwningThread();
   MOZ_ASSERT(aDatabaseInfo);
   MOZ_ASSERT(aDatabaseInfo->mClosing);
+  MOZ_ASSERT(!aDatabaseInfo->mClosingConnectionCount);
+  MOZ_ASSERT(aDatabaseInfo->mReaders.IsEmpty());
   MOZ_ASSERT(!mIdleDatabases.Contains(aDatabaseInfo));
 
   AUTO_PROFILER_LABEL("ConnectionPool::NoteClosedDatabase", DOM);
@@ -11432,27 +11858,9 @@ void ConnectionPool::NoteClosedDatabase(DatabaseInfo* aDatabaseInfo) {
   if (aDatabaseInfo->mThreadInfo.mThread) {
     MOZ_ASSERT(aDatabaseInfo->mThreadInfo.mRunnable);
 
-    if (!mQueuedTransactions.IsEmpty()) {
-      // Give the thread to another database.
-      ScheduleQueuedTransactions(aDatabaseInfo->mThreadInfo);
-    } else if (!aDatabaseInfo->TotalTransactionCount()) {
-      if (mShutdownRequested) {
-        ShutdownThread(aDatabaseInfo->mThreadInfo);
-      } else {
-        MOZ_ASSERT(!mIdleThreads.Contains(aDatabaseInfo->mThreadInfo));
-
-        mIdleThreads.InsertElementSorted(aDatabaseInfo->mThreadInfo);
-
-        aDatabaseInfo->mThreadInfo.mRunnable = nullptr;
-        aDatabaseInfo->mThreadInfo.mThread = nullptr;
-
-        if (mIdleThreads.Length() > kMaxIdleConnectionThreadCount) {
-          ShutdownThread(mIdleThreads[0].mThreadInfo);
-          mIdleThreads.RemoveElementAt(0);
-        }
-
-        AdjustIdleTimer();
-      }
+    if (!mQueuedTransactions.IsEmpty() ||
+        !aDatabaseInfo->TotalTransactionCount()) {
+      RecycleThread(aDatabaseInfo->mThreadInfo);
     }
   }
 
@@ -11566,12 +11974,52 @@ void ConnectionPool::CloseDatabase(DatabaseInfo* aDatabaseInfo) {
   aDatabaseInfo->mNeedsCheckpoint = false;
   aDatabaseInfo->mClosing = true;
 
+  CloseReaders(aDatabaseInfo);
+
+  aDatabaseInfo->mClosingConnectionCount++;
+
   nsCOMPtr<nsIRunnable> runnable = new CloseConnectionRunnable(aDatabaseInfo);
 
   MOZ_ALWAYS_SUCCEEDS(aDatabaseInfo->mThreadInfo.mThread->Dispatch(
       runnable.forget(), NS_DISPATCH_NORMAL));
 }
 
+void ConnectionPool::CloseReader(ReaderInfo* aReaderInfo) {
+  AssertIsOnOwningThread();
+  MOZ_ASSERT(aReaderInfo);
+  MOZ_ASSERT(aReaderInfo->mThreadInfo.mThread);
+  MOZ_ASSERT(aReaderInfo->mThreadInfo.mRunnable);
+
+  DatabaseInfo* dbInfo = aReaderInfo->mDatabaseInfo;
+  MOZ_ASSERT(dbInfo);
+
+  dbInfo->mReaders.NoteClosing(aReaderInfo);
+
+  dbInfo->mClosingConnectionCount++;
+
+  nsCOMPtr<nsIRunnable> runnable =
+      new CloseConnectionRunnable(dbInfo, aReaderInfo);
+
+  MOZ_ALWAYS_SUCCEEDS(aReaderInfo->mThreadInfo.mThread->Dispatch(
+      runnable.forget(), NS_DISPATCH_NORMAL));
+
+  // The close runs before anything else that gets dispatched to the thread so
+  // it can be handed out again right away.
+  RecycleThread(aReaderInfo->mThreadInfo);
+}
+
+void ConnectionPool::CloseReaders(DatabaseInfo* aDatabaseInfo) {
+  AssertIsOnOwningThread();
+  MOZ_ASSERT(aDatabaseInfo);
+
+  nsTArray<ReaderInfo*> readers;
+  aDatabaseInfo->mReaders.GetOpenReaders(readers);
+
+  for (ReaderInfo* readerInfo : readers) {
+    CloseReader(readerInfo);
+  }
+}
+
 bool ConnectionPool::CloseDatabaseWhenIdleInternal(
     const nsACString& aDatabaseId) {
   AssertIsOnOwningThread();
@@ -11652,12 +12100,31 @@ ConnectionPool::CloseConnectionRunnable::Run() {
 
   AUTO_PROFILER_LABEL("ConnectionPool::CloseConnectionRunnable::Run", DOM);
 
-  if (mOwningEventTarget) {
+  if (mOwningEventTarget) {
+    nsCOMPtr<nsIEventTarget> owningThread;
+    mOwningEventTarget.swap(owningThread);
+
+    if (mReaderInfo) {
+      MOZ_ASSERT(sCurrentReaderInfo.get() == mReaderInfo);
+
+      if (mReaderInfo->mConnection) {
+        mReaderInfo->mConnection->Close();
+
+        IDB_DEBUG_LOG(("ConnectionPool closed reader connection 0x%p",
+                       mReaderInfo->mConnection.get()));
+
+        mReaderInfo->mConnection = nullptr;
+      }
+
+      // This thread may serve another database next.
+      sCurrentReaderInfo.set(nullptr);
+
+      MOZ_ALWAYS_SUCCEEDS(owningThread->Dispatch(this, NS_DISPATCH_NORMAL));
+      return NS_OK;
+    }
+
     MOZ_ASSERT(mDatabaseInfo->mClosing);
 
-    nsCOMPtr<nsIEventTarget> owningThread;
-    mOwningEventTarget.swap(owningThread);
-
     // The connection could be null if EnsureConnection() didn't run or was not
     // successful in TransactionDatabaseOperationBase::RunOnConnectionThread().
     if (mDatabaseInfo->mConnection) {
@@ -11682,7 +12149,48 @@ ConnectionPool::CloseConnectionRunnable::Run() {
   RefPtr<ConnectionPool> connectionPool = mDatabaseInfo->mConnectionPool;
   MOZ_ASSERT(connectionPool);
 
-  connectionPool->NoteClosedDatabase(mDatabaseInfo);
+  connectionPool->NoteClosedConnection(mDatabaseInfo, mReaderInfo);
+  return NS_OK;
+}
+
+ConnectionPool::ReaderRunnable::ReaderRunnable(ReaderInfo* aReaderInfo,
+                                               bool aBeginTransaction)
+    : Runnable("dom::indexedDB::ConnectionPool::ReaderRunnable"),
+      mReaderInfo(aReaderInfo),
+      mBeginTransaction(aBeginTransaction) {
+  AssertIsOnBackgroundThread();
+  MOZ_ASSERT(aReaderInfo);
+}
+
+NS_IMETHODIMP
+ConnectionPool::ReaderRunnable::Run() {
+  MOZ_ASSERT(!IsOnBackgroundThread());
+  MOZ_ASSERT(mReaderInfo);
+
+  AUTO_PROFILER_LABEL("ConnectionPool::ReaderRunnable::Run", DOM);
+
+  if (mBeginTransaction) {
+    MOZ_ASSERT_IF(sCurrentReaderInfo.get(),
+                  sCurrentReaderInfo.get() == mReaderInfo);
+
+    sCurrentReaderInfo.set(mReaderInfo);
+
+    // The connection is created lazily by the first request, which starts a
+    // fresh transaction anyway. Otherwise the snapshot being replaced is the
+    // previous transaction's, which finished before the pool handed out this
+    // reader again.
+    if (mReaderInfo->mConnection) {
+      nsresult rv = mReaderInfo->mConnection->RestartReadTransaction();
+      Unused << NS_WARN_IF(NS_FAILED(rv));
+    }
+  } else {
+    MOZ_ASSERT(sCurrentReaderInfo.get() == mReaderInfo);
+
+    if (mReaderInfo->mConnection) {
+      mReaderInfo->mConnection->EndReadTransaction();
+    }
+  }
+
   return NS_OK;
 }
 
@@ -11691,8 +12199,12 @@ ConnectionPool::DatabaseInfo::DatabaseInfo(ConnectionPool* aConnectionPool,
     : mConnectionPool(aConnectionPool),
       mDatabaseId(aDatabaseId),
       mRunningWriteTransaction(nullptr),
+      mReaders(aConnectionPool->mMaxReaderCount),
       mReadTransactionCount(0),
       mWriteTransactionCount(0),
+      mRunningTransactionCount(0),
+      mClosingConnectionCount(0),
+      mReadersAllowed(false),
       mNeedsCheckpoint(false),
       mIdle(false),
       mCloseOnIdle(false),
@@ -11717,11 +12229,31 @@ ConnectionPool::DatabaseInfo::~DatabaseInfo() {
   MOZ_ASSERT(!mRunningWriteTransaction);
   MOZ_ASSERT(!mThreadInfo.mThread);
   MOZ_ASSERT(!mThreadInfo.mRunnable);
+  MOZ_ASSERT(mReaders.IsEmpty());
   MOZ_ASSERT(!TotalTransactionCount());
+  MOZ_ASSERT(!mRunningTransactionCount);
+  MOZ_ASSERT(!mClosingConnectionCount);
 
   MOZ_COUNT_DTOR(ConnectionPool::DatabaseInfo);
 }
 
+ConnectionPool::ReaderInfo::ReaderInfo(DatabaseInfo* aDatabaseInfo)
+    : mDatabaseInfo(aDatabaseInfo) {
+  AssertIsOnBackgroundThread();
+  MOZ_ASSERT(aDatabaseInfo);
+
+  MOZ_COUNT_CTOR(ConnectionPool::ReaderInfo);
+}
+
+ConnectionPool::ReaderInfo::~ReaderInfo() {
+  AssertIsOnBackgroundThread();
+  MOZ_ASSERT(!mConnection);
+  MOZ_ASSERT(!mThreadInfo.mThread);
+  MOZ_ASSERT(!mThreadInfo.mRunnable);
+
+  MOZ_COUNT_DTOR(ConnectionPool::ReaderInfo);
+}
+
 ConnectionPool::DatabasesCompleteCallback::DatabasesCompleteCallback(
     nsTArray<nsCString>&& aDatabaseIds, nsIRunnable* aCallback)
     : mDatabaseIds(std::move(aDatabaseIds)), mCallback(aCallback) {
@@ -11952,6 +12484,7 @@ ConnectionPool::TransactionInfo::TransactionInfo(
       mTransactionId(aTransactionId),
       mLoggingSerialNumber(aLoggingSerialNumber),
       mObjectStoreNames(aObjectStoreNames),
+      mReaderInfo(nullptr),
       mIsWriteTransaction(aIsWriteTransaction),
       mRunning(false)
 #ifdef DEBUG
@@ -12555,6 +13088,13 @@ nsresult Database::EnsureConnection() {
 
   AUTO_PROFILER_LABEL("Database::EnsureConnection", DOM);
 
+  if (ConnectionPool::IsOnReaderThread()) {
+    // Reader connections are owned by the pool and never cached here.
+    RefPtr<DatabaseConnection> connection;
+    return gConnectionPool->GetOrCreateConnection(this,
+                                                  getter_AddRefs(connection));
+  }
+
   if (!mConnection || !mConnection->GetStorageConnection()) {
     nsresult rv = gConnectionPool->GetOrCreateConnection(
         this, getter_AddRefs(mConnection));
@@ -13382,6 +13922,37 @@ bool TransactionBase::VerifyRequestParams(const RequestParams& aParams) const {
       break;
     }
 
+    case RequestParams::TObjectStorePutAllParams: {
+      const ObjectStorePutAllParams& params =
+          aParams.get_ObjectStorePutAllParams();
+      // Checked here as well in case there are no records.
+      if (NS_WARN_IF(mMode != IDBTransaction::READ_WRITE &&
+                     mMode != IDBTransaction::READ_WRITE_FLUSH &&
+                     mMode != IDBTransaction::VERSION_CHANGE)) {
+        ASSERT_UNLESS_FUZZING();
+        return false;
+      }
+      const RefPtr<FullObjectStoreMetadata> objectStoreMetadata =
+          GetMetadataForObjectStoreId(params.objectStoreId());
+      if (NS_WARN_IF(!objectStoreMetadata)) {
+        ASSERT_UNLESS_FUZZING();
+        return false;
+      }
+      for (const ObjectStoreAddPutParams& commonParams :
+           params.commonParams()) {
+        if (NS_WARN_IF(commonParams.objectStoreId() !=
+                       params.objectStoreId())) {
+          ASSERT_UNLESS_FUZZING();
+          return false;
+        }
+        if (NS_WARN_IF(!VerifyRequestParams(commonParams))) {
+          ASSERT_UNLESS_FUZZING();
+          return false;
+        }
+      }
+      break;
+    }
+
     case RequestParams::TObjectStoreGetParams: {
       const ObjectStoreGetParams& params = aParams.get_ObjectStoreGetParams();
       const RefPtr<FullObjectStoreMetadata> objectStoreMetadata =
@@ -13868,6 +14439,7 @@ PBackgroundIDBRequestParent* TransactionBase::AllocRequest(
   switch (aParams.type()) {
     case RequestParams::TObjectStoreAddParams:
     case RequestParams::TObjectStorePutParams:
+    case RequestParams::TObjectStorePutAllParams:
       actor = new ObjectStoreAddOrPutRequestOp(this, aParams);
       break;
 
@@ -14883,6 +15455,10 @@ Cursor::Cursor(TransactionBase* aTransaction, Type aType,
       mIndexMetadata(aIndexMetadata),
       mObjectStoreId(aObjectStoreMetadata->mCommonMetadata.id()),
       mIndexId(aIndexMetadata ? aIndexMetadata->mCommonMetadata.id() : 0),
+      mMaxExtraCount(
+          aType == OpenCursorParams::TObjectStoreOpenCursorParams
+              ? IndexedDatabaseManager::MaxCursorPreloadRecords() - 1
+              : 0),
       mCurrentlyRunningOp(nullptr),
       mType(aType),
       mDirection(aDirection),
@@ -15174,7 +15750,7 @@ mozilla::ipc::IPCResult Cursor::RecvDeleteMe() {
 }
 
 mozilla::ipc::IPCResult Cursor::RecvContinue(
-    const CursorRequestParams& aParams) {
+    const CursorRequestParams& aParams, const Key& aCurrentKey) {
   AssertIsOnBackgroundThread();
   MOZ_ASSERT(aParams.type() != CursorRequestParams::T__None);
   MOZ_ASSERT(!mActorDestroyed);
@@ -15207,6 +15783,22 @@ mozilla::ipc::IPCResult Cursor::RecvContinue(
     return IPC_FAIL_NO_REASON(this);
   }
 
+  if (!aCurrentKey.IsUnset()) {
+    if (NS_WARN_IF(mType != OpenCursorParams::TObjectStoreOpenCursorParams)) {
+      ASSERT_UNLESS_FUZZING();
+      return IPC_FAIL_NO_REASON(this);
+    }
+
+    // Our position is past the current key of the child if it didn't consume
+    // all the records that were preloaded by the previous operation.
+    const bool isNext = mDirection == IDBCursor::NEXT ||
+                        mDirection == IDBCursor::NEXT_UNIQUE;
+    if (NS_WARN_IF(!RepositionPreloadingCursor(mKey, aCurrentKey, isNext))) {
+      ASSERT_UNLESS_FUZZING();
+      return IPC_FAIL_NO_REASON(this);
+    }
+  }
+
   RefPtr<ContinueOp> continueOp = new ContinueOp(this, aParams);
   if (NS_WARN_IF(!continueOp->Init(mTransaction))) {
     continueOp->Cleanup();
@@ -23839,6 +24431,30 @@ nsresult NormalTransactionOp::GetPreprocessParams(PreprocessParams& aParams) {
   return NS_OK;
 }
 
+bool NormalTransactionOp::ShareCloneData(const StructuredCloneReadInfo& aInfo,
+                                         Shmem* aShmem) {
+  AssertIsOnOwningThread();
+  MOZ_ASSERT(aShmem);
+
+  const size_t dataSize = aInfo.mData.Size();
+
+  // Values that need preprocessing are rare and keep the inline path.
+  if (aInfo.mHasPreprocessInfo ||
+      dataSize <= IndexedDatabaseManager::DataThreshold() ||
+      IsActorDestroyed()) {
+    return false;
+  }
+
+  if (NS_WARN_IF(!AllocShmem(dataSize, SharedMemory::TYPE_BASIC, aShmem))) {
+    return false;
+  }
+
+  auto iter = aInfo.mData.Start();
+  MOZ_ALWAYS_TRUE(aInfo.mData.ReadBytes(iter, aShmem->get<char>(), dataSize));
+
+  return true;
+}
+
 nsresult NormalTransactionOp::SendPreprocessInfo() {
   AssertIsOnOwningThread();
   MOZ_ASSERT(!IsActorDestroyed());
@@ -23980,40 +24596,71 @@ mozilla::ipc::IPCResult NormalTransactionOp::RecvContinue(
 ObjectStoreAddOrPutRequestOp::ObjectStoreAddOrPutRequestOp(
     TransactionBase* aTransaction, const RequestParams& aParams)
     : NormalTransactionOp(aTransaction),
-      mParams(aParams.type() == RequestParams::TObjectStoreAddParams
-                  ? aParams.get_ObjectStoreAddParams().commonParams()
-                  : aParams.get_ObjectStorePutParams().commonParams()),
+      mObjectStoreId(0),
       mGroup(aTransaction->GetDatabase()->Group()),
       mOrigin(aTransaction->GetDatabase()->Origin()),
       mPersistenceType(aTransaction->GetDatabase()->Type()),
-      mOverwrite(aParams.type() == RequestParams::TObjectStorePutParams),
+      mOverwrite(aParams.type() != RequestParams::TObjectStoreAddParams),
+      mPutAll(aParams.type() == RequestParams::TObjectStorePutAllParams),
       mObjectStoreMayHaveIndexes(false) {
-  MOZ_ASSERT(aParams.type() == RequestParams::TObjectStoreAddParams ||
-             aParams.type() == RequestParams::TObjectStorePutParams);
+  switch (aParams.type()) {
+    case RequestParams::TObjectStoreAddParams:
+      mRecords.AppendElement()->mParams =
+          aParams.get_ObjectStoreAddParams().commonParams();
+      mObjectStoreId = mRecords[0].mParams.objectStoreId();
+      break;
 
-  mMetadata =
-      aTransaction->GetMetadataForObjectStoreId(mParams.objectStoreId());
+    case RequestParams::TObjectStorePutParams:
+      mRecords.AppendElement()->mParams =
+          aParams.get_ObjectStorePutParams().commonParams();
+      mObjectStoreId = mRecords[0].mParams.objectStoreId();
+      break;
+
+    case RequestParams::TObjectStorePutAllParams: {
+      const ObjectStorePutAllParams& params =
+          aParams.get_ObjectStorePutAllParams();
+
+      mObjectStoreId = params.objectStoreId();
+
+      mRecords.SetCapacity(params.commonParams().Length());
+
+      for (const ObjectStoreAddPutParams& commonParams :
+           params.commonParams()) {
+        MOZ_ASSERT(commonParams.objectStoreId() == mObjectStoreId);
+        mRecords.AppendElement()->mParams = commonParams;
+      }
+      break;
+    }
+
+    default:
+      MOZ_CRASH("Should never get here!");
+  }
+
+  mMetadata = aTransaction->GetMetadataForObjectStoreId(mObjectStoreId);
   MOZ_ASSERT(mMetadata);
 
   mObjectStoreMayHaveIndexes = mMetadata->HasLiveIndexes();
 
-  mDataOverThreshold =
-      snappy::MaxCompressedLength(mParams.cloneInfo().data().data.Size()) >
-      IndexedDatabaseManager::DataThreshold();
+  for (RecordInfo& record : mRecords) {
+    record.mDataOverThreshold =
+        snappy::MaxCompressedLength(
+            record.mParams.cloneInfo().data().data.Size()) >
+        IndexedDatabaseManager::DataThreshold();
+  }
 }
 
 nsresult ObjectStoreAddOrPutRequestOp::RemoveOldIndexDataValues(
-    DatabaseConnection* aConnection) {
+    DatabaseConnection* aConnection, const Key& aKey) {
   AssertIsOnConnectionThread();
   MOZ_ASSERT(aConnection);
   MOZ_ASSERT(mOverwrite);
-  MOZ_ASSERT(!mResponse.IsUnset());
+  MOZ_ASSERT(!aKey.IsUnset());
 
 #ifdef DEBUG
   {
     bool hasIndexes = false;
     MOZ_ASSERT(NS_SUCCEEDED(DatabaseOperationBase::ObjectStoreHasIndexes(
-        aConnection, mParams.objectStoreId(), &hasIndexes)));
+        aConnection, mObjectStoreId, &hasIndexes)));
     MOZ_ASSERT(hasIndexes,
                "Don't use this slow method if there are no indexes!");
   }
@@ -24031,12 +24678,12 @@ nsresult ObjectStoreAddOrPutRequestOp::RemoveOldIndexDataValues(
   }
 
   rv = indexValuesStmt->BindInt64ByName(NS_LITERAL_CSTRING("object_store_id"),
-                                        mParams.objectStoreId());
+                                        mObjectStoreId);
   if (NS_WARN_IF(NS_FAILED(rv))) {
     return rv;
   }
 
-  rv = mResponse.BindToStatement(indexValuesStmt, NS_LITERAL_CSTRING("key"));
+  rv = aKey.BindToStatement(indexValuesStmt, NS_LITERAL_CSTRING("key"));
   if (NS_WARN_IF(NS_FAILED(rv))) {
     return rv;
   }
@@ -24054,7 +24701,7 @@ nsresult ObjectStoreAddOrPutRequestOp::RemoveOldIndexDataValues(
       return rv;
     }
 
-    rv = DeleteIndexDataTableRows(aConnection, mResponse, existingIndexValues);
+    rv = DeleteIndexDataTableRows(aConnection, aKey, existingIndexValues);
     if (NS_WARN_IF(NS_FAILED(rv))) {
       return rv;
     }
@@ -24066,17 +24713,19 @@ nsresult ObjectStoreAddOrPutRequestOp::RemoveOldIndexDataValues(
 bool ObjectStoreAddOrPutRequestOp::Init(TransactionBase* aTransaction) {
   AssertIsOnOwningThread();
 
-  const nsTArray<IndexUpdateInfo>& indexUpdateInfos =
-      mParams.indexUpdateInfos();
-
-  if (!indexUpdateInfos.IsEmpty()) {
-    const uint32_t count = indexUpdateInfos.Length();
+  for (const RecordInfo& record : mRecords) {
+    const nsTArray<IndexUpdateInfo>& indexUpdateInfos =
+        record.mParams.indexUpdateInfos();
 
-    mUniqueIndexTable.emplace();
+    if (indexUpdateInfos.IsEmpty()) {
+      continue;
+    }
 
-    for (uint32_t index = 0; index < count; index++) {
-      const IndexUpdateInfo& updateInfo = indexUpdateInfos[index];
+    if (mUniqueIndexTable.isNothing()) {
+      mUniqueIndexTable.emplace();
+    }
 
+    for (const IndexUpdateInfo& updateInfo : indexUpdateInfos) {
       RefPtr<FullIndexMetadata> indexMetadata;
       MOZ_ALWAYS_TRUE(mMetadata->mIndexes.Get(updateInfo.indexId(),
                                               getter_AddRefs(indexMetadata)));
@@ -24087,6 +24736,12 @@ bool ObjectStoreAddOrPutRequestOp::Init(TransactionBase* aTransaction) {
       const bool& unique = indexMetadata->mCommonMetadata.unique();
 
       MOZ_ASSERT(indexId == updateInfo.indexId());
+
+      // All the records of a putAll() share this table.
+      if (mPutAll && mUniqueIndexTable.ref().Contains(indexId)) {
+        continue;
+      }
+
       MOZ_ASSERT_IF(!indexMetadata->mCommonMetadata.multiEntry(),
                     !mUniqueIndexTable.ref().Get(indexId));
 
@@ -24094,7 +24749,9 @@ bool ObjectStoreAddOrPutRequestOp::Init(TransactionBase* aTransaction) {
         return false;
       }
     }
-  } else if (mOverwrite) {
+  }
+
+  if (mUniqueIndexTable.isNothing() && mOverwrite) {
     mUniqueIndexTable.emplace();
   }
 
@@ -24104,12 +24761,25 @@ bool ObjectStoreAddOrPutRequestOp::Init(TransactionBase* aTransaction) {
   }
 #endif
 
-  const nsTArray<FileAddInfo>& fileAddInfos = mParams.fileAddInfos();
+  for (RecordInfo& record : mRecords) {
+    if (NS_WARN_IF(!InitStoredFileInfos(aTransaction, record))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool ObjectStoreAddOrPutRequestOp::InitStoredFileInfos(
+    TransactionBase* aTransaction, RecordInfo& aRecord) {
+  AssertIsOnOwningThread();
+
+  const nsTArray<FileAddInfo>& fileAddInfos = aRecord.mParams.fileAddInfos();
 
   if (!fileAddInfos.IsEmpty()) {
     const uint32_t count = fileAddInfos.Length();
 
-    if (NS_WARN_IF(!mStoredFileInfos.SetCapacity(count, fallible))) {
+    if (NS_WARN_IF(!aRecord.mStoredFileInfos.SetCapacity(count, fallible))) {
       return false;
     }
 
@@ -24123,7 +24793,8 @@ bool ObjectStoreAddOrPutRequestOp::Init(TransactionBase* aTransaction) {
 
       const DatabaseOrMutableFile& file = fileAddInfo.file();
 
-      StoredFileInfo* storedFileInfo = mStoredFileInfos.AppendElement(fallible);
+      StoredFileInfo* storedFileInfo =
+          aRecord.mStoredFileInfos.AppendElement(fallible);
       MOZ_ASSERT(storedFileInfo);
 
       switch (fileAddInfo.type()) {
@@ -24179,8 +24850,9 @@ bool ObjectStoreAddOrPutRequestOp::Init(TransactionBase* aTransaction) {
     }
   }
 
-  if (mDataOverThreshold) {
-    StoredFileInfo* storedFileInfo = mStoredFileInfos.AppendElement(fallible);
+  if (aRecord.mDataOverThreshold) {
+    StoredFileInfo* storedFileInfo =
+        aRecord.mStoredFileInfos.AppendElement(fallible);
     MOZ_ASSERT(storedFileInfo);
 
     RefPtr<FileManager> fileManager =
@@ -24190,7 +24862,7 @@ bool ObjectStoreAddOrPutRequestOp::Init(TransactionBase* aTransaction) {
     storedFileInfo->mFileInfo = fileManager->GetNewFileInfo();
 
     storedFileInfo->mInputStream =
-        new SCInputStream(mParams.cloneInfo().data().data);
+        new SCInputStream(aRecord.mParams.cloneInfo().data().data);
 
     storedFileInfo->mType = StructuredCloneFile::eStructuredClone;
   }
@@ -24218,24 +24890,57 @@ nsresult ObjectStoreAddOrPutRequestOp::DoDatabaseWork(
   }
 
   bool objectStoreHasIndexes;
-  rv =
-      ObjectStoreHasIndexes(this, aConnection, mParams.objectStoreId(),
-                            mObjectStoreMayHaveIndexes, &objectStoreHasIndexes);
+  rv = ObjectStoreHasIndexes(this, aConnection, mObjectStoreId,
+                             mObjectStoreMayHaveIndexes,
+                             &objectStoreHasIndexes);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  AutoIncrementKeyGenerator keyGenerator(mMetadata->mNextAutoIncrementId);
+
+  // All the records share one savepoint and the cached insert statement, so a
+  // putAll() either stores every record or none of them.
+  for (RecordInfo& record : mRecords) {
+    rv = AddOrPutRecord(aConnection, record, objectStoreHasIndexes,
+                        keyGenerator);
+    if (NS_FAILED(rv)) {
+      return rv;
+    }
+  }
+
+  rv = autoSave.Commit();
   if (NS_WARN_IF(NS_FAILED(rv))) {
     return rv;
   }
 
+  if (keyGenerator.NextId() != mMetadata->mNextAutoIncrementId) {
+    mMetadata->mNextAutoIncrementId = keyGenerator.NextId();
+    Transaction()->NoteModifiedAutoIncrementObjectStore(mMetadata);
+  }
+
+  return NS_OK;
+}
+
+nsresult ObjectStoreAddOrPutRequestOp::AddOrPutRecord(
+    DatabaseConnection* aConnection, RecordInfo& aRecord,
+    bool aObjectStoreHasIndexes, AutoIncrementKeyGenerator& aKeyGenerator) {
+  MOZ_ASSERT(aConnection);
+  aConnection->AssertIsOnConnectionThread();
+
+  nsresult rv;
+
   // This will be the final key we use.
-  Key& key = mResponse;
-  key = mParams.key();
+  Key& key = aRecord.mKey;
+  key = aRecord.mParams.key();
 
   const bool keyUnset = key.IsUnset();
-  const int64_t osid = mParams.objectStoreId();
+  const int64_t& osid = mObjectStoreId;
 
   // First delete old index_data_values if we're overwriting something and we
   // have indexes.
-  if (mOverwrite && !keyUnset && objectStoreHasIndexes) {
-    rv = RemoveOldIndexDataValues(aConnection);
+  if (mOverwrite && !keyUnset && aObjectStoreHasIndexes) {
+    rv = RemoveOldIndexDataValues(aConnection, key);
     if (NS_WARN_IF(NS_FAILED(rv))) {
       return rv;
     }
@@ -24268,7 +24973,8 @@ nsresult ObjectStoreAddOrPutRequestOp::DoDatabaseWork(
     return rv;
   }
 
-  const SerializedStructuredCloneWriteInfo& cloneInfo = mParams.cloneInfo();
+  const SerializedStructuredCloneWriteInfo& cloneInfo =
+      aRecord.mParams.cloneInfo();
   const JSStructuredCloneData& cloneData = cloneInfo.data().data;
   size_t cloneDataSize = cloneData.Size();
 
@@ -24279,26 +24985,19 @@ nsresult ObjectStoreAddOrPutRequestOp::DoDatabaseWork(
 
   if (mMetadata->mCommonMetadata.autoIncrement()) {
     if (keyUnset) {
-      autoIncrementNum = mMetadata->mNextAutoIncrementId;
-
-      MOZ_ASSERT(autoIncrementNum > 0);
-
-      if (autoIncrementNum > (1LL << 53)) {
+      autoIncrementNum = aKeyGenerator.GenerateId();
+      if (!autoIncrementNum) {
         return NS_ERROR_DOM_INDEXEDDB_CONSTRAINT_ERR;
       }
 
       key.SetFromInteger(autoIncrementNum);
     } else if (key.IsFloat()) {
-      double numericKey = key.ToFloat();
-      numericKey = std::min(numericKey, double(1LL << 53));
-      numericKey = floor(numericKey);
-      if (numericKey >= mMetadata->mNextAutoIncrementId) {
-        autoIncrementNum = numericKey;
-      }
+      autoIncrementNum = aKeyGenerator.IdForKey(key.ToFloat());
     }
 
     if (keyUnset && mMetadata->mCommonMetadata.keyPath().IsValid()) {
-      const SerializedStructuredCloneWriteInfo& cloneInfo = mParams.cloneInfo();
+      const SerializedStructuredCloneWriteInfo& cloneInfo =
+          aRecord.mParams.cloneInfo();
       MOZ_ASSERT(cloneInfo.offsetToKeyProp());
       MOZ_ASSERT(cloneDataSize > sizeof(uint64_t));
       MOZ_ASSERT(cloneInfo.offsetToKeyProp() <=
@@ -24323,7 +25022,7 @@ nsresult ObjectStoreAddOrPutRequestOp::DoDatabaseWork(
 
   key.BindToStatement(stmt, NS_LITERAL_CSTRING("key"));
 
-  if (mDataOverThreshold) {
+  if (aRecord.mDataOverThreshold) {
     // The data we store in the SQLite database is a (signed) 64-bit integer.
     // The flags are left-shifted 32 bits so the max value is 0xFFFFFFFF.
     // The file_ids index occupies the lower 32 bits and its max is 0xFFFFFFFF.
@@ -24332,7 +25031,7 @@ nsresult ObjectStoreAddOrPutRequestOp::DoDatabaseWork(
     uint32_t flags = 0;
     flags |= kCompressedFlag;
 
-    uint32_t index = mStoredFileInfos.Length() - 1;
+    uint32_t index = aRecord.mStoredFileInfos.Length() - 1;
 
     int64_t data = (uint64_t(flags) << 32) | index;
 
@@ -24374,15 +25073,15 @@ nsresult ObjectStoreAddOrPutRequestOp::DoDatabaseWork(
     }
   }
 
-  if (!mStoredFileInfos.IsEmpty()) {
+  if (!aRecord.mStoredFileInfos.IsEmpty()) {
     // Moved outside the loop to allow it to be cached when demanded by the
     // first write.  (We may have mStoredFileInfos without any required writes.)
     Maybe<FileHelper> fileHelper;
     nsAutoString fileIds;
 
-    for (uint32_t count = mStoredFileInfos.Length(), index = 0; index < count;
-         index++) {
-      StoredFileInfo& storedFileInfo = mStoredFileInfos[index];
+    for (uint32_t count = aRecord.mStoredFileInfos.Length(), index = 0;
+         index < count; index++) {
+      StoredFileInfo& storedFileInfo = aRecord.mStoredFileInfos[index];
       MOZ_ASSERT(storedFileInfo.mFileInfo);
 
       // If there is a StoredFileInfo, then one of the following is true:
@@ -24487,12 +25186,12 @@ nsresult ObjectStoreAddOrPutRequestOp::DoDatabaseWork(
   }
 
   // Update our indexes if needed.
-  if (!mParams.indexUpdateInfos().IsEmpty()) {
+  if (!aRecord.mParams.indexUpdateInfos().IsEmpty()) {
     MOZ_ASSERT(mUniqueIndexTable.isSome());
 
     // Write the index_data_values column.
     AutoTArray<IndexDataValue, 32> indexValues;
-    rv = IndexDataValuesFromUpdateInfos(mParams.indexUpdateInfos(),
+    rv = IndexDataValuesFromUpdateInfos(aRecord.mParams.indexUpdateInfos(),
                                         mUniqueIndexTable.ref(), indexValues);
     if (NS_WARN_IF(NS_FAILED(rv))) {
       return rv;
@@ -24509,15 +25208,7 @@ nsresult ObjectStoreAddOrPutRequestOp::DoDatabaseWork(
     }
   }
 
-  rv = autoSave.Commit();
-  if (NS_WARN_IF(NS_FAILED(rv))) {
-    return rv;
-  }
-
-  if (autoIncrementNum) {
-    mMetadata->mNextAutoIncrementId = autoIncrementNum + 1;
-    Transaction()->NoteModifiedAutoIncrementObjectStore(mMetadata);
-  }
+  aKeyGenerator.NoteWritten(autoIncrementNum);
 
   return NS_OK;
 }
@@ -24526,19 +25217,38 @@ void ObjectStoreAddOrPutRequestOp::GetResponse(RequestResponse& aResponse,
                                                size_t* aResponseSize) {
   AssertIsOnOwningThread();
 
+  if (mPutAll) {
+    aResponse = ObjectStorePutAllResponse();
+    *aResponseSize = 0;
+
+    nsTArray<Key>& keys = aResponse.get_ObjectStorePutAllResponse().keys();
+    keys.SetCapacity(mRecords.Length());
+
+    for (const RecordInfo& record : mRecords) {
+      keys.AppendElement(record.mKey);
+      *aResponseSize += record.mKey.GetBuffer().Length();
+    }
+    return;
+  }
+
+  MOZ_ASSERT(mRecords.Length() == 1);
+
+  const Key& key = mRecords[0].mKey;
+
   if (mOverwrite) {
-    aResponse = ObjectStorePutResponse(mResponse);
-    *aResponseSize = mResponse.GetBuffer().Length();
+    aResponse = ObjectStorePutResponse(key);
   } else {
-    aResponse = ObjectStoreAddResponse(mResponse);
-    *aResponseSize = mResponse.GetBuffer().Length();
+    aResponse = ObjectStoreAddResponse(key);
   }
+  *aResponseSize = key.GetBuffer().Length();
 }
 
 void ObjectStoreAddOrPutRequestOp::Cleanup() {
   AssertIsOnOwningThread();
 
-  mStoredFileInfos.Clear();
+  for (RecordInfo& record : mRecords) {
+    record.mStoredFileInfos.Clear();
+  }
 
   NormalTransactionOp::Cleanup();
 }
@@ -24639,6 +25349,13 @@ template <>
 void MoveData<WasmModulePreprocessInfo>(StructuredCloneReadInfo& aInfo,
                                         WasmModulePreprocessInfo& aResult) {}
 
+template <>
+void MoveData<SharedCloneGetResponse>(StructuredCloneReadInfo& aInfo,
+                                      SharedCloneGetResponse& aResult) {
+  // The data has already been copied into aResult.data().
+  aInfo.mData.Clear();
+}
+
 template <bool aForPreprocess, typename T>
 nsresult ObjectStoreGetRequestOp::ConvertResponse(
     StructuredCloneReadInfo& aInfo, T& aResult) {
@@ -24823,6 +25540,26 @@ void ObjectStoreGetRequestOp::GetResponse(RequestResponse& aResponse,
     return;
   }
 
+  if (!mResponse.IsEmpty()) {
+    Shmem shmem;
+    if (ShareCloneData(mResponse[0], &shmem)) {
+      aResponse = SharedCloneGetResponse();
+      // The shared memory isn't part of the message.
+      *aResponseSize = 0;
+
+      SharedCloneGetResponse& sharedResponse =
+          aResponse.get_SharedCloneGetResponse();
+      sharedResponse.data() = shmem;
+
+      nsresult rv = ConvertResponse<false>(mResponse[0], sharedResponse);
+      if (NS_WARN_IF(NS_FAILED(rv))) {
+        DeallocShmem(shmem);
+        aResponse = rv;
+      }
+      return;
+    }
+  }
+
   aResponse = ObjectStoreGetResponse();
   *aResponseSize = 0;
 
@@ -25353,6 +26090,26 @@ nsresult IndexGetRequestOp::DoDatabaseWork(DatabaseConnection* aConnection) {
   return NS_OK;
 }
 
+template <typename T>
+nsresult IndexGetRequestOp::ConvertResponse(StructuredCloneReadInfo& aInfo,
+                                            T& aResult) {
+  MoveData(aInfo, aResult);
+
+  FallibleTArray<SerializedStructuredCloneFile> serializedFiles;
+  nsresult rv = SerializeStructuredCloneFiles(
+      mBackgroundParent, mDatabase, aInfo.mFiles,
+      /* aForPreprocess */ false, serializedFiles);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  MOZ_ASSERT(aResult.files().IsEmpty());
+
+  aResult.files().SwapElements(serializedFiles);
+
+  return NS_OK;
+}
+
 void IndexGetRequestOp::GetResponse(RequestResponse& aResponse,
                                     size_t* aResponseSize) {
   MOZ_ASSERT_IF(!mGetAll, mResponse.Length() <= 1);
@@ -25371,26 +26128,13 @@ void IndexGetRequestOp::GetResponse(RequestResponse& aResponse,
 
       for (uint32_t count = mResponse.Length(), index = 0; index < count;
            index++) {
-        StructuredCloneReadInfo& info = mResponse[index];
-        *aResponseSize += info.Size();
-
-        SerializedStructuredCloneReadInfo& serializedInfo =
-            fallibleCloneInfos[index];
-
-        serializedInfo.data().data = std::move(info.mData);
-
-        FallibleTArray<SerializedStructuredCloneFile> serializedFiles;
-        nsresult rv = SerializeStructuredCloneFiles(
-            mBackgroundParent, mDatabase, info.mFiles,
-            /* aForPreprocess */ false, serializedFiles);
+        *aResponseSize += mResponse[index].Size();
+        nsresult rv =
+            ConvertResponse(mResponse[index], fallibleCloneInfos[index]);
         if (NS_WARN_IF(NS_FAILED(rv))) {
           aResponse = rv;
           return;
         }
-
-        MOZ_ASSERT(serializedInfo.files().IsEmpty());
-
-        serializedInfo.files().SwapElements(serializedFiles);
       }
 
       nsTArray<SerializedStructuredCloneReadInfo>& cloneInfos =
@@ -25402,30 +26146,39 @@ void IndexGetRequestOp::GetResponse(RequestResponse& aResponse,
     return;
   }
 
+  if (!mResponse.IsEmpty()) {
+    Shmem shmem;
+    if (ShareCloneData(mResponse[0], &shmem)) {
+      aResponse = SharedCloneGetResponse();
+      // The shared memory isn't part of the message.
+      *aResponseSize = 0;
+
+      SharedCloneGetResponse& sharedResponse =
+          aResponse.get_SharedCloneGetResponse();
+      sharedResponse.data() = shmem;
+
+      nsresult rv = ConvertResponse(mResponse[0], sharedResponse);
+      if (NS_WARN_IF(NS_FAILED(rv))) {
+        DeallocShmem(shmem);
+        aResponse = rv;
+      }
+      return;
+    }
+  }
+
   aResponse = IndexGetResponse();
   *aResponseSize = 0;
 
   if (!mResponse.IsEmpty()) {
-    StructuredCloneReadInfo& info = mResponse[0];
-    *aResponseSize += info.Size();
+    *aResponseSize += mResponse[0].Size();
 
     SerializedStructuredCloneReadInfo& serializedInfo =
         aResponse.get_IndexGetResponse().cloneInfo();
 
-    serializedInfo.data().data = std::move(info.mData);
-
-    FallibleTArray<SerializedStructuredCloneFile> serializedFiles;
-    nsresult rv = SerializeStructuredCloneFiles(
-        mBackgroundParent, mDatabase, info.mFiles,
-        /* aForPreprocess */ false, serializedFiles);
+    nsresult rv = ConvertResponse(mResponse[0], serializedInfo);
     if (NS_WARN_IF(NS_FAILED(rv))) {
       aResponse = rv;
-      return;
     }
-
-    MOZ_ASSERT(serializedInfo.files().IsEmpty());
-
-    serializedInfo.files().SwapElements(serializedFiles);
   }
 }
 
@@ -25665,7 +26418,8 @@ void Cursor::CursorOpBase::Cleanup() {
 nsresult Cursor::CursorOpBase::PopulateResponseFromStatement(
     DatabaseConnection::CachedStatement& aStmt, bool aInitializeResponse) {
   Transaction()->AssertIsOnConnectionThread();
-  MOZ_ASSERT(mResponse.type() == CursorResponse::T__None);
+  MOZ_ASSERT_IF(aInitializeResponse,
+                mResponse.type() == CursorResponse::T__None);
   MOZ_ASSERT_IF(mFiles.IsEmpty(), aInitializeResponse);
 
   nsresult rv = mCursor->mKey.SetFromStatement(aStmt, 0);
@@ -25771,6 +26525,45 @@ nsresult Cursor::CursorOpBase::PopulateResponseFromStatement(
   return NS_OK;
 }
 
+nsresult Cursor::CursorOpBase::PopulateExtraResponses(
+    DatabaseConnection::CachedStatement& aStmt) {
+  Transaction()->AssertIsOnConnectionThread();
+  MOZ_ASSERT(mResponse.type() ==
+             CursorResponse::TArrayOfObjectStoreCursorResponse);
+  MOZ_ASSERT(mCursor->mType == OpenCursorParams::TObjectStoreOpenCursorParams);
+
+  const auto& responses = mResponse.get_ArrayOfObjectStoreCursorResponse();
+  size_t preloadedSize = responses[0].cloneInfo().data().data.Size();
+
+  for (uint32_t extraCount = 0; extraCount < mCursor->mMaxExtraCount;
+       extraCount++) {
+    if (preloadedSize >= kMaxCursorPreloadSize) {
+      break;
+    }
+
+    bool hasResult;
+    nsresult rv = aStmt->ExecuteStep(&hasResult);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+
+    if (!hasResult) {
+      // Unlike ContinueOp we leave our keys alone here, the child finds out
+      // about the end of the range with its next request.
+      break;
+    }
+
+    rv = PopulateResponseFromStatement(aStmt, false);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+
+    preloadedSize += responses.LastElement().cloneInfo().data().data.Size();
+  }
+
+  return NS_OK;
+}
+
 void Cursor::OpenOp::GetRangeKeyInfo(bool aLowerBound, Key* aKey, bool* aOpen) {
   AssertIsOnConnectionThread();
   MOZ_ASSERT(aKey);
@@ -25849,8 +26642,11 @@ nsresult Cursor::OpenOp::DoObjectStoreDatabaseWork(
 
   // Note: Changing the number or order of SELECT columns in the query will
   // require changes to CursorOpBase::PopulateResponseFromStatement.
-  nsCString firstQuery = queryStart + keyRangeClause + directionClause +
-                         openLimit + NS_LITERAL_CSTRING("1");
+  nsAutoCString limitString;
+  limitString.AppendInt(1 + mCursor->mMaxExtraCount);
+
+  nsCString firstQuery =
+      queryStart + keyRangeClause + directionClause + openLimit + limitString;
 
   DatabaseConnection::CachedStatement stmt;
   nsresult rv = aConnection->GetCachedStatement(firstQuery, &stmt);
@@ -25886,6 +26682,11 @@ nsresult Cursor::OpenOp::DoObjectStoreDatabaseWork(
     return rv;
   }
 
+  rv = PopulateExtraResponses(stmt);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
   // Now we need to make the query to get the next match.
   keyRangeClause.Truncate();
   nsAutoCString continueToKeyRangeClause;
@@ -26654,7 +27455,7 @@ nsresult Cursor::ContinueOp::DoDatabaseWork(DatabaseConnection* aConnection) {
 
   MOZ_ASSERT(advanceCount > 0);
   nsAutoCString countString;
-  countString.AppendInt(advanceCount);
+  countString.AppendInt(advanceCount + mCursor->mMaxExtraCount);
 
   nsCString query = continueQuery + countString;
 
@@ -26733,6 +27534,13 @@ nsresult Cursor::ContinueOp::DoDatabaseWork(DatabaseConnection* aConnection) {
     return rv;
   }
 
+  if (mCursor->mMaxExtraCount) {
+    rv = PopulateExtraResponses(stmt);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+  }
+
   return NS_OK;
 }
 
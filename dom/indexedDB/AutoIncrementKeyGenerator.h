@@ -0,0 +1,64 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef mozilla_dom_indexeddb_autoincrementkeygenerator_h__
+#define mozilla_dom_indexeddb_autoincrementkeygenerator_h__
+
+#include <math.h>
+#include <stdint.h>
+
+#include "mozilla/Assertions.h"
+
+namespace mozilla {
+namespace dom {
+namespace indexedDB {
+
+// The key generator of an autoIncrement object store while an add(), put()
+// or putAll() request writes its records, one after another.  It starts at
+// the store's next id, which is only updated once all the records were
+// written, so a putAll() that fails part way doesn't use up any ids.
+class AutoIncrementKeyGenerator final {
+ public:
+  // Larger ids could not all be told apart once converted to a double key.
+  static const int64_t kMaxId = int64_t(1) << 53;
+
+  explicit AutoIncrementKeyGenerator(int64_t aNextId) : mNextId(aNextId) {}
+
+  int64_t NextId() const { return mNextId; }
+
+  // Returns the id for a record stored without a key, or 0 when all the ids
+  // were used up.
+  int64_t GenerateId() const {
+    MOZ_ASSERT(mNextId > 0);
+
+    return mNextId > kMaxId ? 0 : mNextId;
+  }
+
+  // Returns the id a record stored with the numeric key |aKey| moves the
+  // generator to, or 0 when it is behind the next id.
+  int64_t IdForKey(double aKey) const {
+    const double id = floor(aKey < double(kMaxId) ? aKey : double(kMaxId));
+    return id >= mNextId ? int64_t(id) : 0;
+  }
+
+  // Called once the record that used |aId|, from GenerateId() or IdForKey(),
+  // was written.
+  void NoteWritten(int64_t aId) {
+    if (aId) {
+      MOZ_ASSERT(aId >= mNextId);
+      mNextId = aId + 1;
+    }
+  }
+
+ private:
+  int64_t mNextId;
+};
+
+}  // namespace indexedDB
+}  // namespace dom
+}  // namespace mozilla
+
+#endif  // mozilla_dom_indexeddb_autoincrementkeygenerator_h__
@@ -0,0 +1,152 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef mozilla_dom_indexeddb_cursorpreloadcache_h__
+#define mozilla_dom_indexeddb_cursorpreloadcache_h__
+
+#include <deque>
+#include <utility>
+
+#include "mozilla/Assertions.h"
+#include "mozilla/dom/indexedDB/Key.h"
+
+namespace mozilla {
+namespace dom {
+namespace indexedDB {
+
+// The records a cursor's parent sent along with the one that was asked for,
+// kept by the child to answer continue() and advance() without a round trip.
+// |Record| has an mKey member.
+//
+// The transaction's write request count is sampled whenever a request goes
+// to the parent.  Records are only used while it is unchanged: once a write
+// request was started, the parent may have processed it after reading them.
+//
+// The parent's position is that of the last record it sent, so while the
+// child has not used them all it is ahead of the child's, and the next
+// request carries the child's key for the parent to continue from.
+template <typename Record>
+class CursorPreloadCache final {
+ public:
+  explicit CursorPreloadCache(uint64_t aWriteRequestCount)
+      : mWriteRequestCount(aWriteRequestCount), mParentPositionAhead(false) {}
+
+  bool IsEmpty() const { return mRecords.empty(); }
+
+  // Skips the cached records before |aKey|, or with an unset key, none.
+  // Returns true when the first record left answers continue(aKey).
+  bool ConsumeContinue(uint64_t aWriteRequestCount, const Key& aKey,
+                       bool aIsNext) {
+    if (!CheckWriteRequestCount(aWriteRequestCount)) {
+      return false;
+    }
+
+    if (aKey.IsUnset()) {
+      return true;
+    }
+
+    while (!mRecords.empty()) {
+      const Key& cachedKey = mRecords.front().mKey;
+      if (aIsNext ? cachedKey >= aKey : cachedKey <= aKey) {
+        return true;
+      }
+
+      mRecords.pop_front();
+    }
+
+    return false;
+  }
+
+  // Returns true, after dropping the records advance(aCount) steps over,
+  // when the first record left answers it.
+  bool ConsumeAdvance(uint64_t aWriteRequestCount, uint32_t aCount) {
+    MOZ_ASSERT(aCount > 0);
+
+    if (!CheckWriteRequestCount(aWriteRequestCount) ||
+        aCount > mRecords.size()) {
+      mRecords.clear();
+      return false;
+    }
+
+    mRecords.erase(mRecords.begin(), mRecords.begin() + (aCount - 1));
+    return true;
+  }
+
+  // Takes the record a successful Consume*() call left first.
+  Record PopFront() {
+    MOZ_ASSERT(!mRecords.empty());
+
+    Record record = std::move(mRecords.front());
+    mRecords.pop_front();
+    return record;
+  }
+
+  // Called when a request goes to the parent after all.  Returns the key
+  // the parent has to continue from, unset when it is at |aCurrentKey|
+  // already.
+  Key OnRequestSent(uint64_t aWriteRequestCount, const Key& aCurrentKey) {
+    MOZ_ASSERT(mRecords.empty());
+
+    mWriteRequestCount = aWriteRequestCount;
+
+    Key key;
+    if (mParentPositionAhead) {
+      key = aCurrentKey;
+      mParentPositionAhead = false;
+    }
+    return key;
+  }
+
+  // Called when the parent answered with |aRecordCount| records.  Returns
+  // whether those after the first can be kept.
+  bool OnResponse(uint64_t aWriteRequestCount, size_t aRecordCount) {
+    MOZ_ASSERT(mRecords.empty());
+
+    mParentPositionAhead = aRecordCount > 1;
+    return mWriteRequestCount == aWriteRequestCount;
+  }
+
+  void Push(Record&& aRecord) { mRecords.push_back(std::move(aRecord)); }
+
+ private:
+  bool CheckWriteRequestCount(uint64_t aWriteRequestCount) {
+    MOZ_ASSERT(!mRecords.empty());
+
+    if (mWriteRequestCount != aWriteRequestCount) {
+      mRecords.clear();
+      return false;
+    }
+    return true;
+  }
+
+  std::deque<Record> mRecords;
+  uint64_t mWriteRequestCount;
+  bool mParentPositionAhead;
+};
+
+// The parent side: moves |aPosition| back to the |aChildKey| the child sent
+// with Continue, if any.  Returns false when the child's key is ahead of
+// the parent's position, which a child only has preloaded records up to.
+inline bool RepositionPreloadingCursor(Key& aPosition, const Key& aChildKey,
+                                       bool aIsNext) {
+  if (aChildKey.IsUnset()) {
+    return true;
+  }
+
+  if (aPosition.IsUnset() ||
+      (aIsNext ? aChildKey > aPosition : aChildKey < aPosition)) {
+    return false;
+  }
+
+  aPosition = aChildKey;
+  return true;
+}
+
+}  // namespace indexedDB
+}  // namespace dom
+}  // namespace mozilla
+
+#endif  // mozilla_dom_indexeddb_cursorpreloadcache_h__
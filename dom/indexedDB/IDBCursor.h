@@ -151,6 +151,12 @@ class IDBCursor final : public nsISupports, public nsWrapperCache {
 
   void Reset(Key&& aKey, Key&& aSortKey, Key&& aPrimaryKey);
 
+  const Key& CurrentKey() const {
+    AssertIsOnOwningThread();
+
+    return mKey;
+  }
+
   void ClearBackgroundActor() {
     AssertIsOnOwningThread();
 
@@ -1366,6 +1366,31 @@ class DeserializeUpgradeValueHelper final : public Runnable {
   nsresult mStatus;
 };
 
+// Check the size limit of the serialized message which mainly consists of
+// a StructuredCloneBuffer, an encoded object key, and the encoded index keys.
+// kMaxIDBMsgOverhead covers the minor stuff not included in this calculation
+// because the precise calculation would slow down add/put operations.
+size_t GetMaxAddPutMessageSize() {
+  static const size_t kMaxIDBMsgOverhead = 1024 * 1024;  // 1MB
+  const uint32_t maximalSizeFromPref =
+      IndexedDatabaseManager::MaxSerializedMsgSize();
+  MOZ_ASSERT(maximalSizeFromPref > kMaxIDBMsgOverhead);
+  return maximalSizeFromPref - kMaxIDBMsgOverhead;
+}
+
+size_t GetAddPutMessageSize(
+    const IDBObjectStore::StructuredCloneWriteInfo& aCloneWriteInfo,
+    const Key& aKey, const nsTArray<IndexUpdateInfo>& aUpdateInfo) {
+  size_t indexUpdateInfoSize = 0;
+  for (size_t i = 0; i < aUpdateInfo.Length(); i++) {
+    indexUpdateInfoSize += aUpdateInfo[i].value().GetBuffer().Length();
+    indexUpdateInfoSize += aUpdateInfo[i].localizedValue().GetBuffer().Length();
+  }
+
+  return aCloneWriteInfo.mCloneBuffer.data().Size() +
+         aKey.GetBuffer().Length() + indexUpdateInfoSize;
+}
+
 }  // namespace
 
 // static
@@ -1485,80 +1510,21 @@ void IDBObjectStore::GetAddInfo(JSContext* aCx, ValueWrapper& aValueWrapper,
   }
 }
 
-already_AddRefed<IDBRequest> IDBObjectStore::AddOrPut(
-    JSContext* aCx, ValueWrapper& aValueWrapper, JS::Handle<JS::Value> aKey,
-    bool aOverwrite, bool aFromCursor, ErrorResult& aRv) {
+void IDBObjectStore::GetAddPutParams(
+    StructuredCloneWriteInfo& aCloneWriteInfo, const Key& aKey,
+    nsTArray<IndexUpdateInfo>& aUpdateInfo, ObjectStoreAddPutParams& aParams,
+    ErrorResult& aRv) {
   AssertIsOnOwningThread();
-  MOZ_ASSERT(aCx);
-  MOZ_ASSERT_IF(aFromCursor, aOverwrite);
-
-  if (mTransaction->GetMode() == IDBTransaction::CLEANUP || mDeletedSpec) {
-    aRv.Throw(NS_ERROR_DOM_INDEXEDDB_NOT_ALLOWED_ERR);
-    return nullptr;
-  }
-
-  if (!mTransaction->IsOpen()) {
-    aRv.Throw(NS_ERROR_DOM_INDEXEDDB_TRANSACTION_INACTIVE_ERR);
-    return nullptr;
-  }
-
-  if (!mTransaction->IsWriteAllowed()) {
-    aRv.Throw(NS_ERROR_DOM_INDEXEDDB_READ_ONLY_ERR);
-    return nullptr;
-  }
 
-  Key key;
-  StructuredCloneWriteInfo cloneWriteInfo(mTransaction->Database());
-  nsTArray<IndexUpdateInfo> updateInfo;
-
-  GetAddInfo(aCx, aValueWrapper, aKey, cloneWriteInfo, key, updateInfo, aRv);
-  if (aRv.Failed()) {
-    return nullptr;
-  }
-
-  if (!mTransaction->IsOpen()) {
-    aRv.Throw(NS_ERROR_DOM_INDEXEDDB_TRANSACTION_INACTIVE_ERR);
-    return nullptr;
-  }
-
-  // Check the size limit of the serialized message which mainly consists of
-  // a StructuredCloneBuffer, an encoded object key, and the encoded index keys.
-  // kMaxIDBMsgOverhead covers the minor stuff not included in this calculation
-  // because the precise calculation would slow down this AddOrPut operation.
-  static const size_t kMaxIDBMsgOverhead = 1024 * 1024;  // 1MB
-  const uint32_t maximalSizeFromPref =
-      IndexedDatabaseManager::MaxSerializedMsgSize();
-  MOZ_ASSERT(maximalSizeFromPref > kMaxIDBMsgOverhead);
-  const size_t kMaxMessageSize = maximalSizeFromPref - kMaxIDBMsgOverhead;
-
-  size_t indexUpdateInfoSize = 0;
-  for (size_t i = 0; i < updateInfo.Length(); i++) {
-    indexUpdateInfoSize += updateInfo[i].value().GetBuffer().Length();
-    indexUpdateInfoSize += updateInfo[i].localizedValue().GetBuffer().Length();
-  }
-
-  size_t messageSize = cloneWriteInfo.mCloneBuffer.data().Size() +
-                       key.GetBuffer().Length() + indexUpdateInfoSize;
-
-  if (messageSize > kMaxMessageSize) {
-    IDB_REPORT_INTERNAL_ERR();
-    aRv.ThrowDOMException(NS_ERROR_DOM_INDEXEDDB_UNKNOWN_ERR,
-                          nsPrintfCString("The serialized value is too large"
-                                          " (size=%zu bytes, max=%zu bytes).",
-                                          messageSize, kMaxMessageSize));
-    return nullptr;
-  }
-
-  ObjectStoreAddPutParams commonParams;
-  commonParams.objectStoreId() = Id();
-  commonParams.cloneInfo().data().data =
-      std::move(cloneWriteInfo.mCloneBuffer.data());
-  commonParams.cloneInfo().offsetToKeyProp() = cloneWriteInfo.mOffsetToKeyProp;
-  commonParams.key() = key;
-  commonParams.indexUpdateInfos().SwapElements(updateInfo);
+  aParams.objectStoreId() = Id();
+  aParams.cloneInfo().data().data =
+      std::move(aCloneWriteInfo.mCloneBuffer.data());
+  aParams.cloneInfo().offsetToKeyProp() = aCloneWriteInfo.mOffsetToKeyProp;
+  aParams.key() = aKey;
+  aParams.indexUpdateInfos().SwapElements(aUpdateInfo);
 
   // Convert any blobs or mutable files into FileAddInfo.
-  nsTArray<StructuredCloneFile>& files = cloneWriteInfo.mFiles;
+  nsTArray<StructuredCloneFile>& files = aCloneWriteInfo.mFiles;
 
   if (!files.IsEmpty()) {
     const uint32_t count = files.Length();
@@ -1566,7 +1532,7 @@ already_AddRefed<IDBRequest> IDBObjectStore::AddOrPut(
     FallibleTArray<FileAddInfo> fileAddInfos;
     if (NS_WARN_IF(!fileAddInfos.SetCapacity(count, fallible))) {
       aRv = NS_ERROR_OUT_OF_MEMORY;
-      return nullptr;
+      return;
     }
 
     IDBDatabase* database = mTransaction->Database();
@@ -1587,7 +1553,7 @@ already_AddRefed<IDBRequest> IDBObjectStore::AddOrPut(
           if (NS_WARN_IF(!fileActor)) {
             IDB_REPORT_INTERNAL_ERR();
             aRv = NS_ERROR_DOM_INDEXEDDB_UNKNOWN_ERR;
-            return nullptr;
+            return;
           }
 
           fileAddInfo->file() = fileActor;
@@ -1605,7 +1571,7 @@ already_AddRefed<IDBRequest> IDBObjectStore::AddOrPut(
           if (NS_WARN_IF(!mutableFileActor)) {
             IDB_REPORT_INTERNAL_ERR();
             aRv = NS_ERROR_DOM_INDEXEDDB_UNKNOWN_ERR;
-            return nullptr;
+            return;
           }
 
           fileAddInfo->file() = mutableFileActor;
@@ -1624,7 +1590,7 @@ already_AddRefed<IDBRequest> IDBObjectStore::AddOrPut(
           if (NS_WARN_IF(!fileActor)) {
             IDB_REPORT_INTERNAL_ERR();
             aRv = NS_ERROR_DOM_INDEXEDDB_UNKNOWN_ERR;
-            return nullptr;
+            return;
           }
 
           fileAddInfo->file() = fileActor;
@@ -1638,7 +1604,63 @@ already_AddRefed<IDBRequest> IDBObjectStore::AddOrPut(
       }
     }
 
-    commonParams.fileAddInfos().SwapElements(fileAddInfos);
+    aParams.fileAddInfos().SwapElements(fileAddInfos);
+  }
+}
+
+already_AddRefed<IDBRequest> IDBObjectStore::AddOrPut(
+    JSContext* aCx, ValueWrapper& aValueWrapper, JS::Handle<JS::Value> aKey,
+    bool aOverwrite, bool aFromCursor, ErrorResult& aRv) {
+  AssertIsOnOwningThread();
+  MOZ_ASSERT(aCx);
+  MOZ_ASSERT_IF(aFromCursor, aOverwrite);
+
+  if (mTransaction->GetMode() == IDBTransaction::CLEANUP || mDeletedSpec) {
+    aRv.Throw(NS_ERROR_DOM_INDEXEDDB_NOT_ALLOWED_ERR);
+    return nullptr;
+  }
+
+  if (!mTransaction->IsOpen()) {
+    aRv.Throw(NS_ERROR_DOM_INDEXEDDB_TRANSACTION_INACTIVE_ERR);
+    return nullptr;
+  }
+
+  if (!mTransaction->IsWriteAllowed()) {
+    aRv.Throw(NS_ERROR_DOM_INDEXEDDB_READ_ONLY_ERR);
+    return nullptr;
+  }
+
+  Key key;
+  StructuredCloneWriteInfo cloneWriteInfo(mTransaction->Database());
+  nsTArray<IndexUpdateInfo> updateInfo;
+
+  GetAddInfo(aCx, aValueWrapper, aKey, cloneWriteInfo, key, updateInfo, aRv);
+  if (aRv.Failed()) {
+    return nullptr;
+  }
+
+  if (!mTransaction->IsOpen()) {
+    aRv.Throw(NS_ERROR_DOM_INDEXEDDB_TRANSACTION_INACTIVE_ERR);
+    return nullptr;
+  }
+
+  const size_t kMaxMessageSize = GetMaxAddPutMessageSize();
+  const size_t messageSize =
+      GetAddPutMessageSize(cloneWriteInfo, key, updateInfo);
+
+  if (messageSize > kMaxMessageSize) {
+    IDB_REPORT_INTERNAL_ERR();
+    aRv.ThrowDOMException(NS_ERROR_DOM_INDEXEDDB_UNKNOWN_ERR,
+                          nsPrintfCString("The serialized value is too large"
+                                          " (size=%zu bytes, max=%zu bytes).",
+                                          messageSize, kMaxMessageSize));
+    return nullptr;
+  }
+
+  ObjectStoreAddPutParams commonParams;
+  GetAddPutParams(cloneWriteInfo, key, updateInfo, commonParams, aRv);
+  if (aRv.Failed()) {
+    return nullptr;
   }
 
   RequestParams params;
@@ -1680,6 +1702,100 @@ already_AddRefed<IDBRequest> IDBObjectStore::AddOrPut(
   return request.forget();
 }
 
+already_AddRefed<IDBRequest> IDBObjectStore::PutAll(
+    JSContext* aCx, const Sequence<JS::Value>& aValues, ErrorResult& aRv) {
+  AssertIsOnOwningThread();
+  MOZ_ASSERT(aCx);
+
+  if (mTransaction->GetMode() == IDBTransaction::CLEANUP || mDeletedSpec) {
+    aRv.Throw(NS_ERROR_DOM_INDEXEDDB_NOT_ALLOWED_ERR);
+    return nullptr;
+  }
+
+  if (!mTransaction->IsOpen()) {
+    aRv.Throw(NS_ERROR_DOM_INDEXEDDB_TRANSACTION_INACTIVE_ERR);
+    return nullptr;
+  }
+
+  if (!mTransaction->IsWriteAllowed()) {
+    aRv.Throw(NS_ERROR_DOM_INDEXEDDB_READ_ONLY_ERR);
+    return nullptr;
+  }
+
+  // Values are serialized here, one after another, because the structured
+  // clone needs the JSContext. The whole batch is then sent to the parent in
+  // a single request.
+  nsTArray<ObjectStoreAddPutParams> records;
+  if (NS_WARN_IF(!records.SetCapacity(aValues.Length(), fallible))) {
+    aRv = NS_ERROR_OUT_OF_MEMORY;
+    return nullptr;
+  }
+
+  const size_t kMaxMessageSize = GetMaxAddPutMessageSize();
+  size_t messageSize = 0;
+
+  JS::Rooted<JS::Value> value(aCx);
+
+  for (const JS::Value& element : aValues) {
+    value = element;
+
+    ValueWrapper valueWrapper(aCx, value);
+
+    Key key;
+    StructuredCloneWriteInfo cloneWriteInfo(mTransaction->Database());
+    nsTArray<IndexUpdateInfo> updateInfo;
+
+    GetAddInfo(aCx, valueWrapper, JS::UndefinedHandleValue, cloneWriteInfo,
+               key, updateInfo, aRv);
+    if (aRv.Failed()) {
+      return nullptr;
+    }
+
+    messageSize += GetAddPutMessageSize(cloneWriteInfo, key, updateInfo);
+
+    if (messageSize > kMaxMessageSize) {
+      IDB_REPORT_INTERNAL_ERR();
+      aRv.ThrowDOMException(NS_ERROR_DOM_INDEXEDDB_UNKNOWN_ERR,
+                            nsPrintfCString("The serialized values are too "
+                                            "large (size=%zu bytes, "
+                                            "max=%zu bytes).",
+                                            messageSize, kMaxMessageSize));
+      return nullptr;
+    }
+
+    GetAddPutParams(cloneWriteInfo, key, updateInfo,
+                    *records.AppendElement(), aRv);
+    if (aRv.Failed()) {
+      return nullptr;
+    }
+  }
+
+  if (!mTransaction->IsOpen()) {
+    aRv.Throw(NS_ERROR_DOM_INDEXEDDB_TRANSACTION_INACTIVE_ERR);
+    return nullptr;
+  }
+
+  const RequestParams params =
+      ObjectStorePutAllParams(Id(), std::move(records));
+
+  RefPtr<IDBRequest> request = GenerateRequest(aCx, this);
+  MOZ_ASSERT(request);
+
+  IDB_LOG_MARK(
+      "IndexedDB %s: Child  Transaction[%lld] Request[%llu]: "
+      "database(%s).transaction(%s).objectStore(%s).putAll(%zu)",
+      "IndexedDB %s: C T[%lld] R[%llu]: IDBObjectStore.putAll()",
+      IDB_LOG_ID_STRING(), mTransaction->LoggingSerialNumber(),
+      request->LoggingSerialNumber(),
+      IDB_LOG_STRINGIFY(mTransaction->Database()),
+      IDB_LOG_STRINGIFY(mTransaction), IDB_LOG_STRINGIFY(this),
+      records.Length());
+
+  mTransaction->StartRequest(request, params);
+
+  return request.forget();
+}
+
 already_AddRefed<IDBRequest> IDBObjectStore::GetAllInternal(
     bool aKeysOnly, JSContext* aCx, JS::Handle<JS::Value> aKey,
     const Optional<uint32_t>& aLimit, ErrorResult& aRv) {
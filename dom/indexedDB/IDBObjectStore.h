@@ -38,6 +38,7 @@ namespace indexedDB {
 class Key;
 class KeyPath;
 class IndexUpdateInfo;
+class ObjectStoreAddPutParams;
 class ObjectStoreSpec;
 struct StructuredCloneReadInfo;
 }  // namespace indexedDB
@@ -46,6 +47,7 @@ class IDBObjectStore final : public nsISupports, public nsWrapperCache {
   typedef indexedDB::IndexUpdateInfo IndexUpdateInfo;
   typedef indexedDB::Key Key;
   typedef indexedDB::KeyPath KeyPath;
+  typedef indexedDB::ObjectStoreAddPutParams ObjectStoreAddPutParams;
   typedef indexedDB::ObjectStoreSpec ObjectStoreSpec;
   typedef indexedDB::StructuredCloneReadInfo StructuredCloneReadInfo;
 
@@ -182,6 +184,10 @@ class IDBObjectStore final : public nsISupports, public nsWrapperCache {
                     aRv);
   }
 
+  already_AddRefed<IDBRequest> PutAll(JSContext* aCx,
+                                      const Sequence<JS::Value>& aValues,
+                                      ErrorResult& aRv);
+
   already_AddRefed<IDBRequest> Delete(JSContext* aCx,
                                       JS::Handle<JS::Value> aKey,
                                       ErrorResult& aRv) {
@@ -295,6 +301,11 @@ class IDBObjectStore final : public nsISupports, public nsWrapperCache {
                   nsTArray<IndexUpdateInfo>& aUpdateInfoArray,
                   ErrorResult& aRv);
 
+  void GetAddPutParams(StructuredCloneWriteInfo& aCloneWriteInfo,
+                       const Key& aKey,
+                       nsTArray<IndexUpdateInfo>& aUpdateInfo,
+                       ObjectStoreAddPutParams& aParams, ErrorResult& aRv);
+
   already_AddRefed<IDBRequest> AddOrPut(JSContext* aCx,
                                         ValueWrapper& aValueWrapper,
                                         JS::Handle<JS::Value> aKey,
@@ -48,6 +48,7 @@ IDBTransaction::IDBTransaction(IDBDatabase* aDatabase,
       mNextIndexId(0),
       mAbortCode(NS_OK),
       mPendingRequestCount(0),
+      mWriteRequestCount(0),
       mLineNo(0),
       mColumn(0),
       mReadyState(IDBTransaction::INITIAL),
@@ -265,6 +266,20 @@ BackgroundRequestChild* IDBTransaction::StartRequest(
   MOZ_ASSERT(aRequest);
   MOZ_ASSERT(aParams.type() != RequestParams::T__None);
 
+  switch (aParams.type()) {
+    case RequestParams::TObjectStoreAddParams:
+    case RequestParams::TObjectStorePutParams:
+    case RequestParams::TObjectStorePutAllParams:
+    case RequestParams::TObjectStoreDeleteParams:
+    case RequestParams::TObjectStoreClearParams:
+      // Records preloaded by cursors in this transaction may be stale now.
+      mWriteRequestCount++;
+      break;
+
+    default:
+      break;
+  }
+
   BackgroundRequestChild* actor = new BackgroundRequestChild(aRequest);
 
   if (mMode == VERSION_CHANGE) {
@@ -89,6 +89,11 @@ class IDBTransaction final : public DOMEventTargetHelper, public nsIRunnable {
   nsresult mAbortCode;
   uint32_t mPendingRequestCount;
 
+  // Bumped for every request that modifies an object store. Cursors compare
+  // it against the value they saw when records were preloaded to find out
+  // whether their cached records may be stale.
+  uint64_t mWriteRequestCount;
+
   nsString mFilename;
   uint32_t mLineNo;
   uint32_t mColumn;
@@ -177,6 +182,11 @@ class IDBTransaction final : public DOMEventTargetHelper, public nsIRunnable {
     return NS_FAILED(mAbortCode);
   }
 
+  uint64_t WriteRequestCount() const {
+    AssertIsOnOwningThread();
+    return mWriteRequestCount;
+  }
+
   nsresult AbortCode() const {
     AssertIsOnOwningThread();
     return mAbortCode;
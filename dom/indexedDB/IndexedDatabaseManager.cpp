@@ -113,6 +113,11 @@ const int32_t kDefaultDataThresholdBytes = 1024 * 1024;  // 1MB
 // The maximal size of a serialized object to be transfered through IPC.
 const int32_t kDefaultMaxSerializedMsgSize = IPC::Channel::kMaximumMessageSize;
 
+// The maximal number of records a cursor sends to the child in one response.
+// Anything beyond the first record is cached by the child so that subsequent
+// continue() calls don't need a round trip to the parent.
+const int32_t kDefaultMaxCursorPreloadRecords = 64;
+
 #define IDB_PREF_BRANCH_ROOT "dom.indexedDB."
 
 const char kTestingPref[] = IDB_PREF_BRANCH_ROOT "testing";
@@ -123,6 +128,8 @@ const char kPrefMaxSerilizedMsgSize[] =
     IDB_PREF_BRANCH_ROOT "maxSerializedMsgSize";
 const char kPrefErrorEventToSelfError[] =
     IDB_PREF_BRANCH_ROOT "errorEventToSelfError";
+const char kPrefMaxCursorPreloadRecords[] =
+    IDB_PREF_BRANCH_ROOT "cursorPreloading.maxRecords";
 
 #define IDB_PREF_LOGGING_BRANCH_ROOT IDB_PREF_BRANCH_ROOT "logging."
 
@@ -147,6 +154,7 @@ Atomic<bool> gFileHandleEnabled(false);
 Atomic<bool> gPrefErrorEventToSelfError(false);
 Atomic<int32_t> gDataThresholdBytes(0);
 Atomic<int32_t> gMaxSerializedMsgSize(0);
+Atomic<int32_t> gMaxCursorPreloadRecords(0);
 
 void AtomicBoolPrefChangedCallback(const char* aPrefName,
                                    Atomic<bool>* aClosure) {
@@ -183,6 +191,19 @@ void MaxSerializedMsgSizePrefChangeCallback(const char* aPrefName,
   MOZ_ASSERT(gMaxSerializedMsgSize > 0);
 }
 
+void MaxCursorPreloadRecordsPrefChangedCallback(const char* aPrefName,
+                                                void* aClosure) {
+  MOZ_ASSERT(NS_IsMainThread());
+  MOZ_ASSERT(!strcmp(aPrefName, kPrefMaxCursorPreloadRecords));
+  MOZ_ASSERT(!aClosure);
+
+  int32_t maxRecords =
+      Preferences::GetInt(aPrefName, kDefaultMaxCursorPreloadRecords);
+
+  // Values below 1 disable preloading, the first record is always sent.
+  gMaxCursorPreloadRecords = maxRecords > 0 ? maxRecords : 1;
+}
+
 }  // namespace
 
 IndexedDatabaseManager::IndexedDatabaseManager()
@@ -281,6 +302,10 @@ nsresult IndexedDatabaseManager::Init() {
   Preferences::RegisterCallbackAndCall(MaxSerializedMsgSizePrefChangeCallback,
                                        kPrefMaxSerilizedMsgSize);
 
+  Preferences::RegisterCallbackAndCall(
+      MaxCursorPreloadRecordsPrefChangedCallback,
+      kPrefMaxCursorPreloadRecords);
+
   nsAutoCString acceptLang;
   Preferences::GetLocalizedCString("intl.accept_languages", acceptLang);
 
@@ -336,6 +361,9 @@ void IndexedDatabaseManager::Destroy() {
   Preferences::UnregisterCallback(MaxSerializedMsgSizePrefChangeCallback,
                                   kPrefMaxSerilizedMsgSize);
 
+  Preferences::UnregisterCallback(MaxCursorPreloadRecordsPrefChangedCallback,
+                                  kPrefMaxCursorPreloadRecords);
+
   delete this;
 }
 
@@ -617,6 +645,16 @@ uint32_t IndexedDatabaseManager::MaxSerializedMsgSize() {
   return gMaxSerializedMsgSize;
 }
 
+// static
+uint32_t IndexedDatabaseManager::MaxCursorPreloadRecords() {
+  MOZ_ASSERT(gDBManager,
+             "MaxCursorPreloadRecords() called before indexedDB has been "
+             "initialized!");
+  MOZ_ASSERT(gMaxCursorPreloadRecords > 0);
+
+  return gMaxCursorPreloadRecords;
+}
+
 void IndexedDatabaseManager::ClearBackgroundActor() {
   MOZ_ASSERT(NS_IsMainThread());
 
@@ -0,0 +1,132 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef mozilla_dom_indexeddb_readerconnectionset_h__
+#define mozilla_dom_indexeddb_readerconnectionset_h__
+
+#include <utility>
+
+#include "mozilla/Assertions.h"
+#include "mozilla/UniquePtr.h"
+#include "nsTArray.h"
+
+namespace mozilla {
+namespace dom {
+namespace indexedDB {
+
+// The reader connections a database in the ConnectionPool runs readonly
+// transactions on while its main connection is busy, and which of them are
+// free.  Only used on the background thread.
+//
+// A reader runs one transaction at a time: each transaction restarts the
+// reader's read transaction to get a snapshot of everything committed before
+// it, which would pull the snapshot out from under another transaction still
+// reading on the same connection.
+template <typename Reader>
+class ReaderConnectionSet final {
+ public:
+  explicit ReaderConnectionSet(uint32_t aMaxCount)
+      : mMaxCount(aMaxCount), mOpenCount(0) {}
+
+  ~ReaderConnectionSet() { MOZ_ASSERT(mReaders.IsEmpty()); }
+
+  bool IsEmpty() const { return mReaders.IsEmpty(); }
+
+  // Returns an idle reader, now busy with a transaction, or null when none is
+  // idle.
+  Reader* UseIdleReader() {
+    for (Entry& entry : mReaders) {
+      if (entry.mState == State::Idle) {
+        entry.mState = State::Busy;
+        return entry.mReader.get();
+      }
+    }
+    return nullptr;
+  }
+
+  bool CanAddReader() const { return mOpenCount < mMaxCount; }
+
+  // Takes a new reader, busy with the transaction it was opened for.
+  Reader* AddReader(UniquePtr<Reader> aReader) {
+    MOZ_ASSERT(aReader);
+    MOZ_ASSERT(CanAddReader());
+
+    Reader* reader = aReader.get();
+    mReaders.AppendElement(Entry(std::move(aReader)));
+    mOpenCount++;
+    return reader;
+  }
+
+  // The transaction running on |aReader| finished.
+  void NoteIdle(Reader* aReader) {
+    Entry& entry = GetEntry(aReader);
+    MOZ_ASSERT(entry.mState == State::Busy);
+
+    entry.mState = State::Idle;
+  }
+
+  // |aReader|, which is idle, is being closed and won't be used again.
+  void NoteClosing(Reader* aReader) {
+    Entry& entry = GetEntry(aReader);
+    MOZ_ASSERT(entry.mState == State::Idle);
+    MOZ_ASSERT(mOpenCount);
+
+    entry.mState = State::Closing;
+    mOpenCount--;
+  }
+
+  // Appends the readers that aren't being closed already.
+  void GetOpenReaders(nsTArray<Reader*>& aReaders) const {
+    for (const Entry& entry : mReaders) {
+      if (entry.mState != State::Closing) {
+        aReaders.AppendElement(entry.mReader.get());
+      }
+    }
+  }
+
+  // Deletes |aReader| once its connection was closed.
+  void Remove(Reader* aReader) {
+    for (uint32_t index = 0; index < mReaders.Length(); index++) {
+      if (mReaders[index].mReader.get() == aReader) {
+        MOZ_ASSERT(mReaders[index].mState == State::Closing);
+        mReaders.RemoveElementAt(index);
+        return;
+      }
+    }
+    MOZ_ASSERT_UNREACHABLE("Unknown reader!");
+  }
+
+ private:
+  enum class State { Idle, Busy, Closing };
+
+  struct Entry {
+    UniquePtr<Reader> mReader;
+    State mState;
+
+    explicit Entry(UniquePtr<Reader>&& aReader)
+        : mReader(std::move(aReader)), mState(State::Busy) {}
+  };
+
+  Entry& GetEntry(Reader* aReader) {
+    for (Entry& entry : mReaders) {
+      if (entry.mReader.get() == aReader) {
+        return entry;
+      }
+    }
+    MOZ_CRASH("Unknown reader!");
+  }
+
+  nsTArray<Entry> mReaders;
+  const uint32_t mMaxCount;
+  // Readers that aren't being closed.
+  uint32_t mOpenCount;
+};
+
+}  // namespace indexedDB
+}  // namespace dom
+}  // namespace mozilla
+
+#endif  // mozilla_dom_indexeddb_readerconnectionset_h__
@@ -0,0 +1,75 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+
+#include "AutoIncrementKeyGenerator.h"
+
+using namespace mozilla::dom::indexedDB;
+
+namespace {
+
+// Writes a record the way ObjectStoreAddOrPutRequestOp::AddOrPutRecord()
+// does, with a numeric key or none.  Returns the id the record was stored
+// with, 0 when it was stored with its own key and -1 when it failed.
+int64_t WriteKeyGeneratorTestRecord(AutoIncrementKeyGenerator& aGenerator,
+                                    const double* aKey = nullptr) {
+  int64_t id;
+  if (!aKey) {
+    id = aGenerator.GenerateId();
+    if (!id) {
+      return -1;
+    }
+  } else {
+    id = aGenerator.IdForKey(*aKey);
+  }
+
+  aGenerator.NoteWritten(id);
+  return id;
+}
+
+}  // namespace
+
+// The records of a putAll() get consecutive ids, and those stored with
+// their own numeric key move the generator past it.
+TEST(AutoIncrementKeyGenerator, Batch)
+{
+  AutoIncrementKeyGenerator generator(1);
+
+  EXPECT_EQ(1, WriteKeyGeneratorTestRecord(generator));
+  EXPECT_EQ(2, WriteKeyGeneratorTestRecord(generator));
+
+  const double ahead = 10.5;
+  EXPECT_EQ(10, WriteKeyGeneratorTestRecord(generator, &ahead));
+  EXPECT_EQ(11, WriteKeyGeneratorTestRecord(generator));
+
+  // Keys behind the generator, or not ids at all, leave it alone.
+  const double behind = 3;
+  EXPECT_EQ(0, WriteKeyGeneratorTestRecord(generator, &behind));
+  const double negative = -20;
+  EXPECT_EQ(0, WriteKeyGeneratorTestRecord(generator, &negative));
+  EXPECT_EQ(12, WriteKeyGeneratorTestRecord(generator));
+
+  EXPECT_EQ(13, generator.NextId());
+}
+
+// Once the largest id was used, records without a key fail.
+TEST(AutoIncrementKeyGenerator, Exhausted)
+{
+  const int64_t maxId = AutoIncrementKeyGenerator::kMaxId;
+
+  AutoIncrementKeyGenerator generator(maxId - 1);
+  EXPECT_EQ(maxId - 1, WriteKeyGeneratorTestRecord(generator));
+  EXPECT_EQ(maxId, WriteKeyGeneratorTestRecord(generator));
+  EXPECT_EQ(-1, WriteKeyGeneratorTestRecord(generator));
+
+  // Larger keys use up the generator as well.
+  AutoIncrementKeyGenerator other(1);
+  const double huge = 1e300;
+  EXPECT_EQ(maxId, WriteKeyGeneratorTestRecord(other, &huge));
+  EXPECT_EQ(-1, WriteKeyGeneratorTestRecord(other));
+  EXPECT_EQ(maxId + 1, other.NextId());
+}
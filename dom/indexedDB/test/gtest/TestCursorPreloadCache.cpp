@@ -0,0 +1,165 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+
+#include "CursorPreloadCache.h"
+
+using namespace mozilla::dom::indexedDB;
+
+namespace {
+
+struct PreloadTestRecord {
+  Key mKey;
+};
+
+typedef CursorPreloadCache<PreloadTestRecord> PreloadTestCache;
+
+Key MakeKey(int64_t aValue) {
+  Key key;
+  key = aValue;
+  return key;
+}
+
+// What the child does with a response of the records |aFirst| to |aLast|:
+// the first answers the request, the others are cached if still valid.
+void ReceiveRecords(PreloadTestCache& aCache, uint64_t aWriteRequestCount,
+                    int64_t aFirst, int64_t aLast) {
+  int64_t step = aFirst <= aLast ? 1 : -1;
+  size_t count = (aLast - aFirst) * step + 1;
+  if (!aCache.OnResponse(aWriteRequestCount, count)) {
+    return;
+  }
+  for (int64_t value = aFirst + step; value != aLast + step; value += step) {
+    aCache.Push(PreloadTestRecord{MakeKey(value)});
+  }
+}
+
+int64_t PopValue(PreloadTestCache& aCache) {
+  return int64_t(aCache.PopFront().mKey.ToFloat());
+}
+
+}  // namespace
+
+// continue(), continue(key) and advance(n) are answered from the records
+// preloaded with the last response while they last.
+TEST(CursorPreloadCache, ContinueFromCache)
+{
+  PreloadTestCache cache(0);
+
+  EXPECT_TRUE(cache.OnRequestSent(0, Key()).IsUnset());
+  ReceiveRecords(cache, 0, 1, 8);
+
+  ASSERT_TRUE(cache.ConsumeContinue(0, Key(), true));
+  EXPECT_EQ(2, PopValue(cache));
+
+  ASSERT_TRUE(cache.ConsumeContinue(0, MakeKey(4), true));
+  EXPECT_EQ(4, PopValue(cache));
+
+  ASSERT_TRUE(cache.ConsumeAdvance(0, 2));
+  EXPECT_EQ(6, PopValue(cache));
+
+  // Past what was preloaded: the parent has to be asked, from the child's
+  // position since it read up to 8 already.
+  EXPECT_FALSE(cache.ConsumeAdvance(0, 3));
+  EXPECT_TRUE(cache.IsEmpty());
+  Key key = cache.OnRequestSent(0, MakeKey(6));
+  ASSERT_FALSE(key.IsUnset());
+  EXPECT_EQ(6, key.ToFloat());
+
+  // A single record leaves the parent where the child is.
+  ReceiveRecords(cache, 0, 9, 9);
+  EXPECT_TRUE(cache.IsEmpty());
+  EXPECT_TRUE(cache.OnRequestSent(0, MakeKey(9)).IsUnset());
+}
+
+// The same going backwards.
+TEST(CursorPreloadCache, ContinueFromCachePrev)
+{
+  PreloadTestCache cache(0);
+  ReceiveRecords(cache, 0, 10, 6);
+
+  ASSERT_TRUE(cache.ConsumeContinue(0, MakeKey(8), false));
+  EXPECT_EQ(8, PopValue(cache));
+
+  EXPECT_FALSE(cache.ConsumeContinue(0, MakeKey(2), false));
+  EXPECT_TRUE(cache.IsEmpty());
+}
+
+// A write request started in the transaction after the records were asked
+// for makes the child go back to the parent, which continues from the
+// child's position.
+TEST(CursorPreloadCache, WriteInvalidates)
+{
+  PreloadTestCache cache(0);
+  ReceiveRecords(cache, 0, 1, 5);
+
+  // put() or cursor.update() before continue().
+  EXPECT_FALSE(cache.ConsumeContinue(1, Key(), true));
+  EXPECT_TRUE(cache.IsEmpty());
+
+  Key key = cache.OnRequestSent(1, MakeKey(1));
+  ASSERT_FALSE(key.IsUnset());
+
+  Key parentPosition = MakeKey(5);
+  ASSERT_TRUE(RepositionPreloadingCursor(parentPosition, key, true));
+  EXPECT_EQ(1, parentPosition.ToFloat());
+
+  // Unchanged since then, so these are kept.
+  ReceiveRecords(cache, 1, 2, 4);
+  ASSERT_TRUE(cache.ConsumeAdvance(1, 1));
+  EXPECT_EQ(3, PopValue(cache));
+}
+
+// A write request started while continue() is on its way to the parent may
+// be processed after the preloaded records were read: only the requested
+// record is used, and the parent still has to go back.
+TEST(CursorPreloadCache, WriteDuringContinue)
+{
+  PreloadTestCache cache(0);
+  EXPECT_TRUE(cache.OnRequestSent(0, Key()).IsUnset());
+
+  ReceiveRecords(cache, 1, 1, 5);
+  EXPECT_TRUE(cache.IsEmpty());
+
+  Key key = cache.OnRequestSent(1, MakeKey(1));
+  ASSERT_FALSE(key.IsUnset());
+  EXPECT_EQ(1, key.ToFloat());
+}
+
+// The end of the range clears everything.
+TEST(CursorPreloadCache, EndOfRange)
+{
+  PreloadTestCache cache(0);
+  ReceiveRecords(cache, 0, 1, 3);
+  EXPECT_FALSE(cache.ConsumeAdvance(0, 5));
+
+  EXPECT_FALSE(cache.OnRequestSent(0, MakeKey(1)).IsUnset());
+  cache.OnResponse(0, 0);
+  EXPECT_TRUE(cache.OnRequestSent(0, MakeKey(1)).IsUnset());
+}
+
+// The parent only moves back to a key it already went past.
+TEST(CursorPreloadCache, Reposition)
+{
+  Key position = MakeKey(5);
+
+  EXPECT_TRUE(RepositionPreloadingCursor(position, Key(), true));
+  EXPECT_EQ(5, position.ToFloat());
+
+  EXPECT_FALSE(RepositionPreloadingCursor(position, MakeKey(6), true));
+  EXPECT_EQ(5, position.ToFloat());
+  EXPECT_TRUE(RepositionPreloadingCursor(position, MakeKey(5), true));
+  EXPECT_TRUE(RepositionPreloadingCursor(position, MakeKey(3), true));
+  EXPECT_EQ(3, position.ToFloat());
+
+  EXPECT_FALSE(RepositionPreloadingCursor(position, MakeKey(2), false));
+  EXPECT_TRUE(RepositionPreloadingCursor(position, MakeKey(4), false));
+  EXPECT_EQ(4, position.ToFloat());
+
+  Key unset;
+  EXPECT_FALSE(RepositionPreloadingCursor(unset, MakeKey(1), true));
+}
@@ -0,0 +1,206 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set ts=8 sts=2 et sw=2 tw=80: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+
+#include "mozIStorageConnection.h"
+#include "mozIStorageService.h"
+#include "mozIStorageStatement.h"
+#include "mozStorageCID.h"
+#include "nsDirectoryServiceDefs.h"
+#include "nsDirectoryServiceUtils.h"
+#include "nsIFile.h"
+#include "nsServiceManagerUtils.h"
+#include "nsString.h"
+#include "ReaderConnectionSet.h"
+
+using namespace mozilla;
+using namespace mozilla::dom::indexedDB;
+
+namespace {
+
+struct ReaderTestReader {
+  explicit ReaderTestReader(int aId) : mId(aId) {}
+
+  int mId;
+};
+
+typedef ReaderConnectionSet<ReaderTestReader> ReaderTestSet;
+
+// Closes the readers that aren't closing yet, the way the pool does once the
+// database is idle, and forgets all of them.
+void CloseReaderTestSet(ReaderTestSet& aReaders) {
+  nsTArray<ReaderTestReader*> readers;
+  aReaders.GetOpenReaders(readers);
+  for (ReaderTestReader* reader : readers) {
+    aReaders.NoteClosing(reader);
+  }
+  for (ReaderTestReader* reader : readers) {
+    aReaders.Remove(reader);
+  }
+}
+
+already_AddRefed<mozIStorageConnection> OpenReaderTestConnection(
+    nsIFile* aFile) {
+  nsCOMPtr<mozIStorageService> ss =
+      do_GetService(MOZ_STORAGE_SERVICE_CONTRACTID);
+  if (!ss) {
+    return nullptr;
+  }
+
+  nsCOMPtr<mozIStorageConnection> connection;
+  nsresult rv = ss->OpenUnsharedDatabase(aFile, getter_AddRefs(connection));
+  if (NS_FAILED(rv)) {
+    return nullptr;
+  }
+  return connection.forget();
+}
+
+void ExecuteReaderTestSQL(mozIStorageConnection* aConnection,
+                          const char* aSQL) {
+  EXPECT_EQ(NS_OK,
+            aConnection->ExecuteSimpleSQL(nsDependentCString(aSQL)));
+}
+
+nsCString GetReaderTestString(mozIStorageConnection* aConnection,
+                              const char* aSQL) {
+  nsCString result;
+  nsCOMPtr<mozIStorageStatement> stmt;
+  nsresult rv = aConnection->CreateStatement(nsDependentCString(aSQL),
+                                             getter_AddRefs(stmt));
+  EXPECT_EQ(NS_OK, rv);
+  if (NS_FAILED(rv)) {
+    return result;
+  }
+
+  bool hasResult = false;
+  EXPECT_EQ(NS_OK, stmt->ExecuteStep(&hasResult));
+  EXPECT_TRUE(hasResult);
+  if (hasResult) {
+    EXPECT_EQ(NS_OK, stmt->GetUTF8String(0, result));
+  }
+
+  EXPECT_EQ(NS_OK, stmt->Finalize());
+  return result;
+}
+
+}  // namespace
+
+// A reader only runs one transaction at a time, and runs the next one once
+// that finished.
+TEST(ReaderConnectionSet, OnlyIdleReadersReused)
+{
+  ReaderTestSet readers(2);
+  EXPECT_FALSE(readers.UseIdleReader());
+
+  ASSERT_TRUE(readers.CanAddReader());
+  ReaderTestReader* first = readers.AddReader(MakeUnique<ReaderTestReader>(1));
+  EXPECT_EQ(1, first->mId);
+
+  // Busy with the transaction it was opened for.
+  EXPECT_FALSE(readers.UseIdleReader());
+
+  ASSERT_TRUE(readers.CanAddReader());
+  ReaderTestReader* second =
+      readers.AddReader(MakeUnique<ReaderTestReader>(2));
+  EXPECT_FALSE(readers.CanAddReader());
+  EXPECT_FALSE(readers.UseIdleReader());
+
+  readers.NoteIdle(second);
+  EXPECT_EQ(second, readers.UseIdleReader());
+  EXPECT_FALSE(readers.UseIdleReader());
+
+  readers.NoteIdle(first);
+  readers.NoteIdle(second);
+  EXPECT_EQ(first, readers.UseIdleReader());
+  EXPECT_EQ(second, readers.UseIdleReader());
+  EXPECT_FALSE(readers.UseIdleReader());
+
+  readers.NoteIdle(first);
+  readers.NoteIdle(second);
+  CloseReaderTestSet(readers);
+  EXPECT_TRUE(readers.IsEmpty());
+}
+
+// Readers being closed, when they go idle while other databases wait for a
+// thread or when their database goes idle, are not used again and make room
+// for new ones.
+TEST(ReaderConnectionSet, IdleCleanup)
+{
+  ReaderTestSet readers(2);
+  ReaderTestReader* first = readers.AddReader(MakeUnique<ReaderTestReader>(1));
+  ReaderTestReader* second =
+      readers.AddReader(MakeUnique<ReaderTestReader>(2));
+  EXPECT_FALSE(readers.CanAddReader());
+
+  readers.NoteIdle(first);
+  readers.NoteClosing(first);
+  EXPECT_FALSE(readers.UseIdleReader());
+  EXPECT_TRUE(readers.CanAddReader());
+
+  nsTArray<ReaderTestReader*> open;
+  readers.GetOpenReaders(open);
+  ASSERT_EQ(1u, open.Length());
+  EXPECT_EQ(second, open[0]);
+
+  // Its connection closed.
+  readers.Remove(first);
+  EXPECT_FALSE(readers.IsEmpty());
+
+  ReaderTestReader* third = readers.AddReader(MakeUnique<ReaderTestReader>(3));
+  readers.NoteIdle(second);
+  readers.NoteIdle(third);
+  CloseReaderTestSet(readers);
+  EXPECT_TRUE(readers.IsEmpty());
+}
+
+// What readers rely on: in WAL mode a readonly transaction keeps reading the
+// snapshot it started with while a readwrite transaction commits on the
+// main connection, and restarting it makes that write visible.
+TEST(ReaderConnectionSet, SnapshotIsolation)
+{
+  nsCOMPtr<nsIFile> file;
+  ASSERT_EQ(NS_OK,
+            NS_GetSpecialDirectory(NS_OS_TEMP_DIR, getter_AddRefs(file)));
+  ASSERT_EQ(NS_OK, file->Append(NS_LITERAL_STRING("idb_readers.sqlite")));
+  ASSERT_EQ(NS_OK, file->CreateUnique(nsIFile::NORMAL_FILE_TYPE, 0600));
+
+  nsCOMPtr<mozIStorageConnection> main = OpenReaderTestConnection(file);
+  ASSERT_TRUE(main);
+  EXPECT_TRUE(GetReaderTestString(main, "PRAGMA journal_mode = wal;")
+                  .EqualsLiteral("wal"));
+  ExecuteReaderTestSQL(main, "CREATE TABLE data (value INTEGER);");
+  ExecuteReaderTestSQL(main, "INSERT INTO data VALUES (1);");
+
+  // The journal mode is stored in the database.
+  nsCOMPtr<mozIStorageConnection> reader = OpenReaderTestConnection(file);
+  ASSERT_TRUE(reader);
+  EXPECT_TRUE(GetReaderTestString(reader, "PRAGMA journal_mode;")
+                  .EqualsLiteral("wal"));
+
+  ExecuteReaderTestSQL(reader, "BEGIN;");
+  EXPECT_TRUE(GetReaderTestString(reader, "SELECT value FROM data;")
+                  .EqualsLiteral("1"));
+
+  ExecuteReaderTestSQL(main, "BEGIN IMMEDIATE;");
+  ExecuteReaderTestSQL(main, "UPDATE data SET value = 2;");
+  ExecuteReaderTestSQL(main, "COMMIT;");
+  EXPECT_TRUE(GetReaderTestString(main, "SELECT value FROM data;")
+                  .EqualsLiteral("2"));
+  EXPECT_TRUE(GetReaderTestString(reader, "SELECT value FROM data;")
+                  .EqualsLiteral("1"));
+
+  // DatabaseConnection::RestartReadTransaction().
+  ExecuteReaderTestSQL(reader, "ROLLBACK;");
+  ExecuteReaderTestSQL(reader, "BEGIN;");
+  EXPECT_TRUE(GetReaderTestString(reader, "SELECT value FROM data;")
+                  .EqualsLiteral("2"));
+  ExecuteReaderTestSQL(reader, "ROLLBACK;");
+
+  EXPECT_EQ(NS_OK, reader->Close());
+  EXPECT_EQ(NS_OK, main->Close());
+  EXPECT_EQ(NS_OK, file->Remove(false));
+}
@@ -0,0 +1,108 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Values larger than dom.indexedDB.dataThreshold are handed back to get() in
+// shared memory.  objectStore.get() and index.get() must still return them
+// whole, with their blobs.
+
+"use strict";
+
+const { Services } = ChromeUtils.import("resource://gre/modules/Services.jsm");
+
+Cu.importGlobalProperties(["indexedDB", "Blob", "FileReader"]);
+
+const kThresholdPref = "dom.indexedDB.dataThreshold";
+
+function requestPromise(request) {
+  return new Promise((resolve, reject) => {
+    request.onsuccess = event => resolve(event.target.result);
+    request.onerror = event => reject(event.target.error);
+  });
+}
+
+function readBlob(blob) {
+  return new Promise((resolve, reject) => {
+    let reader = new FileReader();
+    reader.onload = () => resolve(reader.result);
+    reader.onerror = () => reject(reader.error);
+    reader.readAsText(blob);
+  });
+}
+
+function makeString(length, seed) {
+  let chunk = "";
+  for (let i = 0; i < 256; i++) {
+    chunk += String.fromCharCode(32 + ((i * 7 + seed) % 95));
+  }
+  return chunk.repeat(Math.ceil(length / chunk.length)).slice(0, length);
+}
+
+add_task(async function setup() {
+  do_get_profile();
+  Services.prefs.setBoolPref("dom.indexedDB.testing", true);
+  Services.prefs.setIntPref(kThresholdPref, 1024);
+  registerCleanupFunction(() => {
+    Services.prefs.clearUserPref(kThresholdPref);
+    Services.prefs.clearUserPref("dom.indexedDB.testing");
+  });
+});
+
+add_task(async function test_large_value_shared_get() {
+  const name = "test_large_value_shared_get";
+  const blobText = makeString(4096, 3);
+
+  const small = { id: 1, tag: "small", text: "tiny" };
+  const large = { id: 2, tag: "large", text: makeString(512 * 1024, 1) };
+  const withBlob = {
+    id: 3,
+    tag: "blob",
+    text: makeString(64 * 1024, 2),
+    blob: new Blob([blobText], { type: "text/plain" }),
+  };
+
+  let request = indexedDB.open(name, 1);
+  request.onupgradeneeded = event => {
+    let db = event.target.result;
+    let objectStore = db.createObjectStore("values", { keyPath: "id" });
+    objectStore.createIndex("tag", "tag", { unique: true });
+  };
+  let db = await requestPromise(request);
+
+  let transaction = db.transaction("values", "readwrite");
+  let objectStore = transaction.objectStore("values");
+  for (let value of [small, large, withBlob]) {
+    objectStore.put(value);
+  }
+  await requestPromise(objectStore.count());
+
+  for (let viaIndex of [false, true]) {
+    objectStore = db.transaction("values").objectStore("values");
+    let source = viaIndex ? objectStore.index("tag") : objectStore;
+    let get = value =>
+      requestPromise(source.get(viaIndex ? value.tag : value.id));
+
+    let result = await get(small);
+    Assert.equal(result.text, small.text);
+
+    result = await get(large);
+    Assert.equal(result.id, large.id);
+    Assert.equal(result.text.length, large.text.length);
+    Assert.ok(result.text == large.text, "Large value is intact");
+
+    result = await get(withBlob);
+    Assert.equal(result.id, withBlob.id);
+    Assert.ok(result.text == withBlob.text, "Value with a blob is intact");
+    Assert.ok(result.blob instanceof Blob);
+    Assert.equal(result.blob.size, blobText.length);
+    Assert.equal(result.blob.type, "text/plain");
+    Assert.ok((await readBlob(result.blob)) == blobText, "Blob is intact");
+
+    // A key that doesn't exist.
+    result = await requestPromise(source.get(viaIndex ? "none" : 4));
+    Assert.equal(result, undefined);
+  }
+
+  db.close();
+  await requestPromise(indexedDB.deleteDatabase(name));
+});
@@ -163,7 +163,7 @@ const uint32_t kHackyDowngradeMinorStorageVersion = 1;
 const uint32_t kMajorStorageVersion = 2;
 
 // Minor storage version. Bump for backwards-compatible changes.
-const uint32_t kMinorStorageVersion = 2;
+const uint32_t kMinorStorageVersion = 3;
 
 // The storage version we store in the SQLite database is a (signed) 32-bit
 // integer. The major version is left-shifted 16 bits so the max value is
@@ -235,12 +235,49 @@ uint32_t GetMajorStorageVersion(int32_t aStorageVersion) {
   return uint32_t(aStorageVersion >> 16);
 }
 
+nsresult CreateCacheTables(mozIStorageConnection* aConnection) {
+  AssertIsOnIOThread();
+  MOZ_ASSERT(aConnection);
+
+  // The cache table holds a single row. valid is only set while the origin
+  // table matches the origin directories, see QuotaManager::UnloadQuota.
+  nsresult rv = aConnection->ExecuteSimpleSQL(
+      NS_LITERAL_CSTRING("CREATE TABLE cache"
+                         "( valid INTEGER NOT NULL DEFAULT 0"
+                         ");"));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  rv = aConnection->ExecuteSimpleSQL(
+      NS_LITERAL_CSTRING("INSERT INTO cache (valid) VALUES (0);"));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  // repository_id is the persistence type of the origin.
+  rv = aConnection->ExecuteSimpleSQL(
+      NS_LITERAL_CSTRING("CREATE TABLE origin"
+                         "( repository_id INTEGER NOT NULL"
+                         ", origin TEXT NOT NULL"
+                         ", group_ TEXT NOT NULL"
+                         ", usage INTEGER NOT NULL"
+                         ", last_access_time INTEGER NOT NULL"
+                         ", PRIMARY KEY (repository_id, origin)"
+                         ");"));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  return NS_OK;
+}
+
 nsresult CreateTables(mozIStorageConnection* aConnection) {
   AssertIsOnIOThread();
   MOZ_ASSERT(aConnection);
 
-  // The database doesn't have any tables for now. It's only used for storage
-  // version checking.
+  // Besides storage version checking, the database is only used for the quota
+  // cache.
   // However, this is the place where any future tables should be created.
 
   nsresult rv;
@@ -257,6 +294,11 @@ nsresult CreateTables(mozIStorageConnection* aConnection) {
   }
 #endif
 
+  rv = CreateCacheTables(aConnection);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
   rv = aConnection->SetSchemaVersion(kStorageVersion);
   if (NS_WARN_IF(NS_FAILED(rv))) {
     return rv;
@@ -265,6 +307,110 @@ nsresult CreateTables(mozIStorageConnection* aConnection) {
   return NS_OK;
 }
 
+nsresult OpenStorageConnection(const nsAString& aBasePath,
+                               mozIStorageConnection** aConnection) {
+  AssertIsOnIOThread();
+  MOZ_ASSERT(aConnection);
+
+  nsCOMPtr<nsIFile> storageFile;
+  nsresult rv = NS_NewLocalFile(aBasePath, false, getter_AddRefs(storageFile));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  rv = storageFile->Append(NS_LITERAL_STRING(STORAGE_FILE_NAME));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  nsCOMPtr<mozIStorageService> ss =
+      do_GetService(MOZ_STORAGE_SERVICE_CONTRACTID, &rv);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  nsCOMPtr<mozIStorageConnection> connection;
+  rv = ss->OpenUnsharedDatabase(storageFile, getter_AddRefs(connection));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  connection.forget(aConnection);
+  return NS_OK;
+}
+
+struct CachedOriginInfo {
+  nsCString mGroup;
+  uint64_t mUsage;
+  int64_t mAccessTime;
+
+  CachedOriginInfo() : mUsage(0), mAccessTime(0) {}
+};
+
+typedef nsDataHashtable<nsCStringHashKey, CachedOriginInfo> CachedOriginTable;
+
+nsresult LoadCachedOrigins(mozIStorageConnection* aConnection,
+                           PersistenceType aPersistenceType,
+                           CachedOriginTable& aCachedOrigins) {
+  AssertIsOnIOThread();
+  MOZ_ASSERT(aConnection);
+
+  nsCOMPtr<mozIStorageStatement> stmt;
+  nsresult rv = aConnection->CreateStatement(
+      NS_LITERAL_CSTRING("SELECT origin, group_, usage, last_access_time "
+                         "FROM origin "
+                         "WHERE repository_id = :repository_id;"),
+      getter_AddRefs(stmt));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  rv = stmt->BindInt32ByName(NS_LITERAL_CSTRING("repository_id"),
+                             aPersistenceType);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  bool hasResult;
+  while (NS_SUCCEEDED((rv = stmt->ExecuteStep(&hasResult))) && hasResult) {
+    nsCString origin;
+    rv = stmt->GetUTF8String(0, origin);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+
+    CachedOriginInfo cachedOrigin;
+    rv = stmt->GetUTF8String(1, cachedOrigin.mGroup);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+
+    int64_t usage;
+    rv = stmt->GetInt64(2, &usage);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+
+    if (NS_WARN_IF(usage < 0)) {
+      return NS_ERROR_FILE_CORRUPTED;
+    }
+
+    cachedOrigin.mUsage = uint64_t(usage);
+
+    rv = stmt->GetInt64(3, &cachedOrigin.mAccessTime);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return rv;
+    }
+
+    aCachedOrigins.Put(origin, cachedOrigin);
+  }
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  return NS_OK;
+}
+
 nsresult CreateWebAppsStoreConnection(nsIFile* aWebAppsStoreFile,
                                       mozIStorageService* aStorageService,
                                       mozIStorageConnection** aConnection) {
@@ -655,6 +801,7 @@ class OriginInfo final {
     AssertCurrentThreadOwnsQuotaMutex();
 
     mAccessTime = aAccessTime;
+    mAccessed = true;
   }
 
   void LockedPersist();
@@ -665,6 +812,9 @@ class OriginInfo final {
   const nsCString mOrigin;
   uint64_t mUsage;
   int64_t mAccessTime;
+  // Set once the origin has been used or created since it was initialized.
+  // Such origins are left out of the quota cache.
+  bool mAccessed;
   bool mPersisted;
   /**
    * In some special cases like the LocalStorage client where it's possible to
@@ -3515,6 +3665,18 @@ void QuotaManager::Shutdown() {
     NS_WARNING("Failed to cancel shutdown timer!");
   }
 
+  // All client work threads are gone at this point, so the usage tracked by
+  // the origin infos is final and can be saved for the next startup.  Like
+  // the runnable below, this one must be destroyed on this thread.
+  RefPtr<Runnable> unloadRunnable =
+      NewRunnableMethod("dom::quota::QuotaManager::UnloadQuota", this,
+                        &QuotaManager::UnloadQuota);
+  MOZ_ASSERT(unloadRunnable);
+
+  if (NS_FAILED(mIOThread->Dispatch(unloadRunnable, NS_DISPATCH_NORMAL))) {
+    NS_WARNING("Failed to dispatch runnable!");
+  }
+
   // NB: It's very important that runnable is destroyed on this thread
   // (i.e. after we join the IO thread) because we can't release the
   // QuotaManager on the IO thread. This should probably use
@@ -3574,6 +3736,7 @@ void QuotaManager::EnsureQuotaForOrigin(PersistenceType aPersistenceType,
     originInfo = new OriginInfo(
         groupInfo, aOrigin, /* aUsageBytes */ 0, /* aAccessTime */ PR_Now(),
         /* aPersisted */ false, /* aDirectoryExists */ false);
+    originInfo->mAccessed = true;
     groupInfo->LockedAddOriginInfo(originInfo);
   }
 }
@@ -3597,12 +3760,14 @@ void QuotaManager::NoteOriginDirectoryCreated(PersistenceType aPersistenceType,
   if (originInfo) {
     originInfo->mPersisted = aPersisted;
     originInfo->mDirectoryExists = true;
+    originInfo->mAccessed = true;
     timestamp = originInfo->LockedAccessTime();
   } else {
     timestamp = PR_Now();
     RefPtr<OriginInfo> originInfo = new OriginInfo(
         groupInfo, aOrigin, /* aUsageBytes */ 0, /* aAccessTime */ timestamp,
         aPersisted, /* aDirectoryExists */ true);
+    originInfo->mAccessed = true;
     groupInfo->LockedAddOriginInfo(originInfo);
   }
 
@@ -3694,6 +3859,187 @@ void QuotaManager::RemoveQuota() {
   NS_ASSERTION(mTemporaryStorageUsage == 0, "Should be zero!");
 }
 
+nsresult QuotaManager::OpenQuotaCache(mozIStorageConnection** aConnection) {
+  AssertIsOnIOThread();
+  MOZ_ASSERT(aConnection);
+
+  *aConnection = nullptr;
+
+  nsCOMPtr<mozIStorageConnection> connection;
+  nsresult rv = OpenStorageConnection(mBasePath, getter_AddRefs(connection));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  nsCOMPtr<mozIStorageStatement> stmt;
+  rv = connection->CreateStatement(NS_LITERAL_CSTRING("SELECT valid "
+                                                      "FROM cache;"),
+                                   getter_AddRefs(stmt));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  bool hasResult;
+  rv = stmt->ExecuteStep(&hasResult);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  if (NS_WARN_IF(!hasResult)) {
+    return NS_ERROR_FILE_CORRUPTED;
+  }
+
+  int32_t valid;
+  rv = stmt->GetInt32(0, &valid);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  stmt = nullptr;
+
+  // The cache only stays valid until the next clean shutdown rewrites it. If
+  // we crash before that, the origins have to be scanned again.
+  rv = connection->ExecuteSimpleSQL(
+      NS_LITERAL_CSTRING("UPDATE cache SET valid = 0;"));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  if (valid) {
+    connection.forget(aConnection);
+  }
+
+  return NS_OK;
+}
+
+void QuotaManager::UnloadQuota() {
+  AssertIsOnIOThread();
+
+  if (!mTemporaryStorageInitialized) {
+    return;
+  }
+
+  struct OriginParams {
+    PersistenceType mPersistenceType;
+    nsCString mGroup;
+    nsCString mOrigin;
+    uint64_t mUsage;
+    int64_t mAccessTime;
+  };
+
+  nsTArray<OriginParams> origins;
+
+  {
+    MutexAutoLock lock(mQuotaMutex);
+
+    for (auto iter = mGroupInfoPairs.Iter(); !iter.Done(); iter.Next()) {
+      nsAutoPtr<GroupInfoPair>& pair = iter.Data();
+
+      MOZ_ASSERT(!iter.Key().IsEmpty(), "Empty key!");
+      MOZ_ASSERT(pair, "Null pointer!");
+
+      for (const PersistenceType type :
+           {PERSISTENCE_TYPE_TEMPORARY, PERSISTENCE_TYPE_DEFAULT}) {
+        RefPtr<GroupInfo> groupInfo = pair->LockedGetGroupInfo(type);
+        if (!groupInfo) {
+          continue;
+        }
+
+        for (const RefPtr<OriginInfo>& originInfo : groupInfo->mOriginInfos) {
+          // Origins which have been used since they were initialized may have
+          // changed on disk without touching the metadata file again, so they
+          // are always scanned on the next startup.
+          if (originInfo->mAccessed || !originInfo->mDirectoryExists) {
+            continue;
+          }
+
+          OriginParams* params = origins.AppendElement();
+          params->mPersistenceType = type;
+          params->mGroup = groupInfo->mGroup;
+          params->mOrigin = originInfo->mOrigin;
+          params->mUsage = originInfo->mUsage;
+          params->mAccessTime = originInfo->mAccessTime;
+        }
+      }
+    }
+  }
+
+  nsCOMPtr<mozIStorageConnection> connection;
+  nsresult rv = OpenStorageConnection(mBasePath, getter_AddRefs(connection));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return;
+  }
+
+  mozStorageTransaction transaction(
+      connection, false, mozIStorageConnection::TRANSACTION_IMMEDIATE);
+
+  rv = connection->ExecuteSimpleSQL(NS_LITERAL_CSTRING("DELETE FROM origin;"));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return;
+  }
+
+  nsCOMPtr<mozIStorageStatement> stmt;
+  rv = connection->CreateStatement(
+      NS_LITERAL_CSTRING("INSERT INTO origin (repository_id, origin, group_, "
+                         "usage, last_access_time) "
+                         "VALUES (:repository_id, :origin, :group_, :usage, "
+                         ":last_access_time);"),
+      getter_AddRefs(stmt));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return;
+  }
+
+  for (const OriginParams& params : origins) {
+    mozStorageStatementScoper scoper(stmt);
+
+    rv = stmt->BindInt32ByName(NS_LITERAL_CSTRING("repository_id"),
+                               params.mPersistenceType);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return;
+    }
+
+    rv = stmt->BindUTF8StringByName(NS_LITERAL_CSTRING("origin"),
+                                    params.mOrigin);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return;
+    }
+
+    rv = stmt->BindUTF8StringByName(NS_LITERAL_CSTRING("group_"),
+                                    params.mGroup);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return;
+    }
+
+    rv = stmt->BindInt64ByName(NS_LITERAL_CSTRING("usage"),
+                               int64_t(params.mUsage));
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return;
+    }
+
+    rv = stmt->BindInt64ByName(NS_LITERAL_CSTRING("last_access_time"),
+                               params.mAccessTime);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return;
+    }
+
+    rv = stmt->Execute();
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      return;
+    }
+  }
+
+  rv = connection->ExecuteSimpleSQL(
+      NS_LITERAL_CSTRING("UPDATE cache SET valid = 1;"));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return;
+  }
+
+  rv = transaction.Commit();
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return;
+  }
+}
+
 already_AddRefed<QuotaObject> QuotaManager::GetQuotaObject(
     PersistenceType aPersistenceType, const nsACString& aGroup,
     const nsACString& aOrigin, nsIFile* aFile, int64_t aFileSize,
@@ -4075,10 +4421,21 @@ nsresult QuotaManager::GetDirectoryMetadata2WithRestore(nsIFile* aDirectory,
   return NS_OK;
 }
 
-nsresult QuotaManager::InitializeRepository(PersistenceType aPersistenceType) {
+nsresult QuotaManager::InitializeRepository(
+    PersistenceType aPersistenceType, mozIStorageConnection* aCacheConnection) {
   MOZ_ASSERT(aPersistenceType == PERSISTENCE_TYPE_TEMPORARY ||
              aPersistenceType == PERSISTENCE_TYPE_DEFAULT);
 
+  CachedOriginTable cachedOrigins;
+  if (aCacheConnection) {
+    nsresult rv =
+        LoadCachedOrigins(aCacheConnection, aPersistenceType, cachedOrigins);
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      // Not fatal, all origins just get scanned.
+      cachedOrigins.Clear();
+    }
+  }
+
   nsCOMPtr<nsIFile> directory;
   nsresult rv = NS_NewLocalFile(GetStoragePath(aPersistenceType), false,
                                 getter_AddRefs(directory));
@@ -4158,6 +4515,20 @@ nsresult QuotaManager::InitializeRepository(PersistenceType aPersistenceType) {
       CONTINUE_IN_NIGHTLY_RETURN_IN_OTHERS(rv);
     }
 
+    // The access time is saved in the metadata file whenever an origin is
+    // used, so a matching timestamp means that nothing has touched the origin
+    // since its usage was cached (even if another build has used the
+    // profile in between) and the scan of the client directories can be
+    // skipped.
+    CachedOriginInfo cachedOrigin;
+    if (cachedOrigins.Get(origin, &cachedOrigin) &&
+        cachedOrigin.mAccessTime == timestamp &&
+        cachedOrigin.mGroup == group) {
+      InitQuotaForOrigin(aPersistenceType, group, origin, cachedOrigin.mUsage,
+                         timestamp, persisted);
+      continue;
+    }
+
     rv = InitializeOrigin(aPersistenceType, group, origin, timestamp, persisted,
                           childDirectory);
     if (NS_WARN_IF(NS_FAILED(rv))) {
@@ -4749,6 +5120,28 @@ nsresult QuotaManager::UpgradeStorageFrom2_1To2_2(
   return NS_OK;
 }
 
+nsresult QuotaManager::UpgradeStorageFrom2_2To2_3(
+    mozIStorageConnection* aConnection) {
+  AssertIsOnIOThread();
+  MOZ_ASSERT(aConnection);
+
+  // The upgrade only adds the tables of the quota cache, origin directories
+  // are left as they are. Older builds ignore the tables, which is fine since
+  // a cached origin is only used if its access time hasn't changed.
+
+  nsresult rv = CreateCacheTables(aConnection);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  rv = aConnection->SetSchemaVersion(MakeStorageVersion(2, 3));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  return NS_OK;
+}
+
 nsresult QuotaManager::MaybeRemoveLocalStorageData() {
   AssertIsOnIOThread();
   MOZ_ASSERT(!CachedNextGenLocalStorageEnabled());
@@ -5474,7 +5867,7 @@ nsresult QuotaManager::EnsureStorageIsInitialized() {
       MOZ_ASSERT(storageVersion == kStorageVersion);
     } else {
       // This logic needs to change next time we change the storage!
-      static_assert(kStorageVersion == int32_t((2 << 16) + 2),
+      static_assert(kStorageVersion == int32_t((2 << 16) + 3),
                     "Upgrade function needed due to storage version increase.");
 
       while (storageVersion != kStorageVersion) {
@@ -5486,6 +5879,8 @@ nsresult QuotaManager::EnsureStorageIsInitialized() {
           rv = UpgradeStorageFrom2_0To2_1(connection);
         } else if (storageVersion == MakeStorageVersion(2, 1)) {
           rv = UpgradeStorageFrom2_1To2_2(connection);
+        } else if (storageVersion == MakeStorageVersion(2, 2)) {
+          rv = UpgradeStorageFrom2_2To2_3(connection);
         } else {
           NS_WARNING(
               "Unable to initialize storage, no upgrade path is "
@@ -5811,7 +6206,14 @@ nsresult QuotaManager::EnsureTemporaryStorageIsInitialized() {
     RETURN_STATUS_OR_RESULT(statusKeeper, NS_ERROR_FAILURE);
   }
 
-  nsresult rv = InitializeRepository(PERSISTENCE_TYPE_DEFAULT);
+  nsCOMPtr<mozIStorageConnection> cacheConnection;
+  nsresult rv = OpenQuotaCache(getter_AddRefs(cacheConnection));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    // Not fatal, all origins just get scanned.
+    cacheConnection = nullptr;
+  }
+
+  rv = InitializeRepository(PERSISTENCE_TYPE_DEFAULT, cacheConnection);
   if (NS_WARN_IF(NS_FAILED(rv))) {
     RECORD_IN_NIGHTLY(statusKeeper, rv);
 
@@ -5827,7 +6229,7 @@ nsresult QuotaManager::EnsureTemporaryStorageIsInitialized() {
     RETURN_STATUS_OR_RESULT(statusKeeper, NS_ERROR_FAILURE);
   }
 
-  rv = InitializeRepository(PERSISTENCE_TYPE_TEMPORARY);
+  rv = InitializeRepository(PERSISTENCE_TYPE_TEMPORARY, cacheConnection);
   if (NS_WARN_IF(NS_FAILED(rv)) || NS_FAILED(statusKeeper)) {
     // We have to cleanup partially initialized quota.
     RemoveQuota();
@@ -6621,6 +7023,7 @@ OriginInfo::OriginInfo(GroupInfo* aGroupInfo, const nsACString& aOrigin,
       mOrigin(aOrigin),
       mUsage(aUsage),
       mAccessTime(aAccessTime),
+      mAccessed(false),
       mPersisted(aPersisted),
       mDirectoryExists(aDirectoryExists) {
   MOZ_ASSERT(aGroupInfo);
@@ -6654,6 +7057,7 @@ void OriginInfo::LockedPersist() {
   MOZ_ASSERT(!mPersisted);
 
   mPersisted = true;
+  mAccessed = true;
 
   // Remove Usage from GroupInfo
   AssertNoUnderflow(mGroupInfo->mUsage, mUsage);
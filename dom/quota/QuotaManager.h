@@ -468,6 +468,8 @@ class QuotaManager final : public BackgroundThreadObject {
 
   nsresult UpgradeStorageFrom2_1To2_2(mozIStorageConnection* aConnection);
 
+  nsresult UpgradeStorageFrom2_2To2_3(mozIStorageConnection* aConnection);
+
   nsresult MaybeRemoveLocalStorageData();
 
   nsresult MaybeRemoveLocalStorageDirectories();
@@ -491,7 +493,12 @@ class QuotaManager final : public BackgroundThreadObject {
   nsresult UpgradeLocalStorageArchiveFrom4To5();
   */
 
-  nsresult InitializeRepository(PersistenceType aPersistenceType);
+  nsresult InitializeRepository(PersistenceType aPersistenceType,
+                                mozIStorageConnection* aCacheConnection);
+
+  nsresult OpenQuotaCache(mozIStorageConnection** aConnection);
+
+  void UnloadQuota();
 
   nsresult InitializeOrigin(PersistenceType aPersistenceType,
                             const nsACString& aGroup, const nsACString& aOrigin,
@@ -0,0 +1,233 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Storage version 2.3 caches the usage of temporary and default origins in
+// storage.sqlite.  A cached origin is only used while the cache is valid and
+// the access time in the origin's metadata file still matches.
+
+"use strict";
+
+const { Services } = ChromeUtils.import("resource://gre/modules/Services.jsm");
+
+const kOriginURL = "http://example.com";
+const kStorageVersion2_2 = (2 << 16) + 2;
+const kStorageVersion2_3 = (2 << 16) + 3;
+const kRepositoryDefault = 2; // PERSISTENCE_TYPE_DEFAULT
+
+// Not what the (empty) origin directory really uses, so it's easy to tell
+// whether the cached usage was used.
+const kCachedUsage = 123456;
+
+function getProfileFile(...aPath) {
+  let file = Services.dirsvc.get("ProfD", Ci.nsIFile);
+  for (let name of aPath) {
+    file.append(name);
+  }
+  return file;
+}
+
+function openStorageDatabase() {
+  return Services.storage.openUnsharedDatabase(
+    getProfileFile("storage.sqlite")
+  );
+}
+
+function getSingleValue(aConnection, aSQL) {
+  let stmt = aConnection.createStatement(aSQL);
+  try {
+    Assert.ok(stmt.executeStep());
+    return stmt.getInt64(0);
+  } finally {
+    stmt.finalize();
+  }
+}
+
+function withStorageDatabase(aCallback) {
+  let connection = openStorageDatabase();
+  try {
+    return aCallback(connection);
+  } finally {
+    connection.close();
+  }
+}
+
+function requestFinished(aRequest) {
+  return new Promise((resolve, reject) => {
+    aRequest.callback = request => {
+      if (request.resultCode == Cr.NS_OK) {
+        resolve(request.result);
+      } else {
+        reject(request.resultCode);
+      }
+    };
+  });
+}
+
+function getPrincipal() {
+  let uri = Services.io.newURI(kOriginURL);
+  return Services.scriptSecurityManager.createCodebasePrincipal(uri, {});
+}
+
+function getGroupUsage() {
+  return new Promise((resolve, reject) => {
+    Services.qms.getUsageForPrincipal(
+      getPrincipal(),
+      request => {
+        if (request.resultCode == Cr.NS_OK) {
+          resolve(request.result.usage);
+        } else {
+          reject(request.resultCode);
+        }
+      },
+      /* aGetGroupUsage */ true
+    );
+  });
+}
+
+// Returns the access time and group stored in the .metadata-v2 file of the
+// test origin.
+function readOriginMetadata() {
+  let file = getProfileFile(
+    "storage",
+    "default",
+    "http+++example.com",
+    ".metadata-v2"
+  );
+  let fileStream = Cc[
+    "@mozilla.org/network/file-input-stream;1"
+  ].createInstance(Ci.nsIFileInputStream);
+  fileStream.init(file, -1, -1, 0);
+
+  let stream = Cc["@mozilla.org/binaryinputstream;1"].createInstance(
+    Ci.nsIBinaryInputStream
+  );
+  stream.setInputStream(fileStream);
+  try {
+    let accessTime = stream.read64();
+    stream.readBoolean(); // persisted
+    stream.read32(); // reserved
+    stream.read32(); // reserved
+    stream.readCString(); // suffix
+    let group = stream.readCString();
+    let origin = stream.readCString();
+    Assert.equal(origin, kOriginURL);
+    return { accessTime, group };
+  } finally {
+    stream.close();
+  }
+}
+
+// Stores a cache for the test origin, the way QuotaManager::UnloadQuota does
+// during a clean shutdown unless aValid is false.
+function writeCache(aAccessTime, aGroup, aValid) {
+  withStorageDatabase(connection => {
+    connection.executeSimpleSQL("DELETE FROM origin;");
+
+    let stmt = connection.createStatement(
+      "INSERT INTO origin (repository_id, origin, group_, usage, " +
+        "last_access_time) " +
+        "VALUES (:repository_id, :origin, :group_, :usage, " +
+        ":last_access_time);"
+    );
+    stmt.params.repository_id = kRepositoryDefault;
+    stmt.params.origin = kOriginURL;
+    stmt.params.group_ = aGroup;
+    stmt.params.usage = kCachedUsage;
+    stmt.params.last_access_time = aAccessTime;
+    stmt.execute();
+    stmt.finalize();
+
+    connection.executeSimpleSQL(
+      "UPDATE cache SET valid = " + (aValid ? 1 : 0) + ";"
+    );
+  });
+}
+
+function isCacheValid() {
+  return withStorageDatabase(
+    connection => getSingleValue(connection, "SELECT valid FROM cache;") != 0
+  );
+}
+
+async function reset() {
+  await requestFinished(Services.qms.reset());
+}
+
+add_task(async function setup() {
+  do_get_profile();
+  Services.prefs.setBoolPref("dom.quotaManager.testing", true);
+  registerCleanupFunction(() => {
+    Services.prefs.clearUserPref("dom.quotaManager.testing");
+  });
+});
+
+add_task(async function test_upgrade_from_2_2() {
+  // A 2.2 storage.sqlite has no tables, it's only used for the version.
+  getProfileFile("storage", "default").create(
+    Ci.nsIFile.DIRECTORY_TYPE,
+    0o755
+  );
+  withStorageDatabase(connection => {
+    connection.schemaVersion = kStorageVersion2_2;
+  });
+
+  await requestFinished(Services.qms.init());
+
+  withStorageDatabase(connection => {
+    Assert.equal(connection.schemaVersion, kStorageVersion2_3);
+    Assert.ok(connection.tableExists("cache"));
+    Assert.ok(connection.tableExists("origin"));
+    Assert.equal(getSingleValue(connection, "SELECT COUNT(*) FROM cache;"), 1);
+    Assert.equal(
+      getSingleValue(connection, "SELECT COUNT(*) FROM origin;"),
+      0
+    );
+  });
+  Assert.ok(!isCacheValid());
+
+  // Create the test origin.
+  await requestFinished(
+    Services.qms.initStoragesForPrincipal(getPrincipal(), "default")
+  );
+  Assert.equal(await getGroupUsage(), 0);
+
+  await reset();
+});
+
+add_task(async function test_cache_used() {
+  let { accessTime, group } = readOriginMetadata();
+  writeCache(accessTime, group, /* aValid */ true);
+
+  Assert.equal(await getGroupUsage(), kCachedUsage);
+
+  await reset();
+});
+
+add_task(async function test_access_time_mismatch() {
+  let { accessTime, group } = readOriginMetadata();
+  writeCache(accessTime + 1, group, /* aValid */ true);
+
+  // The origin is scanned again.
+  Assert.equal(await getGroupUsage(), 0);
+
+  await reset();
+});
+
+add_task(async function test_cache_invalidated_at_init() {
+  let { accessTime, group } = readOriginMetadata();
+  writeCache(accessTime, group, /* aValid */ true);
+
+  Assert.equal(await getGroupUsage(), kCachedUsage);
+
+  // Only a clean shutdown makes the cache valid again.
+  Assert.ok(!isCacheValid());
+
+  // So if the session ends without one, like after a crash, the stale cache
+  // isn't used.
+  await reset();
+  Assert.ok(!isCacheValid());
+  Assert.equal(await getGroupUsage(), 0);
+
+  await reset();
+});
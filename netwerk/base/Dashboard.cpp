@@ -7,6 +7,7 @@
 #include "mozilla/ErrorNames.h"
 #include "mozilla/net/Dashboard.h"
 #include "mozilla/net/HttpInfo.h"
+#include "mozilla/net/NetworkTrace.h"
 #include "nsHttp.h"
 #include "nsICancelable.h"
 #include "nsIDNSService.h"
@@ -791,6 +792,12 @@ void HttpConnInfo::SetHTTP2ProtocolVersion(SpdyVersion pv) {
   protocolVersion.AssignLiteral(u"h2");
 }
 
+NS_IMETHODIMP
+Dashboard::GetNetworkTraces(nsACString& aTraces) {
+  NetworkTrace::DumpJSON(aTraces);
+  return NS_OK;
+}
+
 NS_IMETHODIMP
 Dashboard::GetLogPath(nsACString& aLogPath) {
   aLogPath.SetLength(2048);
@@ -0,0 +1,217 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "NetworkTrace.h"
+
+#include "GeckoProfiler.h"
+#include "mozilla/IntegerPrintfMacros.h"
+#include "mozilla/JSONWriter.h"
+#include "mozilla/Preferences.h"
+#include "mozilla/StaticMutex.h"
+#include "mozilla/StaticPtr.h"
+#include "mozilla/net/TimingStruct.h"
+#include "nsPrintfCString.h"
+#include "nsSocketTransportService2.h"
+#include "nsThreadUtils.h"
+#include "../cache2/CacheFileIOManager.h"
+
+namespace mozilla {
+namespace net {
+
+static bool const kDefaultEnabled = true;
+Atomic<bool, Relaxed> NetworkTrace::sEnabled(kDefaultEnabled);
+
+namespace {
+
+// About 128KB, allocated when the first phase is recorded.
+static const uint32_t kTraceCapacity = 4096;
+
+enum class TraceThread : uint8_t { Main, Socket, Cache, Other };
+
+struct TraceEntry {
+  TimeStamp mStart;
+  TimeStamp mEnd;
+  uint64_t mChannelId;
+  NetworkTracePhase mPhase;
+  TraceThread mThread;
+};
+
+struct TraceRing {
+  TraceEntry mEntries[kTraceCapacity];
+  uint32_t mNext = 0;
+  bool mWrapped = false;
+};
+
+StaticMutex sTraceLock;
+StaticAutoPtr<TraceRing> sTraceRing;
+bool sTraceShutdown = false;
+
+TraceThread CurrentThread() {
+  if (NS_IsMainThread()) {
+    return TraceThread::Main;
+  }
+  if (OnSocketThread()) {
+    return TraceThread::Socket;
+  }
+  if (CacheFileIOManager::IsOnIOThread()) {
+    return TraceThread::Cache;
+  }
+  return TraceThread::Other;
+}
+
+const char* ThreadName(TraceThread aThread) {
+  switch (aThread) {
+    case TraceThread::Main:
+      return "main";
+    case TraceThread::Socket:
+      return "socket";
+    case TraceThread::Cache:
+      return "cache";
+    case TraceThread::Other:
+      break;
+  }
+  return "other";
+}
+
+struct TraceWriteFunc : public JSONWriteFunc {
+  nsACString& mBuffer;
+  explicit TraceWriteFunc(nsACString& aBuffer) : mBuffer(aBuffer) {}
+
+  void Write(const char* aStr) override { mBuffer.Append(aStr); }
+};
+
+}  // namespace
+
+// static
+void NetworkTrace::Init() {
+  Preferences::AddAtomicBoolVarCache(&sEnabled, "network.trace.enabled",
+                                     kDefaultEnabled);
+}
+
+// static
+void NetworkTrace::Shutdown() {
+  StaticMutexAutoLock lock(sTraceLock);
+  sTraceRing = nullptr;
+  sTraceShutdown = true;
+}
+
+// static
+const char* NetworkTrace::PhaseName(NetworkTracePhase aPhase) {
+  switch (aPhase) {
+    case NetworkTracePhase::Queue:
+      return "queue";
+    case NetworkTracePhase::DNS:
+      return "dns";
+    case NetworkTracePhase::Connect:
+      return "connect";
+    case NetworkTracePhase::TLS:
+      return "tls";
+    case NetworkTracePhase::Wait:
+      return "wait";
+    case NetworkTracePhase::Receive:
+      return "receive";
+    case NetworkTracePhase::CacheOpen:
+      return "cache-open";
+    case NetworkTracePhase::CacheRead:
+      return "cache-read";
+    case NetworkTracePhase::IPC:
+      return "ipc";
+    case NetworkTracePhase::Count:
+      break;
+  }
+  MOZ_ASSERT_UNREACHABLE("Unknown phase");
+  return "unknown";
+}
+
+// static
+void NetworkTrace::Record(uint64_t aChannelId, NetworkTracePhase aPhase,
+                          const TimeStamp& aStart, const TimeStamp& aEnd) {
+  if (!sEnabled || aStart.IsNull() || aEnd.IsNull() || aEnd < aStart) {
+    return;
+  }
+
+  TraceThread thread = CurrentThread();
+
+  {
+    StaticMutexAutoLock lock(sTraceLock);
+    if (sTraceShutdown) {
+      return;
+    }
+    if (!sTraceRing) {
+      sTraceRing = new TraceRing();
+    }
+
+    TraceEntry& entry = sTraceRing->mEntries[sTraceRing->mNext];
+    entry.mStart = aStart;
+    entry.mEnd = aEnd;
+    entry.mChannelId = aChannelId;
+    entry.mPhase = aPhase;
+    entry.mThread = thread;
+
+    if (++sTraceRing->mNext == kTraceCapacity) {
+      sTraceRing->mNext = 0;
+      sTraceRing->mWrapped = true;
+    }
+  }
+
+#ifdef MOZ_GECKO_PROFILER
+  if (profiler_is_active()) {
+    nsPrintfCString text("%s %" PRIu64 " (%s)", PhaseName(aPhase), aChannelId,
+                         ThreadName(thread));
+    profiler_add_text_marker("NetworkTrace", text,
+                             JS::ProfilingCategoryPair::NETWORK, aStart, aEnd);
+  }
+#endif
+}
+
+// static
+void NetworkTrace::RecordTimings(uint64_t aChannelId,
+                                 const TimingStruct& aTimings) {
+  if (!sEnabled) {
+    return;
+  }
+
+  Record(aChannelId, NetworkTracePhase::DNS, aTimings.domainLookupStart,
+         aTimings.domainLookupEnd);
+  Record(aChannelId, NetworkTracePhase::Connect, aTimings.connectStart,
+         aTimings.tcpConnectEnd);
+  Record(aChannelId, NetworkTracePhase::TLS, aTimings.secureConnectionStart,
+         aTimings.connectEnd);
+  Record(aChannelId, NetworkTracePhase::Wait, aTimings.requestStart,
+         aTimings.responseStart);
+  Record(aChannelId, NetworkTracePhase::Receive, aTimings.responseStart,
+         aTimings.responseEnd);
+}
+
+// static
+void NetworkTrace::DumpJSON(nsACString& aJSON) {
+  aJSON.Truncate();
+
+  JSONWriter w(MakeUnique<TraceWriteFunc>(aJSON));
+  w.StartArrayElement(JSONWriter::SingleLineStyle);
+
+  StaticMutexAutoLock lock(sTraceLock);
+  if (TraceRing* ring = sTraceRing) {
+    TimeStamp processStart = TimeStamp::ProcessCreation();
+    uint32_t start = ring->mWrapped ? ring->mNext : 0;
+    uint32_t count = ring->mWrapped ? kTraceCapacity : ring->mNext;
+    for (uint32_t i = 0; i < count; ++i) {
+      const TraceEntry& entry = ring->mEntries[(start + i) % kTraceCapacity];
+      w.StartObjectElement(JSONWriter::SingleLineStyle);
+      w.IntProperty("channelId", static_cast<int64_t>(entry.mChannelId));
+      w.StringProperty("phase", PhaseName(entry.mPhase));
+      w.StringProperty("thread", ThreadName(entry.mThread));
+      w.DoubleProperty("start",
+                       (entry.mStart - processStart).ToMilliseconds());
+      w.DoubleProperty("duration",
+                       (entry.mEnd - entry.mStart).ToMilliseconds());
+      w.EndObject();
+    }
+  }
+
+  w.EndArray();
+}
+
+}  // namespace net
+}  // namespace mozilla
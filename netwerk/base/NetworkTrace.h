@@ -0,0 +1,64 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef mozilla_net_NetworkTrace_h
+#define mozilla_net_NetworkTrace_h
+
+#include "mozilla/Atomics.h"
+#include "mozilla/TimeStamp.h"
+#include "nsString.h"
+
+namespace mozilla {
+namespace net {
+
+struct TimingStruct;
+
+enum class NetworkTracePhase : uint8_t {
+  Queue,      // waiting in the connection manager for a connection
+  DNS,        // host name resolution
+  Connect,    // TCP connect
+  TLS,        // TLS handshake
+  Wait,       // request sent, waiting for the first response byte
+  Receive,    // reading the response
+  CacheOpen,  // opening the cache entry, up to the entry check
+  CacheRead,  // reading the response from the cache
+  IPC,        // from the parent's OnStopRequest to the child's
+  Count
+};
+
+// An always-on record of the last few thousand request phases, kept in a
+// fixed-size ring buffer so recording never allocates after the first call.
+// Phases can be recorded from any thread; each entry remembers whether it
+// came from the main, socket or cache I/O thread. When the profiler is
+// running every phase is also added as a text marker.
+class NetworkTrace final {
+ public:
+  static void Init();
+  static void Shutdown();
+
+  static bool IsEnabled() { return sEnabled; }
+
+  // Records that the channel |aChannelId| spent [aStart, aEnd] in |aPhase|.
+  // Does nothing when either time stamp is null.
+  static void Record(uint64_t aChannelId, NetworkTracePhase aPhase,
+                     const TimeStamp& aStart, const TimeStamp& aEnd);
+
+  // Records the connection and transaction phases in |aTimings|.
+  static void RecordTimings(uint64_t aChannelId, const TimingStruct& aTimings);
+
+  // Writes the recorded phases, oldest first, as a JSON array of
+  // {channelId, phase, thread, start, duration} objects. Times are in
+  // milliseconds, |start| relative to process creation.
+  static void DumpJSON(nsACString& aJSON);
+
+  static const char* PhaseName(NetworkTracePhase aPhase);
+
+ private:
+  static Atomic<bool, Relaxed> sEnabled;
+};
+
+}  // namespace net
+}  // namespace mozilla
+
+#endif  // mozilla_net_NetworkTrace_h
@@ -6,6 +6,7 @@
 #include <algorithm>
 
 #include "Predictor.h"
+#include "PredictorStore.h"
 
 #include "nsAppDirectoryServiceDefs.h"
 #include "nsICacheStorage.h"
@@ -51,6 +52,7 @@
 
 #include "mozilla/dom/ContentParent.h"
 #include "mozilla/ClearOnShutdown.h"
+#include "mozilla/OriginAttributes.h"
 
 #include "CacheControlParser.h"
 #include "ReferrerInfo.h"
@@ -102,6 +104,21 @@ static const int32_t kMaxPrefetchRollingLoadCount = 20;
 static const uint32_t kFlagsMask = ((1 << kRollingLoadOffset) - 1);
 
 static bool sEsniEnabled = false;
+static bool sOriginStoreEnabled = true;
+
+static const char PREDICTOR_STORE_FILE[] = "predictor-origins.bin";
+
+// The origin store keeps what was learned under different origin attributes
+// apart, like the cache entries do, by keying on the origin with the suffix
+// of its attributes.
+static void GetStoreKey(nsIURI* aOrigin,
+                        const OriginAttributes& aOriginAttributes,
+                        nsACString& aKey) {
+  aOrigin->GetAsciiSpec(aKey);
+  nsAutoCString suffix;
+  aOriginAttributes.CreateSuffix(suffix);
+  aKey.Append(suffix);
+}
 
 // ID Extensions for cache entries
 #define PREDICTOR_ORIGIN_EXTENSION "predictor-origin"
@@ -289,6 +306,12 @@ nsresult Predictor::InstallObserver() {
   rv = obs->AddObserver(this, NS_XPCOM_SHUTDOWN_OBSERVER_ID, false);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  rv = obs->AddObserver(this, "cacheservice:empty-cache", false);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = obs->AddObserver(this, "clear-origin-attributes-data", false);
+  NS_ENSURE_SUCCESS(rv, rv);
+
   mCleanedUp = Preferences::GetBool(PREDICTOR_CLEANED_UP_PREF, false);
 
   if (!mCleanedUp) {
@@ -305,6 +328,8 @@ void Predictor::RemoveObserver() {
   nsCOMPtr<nsIObserverService> obs = mozilla::services::GetObserverService();
   if (obs) {
     obs->RemoveObserver(this, NS_XPCOM_SHUTDOWN_OBSERVER_ID);
+    obs->RemoveObserver(this, "cacheservice:empty-cache");
+    obs->RemoveObserver(this, "clear-origin-attributes-data");
   }
 
   if (mCleanupTimer) {
@@ -325,6 +350,29 @@ Predictor::Observe(nsISupports* subject, const char* topic,
   } else if (!strcmp("timer-callback", topic)) {
     MaybeCleanupOldDBFiles();
     mCleanupTimer = nullptr;
+  } else if (!strcmp("cacheservice:empty-cache", topic)) {
+    // The origin-only entries went away with the cache, and what took their
+    // place goes with them.
+    if (mStore) {
+      mStore->Clear();
+    }
+  } else if (!strcmp("clear-origin-attributes-data", topic)) {
+    OriginAttributesPattern pattern;
+    if (!pattern.Init(nsDependentString(data_unicode))) {
+      NS_ERROR("Cannot parse origin attributes pattern");
+      return NS_ERROR_FAILURE;
+    }
+
+    // The cache entries of these attributes go away with this notification,
+    // so do the store's origins learned under them.
+    if (mStore) {
+      mStore->RemoveOrigins([&pattern](const nsACString& aKey) {
+        OriginAttributes attrs;
+        nsAutoCString origin;
+        return attrs.PopulateFromOrigin(aKey, origin) &&
+               pattern.Matches(attrs);
+      });
+    }
   }
 
   return rv;
@@ -434,9 +482,13 @@ nsresult Predictor::Init() {
   NS_ENSURE_SUCCESS(rv, rv);
 
   Preferences::AddBoolVarCache(&sEsniEnabled, "network.security.esni.enabled");
+  Preferences::AddBoolVarCache(&sOriginStoreEnabled,
+                               "network.predictor.origin-store.enabled", true);
 
   mInitialized = true;
 
+  OpenStore();
+
   return rv;
 }
 
@@ -585,6 +637,62 @@ void Predictor::MaybeCleanupOldDBFiles() {
   ioThread->Dispatch(runner, NS_DISPATCH_NORMAL);
 }
 
+void Predictor::OpenStore() {
+  MOZ_ASSERT(NS_IsMainThread());
+
+  if (!sOriginStoreEnabled) {
+    return;
+  }
+
+  nsCOMPtr<nsIFile> storeFile;
+  nsresult rv = NS_GetSpecialDirectory(NS_APP_USER_PROFILE_50_DIR,
+                                       getter_AddRefs(storeFile));
+  RETURN_IF_FAILED(rv);
+  rv = storeFile->AppendNative(nsDependentCString(PREDICTOR_STORE_FILE));
+  RETURN_IF_FAILED(rv);
+
+  nsCOMPtr<nsIThread> ioThread;
+  rv = NS_NewNamedThread("NetPredictStore", getter_AddRefs(ioThread));
+  RETURN_IF_FAILED(rv);
+
+  RefPtr<Predictor> self = this;
+  ioThread->Dispatch(
+      NS_NewRunnableFunction(
+          "net::Predictor::OpenStore",
+          [self, ioThread, storeFile]() {
+            RefPtr<PredictorStore> store;
+            nsresult openRv =
+                PredictorStore::Open(storeFile, getter_AddRefs(store));
+            if (NS_FAILED(openRv)) {
+              PREDICTOR_LOG(("Predictor::OpenStore failed rv=0x%" PRIx32,
+                             static_cast<uint32_t>(openRv)));
+            }
+            NS_DispatchToMainThread(NS_NewRunnableFunction(
+                "net::Predictor::OnStoreOpened", [self, ioThread, store]() {
+                  self->OnStoreOpened(store);
+                  ioThread->AsyncShutdown();
+                }));
+          }),
+      NS_DISPATCH_NORMAL);
+}
+
+void Predictor::OnStoreOpened(PredictorStore* aStore) {
+  MOZ_ASSERT(NS_IsMainThread());
+
+  if (!aStore) {
+    return;
+  }
+
+  if (!mInitialized) {
+    // Shut down while the store was being opened.
+    aStore->Close();
+    return;
+  }
+
+  PREDICTOR_LOG(("Predictor::OnStoreOpened"));
+  mStore = aStore;
+}
+
 void Predictor::Shutdown() {
   if (!NS_IsMainThread()) {
     MOZ_ASSERT(false, "Predictor::Shutdown called off the main thread!");
@@ -593,6 +701,11 @@ void Predictor::Shutdown() {
 
   RemoveObserver();
 
+  if (mStore) {
+    mStore->Close();
+    mStore = nullptr;
+  }
+
   mInitialized = false;
 }
 
@@ -768,6 +881,16 @@ Predictor::PredictNative(nsIURI* targetURI, nsIURI* sourceURI,
     originKey = targetOrigin;
   }
 
+  if (reason == nsINetworkPredictor::PREDICT_LOAD && mStore &&
+      sOriginStoreEnabled) {
+    // The origin store answers right away, without a cache entry to open.
+    nsAutoCString storeKey;
+    GetStoreKey(targetOrigin, originAttributes, storeKey);
+    PredictFromStore(storeKey, originAttributes, verifier);
+    PREDICTOR_LOG(("    predict returning"));
+    return NS_OK;
+  }
+
   RefPtr<Predictor::Action> originAction = new Predictor::Action(
       Predictor::Action::IS_ORIGIN, Predictor::Action::DO_PREDICT, argReason,
       targetOrigin, nullptr, verifier, this);
@@ -785,6 +908,33 @@ Predictor::PredictNative(nsIURI* targetURI, nsIURI* sourceURI,
   return NS_OK;
 }
 
+void Predictor::PredictFromStore(const nsACString& storeKey,
+                                 const OriginAttributes& originAttributes,
+                                 nsINetworkPredictorVerifier* verifier) {
+  MOZ_ASSERT(NS_IsMainThread());
+
+  PREDICTOR_LOG(("Predictor::PredictFromStore key=%s",
+                 PromiseFlatCString(storeKey).get()));
+
+  uint32_t loadCount, lastLoad;
+  nsTArray<PredictorStore::Resource> resources;
+  if (!mStore->GetResources(storeKey, &loadCount, &lastLoad, resources)) {
+    PREDICTOR_LOG(("    origin not seen before"));
+    return;
+  }
+
+  int32_t globalDegradation = CalculateGlobalDegradation(lastLoad);
+  for (const PredictorStore::Resource& resource : resources) {
+    int32_t confidence =
+        CalculateConfidence(resource.mHitCount, loadCount, resource.mLastHit,
+                            lastLoad, globalDegradation);
+    // Origins are never prefetched, only connected to or resolved.
+    SetupPrediction(confidence, 0, resource.mOrigin, PREFETCH_OK);
+  }
+
+  RunPredictions(nullptr, originAttributes, verifier);
+}
+
 bool Predictor::PredictInternal(PredictorPredictReason reason,
                                 nsICacheEntry* entry, bool isNew, bool fullUri,
                                 nsIURI* targetURI,
@@ -1543,6 +1693,26 @@ Predictor::LearnNative(nsIURI* targetURI, nsIURI* sourceURI,
   cacheDiskStorage->AsyncOpenURI(uriKey, EmptyCString(), uriOpenFlags,
                                  uriAction);
 
+  if (mStore && sOriginStoreEnabled &&
+      (reason == nsINetworkPredictor::LEARN_LOAD_TOPLEVEL ||
+       reason == nsINetworkPredictor::LEARN_LOAD_SUBRESOURCE)) {
+    // The origin store takes the place of the origin-only entry.
+    // Subresource origins are stored as they are, they are what gets
+    // connected to.
+    nsAutoCString targetOriginStr;
+    if (reason == nsINetworkPredictor::LEARN_LOAD_TOPLEVEL) {
+      GetStoreKey(targetOrigin, originAttributes, targetOriginStr);
+      mStore->NoteLoad(targetOriginStr, NOW_IN_SECONDS());
+    } else {
+      targetOrigin->GetAsciiSpec(targetOriginStr);
+      nsAutoCString sourceKey;
+      GetStoreKey(sourceOrigin, originAttributes, sourceKey);
+      mStore->NoteSubresource(sourceKey, targetOriginStr, NOW_IN_SECONDS());
+    }
+    PREDICTOR_LOG(("Predictor::Learn returning"));
+    return NS_OK;
+  }
+
   // Now we open the origin-only (and therefore predictor-only) entry
   RefPtr<Predictor::Action> originAction = new Predictor::Action(
       Predictor::Action::IS_ORIGIN, Predictor::Action::DO_LEARN, argReason,
@@ -1919,6 +2089,10 @@ Predictor::Reset() {
     return NS_OK;
   }
 
+  if (mStore) {
+    mStore->Clear();
+  }
+
   RefPtr<Predictor::Resetter> reset = new Predictor::Resetter(this);
   PREDICTOR_LOG(("    created a resetter"));
   mCacheStorageService->AsyncVisitAllStorages(reset, true);
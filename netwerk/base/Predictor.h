@@ -36,6 +36,7 @@ namespace net {
 
 class nsHttpRequestHead;
 class nsHttpResponseHead;
+class PredictorStore;
 
 class Predictor final : public nsINetworkPredictor,
                         public nsIObserver,
@@ -222,6 +223,14 @@ class Predictor final : public nsINetworkPredictor,
 
   // Service startup utilities
   void MaybeCleanupOldDBFiles();
+  void OpenStore();
+  void OnStoreOpened(PredictorStore* aStore);
+
+  // Predicts a page load from the origin store, |storeKey| being the
+  // origin with the suffix of its origin attributes.
+  void PredictFromStore(const nsACString& storeKey,
+                        const OriginAttributes& originAttributes,
+                        nsINetworkPredictorVerifier* verifier);
 
   // The guts of prediction
 
@@ -449,6 +458,10 @@ class Predictor final : public nsINetworkPredictor,
 
   RefPtr<DNSListener> mDNSListener;
 
+  // Which origins the pages of each origin load from, used for page loads
+  // instead of the origin-only cache entries once it has been opened.
+  RefPtr<PredictorStore> mStore;
+
   nsTArray<nsCOMPtr<nsIURI>> mPrefetches;
   nsTArray<nsCOMPtr<nsIURI>> mPreconnects;
   nsTArray<nsCOMPtr<nsIURI>> mPreresolves;
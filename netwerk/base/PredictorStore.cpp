@@ -0,0 +1,357 @@
+/* vim: set ts=2 sts=2 et sw=2: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "PredictorStore.h"
+
+#include <string.h>
+
+#include "mozilla/HashFunctions.h"
+#include "mozilla/Logging.h"
+#include "nsIFile.h"
+
+namespace mozilla {
+namespace net {
+
+static LazyLogModule gPredictorStoreLog("NetworkPredictorStore");
+#define PREDICTOR_STORE_LOG(args) \
+  MOZ_LOG(gPredictorStoreLog, mozilla::LogLevel::Debug, args)
+
+// "PDS1"
+static const uint32_t kMagic = 0x50445331;
+static const uint32_t kVersion = 1;
+
+// The file holds a fixed number of origin slots, each with room for a fixed
+// number of resources, so that it never has to be resized or compacted: about
+// half a megabyte in all.
+static const uint32_t kOriginSlots = 256;
+static const uint32_t kResourcesPerOrigin = 15;
+
+// Origins are found by hash, probing this many slots from the home one.  When
+// they are all taken, the least recently loaded origin among them goes.
+static const uint32_t kProbeLimit = 8;
+
+// Longer origins, with their terminating null, are not recorded.
+static const uint32_t kMaxOriginLength = 108;
+
+struct PredictorStore::FileHeader {
+  uint32_t mMagic;
+  uint32_t mVersion;
+  uint32_t mOriginSlots;
+  uint32_t mResourcesPerOrigin;
+};
+
+struct PredictorStore::ResourceRecord {
+  // 0 if the record is unused.
+  uint32_t mHash;
+  uint32_t mHitCount;
+  uint32_t mLastHit;
+  // The load of the source origin that last counted as a hit, so that a page
+  // using an origin many times counts once.
+  uint32_t mHitLoad;
+  char mOrigin[kMaxOriginLength];
+  uint32_t mReserved;
+};
+
+struct PredictorStore::OriginRecord {
+  // 0 if the slot is empty.
+  uint32_t mHash;
+  uint32_t mLoadCount;
+  uint32_t mLastLoad;
+  uint32_t mPreviousLoad;
+  uint32_t mResourceCount;
+  char mOrigin[kMaxOriginLength];
+  ResourceRecord mResources[kResourcesPerOrigin];
+};
+
+static uint32_t HashOrigin(const nsACString& aOrigin) {
+  uint32_t hash = HashString(aOrigin.BeginReading(), aOrigin.Length());
+  // 0 marks unused records.
+  return hash ? hash : 1;
+}
+
+// The origin stored in a record.  The file may have been written by
+// something else, so a name that fills the whole field, without its
+// terminating null, is not trusted; it comes back empty, which matches no
+// origin.
+static nsDependentCSubstring StoredOrigin(
+    const char (&aStored)[kMaxOriginLength]) {
+  size_t length = strnlen(aStored, kMaxOriginLength);
+  if (length == kMaxOriginLength) {
+    length = 0;
+  }
+  return nsDependentCSubstring(aStored, length);
+}
+
+static bool OriginMatches(const char (&aStored)[kMaxOriginLength],
+                          uint32_t aStoredHash, const nsACString& aOrigin,
+                          uint32_t aHash) {
+  return aStoredHash == aHash && aOrigin.Equals(StoredOrigin(aStored));
+}
+
+// static
+nsresult PredictorStore::Open(nsIFile* aFile, PredictorStore** aStore) {
+  static_assert(sizeof(ResourceRecord) == 128, "Unexpected record size");
+  static_assert(sizeof(OriginRecord) == 2048, "Unexpected record size");
+
+  const uint32_t size =
+      sizeof(FileHeader) + kOriginSlots * sizeof(OriginRecord);
+
+  // A file of another size was written by another version of the store.
+  bool exists = false;
+  int64_t fileSize = 0;
+  nsresult rv = aFile->Exists(&exists);
+  if (NS_SUCCEEDED(rv) && exists) {
+    rv = aFile->GetFileSize(&fileSize);
+    if (NS_FAILED(rv) || fileSize != size) {
+      PREDICTOR_STORE_LOG(("PredictorStore::Open removing a file of %" PRId64
+                           " bytes",
+                           fileSize));
+      rv = aFile->Remove(false);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+  }
+
+  PRFileDesc* fd;
+  rv = aFile->OpenNSPRFileDesc(PR_RDWR | PR_CREATE_FILE, 0600, &fd);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Mapping a new file extends it to the size of the map.
+  PRFileMap* map = PR_CreateFileMap(fd, size, PR_PROT_READWRITE);
+  if (!map) {
+    PR_Close(fd);
+    return NS_ERROR_FAILURE;
+  }
+
+  void* data = PR_MemMap(map, 0, size);
+  if (!data) {
+    PR_CloseFileMap(map);
+    PR_Close(fd);
+    return NS_ERROR_FAILURE;
+  }
+
+  RefPtr<PredictorStore> store = new PredictorStore(fd, map, data);
+  FileHeader* header = store->mHeader;
+  if (header->mMagic != kMagic || header->mVersion != kVersion ||
+      header->mOriginSlots != kOriginSlots ||
+      header->mResourcesPerOrigin != kResourcesPerOrigin) {
+    PREDICTOR_STORE_LOG(("PredictorStore::Open starting a new store"));
+    store->Clear();
+  }
+
+  store.forget(aStore);
+  return NS_OK;
+}
+
+PredictorStore::PredictorStore(PRFileDesc* aFD, PRFileMap* aMap, void* aData)
+    : mFD(aFD),
+      mMap(aMap),
+      mHeader(static_cast<FileHeader*>(aData)),
+      mOrigins(reinterpret_cast<OriginRecord*>(mHeader + 1)) {}
+
+PredictorStore::~PredictorStore() { Close(); }
+
+void PredictorStore::Close() {
+  if (!mHeader) {
+    return;
+  }
+
+  PR_MemUnmap(mHeader,
+              sizeof(FileHeader) + kOriginSlots * sizeof(OriginRecord));
+  PR_CloseFileMap(mMap);
+  PR_Close(mFD);
+  mHeader = nullptr;
+  mOrigins = nullptr;
+  mMap = nullptr;
+  mFD = nullptr;
+}
+
+void PredictorStore::InitHeader() {
+  mHeader->mMagic = kMagic;
+  mHeader->mVersion = kVersion;
+  mHeader->mOriginSlots = kOriginSlots;
+  mHeader->mResourcesPerOrigin = kResourcesPerOrigin;
+}
+
+void PredictorStore::Clear() {
+  if (!mHeader) {
+    return;
+  }
+
+  memset(mOrigins, 0, kOriginSlots * sizeof(OriginRecord));
+  InitHeader();
+}
+
+void PredictorStore::RemoveOrigins(
+    const std::function<bool(const nsACString&)>& aMatches) {
+  if (!mHeader) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < kOriginSlots; ++i) {
+    OriginRecord* record = &mOrigins[i];
+    if (record->mHash && aMatches(StoredOrigin(record->mOrigin))) {
+      PREDICTOR_STORE_LOG(("PredictorStore::RemoveOrigins removing slot %u",
+                           i));
+      memset(record, 0, sizeof(OriginRecord));
+    }
+  }
+}
+
+PredictorStore::OriginRecord* PredictorStore::Lookup(const nsACString& aOrigin,
+                                                     bool aCreate) {
+  if (!mHeader || aOrigin.IsEmpty() ||
+      aOrigin.Length() >= kMaxOriginLength) {
+    return nullptr;
+  }
+
+  uint32_t hash = HashOrigin(aOrigin);
+  OriginRecord* empty = nullptr;
+  OriginRecord* victim = nullptr;
+  for (uint32_t i = 0; i < kProbeLimit; ++i) {
+    OriginRecord* record = &mOrigins[(hash + i) % kOriginSlots];
+    if (!record->mHash) {
+      // RemoveOrigins() empties slots in the middle of a probe sequence, so
+      // the origin may still be further along.
+      if (!empty) {
+        empty = record;
+      }
+      continue;
+    }
+    if (OriginMatches(record->mOrigin, record->mHash, aOrigin, hash)) {
+      if (record->mResourceCount <= kResourcesPerOrigin) {
+        return record;
+      }
+      // A damaged or foreign file: nothing recorded for the origin can be
+      // trusted, so it starts over in the same slot.
+      PREDICTOR_STORE_LOG(("PredictorStore::Lookup resetting slot with %u "
+                           "resources",
+                           record->mResourceCount));
+      memset(record, 0, sizeof(OriginRecord));
+      empty = record;
+      break;
+    }
+    if (!victim || record->mLastLoad < victim->mLastLoad) {
+      victim = record;
+    }
+  }
+  if (empty) {
+    victim = empty;
+  }
+
+  if (!aCreate) {
+    return nullptr;
+  }
+
+  PREDICTOR_STORE_LOG(("PredictorStore::Lookup adding %s",
+                       PromiseFlatCString(aOrigin).get()));
+  memset(victim, 0, sizeof(OriginRecord));
+  victim->mHash = hash;
+  memcpy(victim->mOrigin, aOrigin.BeginReading(), aOrigin.Length());
+  return victim;
+}
+
+void PredictorStore::NoteLoad(const nsACString& aOrigin, uint32_t aNow) {
+  OriginRecord* record = Lookup(aOrigin, true);
+  if (!record) {
+    return;
+  }
+
+  record->mPreviousLoad = record->mLastLoad;
+  record->mLastLoad = aNow;
+  ++record->mLoadCount;
+}
+
+void PredictorStore::NoteSubresource(const nsACString& aSourceOrigin,
+                                     const nsACString& aTargetOrigin,
+                                     uint32_t aNow) {
+  if (aTargetOrigin.IsEmpty() || aTargetOrigin.Length() >= kMaxOriginLength) {
+    return;
+  }
+
+  OriginRecord* record = Lookup(aSourceOrigin, true);
+  if (!record) {
+    return;
+  }
+  if (!record->mLoadCount) {
+    // The load itself was not seen, e.g. because the store was cleared
+    // while the page was loading.
+    record->mLoadCount = 1;
+    record->mLastLoad = aNow;
+  }
+
+  uint32_t hash = HashOrigin(aTargetOrigin);
+  ResourceRecord* resource = nullptr;
+  for (uint32_t i = 0; i < record->mResourceCount; ++i) {
+    ResourceRecord* candidate = &record->mResources[i];
+    if (OriginMatches(candidate->mOrigin, candidate->mHash, aTargetOrigin,
+                      hash)) {
+      resource = candidate;
+      break;
+    }
+  }
+
+  if (!resource) {
+    if (record->mResourceCount < kResourcesPerOrigin) {
+      resource = &record->mResources[record->mResourceCount++];
+    } else {
+      // Replace the resource that has gone unused for longest.
+      resource = &record->mResources[0];
+      for (uint32_t i = 1; i < kResourcesPerOrigin; ++i) {
+        if (record->mResources[i].mLastHit < resource->mLastHit) {
+          resource = &record->mResources[i];
+        }
+      }
+    }
+    memset(resource, 0, sizeof(ResourceRecord));
+    resource->mHash = hash;
+    memcpy(resource->mOrigin, aTargetOrigin.BeginReading(),
+           aTargetOrigin.Length());
+  }
+
+  if (resource->mHitLoad != record->mLoadCount) {
+    ++resource->mHitCount;
+    resource->mHitLoad = record->mLoadCount;
+  }
+  resource->mLastHit = aNow;
+}
+
+bool PredictorStore::GetResources(const nsACString& aOrigin,
+                                  uint32_t* aLoadCount, uint32_t* aLastLoad,
+                                  nsTArray<Resource>& aResources) {
+  OriginRecord* record = Lookup(aOrigin, false);
+  if (!record || record->mLoadCount < 2) {
+    return false;
+  }
+
+  *aLoadCount = record->mLoadCount - 1;
+  *aLastLoad = record->mPreviousLoad;
+
+  for (uint32_t i = 0; i < record->mResourceCount; ++i) {
+    const ResourceRecord& stored = record->mResources[i];
+    // Leave out what the most recent load used.
+    uint32_t hits = stored.mHitCount;
+    if (stored.mHitLoad == record->mLoadCount) {
+      --hits;
+    }
+    if (!hits) {
+      continue;
+    }
+
+    nsDependentCSubstring origin = StoredOrigin(stored.mOrigin);
+    if (origin.IsEmpty()) {
+      continue;
+    }
+
+    Resource* resource = aResources.AppendElement();
+    resource->mOrigin.Assign(origin);
+    resource->mHitCount = hits;
+    resource->mLastHit = stored.mLastHit;
+  }
+
+  return true;
+}
+
+}  // namespace net
+}  // namespace mozilla
@@ -0,0 +1,88 @@
+/* vim: set ts=2 sts=2 et sw=2: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef mozilla_net_PredictorStore_h
+#define mozilla_net_PredictorStore_h
+
+#include <functional>
+
+#include "nsISupportsImpl.h"
+#include "nsString.h"
+#include "nsTArray.h"
+#include "prio.h"
+
+class nsIFile;
+
+namespace mozilla {
+namespace net {
+
+// The predictor's origin graph: for each top-level origin, how often it was
+// loaded and which other origins its pages loaded subresources from.  It
+// lives in a small fixed-size file that is mapped into memory, so that a
+// navigation can be predicted from it synchronously, without opening cache
+// entries.
+//
+// Opening does file I/O and must happen off the main thread.  Everything
+// else is meant for the predictor, on the main thread.
+class PredictorStore final {
+ public:
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(PredictorStore)
+
+  // Opens the store in |aFile|, creating it, or starting over if it is not
+  // a store of the current version.
+  static nsresult Open(nsIFile* aFile, PredictorStore** aStore);
+
+  struct Resource {
+    nsCString mOrigin;
+    // Number of earlier loads that used this origin, and when it was last
+    // used, in seconds since the epoch.
+    uint32_t mHitCount;
+    uint32_t mLastHit;
+  };
+
+  // Records a top-level load of |aOrigin| at |aNow|.
+  void NoteLoad(const nsACString& aOrigin, uint32_t aNow);
+
+  // Records that the page of |aSourceOrigin| being loaded used a resource from
+  // |aTargetOrigin|.
+  void NoteSubresource(const nsACString& aSourceOrigin,
+                       const nsACString& aTargetOrigin, uint32_t aNow);
+
+  // Gets what the loads of |aOrigin| before the most recent one used: their
+  // number, when the last of them happened, and the origins they loaded
+  // resources from.  Returns false if there were no such loads.
+  bool GetResources(const nsACString& aOrigin, uint32_t* aLoadCount,
+                    uint32_t* aLastLoad, nsTArray<Resource>& aResources);
+
+  // Forgets the origins, and what their loads used, that |aMatches| returns
+  // true for.
+  void RemoveOrigins(const std::function<bool(const nsACString&)>& aMatches);
+
+  // Forgets everything.
+  void Clear();
+
+  void Close();
+
+ private:
+  struct FileHeader;
+  struct ResourceRecord;
+  struct OriginRecord;
+
+  PredictorStore(PRFileDesc* aFD, PRFileMap* aMap, void* aData);
+  ~PredictorStore();
+
+  void InitHeader();
+  OriginRecord* Lookup(const nsACString& aOrigin, bool aCreate);
+
+  PRFileDesc* mFD;
+  PRFileMap* mMap;
+  FileHeader* mHeader;
+  OriginRecord* mOrigins;
+};
+
+}  // namespace net
+}  // namespace mozilla
+
+#endif  // mozilla_net_PredictorStore_h
@@ -3,8 +3,21 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "SSLTokensCache.h"
+#include "mozilla/EndianUtils.h"
 #include "mozilla/Preferences.h"
 #include "mozilla/Logging.h"
+#include "nsAppDirectoryServiceDefs.h"
+#include "nsDirectoryServiceUtils.h"
+#include "nsIEventTarget.h"
+#include "nsISafeOutputStream.h"
+#include "nsNetCID.h"
+#include "nsNetUtil.h"
+#include "nsServiceManagerUtils.h"
+#include "nsThreadUtils.h"
+#include "nss.h"
+#include "pk11pub.h"
+#include "pk11sdr.h"
+#include "ScopedNSSTypes.h"
 #include "ssl.h"
 #include "sslexp.h"
 
@@ -17,22 +30,80 @@ Atomic<bool, Relaxed> SSLTokensCache::sEnabled(kDefaultEnabled);
 static uint32_t const kDefaultCapacity = 2048;  // 2MB
 Atomic<uint32_t, Relaxed> SSLTokensCache::sCapacity(kDefaultCapacity);
 
+static bool const kDefaultPersist = false;
+Atomic<bool, Relaxed> SSLTokensCache::sPersist(kDefaultPersist);
+
 static LazyLogModule gSSLTokensCacheLog("SSLTokensCache");
 #undef LOG
 #define LOG(args) MOZ_LOG(gSSLTokensCacheLog, mozilla::LogLevel::Debug, args)
 
-class ExpirationComparator {
+static const char kCacheFileName[] = "ssl_tokens_cache.bin";
+static const uint32_t kCacheFileMagic = 0x53534c54;  // "SSLT"
+static const uint32_t kCacheFileVersion = 1;
+
+class LastUsedComparator {
  public:
   bool Equals(SSLTokensCache::HostRecord* a,
               SSLTokensCache::HostRecord* b) const {
-    return a->mExpirationTime == b->mExpirationTime;
+    return a->mLastUsed == b->mLastUsed;
   }
   bool LessThan(SSLTokensCache::HostRecord* a,
                 SSLTokensCache::HostRecord* b) const {
-    return a->mExpirationTime < b->mExpirationTime;
+    return a->mLastUsed < b->mLastUsed;
   }
 };
 
+// Tokens are encrypted with the secret decoder ring key from the profile's
+// key database before they are written to disk. We never prompt for the
+// primary password here: when the key database is locked the token is only
+// kept in memory.
+static bool CanUseSDR() {
+  if (!NSS_IsInitialized()) {
+    return false;
+  }
+  UniquePK11SlotInfo slot(PK11_GetInternalKeySlot());
+  if (!slot || PK11_NeedUserInit(slot.get())) {
+    return false;
+  }
+  return !PK11_NeedLogin(slot.get()) || PK11_IsLoggedIn(slot.get(), nullptr);
+}
+
+static bool SealToken(const uint8_t* aToken, uint32_t aTokenLen,
+                      nsTArray<uint8_t>& aSealed) {
+  if (!CanUseSDR()) {
+    return false;
+  }
+
+  SECItem keyid = {siBuffer, nullptr, 0};
+  SECItem request = {siBuffer, const_cast<uint8_t*>(aToken), aTokenLen};
+  ScopedAutoSECItem reply;
+  if (PK11SDR_Encrypt(&keyid, &request, &reply, nullptr) != SECSuccess) {
+    LOG(("  cannot seal the token, NSS error %d", PORT_GetError()));
+    return false;
+  }
+
+  aSealed.ReplaceElementsAt(0, aSealed.Length(), reply.data, reply.len);
+  return true;
+}
+
+static bool UnsealToken(const nsTArray<uint8_t>& aSealed,
+                        nsTArray<uint8_t>& aToken) {
+  if (!CanUseSDR()) {
+    return false;
+  }
+
+  SECItem request = {siBuffer, const_cast<uint8_t*>(aSealed.Elements()),
+                     static_cast<unsigned int>(aSealed.Length())};
+  ScopedAutoSECItem reply;
+  if (PK11SDR_Decrypt(&request, &reply, nullptr) != SECSuccess) {
+    LOG(("  cannot unseal the token, NSS error %d", PORT_GetError()));
+    return false;
+  }
+
+  aToken.ReplaceElementsAt(0, aToken.Length(), reply.data, reply.len);
+  return true;
+}
+
 StaticRefPtr<SSLTokensCache> SSLTokensCache::gInstance;
 StaticMutex SSLTokensCache::sLock;
 
@@ -42,7 +113,10 @@ NS_IMPL_ISUPPORTS(SSLTokensCache, nsIMemoryReporter)
 nsresult SSLTokensCache::Init() {
   StaticMutexAutoLock lock(sLock);
 
-  if (XRE_GetProcessType() != GeckoProcessType_Default) {
+  // TLS connections are made from the parent process, or from the socket
+  // process when networking runs there. Only the parent has a profile to
+  // persist the tokens to.
+  if (!XRE_IsParentProcess() && !XRE_IsSocketProcess()) {
     return NS_OK;
   }
 
@@ -71,7 +145,152 @@ nsresult SSLTokensCache::Shutdown() {
   return NS_OK;
 }
 
-SSLTokensCache::SSLTokensCache() : mCacheSize(0) {
+// static
+void SSLTokensCache::LoadFromProfile() {
+  MOZ_ASSERT(NS_IsMainThread());
+
+  nsCOMPtr<nsIFile> file;
+  {
+    StaticMutexAutoLock lock(sLock);
+
+    if (!gInstance || !XRE_IsParentProcess()) {
+      return;
+    }
+
+    nsresult rv = NS_GetSpecialDirectory(NS_APP_USER_PROFILE_50_DIR,
+                                         getter_AddRefs(file));
+    if (NS_FAILED(rv) || NS_FAILED(file->AppendNative(
+                             nsLiteralCString(kCacheFileName)))) {
+      LOG(("SSLTokensCache::LoadFromProfile - no profile directory"));
+      return;
+    }
+
+    gInstance->mCacheFile = file;
+    if (!sPersist) {
+      return;
+    }
+  }
+
+  nsCOMPtr<nsIEventTarget> target =
+      do_GetService(NS_STREAMTRANSPORTSERVICE_CONTRACTID);
+  if (!target) {
+    return;
+  }
+
+  target->Dispatch(
+      NS_NewRunnableFunction(
+          "SSLTokensCache::LoadFromProfile",
+          [file]() {
+            nsCOMPtr<nsIInputStream> stream;
+            nsresult rv = NS_NewLocalFileInputStream(getter_AddRefs(stream),
+                                                     file);
+            if (NS_FAILED(rv)) {
+              LOG(("SSLTokensCache::LoadFromProfile - no file"));
+              return;
+            }
+
+            nsAutoCString data;
+            rv = NS_ReadInputStreamToString(stream, data, -1);
+            if (NS_FAILED(rv)) {
+              return;
+            }
+
+            nsTArray<PersistedToken> tokens;
+            Decode(data, PR_Now(), tokens);
+
+            // Decrypt before taking the lock, the socket thread looks up
+            // tokens meanwhile.
+            for (uint32_t i = tokens.Length(); i > 0; --i) {
+              nsTArray<uint8_t> token;
+              if (!UnsealToken(tokens[i - 1].mToken, token)) {
+                tokens.RemoveElementAt(i - 1);
+                continue;
+              }
+              tokens[i - 1].mToken = std::move(token);
+            }
+
+            StaticMutexAutoLock lock(sLock);
+            if (gInstance) {
+              gInstance->AddPersistedTokens(tokens);
+            }
+          }),
+      NS_DISPATCH_NORMAL);
+}
+
+// static
+void SSLTokensCache::Persist() {
+  MOZ_ASSERT(NS_IsMainThread());
+
+  nsCOMPtr<nsIFile> file;
+  nsTArray<PersistedToken> tokens;
+  {
+    StaticMutexAutoLock lock(sLock);
+
+    if (!gInstance || !gInstance->mCacheFile) {
+      return;
+    }
+
+    file = gInstance->mCacheFile;
+    // With persistence turned off we still remove the file, so tokens from
+    // an earlier session do not linger on disk.
+    if (sPersist) {
+      gInstance->CollectPersistedTokens(tokens);
+    }
+  }
+
+  nsCOMPtr<nsIEventTarget> target =
+      do_GetService(NS_STREAMTRANSPORTSERVICE_CONTRACTID);
+  if (!target) {
+    return;
+  }
+
+  target->Dispatch(
+      NS_NewRunnableFunction(
+          "SSLTokensCache::Persist",
+          [file, tokens = std::move(tokens)]() mutable {
+            // Encrypting takes the key database's lock, so it is done here
+            // rather than when the socket thread stores a token.
+            for (uint32_t i = tokens.Length(); i > 0; --i) {
+              nsTArray<uint8_t> sealed;
+              if (!SealToken(tokens[i - 1].mToken.Elements(),
+                             tokens[i - 1].mToken.Length(), sealed)) {
+                tokens.RemoveElementAt(i - 1);
+                continue;
+              }
+              tokens[i - 1].mToken = std::move(sealed);
+            }
+
+            nsCString data;
+            Encode(tokens, data);
+            if (data.IsEmpty()) {
+              file->Remove(false);
+              return;
+            }
+
+            nsCOMPtr<nsIOutputStream> out;
+            nsresult rv = NS_NewSafeLocalFileOutputStream(
+                getter_AddRefs(out), file,
+                PR_WRONLY | PR_CREATE_FILE | PR_TRUNCATE, 0600);
+            if (NS_FAILED(rv)) {
+              LOG(("SSLTokensCache::Persist - cannot open the file"));
+              return;
+            }
+
+            uint32_t written;
+            rv = out->Write(data.BeginReading(), data.Length(), &written);
+            if (NS_FAILED(rv) || written != data.Length()) {
+              return;
+            }
+
+            nsCOMPtr<nsISafeOutputStream> safeOut = do_QueryInterface(out);
+            if (safeOut) {
+              safeOut->Finish();
+            }
+          }),
+      NS_DISPATCH_NORMAL);
+}
+
+SSLTokensCache::SSLTokensCache() : mCacheSize(0), mUseCounter(0) {
   LOG(("SSLTokensCache::SSLTokensCache"));
 }
 
@@ -90,7 +309,8 @@ nsresult SSLTokensCache::Put(const nsACString& aHost, const uint8_t* aToken,
     return NS_ERROR_NOT_INITIALIZED;
   }
 
-  PRUint32 expirationTime;
+  PRTime expirationTime;
+  uint32_t maxEarlyDataSize;
   SSLResumptionTokenInfo tokenInfo;
   if (SSL_GetResumptionTokenInfo(aToken, aTokenLen, &tokenInfo,
                                  sizeof(tokenInfo)) != SECSuccess) {
@@ -99,35 +319,49 @@ nsresult SSLTokensCache::Put(const nsACString& aHost, const uint8_t* aToken,
     return NS_ERROR_FAILURE;
   }
   expirationTime = tokenInfo.expirationTime;
+  maxEarlyDataSize = tokenInfo.maxEarlyDataSize;
   SSL_DestroyResumptionTokenInfo(&tokenInfo);
 
+  return gInstance->PutLocked(aHost, aToken, aTokenLen, expirationTime,
+                              maxEarlyDataSize);
+}
+
+nsresult SSLTokensCache::PutLocked(const nsACString& aHost,
+                                   const uint8_t* aToken, uint32_t aTokenLen,
+                                   PRTime aExpirationTime,
+                                   uint32_t aMaxEarlyDataSize) {
+  sLock.AssertCurrentThreadOwns();
+
   HostRecord* rec = nullptr;
 
-  if (!gInstance->mHostRecs.Get(aHost, &rec)) {
+  if (!mHostRecs.Get(aHost, &rec)) {
     rec = new HostRecord();
     rec->mHost = aHost;
-    gInstance->mHostRecs.Put(aHost, rec);
-    gInstance->mExpirationArray.AppendElement(rec);
+    mHostRecs.Put(aHost, rec);
+    mRecordsArray.AppendElement(rec);
   } else {
-    gInstance->mCacheSize -= rec->mToken.Length();
+    mCacheSize -= rec->mToken.Length();
     rec->mToken.Clear();
   }
 
-  rec->mExpirationTime = expirationTime;
+  rec->mExpirationTime = aExpirationTime;
+  rec->mMaxEarlyDataSize = aMaxEarlyDataSize;
+  rec->mLastUsed = ++mUseCounter;
   MOZ_ASSERT(rec->mToken.IsEmpty());
   rec->mToken.AppendElements(aToken, aTokenLen);
-  gInstance->mCacheSize += rec->mToken.Length();
+  mCacheSize += rec->mToken.Length();
 
-  gInstance->LogStats();
+  LogStats();
 
-  gInstance->EvictIfNecessary();
+  EvictIfNecessary();
 
   return NS_OK;
 }
 
 // static
 nsresult SSLTokensCache::Get(const nsACString& aHost,
-                             nsTArray<uint8_t>& aToken) {
+                             nsTArray<uint8_t>& aToken,
+                             uint32_t* aMaxEarlyDataSize) {
   StaticMutexAutoLock lock(sLock);
 
   LOG(("SSLTokensCache::Get [host=%s]", PromiseFlatCString(aHost).get()));
@@ -137,11 +371,29 @@ nsresult SSLTokensCache::Get(const nsACString& aHost,
     return NS_ERROR_NOT_INITIALIZED;
   }
 
+  return gInstance->GetLocked(aHost, aToken, aMaxEarlyDataSize);
+}
+
+nsresult SSLTokensCache::GetLocked(const nsACString& aHost,
+                                   nsTArray<uint8_t>& aToken,
+                                   uint32_t* aMaxEarlyDataSize) {
+  sLock.AssertCurrentThreadOwns();
+
   HostRecord* rec = nullptr;
 
-  if (gInstance->mHostRecs.Get(aHost, &rec)) {
+  if (mHostRecs.Get(aHost, &rec)) {
+    if (rec->mExpirationTime <= PR_Now()) {
+      LOG(("  token expired"));
+      RemoveLocked(aHost);
+      return NS_ERROR_NOT_AVAILABLE;
+    }
+
     if (rec->mToken.Length()) {
+      rec->mLastUsed = ++mUseCounter;
       aToken = rec->mToken;
+      if (aMaxEarlyDataSize) {
+        *aMaxEarlyDataSize = rec->mMaxEarlyDataSize;
+      }
       return NS_OK;
     }
   }
@@ -179,8 +431,8 @@ nsresult SSLTokensCache::RemoveLocked(const nsACString& aHost) {
 
   mCacheSize -= rec->mToken.Length();
 
-  if (!mExpirationArray.RemoveElement(rec)) {
-    MOZ_ASSERT(false, "token not found in mExpirationArray");
+  if (!mRecordsArray.RemoveElement(rec)) {
+    MOZ_ASSERT(false, "token not found in mRecordsArray");
   }
 
   LogStats();
@@ -193,6 +445,17 @@ void SSLTokensCache::InitPrefs() {
       &sEnabled, "network.ssl_tokens_cache_enabled", kDefaultEnabled);
   Preferences::AddAtomicUintVarCache(
       &sCapacity, "network.ssl_tokens_cache_capacity", kDefaultCapacity);
+  Preferences::AddAtomicBoolVarCache(
+      &sPersist, "network.ssl_tokens_cache_persist", kDefaultPersist);
+}
+
+void SSLTokensCache::RemoveExpired() {
+  PRTime now = PR_Now();
+  for (uint32_t i = mRecordsArray.Length(); i > 0; --i) {
+    if (mRecordsArray[i - 1]->mExpirationTime <= now) {
+      RemoveLocked(mRecordsArray[i - 1]->mHost);
+    }
+  }
 }
 
 void SSLTokensCache::EvictIfNecessary() {
@@ -203,19 +466,154 @@ void SSLTokensCache::EvictIfNecessary() {
 
   LOG(("SSLTokensCache::EvictIfNecessary - evicting"));
 
-  mExpirationArray.Sort(ExpirationComparator());
+  RemoveExpired();
 
-  while (mCacheSize > capacity && mExpirationArray.Length() > 0) {
-    if (NS_FAILED(RemoveLocked(mExpirationArray[0]->mHost))) {
-      MOZ_ASSERT(false, "mExpirationArray and mHostRecs are out of sync!");
-      mExpirationArray.RemoveElementAt(0);
+  // Then the least recently used tokens.
+  mRecordsArray.Sort(LastUsedComparator());
+
+  while (mCacheSize > capacity && mRecordsArray.Length() > 0) {
+    if (NS_FAILED(RemoveLocked(mRecordsArray[0]->mHost))) {
+      MOZ_ASSERT(false, "mRecordsArray and mHostRecs are out of sync!");
+      mRecordsArray.RemoveElementAt(0);
     }
   }
 }
 
 void SSLTokensCache::LogStats() {
   LOG(("SSLTokensCache::LogStats [count=%zu, cacheSize=%u]",
-       mExpirationArray.Length(), mCacheSize));
+       mRecordsArray.Length(), mCacheSize));
+}
+
+void SSLTokensCache::CollectPersistedTokens(
+    nsTArray<PersistedToken>& aTokens) {
+  sLock.AssertCurrentThreadOwns();
+
+  RemoveExpired();
+  // Most recently used last, so they get the newest use counts on load.
+  mRecordsArray.Sort(LastUsedComparator());
+
+  aTokens.SetCapacity(mRecordsArray.Length());
+  for (uint32_t i = 0; i < mRecordsArray.Length(); ++i) {
+    HostRecord* rec = mRecordsArray[i];
+    PersistedToken* token = aTokens.AppendElement();
+    token->mHost = rec->mHost;
+    token->mExpirationTime = rec->mExpirationTime;
+    token->mMaxEarlyDataSize = rec->mMaxEarlyDataSize;
+    token->mToken = rec->mToken;
+  }
+}
+
+void SSLTokensCache::AddPersistedTokens(nsTArray<PersistedToken>& aTokens) {
+  sLock.AssertCurrentThreadOwns();
+
+  uint32_t loaded = 0;
+  for (PersistedToken& token : aTokens) {
+    // Tokens stored during this session are newer than the file's.
+    if (token.mToken.IsEmpty() || mHostRecs.Contains(token.mHost)) {
+      continue;
+    }
+
+    PutLocked(token.mHost, token.mToken.Elements(), token.mToken.Length(),
+              token.mExpirationTime, token.mMaxEarlyDataSize);
+    ++loaded;
+  }
+
+  LOG(("SSLTokensCache::AddPersistedTokens [loaded=%u]", loaded));
+}
+
+// The file is a header (magic, version, record count) followed by, for each
+// record: host length, host, expiration time, max early data size, sealed
+// token length and sealed token. Numbers are in network byte order.
+// static
+void SSLTokensCache::Encode(const nsTArray<PersistedToken>& aTokens,
+                            nsACString& aData) {
+  aData.Truncate();
+  if (aTokens.IsEmpty()) {
+    return;
+  }
+
+  uint8_t buf[sizeof(uint64_t)];
+  for (uint32_t value : {kCacheFileMagic, kCacheFileVersion,
+                         static_cast<uint32_t>(aTokens.Length())}) {
+    NetworkEndian::writeUint32(buf, value);
+    aData.Append(reinterpret_cast<char*>(buf), sizeof(uint32_t));
+  }
+
+  for (const PersistedToken& token : aTokens) {
+    NetworkEndian::writeUint32(buf, token.mHost.Length());
+    aData.Append(reinterpret_cast<char*>(buf), sizeof(uint32_t));
+    aData.Append(token.mHost);
+    NetworkEndian::writeUint64(buf, token.mExpirationTime);
+    aData.Append(reinterpret_cast<char*>(buf), sizeof(uint64_t));
+    NetworkEndian::writeUint32(buf, token.mMaxEarlyDataSize);
+    aData.Append(reinterpret_cast<char*>(buf), sizeof(uint32_t));
+    NetworkEndian::writeUint32(buf, token.mToken.Length());
+    aData.Append(reinterpret_cast<char*>(buf), sizeof(uint32_t));
+    aData.Append(reinterpret_cast<const char*>(token.mToken.Elements()),
+                 token.mToken.Length());
+  }
+
+  LOG(("SSLTokensCache::Encode [count=%zu, size=%u]", aTokens.Length(),
+       aData.Length()));
+}
+
+// static
+void SSLTokensCache::Decode(const nsACString& aData, PRTime aNow,
+                            nsTArray<PersistedToken>& aTokens) {
+  const uint8_t* cur = reinterpret_cast<const uint8_t*>(aData.BeginReading());
+  const uint8_t* end = cur + aData.Length();
+
+  auto readUint32 = [&](uint32_t* aValue) {
+    if (end - cur < static_cast<ptrdiff_t>(sizeof(uint32_t))) {
+      return false;
+    }
+    *aValue = NetworkEndian::readUint32(cur);
+    cur += sizeof(uint32_t);
+    return true;
+  };
+
+  uint32_t magic, version, count;
+  if (!readUint32(&magic) || magic != kCacheFileMagic ||
+      !readUint32(&version) || version != kCacheFileVersion ||
+      !readUint32(&count)) {
+    LOG(("SSLTokensCache::Decode - bad header"));
+    return;
+  }
+
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t hostLen, maxEarlyDataSize, tokenLen;
+    if (!readUint32(&hostLen) || static_cast<size_t>(end - cur) < hostLen) {
+      break;
+    }
+    nsDependentCSubstring host(reinterpret_cast<const char*>(cur), hostLen);
+    cur += hostLen;
+
+    if (end - cur < static_cast<ptrdiff_t>(sizeof(uint64_t))) {
+      break;
+    }
+    PRTime expirationTime = NetworkEndian::readUint64(cur);
+    cur += sizeof(uint64_t);
+
+    if (!readUint32(&maxEarlyDataSize) || !readUint32(&tokenLen) ||
+        static_cast<size_t>(end - cur) < tokenLen) {
+      break;
+    }
+    const uint8_t* data = cur;
+    cur += tokenLen;
+
+    if (expirationTime <= aNow || !tokenLen) {
+      continue;
+    }
+
+    PersistedToken* token = aTokens.AppendElement();
+    token->mHost = host;
+    token->mExpirationTime = expirationTime;
+    token->mMaxEarlyDataSize = maxEarlyDataSize;
+    token->mToken.AppendElements(data, tokenLen);
+  }
+
+  LOG(("SSLTokensCache::Decode [count=%u, valid=%zu]", count,
+       aTokens.Length()));
 }
 
 size_t SSLTokensCache::SizeOfIncludingThis(
@@ -223,12 +621,13 @@ size_t SSLTokensCache::SizeOfIncludingThis(
   size_t n = mallocSizeOf(this);
 
   n += mHostRecs.ShallowSizeOfExcludingThis(mallocSizeOf);
-  n += mExpirationArray.ShallowSizeOfExcludingThis(mallocSizeOf);
+  n += mRecordsArray.ShallowSizeOfExcludingThis(mallocSizeOf);
 
-  for (uint32_t i = 0; i < mExpirationArray.Length(); ++i) {
-    n += mallocSizeOf(mExpirationArray[i]);
-    n += mExpirationArray[i]->mHost.SizeOfExcludingThisIfUnshared(mallocSizeOf);
-    n += mExpirationArray[i]->mToken.ShallowSizeOfExcludingThis(mallocSizeOf);
+  for (uint32_t i = 0; i < mRecordsArray.Length(); ++i) {
+    HostRecord* rec = mRecordsArray[i];
+    n += mallocSizeOf(rec);
+    n += rec->mHost.SizeOfExcludingThisIfUnshared(mallocSizeOf);
+    n += rec->mToken.ShallowSizeOfExcludingThis(mallocSizeOf);
   }
 
   return n;
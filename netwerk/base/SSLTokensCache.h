@@ -7,6 +7,9 @@
 
 #include "nsIMemoryReporter.h"
 #include "nsClassHashtable.h"
+#include "nsCOMPtr.h"
+#include "nsIFile.h"
+#include "prtime.h"
 #include "nsTArray.h"
 #include "mozilla/StaticMutex.h"
 #include "mozilla/StaticPtr.h"
@@ -20,7 +23,8 @@ class SSLTokensCache : public nsIMemoryReporter {
   NS_DECL_THREADSAFE_ISUPPORTS
   NS_DECL_NSIMEMORYREPORTER
 
-  friend class ExpirationComparator;
+  friend class LastUsedComparator;
+  friend class SSLTokensCacheTest;
 
   static nsresult Init();
   static nsresult Shutdown();
@@ -29,19 +33,56 @@ class SSLTokensCache : public nsIMemoryReporter {
 
   static nsresult Put(const nsACString& aHost, const uint8_t* aToken,
                       uint32_t aTokenLen);
-  static nsresult Get(const nsACString& aHost, nsTArray<uint8_t>& aToken);
+  // |aMaxEarlyDataSize|, when given, is set to how much 0-RTT data the
+  // server allowed with this token, zero if it does not allow early data.
+  static nsresult Get(const nsACString& aHost, nsTArray<uint8_t>& aToken,
+                      uint32_t* aMaxEarlyDataSize = nullptr);
   static nsresult Remove(const nsACString& aHost);
 
+  // Called on the main thread once the profile is available. Reads the
+  // tokens persisted by the previous session on a background thread.
+  static void LoadFromProfile();
+  // Called on the main thread before network teardown. Writes the tokens
+  // that can be resumed in the next session on a background thread.
+  static void Persist();
+
  private:
   SSLTokensCache();
   virtual ~SSLTokensCache();
 
+  // A token as it is written to or read from disk.
+  struct PersistedToken {
+    nsCString mHost;
+    PRTime mExpirationTime;
+    uint32_t mMaxEarlyDataSize;
+    // Sealed in the file, plain text once it has been decrypted.
+    nsTArray<uint8_t> mToken;
+  };
+
+  nsresult PutLocked(const nsACString& aHost, const uint8_t* aToken,
+                     uint32_t aTokenLen, PRTime aExpirationTime,
+                     uint32_t aMaxEarlyDataSize);
+  nsresult GetLocked(const nsACString& aHost, nsTArray<uint8_t>& aToken,
+                     uint32_t* aMaxEarlyDataSize);
   nsresult RemoveLocked(const nsACString& aHost);
 
   void InitPrefs();
   void EvictIfNecessary();
+  void RemoveExpired();
   void LogStats();
 
+  // Copies the tokens that can be resumed in the next session, least
+  // recently used first.
+  void CollectPersistedTokens(nsTArray<PersistedToken>& aTokens);
+  void AddPersistedTokens(nsTArray<PersistedToken>& aTokens);
+
+  // The file format. Encode() gives an empty string when there are no
+  // tokens, Decode() skips the tokens that expired before |aNow|.
+  static void Encode(const nsTArray<PersistedToken>& aTokens,
+                     nsACString& aData);
+  static void Decode(const nsACString& aData, PRTime aNow,
+                     nsTArray<PersistedToken>& aTokens);
+
   size_t SizeOfIncludingThis(mozilla::MallocSizeOf mallocSizeOf) const;
 
   static mozilla::StaticRefPtr<SSLTokensCache> gInstance;
@@ -50,18 +91,27 @@ class SSLTokensCache : public nsIMemoryReporter {
   static Atomic<bool, Relaxed> sEnabled;
   // Capacity of the cache in kilobytes
   static Atomic<uint32_t, Relaxed> sCapacity;
+  // Whether tokens are kept on disk across sessions
+  static Atomic<bool, Relaxed> sPersist;
 
   uint32_t mCacheSize;  // Actual cache size in bytes
+  uint64_t mUseCounter;
+
+  // Set once the profile is available, only in the parent process.
+  nsCOMPtr<nsIFile> mCacheFile;
 
   class HostRecord {
    public:
     nsCString mHost;
-    PRUint32 mExpirationTime;
+    PRTime mExpirationTime;
+    uint32_t mMaxEarlyDataSize;
+    // Value of mUseCounter when the token was last stored or handed out.
+    uint64_t mLastUsed;
     nsTArray<uint8_t> mToken;
   };
 
   nsClassHashtable<nsCStringHashKey, HostRecord> mHostRecs;
-  nsTArray<HostRecord*> mExpirationArray;
+  nsTArray<HostRecord*> mRecordsArray;
 };
 
 }  // namespace net
@@ -0,0 +1,182 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim:set ts=2 sw=2 sts=2 et cindent: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "SocketEpoll.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "nsSocketTransportService2.h"
+#include "prerror.h"
+#include "private/pprio.h"
+
+namespace mozilla {
+namespace net {
+
+// Bits of SocketEpollState::mFlagMap, mirroring the _PR_POLL_*_SYS_* bits
+// NSPR uses internally to map native readiness back to the caller's flags.
+static const uint16_t kReadSysRead = 0x01;
+static const uint16_t kReadSysWrite = 0x02;
+static const uint16_t kWriteSysRead = 0x04;
+static const uint16_t kWriteSysWrite = 0x08;
+static const uint16_t kExcept = 0x10;
+
+// Upper bound on the number of events harvested by a single epoll_wait.
+static const uint32_t kMaxEventsPerWait = 256;
+
+/* static */
+UniquePtr<SocketEpoll> SocketEpoll::Create() {
+  int fd = epoll_create1(EPOLL_CLOEXEC);
+  if (fd < 0) {
+    SOCKET_LOG(("SocketEpoll::Create failed [errno=%d]", errno));
+    return nullptr;
+  }
+  return UniquePtr<SocketEpoll>(new SocketEpoll(fd));
+}
+
+SocketEpoll::SocketEpoll(int aEpollFD) : mEpollFD(aEpollFD) {
+  mEvents.SetLength(kMaxEventsPerWait);
+}
+
+SocketEpoll::~SocketEpoll() { close(mEpollFD); }
+
+bool SocketEpoll::Watch(uint32_t aToken, PRFileDesc* aFD, int16_t aInFlags,
+                        SocketEpollState& aState, int16_t* aOutFlags) {
+  *aOutFlags = 0;
+
+  // Ask the layer stack what it needs from the OS socket, exactly like
+  // PR_Poll does.  A layer may already be ready (e.g. buffered TLS data).
+  int16_t outFlagsRead = 0;
+  int16_t outFlagsWrite = 0;
+  int16_t inFlagsRead =
+      aFD->methods->poll(aFD, aInFlags & ~PR_POLL_WRITE, &outFlagsRead);
+  int16_t inFlagsWrite =
+      aFD->methods->poll(aFD, aInFlags & ~PR_POLL_READ, &outFlagsWrite);
+  if ((inFlagsRead & outFlagsRead) || (inFlagsWrite & outFlagsWrite)) {
+    *aOutFlags = (inFlagsRead & outFlagsRead) | (inFlagsWrite & outFlagsWrite);
+  }
+
+  PRFileDesc* bottom = PR_GetIdentitiesLayer(aFD, PR_NSPR_IO_LAYER);
+  if (!bottom) {
+    Unwatch(aState);
+    return false;
+  }
+  int32_t nativeFD = PR_FileDesc2NativeHandle(bottom);
+  if (nativeFD < 0) {
+    Unwatch(aState);
+    return false;
+  }
+
+  uint16_t flagMap = 0;
+  uint32_t events = 0;
+  if (inFlagsRead & PR_POLL_READ) {
+    flagMap |= kReadSysRead;
+    events |= EPOLLIN;
+  }
+  if (inFlagsRead & PR_POLL_WRITE) {
+    flagMap |= kReadSysWrite;
+    events |= EPOLLOUT;
+  }
+  if (inFlagsWrite & PR_POLL_READ) {
+    flagMap |= kWriteSysRead;
+    events |= EPOLLIN;
+  }
+  if (inFlagsWrite & PR_POLL_WRITE) {
+    flagMap |= kWriteSysWrite;
+    events |= EPOLLOUT;
+  }
+  if (aInFlags & PR_POLL_EXCEPT) {
+    flagMap |= kExcept;
+    events |= EPOLLPRI;
+  }
+  aState.mFlagMap = flagMap;
+  aState.mInFlags = aInFlags;
+
+  if (aState.mNativeFD == nativeFD && aState.mEvents == events &&
+      aState.mToken == aToken) {
+    return true;
+  }
+
+  struct epoll_event ev;
+  ev.events = events;
+  ev.data.u64 = 0;
+  ev.data.u32 = aToken;
+
+  int op = EPOLL_CTL_MOD;
+  if (aState.mNativeFD != nativeFD) {
+    Unwatch(aState);
+    op = EPOLL_CTL_ADD;
+  }
+  if (epoll_ctl(mEpollFD, op, nativeFD, &ev) < 0) {
+    SOCKET_LOG(("SocketEpoll::Watch epoll_ctl(%d) failed [fd=%d errno=%d]", op,
+                nativeFD, errno));
+    Unwatch(aState);
+    return false;
+  }
+
+  aState.mNativeFD = nativeFD;
+  aState.mToken = aToken;
+  aState.mEvents = events;
+  return true;
+}
+
+void SocketEpoll::Unwatch(SocketEpollState& aState) {
+  if (aState.mNativeFD >= 0) {
+    // Kernels before 2.6.9 require a non-null event for EPOLL_CTL_DEL.
+    struct epoll_event ev = {};
+    epoll_ctl(mEpollFD, EPOLL_CTL_DEL, aState.mNativeFD, &ev);
+  }
+  aState.Reset();
+}
+
+int32_t SocketEpoll::Wait(PRIntervalTime aTimeout) {
+  int timeout;
+  if (aTimeout == PR_INTERVAL_NO_TIMEOUT) {
+    timeout = -1;
+  } else {
+    timeout = PR_IntervalToMilliseconds(aTimeout);
+  }
+
+  int rv;
+  do {
+    rv = epoll_wait(mEpollFD, mEvents.Elements(), mEvents.Length(), timeout);
+  } while (rv < 0 && errno == EINTR);
+
+  if (rv < 0) {
+    SOCKET_LOG(("SocketEpoll::Wait failed [errno=%d]", errno));
+    PR_SetError(PR_UNKNOWN_ERROR, errno);
+  }
+  return rv;
+}
+
+uint32_t SocketEpoll::TokenAt(int32_t aIndex) const {
+  return mEvents[aIndex].data.u32;
+}
+
+int16_t SocketEpoll::OutFlagsAt(int32_t aIndex,
+                                const SocketEpollState& aState) const {
+  uint32_t revents = mEvents[aIndex].events;
+  int16_t outFlags = 0;
+
+  if (revents & EPOLLIN) {
+    if (aState.mFlagMap & kReadSysRead) outFlags |= PR_POLL_READ;
+    if (aState.mFlagMap & kWriteSysRead) outFlags |= PR_POLL_WRITE;
+  }
+  if (revents & EPOLLOUT) {
+    if (aState.mFlagMap & kReadSysWrite) outFlags |= PR_POLL_READ;
+    if (aState.mFlagMap & kWriteSysWrite) outFlags |= PR_POLL_WRITE;
+  }
+  if ((revents & EPOLLPRI) && (aState.mFlagMap & kExcept)) {
+    outFlags |= PR_POLL_EXCEPT;
+  }
+  if (revents & EPOLLERR) outFlags |= PR_POLL_ERR;
+  if (revents & EPOLLHUP) outFlags |= PR_POLL_HUP;
+
+  return outFlags;
+}
+
+}  // namespace net
+}  // namespace mozilla
@@ -0,0 +1,100 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim:set ts=2 sw=2 sts=2 et cindent: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef SocketEpoll_h__
+#define SocketEpoll_h__
+
+#include <sys/epoll.h>
+#include "prio.h"
+#include "nsTArray.h"
+#include "mozilla/UniquePtr.h"
+
+namespace mozilla {
+namespace net {
+
+// Per-socket registration state kept by the socket transport service next
+// to each SocketContext.  It is a plain struct so it can be moved around
+// with the rest of the context when the active list is compacted.
+struct SocketEpollState {
+  // Native descriptor currently registered with epoll, or -1.
+  int32_t mNativeFD;
+  // Token (index into the active list) the registration carries.
+  uint32_t mToken;
+  // EPOLLIN/EPOLLOUT/EPOLLPRI mask currently registered.
+  uint32_t mEvents;
+  // How native readiness maps back to NSPR flags, see SocketEpoll::Watch.
+  uint16_t mFlagMap;
+  // PR_POLL_* flags the registration was made for.
+  int16_t mInFlags;
+
+  void Reset() {
+    mNativeFD = -1;
+    mToken = 0;
+    mEvents = 0;
+    mFlagMap = 0;
+    mInFlags = 0;
+  }
+};
+
+// SocketEpoll is a Linux epoll(7) backend for the socket transport service
+// poll loop.  Instead of handing the whole poll list to PR_Poll on every
+// iteration, sockets are registered once and Watch() is only called again
+// when something about the socket may have changed, so neither the kernel
+// nor the socket thread has to walk and re-arm every descriptor on every
+// wakeup.
+//
+// NSPR I/O layers (e.g. the SSL layer) may translate the caller's interest
+// into a different interest on the underlying OS socket, or may already be
+// ready without touching the OS socket at all.  Watch() replicates what
+// PR_Poll does for each descriptor: it asks the layer stack for the native
+// interest and remembers how to map native readiness back to the flags the
+// handler asked for.  Descriptors without an OS socket at the bottom of the
+// stack cannot be watched; the caller then falls back to PR_Poll.
+//
+// The registration is level-triggered.  Socket handlers do not drain their
+// sockets in OnSocketReady, so edge-triggered notifications would be lost.
+//
+// All methods must be called on the socket thread.
+class SocketEpoll final {
+ public:
+  // Token used for the pollable event, which is not in the active list.
+  static const uint32_t kPollableEventToken = UINT32_MAX;
+
+  static UniquePtr<SocketEpoll> Create();
+  ~SocketEpoll();
+
+  // Starts or updates watching |aFD| for |aInFlags| (PR_POLL_* flags).
+  // |aToken| is returned by TokenAt() when the socket becomes ready; it is
+  // updated when it changes.  Returns false, and drops any previous
+  // registration, when the descriptor cannot be watched natively.  When a
+  // layer reports readiness without a native wait, the ready flags are
+  // returned in |aOutFlags| and the caller must not block in Wait().
+  bool Watch(uint32_t aToken, PRFileDesc* aFD, int16_t aInFlags,
+             SocketEpollState& aState, int16_t* aOutFlags);
+
+  // Removes the registration.  Must be called before the descriptor is
+  // closed.  Does nothing when the socket is not registered.
+  void Unwatch(SocketEpollState& aState);
+
+  // Waits up to |aTimeout| for readiness.  Returns the number of ready
+  // entries or -1 on error.  Results are read with TokenAt/OutFlagsAt.
+  int32_t Wait(PRIntervalTime aTimeout);
+  uint32_t TokenAt(int32_t aIndex) const;
+  // Translates the native readiness of the result at |aIndex| into
+  // PR_POLL_* out flags using the mapping recorded in |aState|.
+  int16_t OutFlagsAt(int32_t aIndex, const SocketEpollState& aState) const;
+
+ private:
+  explicit SocketEpoll(int aEpollFD);
+
+  int mEpollFD;
+  nsTArray<epoll_event> mEvents;
+};
+
+}  // namespace net
+}  // namespace mozilla
+
+#endif  // SocketEpoll_h__
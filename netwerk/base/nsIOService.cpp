@@ -55,6 +55,7 @@
 #include "mozilla/net/NetworkConnectivityService.h"
 #include "mozilla/net/SocketProcessHost.h"
 #include "mozilla/net/SocketProcessParent.h"
+#include "mozilla/net/NetworkTrace.h"
 #include "mozilla/net/SSLTokensCache.h"
 #include "mozilla/Unused.h"
 #include "ReferrerPolicy.h"
@@ -235,6 +236,7 @@ nsresult nsIOService::Init() {
                                           NECKO_MSGS_URL);
 
   SSLTokensCache::Init();
+  NetworkTrace::Init();
 
   InitializeCaptivePortalService();
 
@@ -1372,6 +1374,7 @@ nsIOService::Observe(nsISupports* subject, const char* topic,
       mOfflineForProfileChange = true;
       SetOffline(true);
     }
+    SSLTokensCache::Persist();
   } else if (!strcmp(topic, kProfileChangeNetRestoreTopic)) {
     if (mOfflineForProfileChange) {
       mOfflineForProfileChange = false;
@@ -1396,6 +1399,10 @@ nsIOService::Observe(nsISupports* subject, const char* topic,
       // before something calls into the cookie service.
       nsCOMPtr<nsISupports> cookieServ =
           do_GetService(NS_COOKIESERVICE_CONTRACTID);
+
+      // Read the TLS resumption tokens stored by the previous session, so
+      // the first connections after a restart can skip the full handshake.
+      SSLTokensCache::LoadFromProfile();
     } else if (NS_LITERAL_STRING("xpcshell-do-get-profile").Equals(data)) {
       // xpcshell doesn't read user profile.
       LaunchSocketProcess();
@@ -1419,6 +1426,7 @@ nsIOService::Observe(nsISupports* subject, const char* topic,
     }
 
     SSLTokensCache::Shutdown();
+    NetworkTrace::Shutdown();
 
     DestroySocketProcess();
   } else if (!strcmp(topic, NS_NETWORK_LINK_TOPIC)) {
@@ -1534,8 +1534,11 @@ nsresult nsSocketTransport::InitiateSocket() {
     // If SSL_NO_CACHE option was set, we must not use the cache
     if (SSL_OptionGet(fd, SSL_NO_CACHE, &val) == SECSuccess && val == 0) {
       nsTArray<uint8_t> token;
-      nsresult rv2 = SSLTokensCache::Get(mHost, token);
+      uint32_t maxEarlyDataSize = 0;
+      nsresult rv2 = SSLTokensCache::Get(mHost, token, &maxEarlyDataSize);
       if (NS_SUCCEEDED(rv2) && token.Length() != 0) {
+        SOCKET_LOG(("Resuming with a cached token [host=%s, maxEarlyData=%u]",
+                    PromiseFlatCString(mHost).get(), maxEarlyDataSize));
         SECStatus srv =
             SSL_SetResumptionToken(fd, token.Elements(), token.Length());
         if (srv == SECFailure) {
@@ -32,6 +32,8 @@
 #  include "GeckoTaskTracer.h"
 #endif
 
+#include <algorithm>
+
 namespace mozilla {
 namespace net {
 
@@ -59,6 +61,7 @@ static Atomic<PRThread*, Relaxed> gSocketThread;
 #define POLLABLE_EVENT_TIMEOUT "network.sts.pollable_event_timeout"
 #define ESNI_ENABLED "network.security.esni.enabled"
 #define ESNI_DISABLED_MITM "security.pki.mitm_detected"
+#define EPOLL_ENABLED "network.sts.epoll.enabled"
 
 #define REPAIR_POLLABLE_EVENT_TIME 10
 
@@ -116,6 +119,18 @@ void nsSocketTransportService::SocketContext::MaybeResetEpoch() {
   }
 }
 
+#if defined(XP_LINUX)
+bool nsSocketTransportService::SocketContext::GetDeadline(
+    PRIntervalTime* aDeadline) const {
+  if (mHandler->mPollTimeout == UINT16_MAX || !mPollStartEpoch) {
+    return false;
+  }
+
+  *aDeadline = mPollStartEpoch + PR_SecondsToInterval(mHandler->mPollTimeout);
+  return true;
+}
+#endif
+
 //-----------------------------------------------------------------------------
 // ctor/dtor (called on the main/UI thread by the service manager)
 
@@ -133,6 +148,13 @@ nsSocketTransportService::nsSocketTransportService()
       mIdleCount(0),
       mSentBytesCount(0),
       mReceivedBytesCount(0),
+#if defined(XP_LINUX)
+      mEpollTimerGeneration(0),
+      mEpollWatchedCount(0),
+      mEpollActive(false),
+      mEpollRecheckAll(true),
+      mEpollEnabledPref(true),
+#endif
       mSendBufferSize(0),
       mKeepaliveIdleTimeS(600),
       mKeepaliveRetryIntervalS(1),
@@ -164,6 +186,9 @@ nsSocketTransportService::nsSocketTransportService()
       (SocketContext*)moz_xmalloc(sizeof(SocketContext) * mIdleListSize);
   mPollList =
       (PRPollDesc*)moz_xmalloc(sizeof(PRPollDesc) * (mActiveListSize + 1));
+#if defined(XP_LINUX)
+  mPollableEventEpollState.Reset();
+#endif
 
   NS_ASSERTION(!gSocketTransportService, "must not instantiate twice");
   gSocketTransportService = this;
@@ -267,6 +292,9 @@ nsSocketTransportService::AttachSocket(PRFileDesc* fd,
   sock.mFD = fd;
   sock.mHandler = handler;
   sock.mPollStartEpoch = 0;
+#if defined(XP_LINUX)
+  sock.ResetEpoll();
+#endif
 
   nsresult rv = AddToIdleList(&sock);
   if (NS_SUCCEEDED(rv)) NS_ADDREF(handler);
@@ -301,6 +329,13 @@ nsresult nsSocketTransportService::DetachSocket(SocketContext* listHead,
   MOZ_ASSERT((listHead == mActiveList) || (listHead == mIdleList),
              "DetachSocket invalid head");
 
+#if defined(XP_LINUX)
+  // the handler may close the socket, unregister it while it is still open.
+  if (listHead == mActiveList) {
+    EpollUnwatch(sock);
+  }
+#endif
+
   {
 #ifdef MOZ_TASK_TRACER
     tasktracer::AutoSourceEvent taskTracerEvent(
@@ -361,6 +396,17 @@ nsresult nsSocketTransportService::AddToPollList(SocketContext* sock) {
             mActiveCount - newSocketIndex);
     PodMove(mPollList + newSocketIndex + 2, mPollList + newSocketIndex + 1,
             mActiveCount - newSocketIndex);
+#if defined(XP_LINUX)
+    // every socket behind the insertion point has a new index now.
+    for (uint32_t& index : mEpollChangedList) {
+      if (index >= newSocketIndex) {
+        ++index;
+      }
+    }
+    for (uint32_t i = newSocketIndex + 1; i <= mActiveCount; ++i) {
+      EpollQueue(i);
+    }
+#endif
   }
 
   sock->EnsureTimeout(PR_IntervalNow());
@@ -371,6 +417,12 @@ nsresult nsSocketTransportService::AddToPollList(SocketContext* sock) {
   mPollList[newSocketIndex + 1].in_flags = sock->mHandler->mPollFlags;
   mPollList[newSocketIndex + 1].out_flags = 0;
 
+#if defined(XP_LINUX)
+  // registration happens in EpollWatchActiveList() before the next wait.
+  mActiveList[newSocketIndex].ResetEpoll();
+  EpollQueue(newSocketIndex);
+#endif
+
   SOCKET_LOG(("  active=%u idle=%u\n", mActiveCount, mIdleCount));
   return NS_OK;
 }
@@ -384,9 +436,18 @@ void nsSocketTransportService::RemoveFromPollList(SocketContext* sock) {
 
   SOCKET_LOG(("  index=%u mActiveCount=%u\n", index, mActiveCount));
 
+#if defined(XP_LINUX)
+  EpollUnwatch(sock);
+#endif
+
   if (index != mActiveCount - 1) {
     mActiveList[index] = mActiveList[mActiveCount - 1];
     mPollList[index + 1] = mPollList[mActiveCount];
+#if defined(XP_LINUX)
+    // the moved socket keeps its stale token until the next
+    // EpollWatchActiveList(), which always runs before we wait again.
+    EpollMoved(mActiveCount - 1, index);
+#endif
   }
   mActiveCount--;
 
@@ -476,6 +537,15 @@ bool nsSocketTransportService::GrowIdleList() {
 }
 
 PRIntervalTime nsSocketTransportService::PollTimeout(PRIntervalTime now) {
+#if defined(XP_LINUX)
+  if (mEpollActive) {
+    // EpollWatchActiveList() already queued the sockets whose layers are
+    // ready without waiting.
+    return mEpollReadyList.IsEmpty() ? EpollNextTimeout(now)
+                                     : PR_INTERVAL_NO_WAIT;
+  }
+#endif
+
   if (mActiveCount == 0) {
     return NS_SOCKET_POLL_TIMEOUT;
   }
@@ -543,15 +613,24 @@ int32_t nsSocketTransportService::Poll(TimeDuration* pollDuration,
   SOCKET_LOG(("    timeout = %i milliseconds\n",
               PR_IntervalToMilliseconds(pollTimeout)));
 
+  auto poll = [&]() {
+#if defined(XP_LINUX)
+    if (mEpollActive) {
+      return EpollWait(pollTimeout);
+    }
+#endif
+    return PR_Poll(pollList, pollCount, pollTimeout);
+  };
+
   int32_t rv = [&]() {
     if (pollTimeout != PR_INTERVAL_NO_WAIT) {
       // There will be an actual non-zero wait, let the profiler record
       // idle time and mark thread as sleeping around the polling call.
       AUTO_PROFILER_LABEL("nsSocketTransportService::Poll", IDLE);
       AUTO_PROFILER_THREAD_SLEEP;
-      return PR_Poll(pollList, pollCount, pollTimeout);
+      return poll();
     }
-    return PR_Poll(pollList, pollCount, pollTimeout);
+    return poll();
   }();
 
   if (Telemetry::CanRecordPrereleaseData() && !pollStart.IsNull()) {
@@ -583,6 +662,9 @@ static const char* gCallbackPrefs[] = {
     POLLABLE_EVENT_TIMEOUT,
     ESNI_ENABLED,
     ESNI_DISABLED_MITM,
+#if defined(XP_LINUX)
+    EPOLL_ENABLED,
+#endif
     nullptr,
 };
 
@@ -871,6 +953,13 @@ nsSocketTransportService::OnProcessNextEvent(nsIThreadInternal* thread,
 NS_IMETHODIMP
 nsSocketTransportService::AfterProcessNextEvent(nsIThreadInternal* thread,
                                                 bool eventWasProcessed) {
+#if defined(XP_LINUX)
+  // the event may have changed the poll flags or the condition of any
+  // socket.
+  if (eventWasProcessed) {
+    mEpollRecheckAll = true;
+  }
+#endif
   return NS_OK;
 }
 
@@ -1062,6 +1151,10 @@ nsSocketTransportService::Run() {
   // detach all sockets, including locals
   Reset(false);
 
+#if defined(XP_LINUX)
+  mEpoll = nullptr;
+#endif
+
   // We don't clear gSocketThread so that OnSocketThread() won't be a false
   // alarm for events generated by stopping the SLL threads during shutdown.
   psm::StopSSLServerCertVerificationThreads();
@@ -1111,8 +1204,20 @@ nsresult nsSocketTransportService::DoPollIteration(TimeDuration* pollDuration) {
   // should become active.  take care to check only idle sockets that
   // were idle to begin with ;-)
   //
+  // with epoll, the lists only have to be walked when an event ran since
+  // the last iteration.  otherwise only the handlers of the sockets the
+  // last iteration serviced ran, and those are on mEpollChangedList.
+  //
+  bool walkLists = true;
+#if defined(XP_LINUX)
+  if (mEpollActive && !mEpollRecheckAll) {
+    EpollCheckQueued(now, false);
+    walkLists = false;
+  }
+  mEpollRecheckAll = false;
+#endif
   count = mIdleCount;
-  for (i = mActiveCount - 1; i >= 0; --i) {
+  for (i = mActiveCount - 1; walkLists && i >= 0; --i) {
     //---
     SOCKET_LOG(("  active [%u] { handler=%p condition=%" PRIx32
                 " pollflags=%hu }\n",
@@ -1131,10 +1236,13 @@ nsresult nsSocketTransportService::DoPollIteration(TimeDuration* pollDuration) {
         mPollList[i + 1].in_flags = in_flags;
         mPollList[i + 1].out_flags = 0;
         mActiveList[i].EnsureTimeout(now);
+#if defined(XP_LINUX)
+        EpollCheckChanged(i);
+#endif
       }
     }
   }
-  for (i = count - 1; i >= 0; --i) {
+  for (i = count - 1; walkLists && i >= 0; --i) {
     //---
     SOCKET_LOG(("  idle [%u] { handler=%p condition=%" PRIx32
                 " pollflags=%hu }\n",
@@ -1148,6 +1256,11 @@ nsresult nsSocketTransportService::DoPollIteration(TimeDuration* pollDuration) {
       MoveToPollList(&mIdleList[i]);
   }
 
+#if defined(XP_LINUX)
+  UpdateEpoll();
+  mEpollActive = mEpoll && EpollWatchActiveList();
+#endif
+
   {
     MutexAutoLock lock(mLock);
     if (mPollableEvent) {
@@ -1197,7 +1310,14 @@ nsresult nsSocketTransportService::DoPollIteration(TimeDuration* pollDuration) {
     // service "active" sockets...
     //
     uint32_t numberOfOnSocketReadyCalls = 0;
-    for (i = 0; i < int32_t(mActiveCount); ++i) {
+    bool walkActiveList = true;
+#if defined(XP_LINUX)
+    if (mEpollActive) {
+      numberOfOnSocketReadyCalls = EpollServiceActiveList(now);
+      walkActiveList = false;
+    }
+#endif
+    for (i = 0; walkActiveList && i < int32_t(mActiveCount); ++i) {
       PRPollDesc& desc = mPollList[i + 1];
       SocketContext& s = mActiveList[i];
       if (n > 0 && desc.out_flags != 0) {
@@ -1208,6 +1328,9 @@ nsresult nsSocketTransportService::DoPollIteration(TimeDuration* pollDuration) {
         s.DisengageTimeout();
         s.mHandler->OnSocketReady(desc.fd, desc.out_flags);
         numberOfOnSocketReadyCalls++;
+#if defined(XP_LINUX)
+        EpollQueue(i);
+#endif
       } else if (s.IsTimedOut(now)) {
 #ifdef MOZ_TASK_TRACER
         tasktracer::AutoSourceEvent taskTracerEvent(
@@ -1217,6 +1340,9 @@ nsresult nsSocketTransportService::DoPollIteration(TimeDuration* pollDuration) {
         s.DisengageTimeout();
         s.mHandler->OnSocketReady(desc.fd, -1);
         numberOfOnSocketReadyCalls++;
+#if defined(XP_LINUX)
+        EpollQueue(i);
+#endif
       } else {
         s.MaybeResetEpoch();
       }
@@ -1230,10 +1356,16 @@ nsresult nsSocketTransportService::DoPollIteration(TimeDuration* pollDuration) {
     // check for "dead" sockets and remove them (need to do this in
     // reverse order obviously).
     //
-    for (i = mActiveCount - 1; i >= 0; --i) {
+    for (i = mActiveCount - 1; walkActiveList && i >= 0; --i) {
       if (NS_FAILED(mActiveList[i].mHandler->mCondition))
         DetachSocket(mActiveList, &mActiveList[i]);
     }
+#if defined(XP_LINUX)
+    if (!walkActiveList) {
+      // the serviced sockets have all been queued.
+      EpollCheckQueued(now, true);
+    }
+#endif
 
     {
       MutexAutoLock lock(mLock);
@@ -1354,6 +1486,14 @@ nsresult nsSocketTransportService::UpdatePrefs() {
     mTrustedMitmDetected = esniMitmPref;
   }
 
+#if defined(XP_LINUX)
+  bool epollPref = false;
+  rv = Preferences::GetBool(EPOLL_ENABLED, &epollPref);
+  if (NS_SUCCEEDED(rv)) {
+    mEpollEnabledPref = epollPref;
+  }
+#endif
+
   return NS_OK;
 }
 
@@ -1690,6 +1830,13 @@ void nsSocketTransportService::TryRepairPollableEvent() {
   mLock.AssertCurrentThreadOwns();
 
   NS_WARNING("Trying to repair mPollableEvent");
+#if defined(XP_LINUX)
+  // the new event may get the same descriptor number, make sure the old one
+  // is unregistered before it is closed.
+  if (mEpoll) {
+    mEpoll->Unwatch(mPollableEventEpollState);
+  }
+#endif
   mPollableEvent.reset(new PollableEvent());
   if (!mPollableEvent->Valid()) {
     mPollableEvent = nullptr;
@@ -1703,5 +1850,340 @@ void nsSocketTransportService::TryRepairPollableEvent() {
   mPollList[0].out_flags = 0;
 }
 
+#if defined(XP_LINUX)
+void nsSocketTransportService::UpdateEpoll() {
+  if (mEpollEnabledPref == !!mEpoll) {
+    return;
+  }
+
+  if (!mEpollEnabledPref) {
+    SOCKET_LOG(("nsSocketTransportService::UpdateEpoll disabling epoll"));
+    // closing the epoll descriptor drops all registrations at once.
+    mEpoll = nullptr;
+    for (uint32_t i = 0; i < mActiveCount; ++i) {
+      mActiveList[i].ResetEpoll();
+    }
+    mPollableEventEpollState.Reset();
+    mEpollChangedList.Clear();
+    mEpollReadyList.Clear();
+    mEpollTimers.Clear();
+    mEpollWatchedCount = 0;
+    return;
+  }
+
+  SOCKET_LOG(("nsSocketTransportService::UpdateEpoll enabling epoll"));
+  mEpoll = SocketEpoll::Create();
+  if (!mEpoll) {
+    NS_WARNING("epoll is not available, falling back to PR_Poll");
+    mEpollEnabledPref = false;
+    return;
+  }
+
+  for (uint32_t i = 0; i < mActiveCount; ++i) {
+    EpollQueue(i);
+  }
+}
+
+void nsSocketTransportService::EpollQueue(uint32_t index) {
+  if (!mEpoll) {
+    return;
+  }
+
+  SocketContext& s = mActiveList[index];
+  if (!s.mEpollQueued) {
+    s.mEpollQueued = true;
+    mEpollChangedList.AppendElement(index);
+  }
+}
+
+void nsSocketTransportService::EpollCheckChanged(uint32_t index) {
+  if (!mEpoll) {
+    return;
+  }
+
+  SocketContext& s = mActiveList[index];
+  s.MaybeResetEpoch();
+  if (s.mEpollQueued) {
+    return;
+  }
+
+  // handlers change their poll flags and timeouts by plain assignment, so
+  // this is the only place we can notice it.
+  PRIntervalTime deadline = 0;
+  bool hasDeadline = s.GetDeadline(&deadline);
+  if (s.mEpollState.mInFlags != mPollList[index + 1].in_flags ||
+      s.mEpollHasDeadline != hasDeadline ||
+      (hasDeadline && s.mEpollDeadline != deadline)) {
+    EpollQueue(index);
+  }
+}
+
+void nsSocketTransportService::EpollCheckQueued(PRIntervalTime now,
+                                                bool detachOnly) {
+  // walk backwards like DoPollIteration() does: a socket detached or moved
+  // to the idle list is replaced by the last active one, which has been
+  // checked already if it was queued.
+  AutoTArray<uint32_t, 64> queued(mEpollChangedList);
+  queued.Sort();
+  for (uint32_t k = queued.Length(); k > 0; --k) {
+    uint32_t index = queued[k - 1];
+    SocketContext& s = mActiveList[index];
+    if (NS_FAILED(s.mHandler->mCondition)) {
+      DetachSocket(mActiveList, &s);
+      continue;
+    }
+    if (detachOnly) {
+      continue;
+    }
+
+    uint16_t in_flags = s.mHandler->mPollFlags;
+    if (in_flags == 0) {
+      MoveToIdleList(&s);
+      continue;
+    }
+    mPollList[index + 1].in_flags = in_flags;
+    mPollList[index + 1].out_flags = 0;
+    s.EnsureTimeout(now);
+    s.MaybeResetEpoch();
+  }
+}
+
+bool nsSocketTransportService::EpollWatchActiveList() {
+  mEpollReadyList.Clear();
+
+  // the layers of a socket that was neither serviced nor changed its poll
+  // flags since it was last watched cannot have become ready on their own,
+  // so only the queued sockets have to be asked again.
+  int16_t outFlags;
+  for (uint32_t index : mEpollChangedList) {
+    SocketContext& s = mActiveList[index];
+    PRPollDesc& desc = mPollList[index + 1];
+    s.mEpollQueued = false;
+
+    bool wasWatched = s.mEpollState.mNativeFD >= 0;
+    if (!mEpoll->Watch(index, desc.fd, desc.in_flags, s.mEpollState,
+                       &outFlags)) {
+      SOCKET_LOG(("  socket %p cannot be watched by epoll, using PR_Poll",
+                  s.mHandler));
+    }
+    bool isWatched = s.mEpollState.mNativeFD >= 0;
+    if (isWatched != wasWatched) {
+      if (isWatched) {
+        ++mEpollWatchedCount;
+      } else {
+        MOZ_ASSERT(mEpollWatchedCount);
+        --mEpollWatchedCount;
+      }
+    }
+
+    if (outFlags) {
+      desc.out_flags = outFlags;
+      mEpollReadyList.AppendElement(index);
+    }
+
+    EpollPushTimer(index);
+  }
+  mEpollChangedList.Clear();
+
+  // stale timers are only dropped when they reach the top of the heap,
+  // rebuild it before they pile up.
+  if (mEpollTimers.Length() > 2 * mActiveCount + 64) {
+    mEpollTimers.ClearAndRetainStorage();
+    for (uint32_t i = 0; i < mActiveCount; ++i) {
+      const SocketContext& s = mActiveList[i];
+      if (s.mEpollHasDeadline) {
+        mEpollTimers.AppendElement(
+            EpollTimer{s.mEpollDeadline, i, s.mEpollTimerGeneration});
+      }
+    }
+    std::make_heap(mEpollTimers.Elements(),
+                   mEpollTimers.Elements() + mEpollTimers.Length(),
+                   EpollTimerLater);
+  }
+
+  // without a pollable event Poll() busy waits, keep that on PR_Poll.
+  if (!mPollList[0].fd) {
+    return false;
+  }
+
+  if (!mEpoll->Watch(SocketEpoll::kPollableEventToken, mPollList[0].fd,
+                     mPollList[0].in_flags, mPollableEventEpollState,
+                     &outFlags)) {
+    return false;
+  }
+
+  return mEpollWatchedCount == mActiveCount;
+}
+
+int32_t nsSocketTransportService::EpollWait(PRIntervalTime timeout) {
+  int32_t n = mEpoll->Wait(timeout);
+  if (n < 0) {
+    return n;
+  }
+
+  for (int32_t k = 0; k < n; ++k) {
+    uint32_t token = mEpoll->TokenAt(k);
+    if (token == SocketEpoll::kPollableEventToken) {
+      mPollList[0].out_flags |=
+          mEpoll->OutFlagsAt(k, mPollableEventEpollState);
+      continue;
+    }
+
+    if (token >= mActiveCount) {
+      MOZ_ASSERT_UNREACHABLE("epoll token out of the active list");
+      continue;
+    }
+
+    PRPollDesc& desc = mPollList[token + 1];
+    int16_t outFlags = mEpoll->OutFlagsAt(k, mActiveList[token].mEpollState);
+    if (!outFlags) {
+      continue;
+    }
+    if (!desc.out_flags) {
+      mEpollReadyList.AppendElement(token);
+    }
+    desc.out_flags |= outFlags;
+  }
+
+  return mEpollReadyList.Length() + (mPollList[0].out_flags ? 1 : 0);
+}
+
+uint32_t nsSocketTransportService::EpollServiceActiveList(
+    PRIntervalTime now) {
+  uint32_t numberOfOnSocketReadyCalls = 0;
+
+  for (uint32_t index : mEpollReadyList) {
+    PRPollDesc& desc = mPollList[index + 1];
+    SocketContext& s = mActiveList[index];
+#  ifdef MOZ_TASK_TRACER
+    tasktracer::AutoSourceEvent taskTracerEvent(
+        tasktracer::SourceEventType::SocketIO);
+#  endif
+    s.DisengageTimeout();
+    s.mHandler->OnSocketReady(desc.fd, desc.out_flags);
+    numberOfOnSocketReadyCalls++;
+    EpollQueue(index);
+  }
+
+  while (!mEpollTimers.IsEmpty()) {
+    EpollTimer timer = mEpollTimers[0];
+    if (!EpollTimerValid(timer)) {
+      EpollPopTimer();
+      continue;
+    }
+    if (int32_t(timer.mDeadline - now) > 0) {
+      break;
+    }
+    EpollPopTimer();
+
+    // the socket gets a new timer when it is watched again.
+    EpollQueue(timer.mIndex);
+
+    // sockets serviced above have disengaged their timeout.
+    SocketContext& s = mActiveList[timer.mIndex];
+    if (!s.IsTimedOut(now)) {
+      continue;
+    }
+
+#  ifdef MOZ_TASK_TRACER
+    tasktracer::AutoSourceEvent taskTracerEvent(
+        tasktracer::SourceEventType::SocketIO);
+#  endif
+    SOCKET_LOG(("socket %p timed out", s.mHandler));
+    s.DisengageTimeout();
+    s.mHandler->OnSocketReady(mPollList[timer.mIndex + 1].fd, -1);
+    numberOfOnSocketReadyCalls++;
+  }
+
+  return numberOfOnSocketReadyCalls;
+}
+
+PRIntervalTime nsSocketTransportService::EpollNextTimeout(PRIntervalTime now) {
+  while (!mEpollTimers.IsEmpty()) {
+    const EpollTimer& timer = mEpollTimers[0];
+    if (!EpollTimerValid(timer)) {
+      EpollPopTimer();
+      continue;
+    }
+
+    int32_t remains = int32_t(timer.mDeadline - now);
+    if (remains <= 0) {
+      return PR_INTERVAL_NO_WAIT;
+    }
+    SOCKET_LOG(("poll timeout: %" PRIu32 "\n",
+                PR_IntervalToSeconds(PRIntervalTime(remains))));
+    return PRIntervalTime(remains);
+  }
+
+  SOCKET_LOG(("poll timeout: none\n"));
+  return NS_SOCKET_POLL_TIMEOUT;
+}
+
+/* static */
+bool nsSocketTransportService::EpollTimerLater(const EpollTimer& a,
+                                               const EpollTimer& b) {
+  // interval times wrap around, compare them by their distance.
+  return int32_t(a.mDeadline - b.mDeadline) > 0;
+}
+
+bool nsSocketTransportService::EpollTimerValid(const EpollTimer& timer) const {
+  return timer.mIndex < mActiveCount &&
+         mActiveList[timer.mIndex].mEpollTimerGeneration == timer.mGeneration;
+}
+
+void nsSocketTransportService::EpollPushTimer(uint32_t index) {
+  SocketContext& s = mActiveList[index];
+
+  // a new generation invalidates any entry the socket still has.
+  if (!++mEpollTimerGeneration) {
+    ++mEpollTimerGeneration;
+  }
+  s.mEpollTimerGeneration = mEpollTimerGeneration;
+  s.mEpollHasDeadline = s.GetDeadline(&s.mEpollDeadline);
+  if (!s.mEpollHasDeadline) {
+    return;
+  }
+
+  mEpollTimers.AppendElement(
+      EpollTimer{s.mEpollDeadline, index, s.mEpollTimerGeneration});
+  std::push_heap(mEpollTimers.Elements(),
+                 mEpollTimers.Elements() + mEpollTimers.Length(),
+                 EpollTimerLater);
+}
+
+void nsSocketTransportService::EpollPopTimer() {
+  std::pop_heap(mEpollTimers.Elements(),
+                mEpollTimers.Elements() + mEpollTimers.Length(),
+                EpollTimerLater);
+  mEpollTimers.RemoveLastElement();
+}
+
+void nsSocketTransportService::EpollUnwatch(SocketContext* sock) {
+  if (sock->mEpollQueued) {
+    mEpollChangedList.RemoveElement(uint32_t(sock - mActiveList));
+  }
+  if (sock->mEpollState.mNativeFD >= 0) {
+    MOZ_ASSERT(mEpollWatchedCount);
+    --mEpollWatchedCount;
+  }
+  if (mEpoll) {
+    mEpoll->Unwatch(sock->mEpollState);
+  }
+  sock->ResetEpoll();
+}
+
+void nsSocketTransportService::EpollMoved(uint32_t from, uint32_t to) {
+  SocketContext& s = mActiveList[to];
+  if (!s.mEpollQueued) {
+    EpollQueue(to);
+    return;
+  }
+
+  auto pos = mEpollChangedList.IndexOf(from);
+  MOZ_ASSERT(pos != mEpollChangedList.NoIndex);
+  mEpollChangedList[pos] = to;
+}
+#endif
+
 }  // namespace net
 }  // namespace mozilla
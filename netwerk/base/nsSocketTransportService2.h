@@ -22,6 +22,9 @@
 #include "nsITimer.h"
 #include "mozilla/UniquePtr.h"
 #include "PollableEvent.h"
+#ifdef XP_LINUX
+#  include "SocketEpoll.h"
+#endif
 
 class nsASocketHandler;
 struct PRPollDesc;
@@ -189,6 +192,30 @@ class nsSocketTransportService final : public nsPISocketTransportService,
     // that mPollStartEpoch is not reset in between.  We have to manually
     // call this on every iteration over sockets to ensure the epoch reset.
     void MaybeResetEpoch();
+
+#ifdef XP_LINUX
+    // Returns false when no timeout is engaged, otherwise the interval
+    // time at which the socket times out.
+    bool GetDeadline(PRIntervalTime* aDeadline) const;
+
+    // Registration of this socket with mEpoll, only used on active sockets.
+    SocketEpollState mEpollState;
+    // Deadline the socket's entry in mEpollTimers was made for.
+    PRIntervalTime mEpollDeadline;
+    // Tags the valid entry in mEpollTimers, older entries are stale.
+    uint32_t mEpollTimerGeneration;
+    bool mEpollHasDeadline;
+    // true while the socket's index is on mEpollChangedList.
+    bool mEpollQueued;
+
+    void ResetEpoll() {
+      mEpollState.Reset();
+      mEpollDeadline = 0;
+      mEpollTimerGeneration = 0;
+      mEpollHasDeadline = false;
+      mEpollQueued = false;
+    }
+#endif
   };
 
   SocketContext* mActiveList; /* mListSize entries */
@@ -235,6 +262,81 @@ class nsSocketTransportService final : public nsPISocketTransportService,
   // pollDuration is used only for
   // telemetry
 
+#ifdef XP_LINUX
+  //-------------------------------------------------------------------------
+  // epoll backend (socket thread only)
+  //
+  // when enabled, the active sockets and the pollable event are registered
+  // with mEpoll and Poll() waits on it instead of calling PR_Poll.  a socket
+  // is only re-registered when it was added, moved in the active list,
+  // serviced, or its poll flags or timeout changed; such sockets are queued
+  // on mEpollChangedList.  socket timeouts are kept in the mEpollTimers
+  // heap, so neither waiting nor servicing walks the active list.  if any
+  // active socket cannot be watched natively the iteration falls back to
+  // PR_Poll.
+  //-------------------------------------------------------------------------
+
+  struct EpollTimer {
+    PRIntervalTime mDeadline;
+    uint32_t mIndex;  // into mActiveList
+    uint32_t mGeneration;
+  };
+
+  UniquePtr<SocketEpoll> mEpoll;
+  SocketEpollState mPollableEventEpollState;
+  // indices into mActiveList that have to be passed to Watch() again
+  nsTArray<uint32_t> mEpollChangedList;
+  // indices into mActiveList signalled by the last EpollWait()
+  nsTArray<uint32_t> mEpollReadyList;
+  // min-heap on mDeadline, entries whose generation doesn't match their
+  // socket's mEpollTimerGeneration are stale and dropped lazily.
+  nsTArray<EpollTimer> mEpollTimers;
+  uint32_t mEpollTimerGeneration;
+  // number of active sockets currently registered with mEpoll
+  uint32_t mEpollWatchedCount;
+  // true when the current poll iteration waits on mEpoll
+  bool mEpollActive;
+  // true when an event ran on the socket thread since DoPollIteration()
+  // last walked the socket lists.  otherwise only the handlers serviced by
+  // the last iteration can have changed their sockets.
+  bool mEpollRecheckAll;
+  Atomic<bool, Relaxed> mEpollEnabledPref;
+
+  // creates or drops mEpoll according to the pref.
+  void UpdateEpoll();
+  // queues the active socket at |index| on mEpollChangedList.
+  void EpollQueue(uint32_t index);
+  // queues the active socket at |index| when its poll flags or timeout
+  // differ from what it was last registered with.
+  void EpollCheckChanged(uint32_t index);
+  // what DoPollIteration() does for every socket, for the active sockets
+  // on mEpollChangedList only.  with |detachOnly| the failed ones are
+  // detached and nothing else is done.
+  void EpollCheckQueued(PRIntervalTime now, bool detachOnly);
+  // re-registers the sockets on mEpollChangedList and the pollable event.
+  // returns false when the iteration has to fall back to PR_Poll.
+  bool EpollWatchActiveList();
+  // waits on mEpoll and stores the results in mPollList and
+  // mEpollReadyList.  returns the same as PR_Poll would.
+  int32_t EpollWait(PRIntervalTime timeout);
+  // delivers the sockets on mEpollReadyList to their handlers and those
+  // on mEpollTimers that timed out.  returns the number of OnSocketReady
+  // calls.
+  uint32_t EpollServiceActiveList(PRIntervalTime now);
+  // time until the earliest deadline on mEpollTimers.
+  PRIntervalTime EpollNextTimeout(PRIntervalTime now);
+  // orders mEpollTimers so that std heap functions keep the earliest
+  // deadline first.
+  static bool EpollTimerLater(const EpollTimer& a, const EpollTimer& b);
+  bool EpollTimerValid(const EpollTimer& timer) const;
+  void EpollPushTimer(uint32_t index);
+  void EpollPopTimer();
+  void EpollUnwatch(SocketContext* sock);
+  // fixes up the bookkeeping after the active socket at |from| has been
+  // moved to |to|.
+  void EpollMoved(uint32_t from, uint32_t to);
+#endif
+
   //-------------------------------------------------------------------------
   // pending socket queue - see NotifyWhenCanAttachSocket
   //-------------------------------------------------------------------------
@@ -80,6 +80,34 @@ constexpr bool TestForInvalidHostCharacters(char c) {
 constexpr ASCIIMaskArray sInvalidHostChars =
     CreateASCIIMask(TestForInvalidHostCharacters);
 
+// Characters of hosts that need neither unescaping nor IDN processing,
+// beyond lowercasing.
+constexpr bool TestForPlainHostCharacters(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '-' || c == '.';
+}
+
+constexpr ASCIIMaskArray sPlainHostChars =
+    CreateASCIIMask(TestForPlainHostCharacters);
+
+// Whether BuildNormalizedSpec can take |aHost| as it is, lowercased. This is
+// the case of nearly every host, and saves the unescaping copy and the trip
+// through the IDN service.
+static bool IsPlainHost(const char* aHost, uint32_t aLength) {
+  for (uint32_t i = 0; i < aLength; i++) {
+    if (!ASCIIMask::IsMasked(sPlainHostChars, aHost[i])) {
+      return false;
+    }
+    // ACE labels are converted for display.
+    if ((i == 0 || aHost[i - 1] == '.') && aLength - i >= 4 &&
+        (aHost[i] | 0x20) == 'x' && (aHost[i + 1] | 0x20) == 'n' &&
+        aHost[i + 2] == '-' && aHost[i + 3] == '-') {
+      return false;
+    }
+  }
+  return true;
+}
+
 //----------------------------------------------------------------------------
 // nsStandardURL::nsSegmentEncoder
 //----------------------------------------------------------------------------
@@ -739,16 +767,25 @@ nsresult nsStandardURL::BuildNormalizedSpec(const char* spec,
   // However, perform Unicode normalization on it, as IDN does.
   // Note that we don't disallow URLs without a host - file:, etc
   if (mHost.mLen > 0) {
-    nsAutoCString tempHost;
-    NS_UnescapeURL(spec + mHost.mPos, mHost.mLen, esc_AlwaysCopy | esc_Host,
-                   tempHost);
-    if (tempHost.Contains('\0'))
-      return NS_ERROR_MALFORMED_URI;  // null embedded in hostname
-    if (tempHost.Contains(' '))
-      return NS_ERROR_MALFORMED_URI;  // don't allow spaces in the hostname
-    nsresult rv = NormalizeIDN(tempHost, encHost);
-    if (NS_FAILED(rv)) {
-      return rv;
+    nsresult rv;
+    if (IsPlainHost(spec + mHost.mPos, mHost.mLen)) {
+      // Same result as NormalizeIDN() below, for such hosts.
+      encHost.Assign(spec + mHost.mPos, mHost.mLen);
+      ToLowerCase(encHost);
+      mCheckedIfHostA = true;
+      mDisplayHost.Truncate();
+    } else {
+      nsAutoCString tempHost;
+      NS_UnescapeURL(spec + mHost.mPos, mHost.mLen, esc_AlwaysCopy | esc_Host,
+                     tempHost);
+      if (tempHost.Contains('\0'))
+        return NS_ERROR_MALFORMED_URI;  // null embedded in hostname
+      if (tempHost.Contains(' '))
+        return NS_ERROR_MALFORMED_URI;  // don't allow spaces in the hostname
+      rv = NormalizeIDN(tempHost, encHost);
+      if (NS_FAILED(rv)) {
+        return rv;
+      }
     }
     if (!SegmentIs(spec, mScheme, "resource") &&
         !SegmentIs(spec, mScheme, "chrome")) {
@@ -3,6 +3,7 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include "mozilla/Atomics.h"
 #include "mozilla/Attributes.h"
 #include "mozilla/EndianUtils.h"
 #include "mozilla/dom/TypedArray.h"
@@ -32,11 +33,44 @@
 #include "nsICancelable.h"
 #include "nsWrapperCacheInlines.h"
 
+#include <algorithm>
+
+#if defined(XP_LINUX) && !defined(ANDROID)
+#  define UDP_USE_MMSG 1
+#  include <errno.h>
+#  include <sys/socket.h>
+#  include "private/pprio.h"
+#endif
+
 namespace mozilla {
 namespace net {
 
 static const uint32_t UDP_PACKET_CHUNK_SIZE = 1400;
 
+// Bug 1252755 - use 9216 bytes to allign with nICEr and transportlayer to
+// support the maximum size of jumbo frames
+static const uint32_t UDP_MAX_DATAGRAM_SIZE = 9216;
+
+// How many datagrams are read per OnSocketReady, and sent per system call
+// when flushing the datagrams queued from other threads.
+static const uint32_t UDP_RECV_BATCH = 8;
+static const uint32_t UDP_SEND_BATCH = 32;
+
+#ifdef UDP_USE_MMSG
+// NSPR uses the native address families on Linux, so the PRNetAddrs it
+// gives and takes can be handed to the kernel as they are.
+static_assert(PR_AF_INET == AF_INET && PR_AF_INET6 == AF_INET6,
+              "PRNetAddr families must match the native ones");
+
+// Set on the socket thread if the kernel lacks recvmmsg/sendmmsg.
+static bool sMmsgUnsupported = false;
+
+static socklen_t NativeAddrLength(const PRNetAddr& aAddr) {
+  return aAddr.raw.family == PR_AF_INET ? sizeof(aAddr.inet)
+                                        : sizeof(aAddr.ipv6);
+}
+#endif
+
 //-----------------------------------------------------------------------------
 
 typedef void (nsUDPSocket::*nsUDPSocketFunc)(void);
@@ -94,62 +128,6 @@ class SetSocketOptionRunnable : public Runnable {
   PRSocketOptionData mOpt;
 };
 
-//-----------------------------------------------------------------------------
-// nsUDPOutputStream impl
-//-----------------------------------------------------------------------------
-NS_IMPL_ISUPPORTS(nsUDPOutputStream, nsIOutputStream)
-
-nsUDPOutputStream::nsUDPOutputStream(nsUDPSocket* aSocket, PRFileDesc* aFD,
-                                     PRNetAddr& aPrClientAddr)
-    : mSocket(aSocket),
-      mFD(aFD),
-      mPrClientAddr(aPrClientAddr),
-      mIsClosed(false) {}
-
-NS_IMETHODIMP nsUDPOutputStream::Close() {
-  if (mIsClosed) return NS_BASE_STREAM_CLOSED;
-
-  mIsClosed = true;
-  return NS_OK;
-}
-
-NS_IMETHODIMP nsUDPOutputStream::Flush() { return NS_OK; }
-
-NS_IMETHODIMP nsUDPOutputStream::Write(const char* aBuf, uint32_t aCount,
-                                       uint32_t* _retval) {
-  if (mIsClosed) return NS_BASE_STREAM_CLOSED;
-
-  *_retval = 0;
-  int32_t count =
-      PR_SendTo(mFD, aBuf, aCount, 0, &mPrClientAddr, PR_INTERVAL_NO_WAIT);
-  if (count < 0) {
-    PRErrorCode code = PR_GetError();
-    return ErrorAccordingToNSPR(code);
-  }
-
-  *_retval = count;
-
-  mSocket->AddOutputBytes(count);
-
-  return NS_OK;
-}
-
-NS_IMETHODIMP nsUDPOutputStream::WriteFrom(nsIInputStream* aFromStream,
-                                           uint32_t aCount, uint32_t* _retval) {
-  return NS_ERROR_NOT_IMPLEMENTED;
-}
-
-NS_IMETHODIMP nsUDPOutputStream::WriteSegments(nsReadSegmentFun aReader,
-                                               void* aClosure, uint32_t aCount,
-                                               uint32_t* _retval) {
-  return NS_ERROR_NOT_IMPLEMENTED;
-}
-
-NS_IMETHODIMP nsUDPOutputStream::IsNonBlocking(bool* _retval) {
-  *_retval = true;
-  return NS_OK;
-}
-
 //-----------------------------------------------------------------------------
 // nsUDPMessage impl
 //-----------------------------------------------------------------------------
@@ -229,7 +207,8 @@ nsUDPSocket::nsUDPSocket()
       mOriginAttributes(),
       mAttached(false),
       mByteReadCount(0),
-      mByteWriteCount(0) {
+      mByteWriteCount(0),
+      mFlushPending(false) {
   this->mAddr.inet = {};
   mAddr.raw.family = PR_AF_UNSPEC;
   // we want to be able to access the STS directly, and it may not have been
@@ -379,8 +358,94 @@ UDPMessageProxy::GetOutputStream(nsIOutputStream** aOutputStream) {
   return NS_OK;
 }
 
+//-----------------------------------------------------------------------------
+// UDPOutputStream
+//-----------------------------------------------------------------------------
+// Sends what is written to it to one address, as the output stream of a
+// received message and as the target of SendBinaryStreamWithAddress().
+// Most messages are never replied to, so rather than setting up a pipe and
+// an async copy for each of them, writes go straight to
+// nsUDPSocket::SendDatagram, which queues them for the socket thread when
+// called from another thread.
+class UDPOutputStream final : public nsIOutputStream {
+ public:
+  UDPOutputStream(nsUDPSocket* aSocket, const NetAddr& aAddr)
+      : mSocket(aSocket), mAddr(aAddr), mIsClosed(false) {}
+
+  NS_DECL_THREADSAFE_ISUPPORTS
+  NS_DECL_NSIOUTPUTSTREAM
+
+ private:
+  ~UDPOutputStream() = default;
+
+  RefPtr<nsUDPSocket> mSocket;
+  const NetAddr mAddr;
+  Atomic<bool> mIsClosed;
+};
+
+NS_IMPL_ISUPPORTS(UDPOutputStream, nsIOutputStream)
+
+NS_IMETHODIMP UDPOutputStream::Close() {
+  if (mIsClosed.exchange(true)) return NS_BASE_STREAM_CLOSED;
+  return NS_OK;
+}
+
+NS_IMETHODIMP UDPOutputStream::Flush() { return NS_OK; }
+
+NS_IMETHODIMP UDPOutputStream::Write(const char* aBuf, uint32_t aCount,
+                                     uint32_t* _retval) {
+  if (mIsClosed) return NS_BASE_STREAM_CLOSED;
+
+  // Writes larger than a chunk go out as several datagrams, the way
+  // SendBinaryStreamWithAddress() splits its copy.
+  *_retval = 0;
+  while (*_retval < aCount) {
+    uint32_t chunk = std::min(aCount - *_retval, UDP_PACKET_CHUNK_SIZE);
+    uint32_t count;
+    nsresult rv = mSocket->SendDatagram(
+        mAddr, reinterpret_cast<const uint8_t*>(aBuf) + *_retval, chunk,
+        &count);
+    if (NS_FAILED(rv)) {
+      return *_retval ? NS_OK : rv;
+    }
+    *_retval += chunk;
+  }
+  return NS_OK;
+}
+
+NS_IMETHODIMP UDPOutputStream::WriteFrom(nsIInputStream* aFromStream,
+                                         uint32_t aCount, uint32_t* _retval) {
+  return NS_ERROR_NOT_IMPLEMENTED;
+}
+
+NS_IMETHODIMP UDPOutputStream::WriteSegments(nsReadSegmentFun aReader,
+                                             void* aClosure, uint32_t aCount,
+                                             uint32_t* _retval) {
+  return NS_ERROR_NOT_IMPLEMENTED;
+}
+
+NS_IMETHODIMP UDPOutputStream::IsNonBlocking(bool* _retval) {
+  *_retval = true;
+  return NS_OK;
+}
+
 }  // anonymous namespace
 
+//-----------------------------------------------------------------------------
+// UDPListenerProxy
+//-----------------------------------------------------------------------------
+// Base of the proxies AsyncListen() wraps listeners in.  The socket thread
+// hands them all the datagrams read in one go, so that a burst costs one
+// dispatch to the listener's thread rather than one per datagram.
+class UDPListenerProxy : public nsIUDPSocketListener {
+ public:
+  virtual nsresult OnPacketsReceived(
+      nsIUDPSocket* aSocket, nsTArray<nsCOMPtr<nsIUDPMessage>>&& aMessages) = 0;
+
+ protected:
+  virtual ~UDPListenerProxy() = default;
+};
+
 //-----------------------------------------------------------------------------
 // nsUDPSocket::nsASocketHandler
 //-----------------------------------------------------------------------------
@@ -398,54 +463,102 @@ void nsUDPSocket::OnSocketReady(PRFileDesc* fd, int16_t outFlags) {
     return;
   }
 
-  PRNetAddr prClientAddr;
-  int32_t count;
-  // Bug 1252755 - use 9216 bytes to allign with nICEr and transportlayer to
-  // support the maximum size of jumbo frames
-  char buff[9216];
-  count = PR_RecvFrom(mFD, buff, sizeof(buff), 0, &prClientAddr,
-                      PR_INTERVAL_NO_WAIT);
-  if (count < 0) {
-    UDPSOCKET_LOG(
-        ("nsUDPSocket::OnSocketReady: PR_RecvFrom failed [this=%p]\n", this));
-    return;
+  nsTArray<nsCOMPtr<nsIUDPMessage>> messages;
+  ReadDatagrams(messages);
+  if (!messages.IsEmpty()) {
+    mListener->OnPacketsReceived(this, std::move(messages));
   }
-  mByteReadCount += count;
+}
 
-  FallibleTArray<uint8_t> data;
-  if (!data.AppendElements(buff, count, fallible)) {
-    UDPSOCKET_LOG((
-        "nsUDPSocket::OnSocketReady: AppendElements FAILED [this=%p]\n", this));
-    mCondition = NS_ERROR_UNEXPECTED;
-    return;
+void nsUDPSocket::ReadDatagrams(nsTArray<nsCOMPtr<nsIUDPMessage>>& aMessages) {
+  if (!mRecvBuffers) {
+    mRecvBuffers = MakeUnique<char[]>(UDP_RECV_BATCH * UDP_MAX_DATAGRAM_SIZE);
   }
 
-  nsCOMPtr<nsIAsyncInputStream> pipeIn;
-  nsCOMPtr<nsIAsyncOutputStream> pipeOut;
+#ifdef UDP_USE_MMSG
+  if (!sMmsgUnsupported) {
+    PRNetAddr from[UDP_RECV_BATCH];
+    struct iovec iov[UDP_RECV_BATCH];
+    struct mmsghdr msgs[UDP_RECV_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    for (uint32_t i = 0; i < UDP_RECV_BATCH; ++i) {
+      iov[i].iov_base = mRecvBuffers.get() + i * UDP_MAX_DATAGRAM_SIZE;
+      iov[i].iov_len = UDP_MAX_DATAGRAM_SIZE;
+      msgs[i].msg_hdr.msg_name = &from[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
 
-  uint32_t segsize = UDP_PACKET_CHUNK_SIZE;
-  uint32_t segcount = 0;
-  net_ResolveSegmentParams(segsize, segcount);
-  nsresult rv = NS_NewPipe2(getter_AddRefs(pipeIn), getter_AddRefs(pipeOut),
-                            true, true, segsize, segcount);
+    int count = recvmmsg(PR_FileDesc2NativeHandle(mFD), msgs, UDP_RECV_BATCH,
+                         MSG_DONTWAIT, nullptr);
+    if (count < 0 && errno == ENOSYS) {
+      sMmsgUnsupported = true;
+    } else {
+      if (count < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          UDPSOCKET_LOG(
+              ("nsUDPSocket::ReadDatagrams: recvmmsg failed errno=%d "
+               "[this=%p]\n",
+               errno, this));
+        }
+        return;
+      }
+      // recvmmsg goes around the IOActivityMonitor layer.
+      bool monitor = IOActivityMonitor::IsActive();
+      for (int i = 0; i < count; ++i) {
+        if (monitor) {
+          IOActivityMonitor::Read(mFD, msgs[i].msg_len);
+        }
+        if (!AppendDatagram(from[i],
+                            static_cast<const char*>(iov[i].iov_base),
+                            msgs[i].msg_len, aMessages)) {
+          return;
+        }
+      }
+      return;
+    }
+  }
+#endif
 
-  if (NS_FAILED(rv)) {
-    return;
+  for (uint32_t i = 0; i < UDP_RECV_BATCH; ++i) {
+    PRNetAddr from;
+    char* buff = mRecvBuffers.get() + i * UDP_MAX_DATAGRAM_SIZE;
+    int32_t count = PR_RecvFrom(mFD, buff, UDP_MAX_DATAGRAM_SIZE, 0, &from,
+                                PR_INTERVAL_NO_WAIT);
+    if (count < 0) {
+      if (PR_GetError() != PR_WOULD_BLOCK_ERROR) {
+        UDPSOCKET_LOG(
+            ("nsUDPSocket::ReadDatagrams: PR_RecvFrom failed [this=%p]\n",
+             this));
+      }
+      return;
+    }
+    if (!AppendDatagram(from, buff, count, aMessages)) {
+      return;
+    }
   }
+}
 
-  RefPtr<nsUDPOutputStream> os = new nsUDPOutputStream(this, mFD, prClientAddr);
-  rv = NS_AsyncCopy(pipeIn, os, mSts, NS_ASYNCCOPY_VIA_READSEGMENTS,
-                    UDP_PACKET_CHUNK_SIZE);
+bool nsUDPSocket::AppendDatagram(
+    const PRNetAddr& aFrom, const char* aData, uint32_t aLength,
+    nsTArray<nsCOMPtr<nsIUDPMessage>>& aMessages) {
+  mByteReadCount += aLength;
 
-  if (NS_FAILED(rv)) {
-    return;
+  FallibleTArray<uint8_t> data;
+  if (!data.AppendElements(aData, aLength, fallible)) {
+    UDPSOCKET_LOG(
+        ("nsUDPSocket::AppendDatagram: AppendElements FAILED [this=%p]\n",
+         this));
+    mCondition = NS_ERROR_UNEXPECTED;
+    return false;
   }
 
   NetAddr netAddr;
-  PRNetAddrToNetAddr(&prClientAddr, &netAddr);
-  nsCOMPtr<nsIUDPMessage> message =
-      new UDPMessageProxy(&netAddr, pipeOut, data);
-  mListener->OnPacketReceived(this, message);
+  PRNetAddrToNetAddr(&aFrom, &netAddr);
+  nsCOMPtr<nsIOutputStream> reply = new UDPOutputStream(this, netAddr);
+  aMessages.AppendElement(new UDPMessageProxy(&netAddr, reply, data));
+  return true;
 }
 
 void nsUDPSocket::OnSocketDetached(PRFileDesc* fd) {
@@ -457,10 +570,11 @@ void nsUDPSocket::OnSocketDetached(PRFileDesc* fd) {
     NS_ASSERTION(mFD == fd, "wrong file descriptor");
     CloseSocket();
   }
+  mRecvBuffers = nullptr;
 
   if (mListener) {
     // need to atomically clear mListener.  see our Close() method.
-    RefPtr<nsIUDPSocketListener> listener = nullptr;
+    RefPtr<UDPListenerProxy> listener = nullptr;
     {
       MutexAutoLock lock(mLock);
       listener = mListener.forget();
@@ -762,7 +876,7 @@ namespace {
 //-----------------------------------------------------------------------------
 // SocketListenerProxy
 //-----------------------------------------------------------------------------
-class SocketListenerProxy final : public nsIUDPSocketListener {
+class SocketListenerProxy final : public UDPListenerProxy {
   ~SocketListenerProxy() = default;
 
  public:
@@ -774,22 +888,26 @@ class SocketListenerProxy final : public nsIUDPSocketListener {
   NS_DECL_THREADSAFE_ISUPPORTS
   NS_DECL_NSIUDPSOCKETLISTENER
 
-  class OnPacketReceivedRunnable : public Runnable {
+  nsresult OnPacketsReceived(
+      nsIUDPSocket* aSocket,
+      nsTArray<nsCOMPtr<nsIUDPMessage>>&& aMessages) override;
+
+  class OnPacketsReceivedRunnable : public Runnable {
    public:
-    OnPacketReceivedRunnable(
+    OnPacketsReceivedRunnable(
         const nsMainThreadPtrHandle<nsIUDPSocketListener>& aListener,
-        nsIUDPSocket* aSocket, nsIUDPMessage* aMessage)
-        : Runnable("net::SocketListenerProxy::OnPacketReceivedRunnable"),
+        nsIUDPSocket* aSocket, nsTArray<nsCOMPtr<nsIUDPMessage>>&& aMessages)
+        : Runnable("net::SocketListenerProxy::OnPacketsReceivedRunnable"),
           mListener(aListener),
           mSocket(aSocket),
-          mMessage(aMessage) {}
+          mMessages(std::move(aMessages)) {}
 
     NS_DECL_NSIRUNNABLE
 
    private:
     nsMainThreadPtrHandle<nsIUDPSocketListener> mListener;
     nsCOMPtr<nsIUDPSocket> mSocket;
-    nsCOMPtr<nsIUDPMessage> mMessage;
+    nsTArray<nsCOMPtr<nsIUDPMessage>> mMessages;
   };
 
   class OnStopListeningRunnable : public Runnable {
@@ -820,8 +938,15 @@ NS_IMPL_ISUPPORTS(SocketListenerProxy, nsIUDPSocketListener)
 NS_IMETHODIMP
 SocketListenerProxy::OnPacketReceived(nsIUDPSocket* aSocket,
                                       nsIUDPMessage* aMessage) {
-  RefPtr<OnPacketReceivedRunnable> r =
-      new OnPacketReceivedRunnable(mListener, aSocket, aMessage);
+  nsTArray<nsCOMPtr<nsIUDPMessage>> messages;
+  messages.AppendElement(aMessage);
+  return OnPacketsReceived(aSocket, std::move(messages));
+}
+
+nsresult SocketListenerProxy::OnPacketsReceived(
+    nsIUDPSocket* aSocket, nsTArray<nsCOMPtr<nsIUDPMessage>>&& aMessages) {
+  RefPtr<OnPacketsReceivedRunnable> r =
+      new OnPacketsReceivedRunnable(mListener, aSocket, std::move(aMessages));
   return mTarget->Dispatch(r, NS_DISPATCH_NORMAL);
 }
 
@@ -833,20 +958,22 @@ SocketListenerProxy::OnStopListening(nsIUDPSocket* aSocket, nsresult aStatus) {
 }
 
 NS_IMETHODIMP
-SocketListenerProxy::OnPacketReceivedRunnable::Run() {
-  NetAddr netAddr;
-  nsCOMPtr<nsINetAddr> nsAddr;
-  mMessage->GetFromAddr(getter_AddRefs(nsAddr));
-  nsAddr->GetNetAddr(&netAddr);
+SocketListenerProxy::OnPacketsReceivedRunnable::Run() {
+  for (const nsCOMPtr<nsIUDPMessage>& proxy : mMessages) {
+    NetAddr netAddr;
+    nsCOMPtr<nsINetAddr> nsAddr;
+    proxy->GetFromAddr(getter_AddRefs(nsAddr));
+    nsAddr->GetNetAddr(&netAddr);
 
-  nsCOMPtr<nsIOutputStream> outputStream;
-  mMessage->GetOutputStream(getter_AddRefs(outputStream));
+    nsCOMPtr<nsIOutputStream> outputStream;
+    proxy->GetOutputStream(getter_AddRefs(outputStream));
 
-  FallibleTArray<uint8_t>& data = mMessage->GetDataAsTArray();
+    FallibleTArray<uint8_t>& data = proxy->GetDataAsTArray();
 
-  nsCOMPtr<nsIUDPMessage> message =
-      new nsUDPMessage(&netAddr, outputStream, data);
-  mListener->OnPacketReceived(mSocket, message);
+    nsCOMPtr<nsIUDPMessage> message =
+        new nsUDPMessage(&netAddr, outputStream, data);
+    mListener->OnPacketReceived(mSocket, message);
+  }
   return NS_OK;
 }
 
@@ -856,7 +983,7 @@ SocketListenerProxy::OnStopListeningRunnable::Run() {
   return NS_OK;
 }
 
-class SocketListenerProxyBackground final : public nsIUDPSocketListener {
+class SocketListenerProxyBackground final : public UDPListenerProxy {
   ~SocketListenerProxyBackground() = default;
 
  public:
@@ -866,22 +993,27 @@ class SocketListenerProxyBackground final : public nsIUDPSocketListener {
   NS_DECL_THREADSAFE_ISUPPORTS
   NS_DECL_NSIUDPSOCKETLISTENER
 
-  class OnPacketReceivedRunnable : public Runnable {
+  nsresult OnPacketsReceived(
+      nsIUDPSocket* aSocket,
+      nsTArray<nsCOMPtr<nsIUDPMessage>>&& aMessages) override;
+
+  class OnPacketsReceivedRunnable : public Runnable {
    public:
-    OnPacketReceivedRunnable(const nsCOMPtr<nsIUDPSocketListener>& aListener,
-                             nsIUDPSocket* aSocket, nsIUDPMessage* aMessage)
+    OnPacketsReceivedRunnable(const nsCOMPtr<nsIUDPSocketListener>& aListener,
+                              nsIUDPSocket* aSocket,
+                              nsTArray<nsCOMPtr<nsIUDPMessage>>&& aMessages)
         : Runnable(
-              "net::SocketListenerProxyBackground::OnPacketReceivedRunnable"),
+              "net::SocketListenerProxyBackground::OnPacketsReceivedRunnable"),
           mListener(aListener),
           mSocket(aSocket),
-          mMessage(aMessage) {}
+          mMessages(std::move(aMessages)) {}
 
     NS_DECL_NSIRUNNABLE
 
    private:
     nsCOMPtr<nsIUDPSocketListener> mListener;
     nsCOMPtr<nsIUDPSocket> mSocket;
-    nsCOMPtr<nsIUDPMessage> mMessage;
+    nsTArray<nsCOMPtr<nsIUDPMessage>> mMessages;
   };
 
   class OnStopListeningRunnable : public Runnable {
@@ -912,8 +1044,15 @@ NS_IMPL_ISUPPORTS(SocketListenerProxyBackground, nsIUDPSocketListener)
 NS_IMETHODIMP
 SocketListenerProxyBackground::OnPacketReceived(nsIUDPSocket* aSocket,
                                                 nsIUDPMessage* aMessage) {
-  RefPtr<OnPacketReceivedRunnable> r =
-      new OnPacketReceivedRunnable(mListener, aSocket, aMessage);
+  nsTArray<nsCOMPtr<nsIUDPMessage>> messages;
+  messages.AppendElement(aMessage);
+  return OnPacketsReceived(aSocket, std::move(messages));
+}
+
+nsresult SocketListenerProxyBackground::OnPacketsReceived(
+    nsIUDPSocket* aSocket, nsTArray<nsCOMPtr<nsIUDPMessage>>&& aMessages) {
+  RefPtr<OnPacketsReceivedRunnable> r =
+      new OnPacketsReceivedRunnable(mListener, aSocket, std::move(aMessages));
   return mTarget->Dispatch(r, NS_DISPATCH_NORMAL);
 }
 
@@ -926,21 +1065,24 @@ SocketListenerProxyBackground::OnStopListening(nsIUDPSocket* aSocket,
 }
 
 NS_IMETHODIMP
-SocketListenerProxyBackground::OnPacketReceivedRunnable::Run() {
-  NetAddr netAddr;
-  nsCOMPtr<nsINetAddr> nsAddr;
-  mMessage->GetFromAddr(getter_AddRefs(nsAddr));
-  nsAddr->GetNetAddr(&netAddr);
+SocketListenerProxyBackground::OnPacketsReceivedRunnable::Run() {
+  for (const nsCOMPtr<nsIUDPMessage>& proxy : mMessages) {
+    NetAddr netAddr;
+    nsCOMPtr<nsINetAddr> nsAddr;
+    proxy->GetFromAddr(getter_AddRefs(nsAddr));
+    nsAddr->GetNetAddr(&netAddr);
 
-  nsCOMPtr<nsIOutputStream> outputStream;
-  mMessage->GetOutputStream(getter_AddRefs(outputStream));
+    nsCOMPtr<nsIOutputStream> outputStream;
+    proxy->GetOutputStream(getter_AddRefs(outputStream));
 
-  FallibleTArray<uint8_t>& data = mMessage->GetDataAsTArray();
+    FallibleTArray<uint8_t>& data = proxy->GetDataAsTArray();
 
-  UDPSOCKET_LOG(("%s [this=%p], len %zu", __FUNCTION__, this, data.Length()));
-  nsCOMPtr<nsIUDPMessage> message =
-      new UDPMessageProxy(&netAddr, outputStream, data);
-  mListener->OnPacketReceived(mSocket, message);
+    UDPSOCKET_LOG(
+        ("%s [this=%p], len %zu", __FUNCTION__, this, data.Length()));
+    nsCOMPtr<nsIUDPMessage> message =
+        new UDPMessageProxy(&netAddr, outputStream, data);
+    mListener->OnPacketReceived(mSocket, message);
+  }
   return NS_OK;
 }
 
@@ -1039,30 +1181,6 @@ PendingSendStream::OnLookupByTypeComplete(nsICancelable* aRequest,
   return NS_OK;
 }
 
-class SendRequestRunnable : public Runnable {
- public:
-  SendRequestRunnable(nsUDPSocket* aSocket, const NetAddr& aAddr,
-                      FallibleTArray<uint8_t>&& aData)
-      : Runnable("net::SendRequestRunnable"),
-        mSocket(aSocket),
-        mAddr(aAddr),
-        mData(std::move(aData)) {}
-
-  NS_DECL_NSIRUNNABLE
-
- private:
-  RefPtr<nsUDPSocket> mSocket;
-  const NetAddr mAddr;
-  FallibleTArray<uint8_t> mData;
-};
-
-NS_IMETHODIMP
-SendRequestRunnable::Run() {
-  uint32_t count;
-  mSocket->SendWithAddress(&mAddr, mData, &count);
-  return NS_OK;
-}
-
 }  // namespace
 
 NS_IMETHODIMP
@@ -1124,44 +1242,149 @@ nsUDPSocket::SendWithAddress(const NetAddr* aAddr,
   NS_ENSURE_ARG(aAddr);
   NS_ENSURE_ARG_POINTER(_retval);
 
-  *_retval = 0;
+  return SendDatagram(*aAddr, aData.Elements(), aData.Length(), _retval);
+}
 
-  PRNetAddr prAddr;
-  NetAddrToPRNetAddr(aAddr, &prAddr);
+nsresult nsUDPSocket::SendDatagram(const NetAddr& aAddr, const uint8_t* aData,
+                                   uint32_t aLength, uint32_t* aCount) {
+  *aCount = 0;
 
   bool onSTSThread = false;
   mSts->IsOnCurrentThread(&onSTSThread);
 
   if (onSTSThread) {
+    PRNetAddr prAddr;
+    NetAddrToPRNetAddr(&aAddr, &prAddr);
+
     MutexAutoLock lock(mLock);
     if (!mFD) {
       // socket is not initialized or has been closed
       return NS_ERROR_FAILURE;
     }
     int32_t count =
-        PR_SendTo(mFD, aData.Elements(), sizeof(uint8_t) * aData.Length(), 0,
-                  &prAddr, PR_INTERVAL_NO_WAIT);
+        PR_SendTo(mFD, aData, aLength, 0, &prAddr, PR_INTERVAL_NO_WAIT);
     if (count < 0) {
       PRErrorCode code = PR_GetError();
       return ErrorAccordingToNSPR(code);
     }
     this->AddOutputBytes(count);
-    *_retval = count;
-  } else {
-    FallibleTArray<uint8_t> fallibleArray;
-    if (!fallibleArray.InsertElementsAt(0, aData, fallible)) {
+    *aCount = count;
+    return NS_OK;
+  }
+
+  // Queue the datagram for the socket thread.  Only the first datagram
+  // queued dispatches a flush; the ones that follow before it runs are sent
+  // along with it.
+  bool dispatch;
+  size_t index;
+  {
+    MutexAutoLock lock(mLock);
+    PendingDatagram* pending = mPendingSends.AppendElement();
+    pending->mAddr = aAddr;
+    if (!pending->mData.AppendElements(aData, aLength, fallible)) {
+      mPendingSends.RemoveLastElement();
       return NS_ERROR_OUT_OF_MEMORY;
     }
+    index = mPendingSends.Length() - 1;
+    dispatch = !mFlushPending;
+    mFlushPending = true;
+  }
 
+  if (dispatch) {
     nsresult rv = mSts->Dispatch(
-        new SendRequestRunnable(this, *aAddr, std::move(fallibleArray)),
+        NewRunnableMethod("net::nsUDPSocket::FlushPendingSends", this,
+                          &nsUDPSocket::FlushPendingSends),
         NS_DISPATCH_NORMAL);
-    NS_ENSURE_SUCCESS(rv, rv);
-    *_retval = aData.Length();
+    if (NS_FAILED(rv)) {
+      // No flush could have taken the queue since ours is the one that
+      // failed, so our datagram is still at |index|.  The ones queued behind
+      // it were accepted and go out with the next flush that dispatches.
+      MutexAutoLock lock(mLock);
+      mPendingSends.RemoveElementAt(index);
+      mFlushPending = false;
+      return rv;
+    }
   }
+
+  *aCount = aLength;
   return NS_OK;
 }
 
+void nsUDPSocket::FlushPendingSends() {
+  MutexAutoLock lock(mLock);
+
+  nsTArray<PendingDatagram> pending;
+  pending.SwapElements(mPendingSends);
+  mFlushPending = false;
+  if (!mFD) {
+    return;
+  }
+
+  uint32_t index = 0;
+  while (index < pending.Length()) {
+#ifdef UDP_USE_MMSG
+    if (!sMmsgUnsupported) {
+      // Batch the run of datagrams from here on whose destinations the
+      // socket can take without NSPR's help.
+      PRNetAddr to[UDP_SEND_BATCH];
+      struct iovec iov[UDP_SEND_BATCH];
+      struct mmsghdr msgs[UDP_SEND_BATCH];
+      uint32_t batch = 0;
+      while (batch < UDP_SEND_BATCH && index + batch < pending.Length()) {
+        PendingDatagram& datagram = pending[index + batch];
+        if (datagram.mAddr.raw.family != mAddr.raw.family) {
+          break;
+        }
+        NetAddrToPRNetAddr(&datagram.mAddr, &to[batch]);
+        iov[batch].iov_base = datagram.mData.Elements();
+        iov[batch].iov_len = datagram.mData.Length();
+        memset(&msgs[batch], 0, sizeof(msgs[batch]));
+        msgs[batch].msg_hdr.msg_name = &to[batch];
+        msgs[batch].msg_hdr.msg_namelen = NativeAddrLength(to[batch]);
+        msgs[batch].msg_hdr.msg_iov = &iov[batch];
+        msgs[batch].msg_hdr.msg_iovlen = 1;
+        ++batch;
+      }
+
+      if (batch > 1) {
+        int sent = sendmmsg(PR_FileDesc2NativeHandle(mFD), msgs, batch,
+                            MSG_DONTWAIT);
+        if (sent < 0 && errno == ENOSYS) {
+          sMmsgUnsupported = true;
+        } else if (sent > 0) {
+          // sendmmsg goes around the IOActivityMonitor layer.
+          bool monitor = IOActivityMonitor::IsActive();
+          for (int i = 0; i < sent; ++i) {
+            AddOutputBytes(msgs[i].msg_len);
+            if (monitor) {
+              IOActivityMonitor::Write(mFD, msgs[i].msg_len);
+            }
+          }
+          index += sent;
+          continue;
+        }
+        // Otherwise the first datagram failed; PR_SendTo below reports why.
+      }
+    }
+#endif
+
+    PendingDatagram& datagram = pending[index++];
+    PRNetAddr prAddr;
+    NetAddrToPRNetAddr(&datagram.mAddr, &prAddr);
+    int32_t count =
+        PR_SendTo(mFD, datagram.mData.Elements(), datagram.mData.Length(), 0,
+                  &prAddr, PR_INTERVAL_NO_WAIT);
+    if (count < 0) {
+      UDPSOCKET_LOG(
+          ("nsUDPSocket::FlushPendingSends: PR_SendTo failed err=%d "
+           "[this=%p]\n",
+           PR_GetError(), this));
+      continue;
+    }
+    AddOutputBytes(count);
+  }
+}
+
 NS_IMETHODIMP
 nsUDPSocket::SendBinaryStream(const nsACString& aHost, uint16_t aPort,
                               nsIInputStream* aStream) {
@@ -1179,11 +1402,7 @@ nsUDPSocket::SendBinaryStreamWithAddress(const NetAddr* aAddr,
   NS_ENSURE_ARG(aAddr);
   NS_ENSURE_ARG(aStream);
 
-  PRNetAddr prAddr;
-  PR_InitializeNetAddr(PR_IpAddrAny, 0, &prAddr);
-  NetAddrToPRNetAddr(aAddr, &prAddr);
-
-  RefPtr<nsUDPOutputStream> os = new nsUDPOutputStream(this, mFD, prAddr);
+  nsCOMPtr<nsIOutputStream> os = new UDPOutputStream(this, *aAddr);
   return NS_AsyncCopy(aStream, os, mSts, NS_ASYNCCOPY_VIA_READSEGMENTS,
                       UDP_PACKET_CHUNK_SIZE);
 }
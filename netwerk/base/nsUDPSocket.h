@@ -8,16 +8,20 @@
 
 #include "nsIUDPSocket.h"
 #include "mozilla/Mutex.h"
+#include "mozilla/UniquePtr.h"
 #include "mozilla/net/DNS.h"
 #include "nsIOutputStream.h"
 #include "nsAutoPtr.h"
 #include "nsCycleCollectionParticipant.h"
+#include "nsTArray.h"
 
 //-----------------------------------------------------------------------------
 
 namespace mozilla {
 namespace net {
 
+class UDPListenerProxy;
+
 class nsUDPSocket final : public nsASocketHandler, public nsIUDPSocket {
  public:
   NS_DECL_THREADSAFE_ISUPPORTS
@@ -33,6 +37,11 @@ class nsUDPSocket final : public nsASocketHandler, public nsIUDPSocket {
 
   void AddOutputBytes(uint64_t aBytes);
 
+  // Sends |aLength| bytes to |aAddr| as one datagram.  Off the socket thread
+  // the datagram is queued, and *aCount is set to |aLength| once it is.
+  nsresult SendDatagram(const NetAddr& aAddr, const uint8_t* aData,
+                        uint32_t aLength, uint32_t* aCount);
+
   nsUDPSocket();
 
  private:
@@ -54,19 +63,45 @@ class nsUDPSocket final : public nsASocketHandler, public nsIUDPSocket {
 
   void CloseSocket();
 
+  // Reads the datagrams queued on the socket, up to a batch, and appends a
+  // message for each of them to |aMessages|.
+  void ReadDatagrams(nsTArray<nsCOMPtr<nsIUDPMessage>>& aMessages);
+  bool AppendDatagram(const PRNetAddr& aFrom, const char* aData,
+                      uint32_t aLength,
+                      nsTArray<nsCOMPtr<nsIUDPMessage>>& aMessages);
+
+  // Sends the datagrams queued by SendWithAddress off the socket thread.
+  void FlushPendingSends();
+
+  struct PendingDatagram {
+    NetAddr mAddr;
+    FallibleTArray<uint8_t> mData;
+  };
+
   // lock protects access to mListener;
   // so mListener is not cleared while being used/locked.
+  // It also protects mPendingSends.
   Mutex mLock;
   PRFileDesc* mFD;
   NetAddr mAddr;
   OriginAttributes mOriginAttributes;
-  nsCOMPtr<nsIUDPSocketListener> mListener;
+  RefPtr<UDPListenerProxy> mListener;
   nsCOMPtr<nsIEventTarget> mListenerTarget;
   bool mAttached;
   RefPtr<nsSocketTransportService> mSts;
 
   uint64_t mByteReadCount;
   uint64_t mByteWriteCount;
+
+  // Scratch space for reading a batch of datagrams, allocated on the first
+  // read and released when the socket is detached.  Socket thread only.
+  UniquePtr<char[]> mRecvBuffers;
+
+  // Datagrams sent from other threads; one runnable sends all that queued
+  // up before it ran.
+  nsTArray<PendingDatagram> mPendingSends;
+  // Whether that runnable was dispatched and has not taken the queue yet.
+  bool mFlushPending;
 };
 
 //-----------------------------------------------------------------------------
@@ -89,25 +124,6 @@ class nsUDPMessage : public nsIUDPMessage {
   JS::Heap<JSObject*> mJsobj;
 };
 
-//-----------------------------------------------------------------------------
-
-class nsUDPOutputStream : public nsIOutputStream {
- public:
-  NS_DECL_THREADSAFE_ISUPPORTS
-  NS_DECL_NSIOUTPUTSTREAM
-
-  nsUDPOutputStream(nsUDPSocket* aSocket, PRFileDesc* aFD,
-                    PRNetAddr& aPrClientAddr);
-
- private:
-  virtual ~nsUDPOutputStream() = default;
-
-  RefPtr<nsUDPSocket> mSocket;
-  PRFileDesc* mFD;
-  PRNetAddr mPrClientAddr;
-  bool mIsClosed;
-};
-
 }  // namespace net
 }  // namespace mozilla
 
@@ -152,6 +152,7 @@ nsresult NS_NewStreamConv(nsStreamConverterService** aStreamConv);
 #define COMPRESS_TO_UNCOMPRESSED "?from=compress&to=uncompressed"
 #define XCOMPRESS_TO_UNCOMPRESSED "?from=x-compress&to=uncompressed"
 #define DEFLATE_TO_UNCOMPRESSED "?from=deflate&to=uncompressed"
+#define ZSTD_TO_UNCOMPRESSED "?from=zstd&to=uncompressed"
 
 static const mozilla::Module::CategoryEntry kNeckoCategories[] = {
     {NS_ISTREAMCONVERTER_KEY, FTP_TO_INDEX, ""},
@@ -166,6 +167,9 @@ static const mozilla::Module::CategoryEntry kNeckoCategories[] = {
     {NS_ISTREAMCONVERTER_KEY, COMPRESS_TO_UNCOMPRESSED, ""},
     {NS_ISTREAMCONVERTER_KEY, XCOMPRESS_TO_UNCOMPRESSED, ""},
     {NS_ISTREAMCONVERTER_KEY, DEFLATE_TO_UNCOMPRESSED, ""},
+#ifdef MOZ_ZSTD
+    {NS_ISTREAMCONVERTER_KEY, ZSTD_TO_UNCOMPRESSED, ""},
+#endif
     NS_BINARYDETECTOR_CATEGORYENTRY,
     {nullptr}};
 
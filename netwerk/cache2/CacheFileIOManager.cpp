@@ -15,6 +15,9 @@
 #include "CacheObserver.h"
 #include "nsIFile.h"
 #include "CacheFileContextEvictor.h"
+#if defined(XP_LINUX)
+#  include "CacheFileIOUring.h"
+#endif
 #include "nsITimer.h"
 #include "nsISimpleEnumerator.h"
 #include "nsIDirectoryEnumerator.h"
@@ -24,6 +27,7 @@
 #include "mozilla/net/MozURL.h"
 #include "mozilla/Telemetry.h"
 #include "mozilla/DebugOnly.h"
+#include "mozilla/EndianUtils.h"
 #include "mozilla/Services.h"
 #include "nsDirectoryServiceUtils.h"
 #include "nsAppDirectoryServiceDefs.h"
@@ -34,6 +38,7 @@
 
 // include files for ftruncate (or equivalent)
 #if defined(XP_UNIX)
+#  include <errno.h>
 #  include <unistd.h>
 #elif defined(XP_WIN)
 #  include <windows.h>
@@ -47,6 +52,8 @@ namespace mozilla {
 namespace net {
 
 #define kOpenHandlesLimit 128
+// At most this many open handles can be pinned by parallel reads.
+#define kMaxPinnedHandles (kOpenHandlesLimit / 2)
 #define kMetadataWriteDelay 5000
 #define kRemoveTrashStartDelay 60000    // in milliseconds
 #define kSmartSizeUpdateInterval 60000  // in milliseconds
@@ -122,6 +129,8 @@ CacheFileHandle::CacheFileHandle(const SHA1Sum::Hash* aHash, bool aPriority,
       mDoomWhenFoundNonPinned(false),
       mKilled(false),
       mPinning(aPinning),
+      mParallelReads(0),
+      mReleaseAfterParallelReads(false),
       mFileSize(-1),
       mFD(nullptr) {
   // If we initialize mDoomed in the initialization list, that initialization is
@@ -147,6 +156,8 @@ CacheFileHandle::CacheFileHandle(const nsACString& aKey, bool aPriority,
       mDoomWhenFoundNonPinned(false),
       mKilled(false),
       mPinning(aPinning),
+      mParallelReads(0),
+      mReleaseAfterParallelReads(false),
       mFileSize(-1),
       mFD(nullptr),
       mKey(aKey) {
@@ -678,7 +689,10 @@ class ReadEvent : public Runnable, public IOPerfReportEvent {
         mOffset(aOffset),
         mBuf(aBuf),
         mCount(aCount),
-        mCallback(aCallback) {
+        mCallback(aCallback),
+        mPhase(eOnIOThread),
+        mFD(nullptr),
+        mResult(NS_OK) {
     if (!mHandle->IsSpecialFile()) {
       Start(CacheFileIOManager::gInstance->mIOThread);
     }
@@ -691,13 +705,79 @@ class ReadEvent : public Runnable, public IOPerfReportEvent {
   NS_IMETHOD Run() override {
     nsresult rv;
 
+    if (mPhase == eOnReadThread || mPhase == eOnRingThread) {
+      // Second run, on a parallel read thread or on the io_uring completion
+      // thread.  The descriptor has been pinned by PrepareParallelRead() on
+      // the IO thread.  Only the read itself happens here, the result goes
+      // back to the IO thread, which owns the handle bookkeeping and where
+      // listeners expect OnDataRead.
+      if (mPhase == eOnReadThread) {
+        mResult = CacheFileIOManager::ParallelReadInternal(mFD, mOffset,
+                                                           mBuf, mCount);
+      }
+      mPhase = eCompleted;
+      rv = mIOThread->Dispatch(this, mHandle->IsPriority()
+                                         ? CacheIOThread::READ_PRIORITY
+                                         : CacheIOThread::READ);
+      // The IO thread outlives the read threads and the ring.
+      MOZ_RELEASE_ASSERT(NS_SUCCEEDED(rv));
+      return NS_OK;
+    }
+
+    if (mPhase == eCompleted) {
+      CacheFileIOManager::gInstance->FinishParallelRead(mHandle);
+      if (NS_SUCCEEDED(mResult)) {
+        Report(mIOThread);
+      }
+      mIOThread = nullptr;
+
+      mCallback->OnDataRead(mHandle, mBuf, mResult);
+      return NS_OK;
+    }
+
     if (mHandle->IsClosed() || (mCallback && mCallback->IsKilled())) {
       rv = NS_ERROR_NOT_INITIALIZED;
     } else {
-      rv = CacheFileIOManager::gInstance->ReadInternal(mHandle, mOffset, mBuf,
-                                                       mCount);
+      RefPtr<CacheFileIOManager> ioMan = CacheFileIOManager::gInstance;
+      if (ioMan->CanReadInParallel(mHandle) &&
+          NS_SUCCEEDED(ioMan->PrepareParallelRead(mHandle))) {
+        mIOThread = ioMan->mIOThread;
+        mFD = mHandle->mFD;
+
+#if defined(XP_LINUX)
+        if (ioMan->mIOUring) {
+          mPhase = eOnRingThread;
+          rv = ioMan->mIOUring->Read(PR_FileDesc2NativeHandle(mFD),
+                                     mOffset, mBuf, mCount, &mResult, this);
+          if (NS_SUCCEEDED(rv)) {
+            ioMan->ScheduleIOUringSubmit(mHandle->IsPriority()
+                                             ? CacheIOThread::READ_PRIORITY
+                                             : CacheIOThread::READ);
+            return NS_OK;
+          }
+        }
+#endif
+
+        nsCOMPtr<nsIEventTarget> target = ioMan->ParallelReadTarget(mHandle);
+        if (target) {
+          mPhase = eOnReadThread;
+          rv = target->Dispatch(this, nsIEventTarget::DISPATCH_NORMAL);
+          if (NS_SUCCEEDED(rv)) {
+            return NS_OK;
+          }
+        }
+
+        // The ring is full or the read threads are gone (shutdown), read
+        // here instead.
+        mPhase = eOnIOThread;
+        mIOThread = nullptr;
+        mFD = nullptr;
+        ioMan->FinishParallelRead(mHandle);
+      }
+
+      rv = ioMan->ReadInternal(mHandle, mOffset, mBuf, mCount);
       if (NS_SUCCEEDED(rv)) {
-        Report(CacheFileIOManager::gInstance->mIOThread);
+        Report(ioMan->mIOThread);
       }
     }
 
@@ -711,6 +791,15 @@ class ReadEvent : public Runnable, public IOPerfReportEvent {
   char* mBuf;
   int32_t mCount;
   nsCOMPtr<CacheFileIOListener> mCallback;
+  // Where the next Run() happens.
+  enum { eOnIOThread, eOnReadThread, eOnRingThread, eCompleted } mPhase;
+  // Descriptor pinned for the parallel read.  The handle's mFD is only
+  // touched on the IO thread.
+  PRFileDesc* mFD;
+  // Result of the parallel read.
+  nsresult mResult;
+  // Where the parallel read completes, also used for the stats report.
+  RefPtr<CacheIOThread> mIOThread;
 };
 
 class WriteEvent : public Runnable, public IOPerfReportEvent {
@@ -1122,6 +1211,10 @@ NS_IMPL_ISUPPORTS(CacheFileIOManager, nsITimerCallback, nsINamed)
 
 CacheFileIOManager::CacheFileIOManager()
     : mShuttingDown(false),
+#if defined(XP_LINUX)
+      mIOUringSubmitLevel(CacheIOThread::LAST_LEVEL),
+#endif
+      mPinnedHandles(0),
       mTreeCreated(false),
       mTreeCreationFailed(false),
       mOverLimitEvicting(false),
@@ -1163,6 +1256,28 @@ nsresult CacheFileIOManager::InitInternal() {
   MOZ_ASSERT(NS_SUCCEEDED(rv), "Can't create background thread");
   NS_ENSURE_SUCCESS(rv, rv);
 
+#if defined(XP_UNIX)
+  // Parallel reads rely on positional reads (pread), see
+  // ParallelReadInternal().
+  uint32_t readThreads = std::min(CacheObserver::ParallelReadThreads(), 16U);
+  for (uint32_t i = 0; i < readThreads; ++i) {
+    nsCOMPtr<nsIThread> thread;
+    rv = NS_NewNamedThread(nsPrintfCString("Cache Read #%u", i + 1),
+                           getter_AddRefs(thread));
+    if (NS_WARN_IF(NS_FAILED(rv))) {
+      // Reads of handles mapped to missing threads run on the IO thread.
+      break;
+    }
+    mReadThreads.AppendElement(thread);
+  }
+#endif
+
+#if defined(XP_LINUX)
+  if (CacheObserver::UseIOUring()) {
+    mIOUring = CacheFileIOUring::Create();
+  }
+#endif
+
   mStartTime = TimeStamp::NowLoRes();
 
   return NS_OK;
@@ -1184,6 +1299,18 @@ nsresult CacheFileIOManager::Shutdown() {
 
   ShutdownMetadataWriteScheduling();
 
+  // Let the pending parallel reads finish (and unpin their descriptors)
+  // before the IO thread closes all handles.  Reads posted after this point
+  // fail to dispatch and run on the IO thread.
+  for (auto& thread : gInstance->mReadThreads) {
+    thread->Shutdown();
+  }
+#if defined(XP_LINUX)
+  if (gInstance->mIOUring) {
+    gInstance->mIOUring->Shutdown();
+  }
+#endif
+
   RefPtr<ShutdownEvent> ev = new ShutdownEvent();
   ev->PostAndWait();
 
@@ -1194,6 +1321,11 @@ nsresult CacheFileIOManager::Shutdown() {
     gInstance->mIOThread->Shutdown();
   }
 
+  gInstance->mReadThreads.Clear();
+#if defined(XP_LINUX)
+  gInstance->mIOUring = nullptr;
+#endif
+
   CacheIndex::Shutdown();
 
   if (CacheObserver::ClearCacheOnShutdown()) {
@@ -2317,6 +2449,14 @@ nsresult CacheFileIOManager::MaybeReleaseNSPRHandleInternal(
 
   MOZ_ASSERT(CacheFileIOManager::IsOnIOThreadOrCeased());
 
+  if (aHandle->mFD && aHandle->mParallelReads) {
+    // A read thread is using the descriptor, FinishParallelRead() releases
+    // it once the last read is back on the IO thread.
+    LOG(("  parallel reads pending, release deferred"));
+    aHandle->mReleaseAfterParallelReads = true;
+    return NS_OK;
+  }
+
   if (aHandle->mFD) {
     DebugOnly<bool> found;
     found = mHandlesByLastUsed.RemoveElement(aHandle);
@@ -3922,9 +4062,17 @@ nsresult CacheFileIOManager::OpenNSPRHandle(CacheFileHandle* aHandle,
   nsresult rv;
 
   if (mHandlesByLastUsed.Length() == kOpenHandlesLimit) {
-    // close handle that hasn't been used for the longest time
-    rv = MaybeReleaseNSPRHandleInternal(mHandlesByLastUsed[0], true);
-    NS_ENSURE_SUCCESS(rv, rv);
+    // close handle that hasn't been used for the longest time, skipping
+    // handles pinned by parallel reads.  PrepareParallelRead() pins at most
+    // kMaxPinnedHandles, so there always is one that can be closed.
+    for (uint32_t i = 0; i < mHandlesByLastUsed.Length(); ++i) {
+      if (!mHandlesByLastUsed[i]->mParallelReads) {
+        rv = MaybeReleaseNSPRHandleInternal(mHandlesByLastUsed[i], true);
+        NS_ENSURE_SUCCESS(rv, rv);
+        break;
+      }
+    }
+    MOZ_ASSERT(mHandlesByLastUsed.Length() < kOpenHandlesLimit);
   }
 
   if (aCreate) {
@@ -4012,6 +4160,167 @@ void CacheFileIOManager::NSPRHandleUsed(CacheFileHandle* aHandle) {
   mHandlesByLastUsed.AppendElement(aHandle);
 }
 
+bool CacheFileIOManager::CanReadInParallel(CacheFileHandle* aHandle) {
+  MOZ_ASSERT(CacheFileIOManager::IsOnIOThread());
+
+  // Special files (index, journal) are read rarely and their readers
+  // expect to be called back on the IO thread.
+  if (aHandle->IsSpecialFile() || mShuttingDown) {
+    return false;
+  }
+
+#if defined(XP_LINUX)
+  if (mIOUring) {
+    return true;
+  }
+#endif
+
+  return !mReadThreads.IsEmpty();
+}
+
+already_AddRefed<nsIEventTarget> CacheFileIOManager::ParallelReadTarget(
+    CacheFileHandle* aHandle) {
+  MOZ_ASSERT(CacheFileIOManager::IsOnIOThread());
+
+  if (mReadThreads.IsEmpty()) {
+    return nullptr;
+  }
+
+  // The hash is uniformly distributed, use its first word for affinity.
+  uint32_t index =
+      NetworkEndian::readUint32(aHandle->Hash()) % mReadThreads.Length();
+  nsCOMPtr<nsIEventTarget> target = mReadThreads[index];
+  return target.forget();
+}
+
+nsresult CacheFileIOManager::PrepareParallelRead(CacheFileHandle* aHandle) {
+  LOG(("CacheFileIOManager::PrepareParallelRead() [handle=%p]", aHandle));
+
+  MOZ_ASSERT(CacheFileIOManager::IsOnIOThread());
+
+  nsresult rv;
+
+  if (CacheObserver::ShuttingDown() || !aHandle->mFileExists) {
+    // Let ReadInternal() produce the error.
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  if (!aHandle->mParallelReads && mPinnedHandles >= kMaxPinnedHandles) {
+    // Keep enough unpinned descriptors for OpenNSPRHandle() to stay within
+    // kOpenHandlesLimit, the read happens on the IO thread instead.
+    LOG(("  too many pinned handles"));
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  if (!aHandle->mFD) {
+    rv = OpenNSPRHandle(aHandle);
+    if (NS_FAILED(rv)) {
+      return rv;
+    }
+  } else {
+    NSPRHandleUsed(aHandle);
+  }
+
+  // OpenNSPRHandle could figure out the file was gone.
+  if (!aHandle->mFileExists || !aHandle->mFD) {
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  if (!aHandle->mParallelReads++) {
+    ++mPinnedHandles;
+  }
+  return NS_OK;
+}
+
+// static
+nsresult CacheFileIOManager::ParallelReadInternal(PRFileDesc* aFD,
+                                                  int64_t aOffset, char* aBuf,
+                                                  int32_t aCount) {
+  LOG(("CacheFileIOManager::ParallelReadInternal() [fd=%p, offset=%" PRId64
+       ", count=%d]",
+       aFD, aOffset, aCount));
+
+#if defined(XP_UNIX)
+  // The IO thread may seek and write the same descriptor concurrently, a
+  // positional read doesn't touch the file offset.
+  int fd = PR_FileDesc2NativeHandle(aFD);
+  int32_t bytesRead = 0;
+  while (bytesRead < aCount) {
+    ssize_t rv = pread(fd, aBuf + bytesRead, aCount - bytesRead,
+                       aOffset + bytesRead);
+    if (rv < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rv <= 0) {
+      return NS_ERROR_FAILURE;
+    }
+    bytesRead += rv;
+  }
+
+  return NS_OK;
+#else
+  MOZ_ASSERT_UNREACHABLE("Parallel reads need positional I/O");
+  return NS_ERROR_NOT_IMPLEMENTED;
+#endif
+}
+
+void CacheFileIOManager::FinishParallelRead(CacheFileHandle* aHandle) {
+  MOZ_ASSERT(CacheFileIOManager::IsOnIOThreadOrCeased());
+  MOZ_ASSERT(aHandle->mParallelReads);
+
+  if (--aHandle->mParallelReads) {
+    return;
+  }
+
+  MOZ_ASSERT(mPinnedHandles);
+  --mPinnedHandles;
+
+  if (!aHandle->mReleaseAfterParallelReads) {
+    return;
+  }
+
+  // The descriptor was asked to be released while we were reading, possibly
+  // by CloseHandleInternal().  Release it even when the handle is closed by
+  // now, nothing else would close the descriptor and remove the handle from
+  // mHandlesByLastUsed.
+  LOG(("CacheFileIOManager::FinishParallelRead() - deferred release "
+       "[handle=%p]",
+       aHandle));
+  aHandle->mReleaseAfterParallelReads = false;
+  MaybeReleaseNSPRHandleInternal(aHandle);
+}
+
+#if defined(XP_LINUX)
+void CacheFileIOManager::ScheduleIOUringSubmit(uint32_t aLevel) {
+  MOZ_ASSERT(CacheFileIOManager::IsOnIOThread());
+
+  // The event runs after the reads already pending at |aLevel|, so that
+  // they are all submitted together.  A read of a higher priority than the
+  // pending event needs an event of its own to not wait for lower levels.
+  if (aLevel >= mIOUringSubmitLevel) {
+    return;
+  }
+
+  nsCOMPtr<nsIRunnable> ev =
+      NewRunnableMethod("net::CacheFileIOManager::SubmitIOUringReads", this,
+                        &CacheFileIOManager::SubmitIOUringReads);
+  nsresult rv = mIOThread->Dispatch(ev, aLevel);
+  if (NS_FAILED(rv)) {
+    // Shutting down, CacheFileIOUring::Shutdown() submits what is queued.
+    return;
+  }
+
+  mIOUringSubmitLevel = aLevel;
+}
+
+void CacheFileIOManager::SubmitIOUringReads() {
+  MOZ_ASSERT(CacheFileIOManager::IsOnIOThread());
+
+  mIOUringSubmitLevel = CacheIOThread::LAST_LEVEL;
+  mIOUring->Submit();
+}
+#endif
+
 nsresult CacheFileIOManager::SyncRemoveDir(nsIFile* aFile, const char* aDir) {
   nsresult rv;
   nsCOMPtr<nsIFile> file;
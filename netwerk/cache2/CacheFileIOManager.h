@@ -33,6 +33,7 @@ namespace net {
 
 class CacheFile;
 class CacheFileIOListener;
+class CacheFileIOUring;
 
 #ifdef DEBUG_HANDLES
 class CacheFileHandlesEntry;
@@ -121,6 +122,14 @@ class CacheFileHandle final : public nsISupports {
   // unchanged afterwards. This status is only accessed on the IO thread.
   PinningStatus mPinning;
 
+  // Number of reads of this handle currently in flight on one of the
+  // parallel read threads.  While non-zero the NSPR handle must stay open.
+  // Only accessed on the IO thread, reads complete there.
+  uint32_t mParallelReads;
+  // Raised when the NSPR handle was asked to be released while parallel
+  // reads were in flight.  The last read to finish releases it.
+  bool mReleaseAfterParallelReads;
+
   nsCOMPtr<nsIFile> mFile;
   int64_t mFileSize;
   PRFileDesc* mFD;  // if null then the file doesn't exists on the disk
@@ -416,6 +425,35 @@ class CacheFileIOManager final : public nsITimerCallback, public nsINamed {
   nsresult OpenNSPRHandle(CacheFileHandle* aHandle, bool aCreate = false);
   void NSPRHandleUsed(CacheFileHandle* aHandle);
 
+  // Parallel reads.  Data reads of regular entry files are handed from the
+  // IO thread to one of mReadThreads, selected by the entry hash so that
+  // reads of a single handle stay ordered.  The IO thread still does all
+  // the bookkeeping (opening the NSPR handle, the LRU of open handles) and
+  // pins the descriptor for the duration of the read; the read itself uses
+  // positional I/O so it doesn't interfere with writes on the IO thread.
+  // Everything else (opens, dooms, index and eviction work) stays
+  // serialized on the IO thread.
+  //
+  // On Linux the reads can instead be submitted to an io_uring (see
+  // CacheFileIOUring).  Either way the completed read is posted back to
+  // the IO thread, FinishParallelRead() unpins the descriptor there and the
+  // listener is called.
+  //
+  // Reads queued to the ring are submitted together by an event posted
+  // after the read events pending on the IO thread, see
+  // ScheduleIOUringSubmit().
+  bool CanReadInParallel(CacheFileHandle* aHandle);
+  already_AddRefed<nsIEventTarget> ParallelReadTarget(
+      CacheFileHandle* aHandle);
+  nsresult PrepareParallelRead(CacheFileHandle* aHandle);
+  static nsresult ParallelReadInternal(PRFileDesc* aFD, int64_t aOffset,
+                                       char* aBuf, int32_t aCount);
+  void FinishParallelRead(CacheFileHandle* aHandle);
+#if defined(XP_LINUX)
+  void ScheduleIOUringSubmit(uint32_t aLevel);
+  void SubmitIOUringReads();
+#endif
+
   // Removing all cache files during shutdown
   nsresult SyncRemoveDir(nsIFile* aFile, const char* aDir);
   void SyncRemoveAllCacheFiles();
@@ -443,6 +481,18 @@ class CacheFileIOManager final : public nsITimerCallback, public nsINamed {
   // procedure.
   bool mShuttingDown;
   RefPtr<CacheIOThread> mIOThread;
+  // Created on init and only shut down (not removed) until the manager is
+  // shut down, so that the IO thread can read the array without a lock.
+  nsTArray<nsCOMPtr<nsIThread>> mReadThreads;
+#if defined(XP_LINUX)
+  // Same lifetime rules as mReadThreads.
+  RefPtr<CacheFileIOUring> mIOUring;
+  // Level of the pending SubmitIOUringReads() event, LAST_LEVEL when there
+  // is none.  IO thread only.
+  uint32_t mIOUringSubmitLevel;
+#endif
+  // Number of handles with parallel reads in flight, IO thread only.
+  uint32_t mPinnedHandles;
   nsCOMPtr<nsIFile> mCacheDirectory;
 #if defined(MOZ_WIDGET_ANDROID)
   // On Android we add the active profile directory name between the path
@@ -0,0 +1,375 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "CacheLog.h"
+#include "CacheFileIOUring.h"
+
+#include "nsIRunnable.h"
+#include "nsThreadUtils.h"
+#include "mozilla/IntegerPrintfMacros.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__has_include)
+#  if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#    include <linux/io_uring.h>
+#    define CACHE_HAVE_IO_URING 1
+#  endif
+#endif
+
+namespace mozilla {
+namespace net {
+
+#ifdef CACHE_HAVE_IO_URING
+
+// Ring size.  The CacheIOThread never has many reads pending at once, when
+// the ring is full reads fall back to the other paths.
+static const uint32_t kRingEntries = 64;
+
+// user_data of the no-op used to wake the completion thread up on shutdown.
+static const uint64_t kWakeUpUserData = 0;
+
+struct CacheFileIOUring::Request {
+  int mFD;
+  int64_t mOffset;
+  char* mBuf;
+  int32_t mCount;
+  int32_t mDone;
+  struct iovec mIOVec;
+  nsresult* mResult;
+  nsCOMPtr<nsIRunnable> mCompletion;
+};
+
+CacheFileIOUring::CacheFileIOUring()
+    : mLock("CacheFileIOUring.mLock"),
+      mRingFD(-1),
+      mEntries(0),
+      mInFlight(0),
+      mShutdown(false),
+      mSQRing(MAP_FAILED),
+      mSQRingSize(0),
+      mCQRing(MAP_FAILED),
+      mCQRingSize(0),
+      mSQEs(static_cast<io_uring_sqe*>(MAP_FAILED)),
+      mSQEsSize(0),
+      mSQHead(nullptr),
+      mSQTail(nullptr),
+      mSQMask(nullptr),
+      mSQArray(nullptr),
+      mCQHead(nullptr),
+      mCQTail(nullptr),
+      mCQMask(nullptr),
+      mCQEs(nullptr) {}
+
+CacheFileIOUring::~CacheFileIOUring() {
+  MOZ_ASSERT(!mInFlight);
+
+  if (mSQEs != MAP_FAILED) {
+    munmap(mSQEs, mSQEsSize);
+  }
+  if (mCQRing != MAP_FAILED && mCQRing != mSQRing) {
+    munmap(mCQRing, mCQRingSize);
+  }
+  if (mSQRing != MAP_FAILED) {
+    munmap(mSQRing, mSQRingSize);
+  }
+  if (mRingFD != -1) {
+    close(mRingFD);
+  }
+}
+
+// static
+already_AddRefed<CacheFileIOUring> CacheFileIOUring::Create() {
+  RefPtr<CacheFileIOUring> ring = new CacheFileIOUring();
+  nsresult rv = ring->Init();
+  if (NS_FAILED(rv)) {
+    LOG(("CacheFileIOUring::Create() - io_uring not available [rv=0x%08" PRIx32
+         "]",
+         static_cast<uint32_t>(rv)));
+    return nullptr;
+  }
+
+  return ring.forget();
+}
+
+nsresult CacheFileIOUring::Init() {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  mRingFD = syscall(__NR_io_uring_setup, kRingEntries, &params);
+  if (mRingFD < 0) {
+    mRingFD = -1;
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  mEntries = params.sq_entries;
+  mSQRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  mCQRingSize =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMmap) {
+    mSQRingSize = mCQRingSize = std::max(mSQRingSize, mCQRingSize);
+  }
+
+  mSQRing = mmap(nullptr, mSQRingSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, mRingFD, IORING_OFF_SQ_RING);
+  if (mSQRing == MAP_FAILED) {
+    return NS_ERROR_FAILURE;
+  }
+
+  if (singleMmap) {
+    mCQRing = mSQRing;
+  } else {
+    mCQRing = mmap(nullptr, mCQRingSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, mRingFD, IORING_OFF_CQ_RING);
+    if (mCQRing == MAP_FAILED) {
+      return NS_ERROR_FAILURE;
+    }
+  }
+
+  mSQEsSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  mSQEs = static_cast<io_uring_sqe*>(
+      mmap(nullptr, mSQEsSize, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, mRingFD, IORING_OFF_SQES));
+  if (mSQEs == MAP_FAILED) {
+    return NS_ERROR_FAILURE;
+  }
+
+  char* sq = static_cast<char*>(mSQRing);
+  mSQHead = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+  mSQTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+  mSQMask = reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+  mSQArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+
+  char* cq = static_cast<char*>(mCQRing);
+  mCQHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+  mCQTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+  mCQMask = reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+  mCQEs = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  nsresult rv = NS_NewNamedThread(
+      "Cache IO Ring", getter_AddRefs(mThread),
+      NewNonOwningRunnableMethod("net::CacheFileIOUring::CompletionLoop", this,
+                                 &CacheFileIOUring::CompletionLoop));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+int CacheFileIOUring::Enter(uint32_t aToSubmit, uint32_t aMinComplete,
+                            uint32_t aFlags) {
+  int rv;
+  do {
+    rv = syscall(__NR_io_uring_enter, mRingFD, aToSubmit, aMinComplete, aFlags,
+                 nullptr, 0);
+  } while (rv < 0 && errno == EINTR);
+
+  return rv;
+}
+
+bool CacheFileIOUring::QueueLocked(Request* aRequest) {
+  mLock.AssertCurrentThreadOwns();
+
+  uint32_t tail = *mSQTail;
+  uint32_t head = __atomic_load_n(mSQHead, __ATOMIC_ACQUIRE);
+  if (tail - head >= mEntries) {
+    return false;
+  }
+
+  uint32_t index = tail & *mSQMask;
+  struct io_uring_sqe* sqe = &mSQEs[index];
+  memset(sqe, 0, sizeof(*sqe));
+  if (aRequest) {
+    aRequest->mIOVec.iov_base = aRequest->mBuf + aRequest->mDone;
+    aRequest->mIOVec.iov_len = aRequest->mCount - aRequest->mDone;
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = aRequest->mFD;
+    sqe->off = aRequest->mOffset + aRequest->mDone;
+    sqe->addr = reinterpret_cast<uint64_t>(&aRequest->mIOVec);
+    sqe->len = 1;
+    sqe->user_data = reinterpret_cast<uint64_t>(aRequest);
+  } else {
+    sqe->opcode = IORING_OP_NOP;
+    sqe->user_data = kWakeUpUserData;
+  }
+  mSQArray[index] = index;
+  __atomic_store_n(mSQTail, tail + 1, __ATOMIC_RELEASE);
+
+  return true;
+}
+
+void CacheFileIOUring::SubmitLocked() {
+  mLock.AssertCurrentThreadOwns();
+
+  // Submit everything not yet consumed by the kernel.  When this fails the
+  // entries stay in the ring and go with the next submission.
+  uint32_t tail = *mSQTail;
+  uint32_t head = __atomic_load_n(mSQHead, __ATOMIC_ACQUIRE);
+  if (tail == head) {
+    return;
+  }
+
+  if (Enter(tail - head, 0, 0) < 0) {
+    LOG(("CacheFileIOUring::SubmitLocked() - io_uring_enter failed "
+         "[errno=%d]",
+         errno));
+  }
+}
+
+nsresult CacheFileIOUring::Read(int aFD, int64_t aOffset, char* aBuf,
+                                int32_t aCount, nsresult* aResult,
+                                nsIRunnable* aCompletion) {
+  LOG(("CacheFileIOUring::Read() [fd=%d, offset=%" PRId64 ", count=%d]", aFD,
+       aOffset, aCount));
+
+  MutexAutoLock lock(mLock);
+
+  // Keep the number of requests in flight at the submission queue size so
+  // that the completion queue (twice as big) never overflows.
+  if (mShutdown || mInFlight >= mEntries) {
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  Request* request = new Request();
+  request->mFD = aFD;
+  request->mOffset = aOffset;
+  request->mBuf = aBuf;
+  request->mCount = aCount;
+  request->mDone = 0;
+  request->mResult = aResult;
+  request->mCompletion = aCompletion;
+
+  if (!QueueLocked(request)) {
+    delete request;
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  ++mInFlight;
+  return NS_OK;
+}
+
+void CacheFileIOUring::Submit() {
+  MutexAutoLock lock(mLock);
+  SubmitLocked();
+}
+
+void CacheFileIOUring::Shutdown() {
+  MOZ_ASSERT(NS_IsMainThread());
+
+  {
+    MutexAutoLock lock(mLock);
+    if (mShutdown) {
+      return;
+    }
+    mShutdown = true;
+
+    // Wake the completion thread up so it notices the flag even when
+    // there is nothing in flight.  This also submits the reads still
+    // queued, the thread waits for them.
+    if (!QueueLocked(nullptr)) {
+      // The ring is full, so there are completions coming anyway.
+      MOZ_ASSERT(mInFlight);
+    }
+    SubmitLocked();
+  }
+
+  mThread->Shutdown();
+  mThread = nullptr;
+}
+
+void CacheFileIOUring::CompletionLoop() {
+  LOG(("CacheFileIOUring::CompletionLoop() - start"));
+
+  while (!ProcessCompletions()) {
+    if (Enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+      LOG(("CacheFileIOUring::CompletionLoop() - io_uring_enter failed "
+           "[errno=%d]",
+           errno));
+    }
+  }
+
+  LOG(("CacheFileIOUring::CompletionLoop() - end"));
+}
+
+bool CacheFileIOUring::ProcessCompletions() {
+  uint32_t head = *mCQHead;
+  uint32_t tail = __atomic_load_n(mCQTail, __ATOMIC_ACQUIRE);
+
+  for (; head != tail; ++head) {
+    struct io_uring_cqe* cqe = &mCQEs[head & *mCQMask];
+    Request* request = reinterpret_cast<Request*>(cqe->user_data);
+    int32_t res = cqe->res;
+
+    if (!request) {
+      continue;
+    }
+
+    if (res == -EINTR || res == -EAGAIN ||
+        (res > 0 && request->mDone + res < request->mCount)) {
+      // Interrupted or short read, read the rest right away, the IO thread
+      // doesn't know about it anymore.
+      if (res > 0) {
+        request->mDone += res;
+      }
+      MutexAutoLock lock(mLock);
+      if (QueueLocked(request)) {
+        SubmitLocked();
+        continue;
+      }
+      res = -EBUSY;
+    }
+
+    if (res > 0) {
+      request->mDone += res;
+      *request->mResult = NS_OK;
+    } else {
+      // Error or unexpected end of file.
+      LOG(("CacheFileIOUring::ProcessCompletions() - read failed [res=%d]",
+           res));
+      *request->mResult = NS_ERROR_FAILURE;
+    }
+
+    nsCOMPtr<nsIRunnable> completion = std::move(request->mCompletion);
+    delete request;
+    completion->Run();
+
+    MutexAutoLock lock(mLock);
+    --mInFlight;
+  }
+
+  __atomic_store_n(mCQHead, head, __ATOMIC_RELEASE);
+
+  MutexAutoLock lock(mLock);
+  return mShutdown && !mInFlight;
+}
+
+#else  // CACHE_HAVE_IO_URING
+
+// static
+already_AddRefed<CacheFileIOUring> CacheFileIOUring::Create() {
+  return nullptr;
+}
+
+nsresult CacheFileIOUring::Read(int aFD, int64_t aOffset, char* aBuf,
+                                int32_t aCount, nsresult* aResult,
+                                nsIRunnable* aCompletion) {
+  MOZ_CRASH("Not reachable, Create() never succeeds");
+}
+
+void CacheFileIOUring::Submit() {}
+
+void CacheFileIOUring::Shutdown() {}
+
+CacheFileIOUring::~CacheFileIOUring() = default;
+
+#endif  // CACHE_HAVE_IO_URING
+
+}  // namespace net
+}  // namespace mozilla
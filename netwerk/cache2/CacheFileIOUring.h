@@ -0,0 +1,98 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef CacheFileIOUring__h__
+#define CacheFileIOUring__h__
+
+#include "nsCOMPtr.h"
+#include "nsError.h"
+#include "mozilla/Mutex.h"
+
+class nsIRunnable;
+class nsIThread;
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace mozilla {
+namespace net {
+
+// Asynchronous positional reads of cache entry files through a Linux
+// io_uring.  The cache IO thread queues reads and goes on with its queue,
+// once it ran the reads it had queued it submits all of them with a single
+// system call.  A dedicated completion thread reaps finished reads in
+// batches and runs the completion runnable of each of them.
+//
+// Create() returns null when the running kernel (or the headers we were
+// built with) doesn't support io_uring, the caller then keeps using
+// blocking I/O.
+class CacheFileIOUring final {
+ public:
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(CacheFileIOUring)
+
+  static already_AddRefed<CacheFileIOUring> Create();
+
+  // Queues a read of |aCount| bytes at |aOffset| of the native descriptor
+  // |aFD| into |aBuf|, it starts with the next Submit().  When done (short
+  // reads are resubmitted), the result is stored to |aResult| and
+  // |aCompletion| is run on the completion thread.  The descriptor, the
+  // buffer and |aResult| must stay valid until then.  Fails when the ring
+  // is full or shut down; nothing is run then.
+  nsresult Read(int aFD, int64_t aOffset, char* aBuf, int32_t aCount,
+                nsresult* aResult, nsIRunnable* aCompletion);
+
+  // Hands all the reads queued by Read() to the kernel.
+  void Submit();
+
+  // Waits for all submitted reads to complete and stops the completion
+  // thread.  Reads submitted afterwards fail.  Main thread only.
+  void Shutdown();
+
+ private:
+  struct Request;
+
+  CacheFileIOUring();
+  ~CacheFileIOUring();
+
+  nsresult Init();
+  // Adds the read, or the no-op waking the completion thread up when
+  // |aRequest| is null, to the submission queue.  Returns false when the
+  // queue is full.
+  bool QueueLocked(Request* aRequest);
+  void SubmitLocked();
+  int Enter(uint32_t aToSubmit, uint32_t aMinComplete, uint32_t aFlags);
+  void CompletionLoop();
+  // Returns true when the completion loop should exit.
+  bool ProcessCompletions();
+
+  Mutex mLock;
+
+  int mRingFD;
+  uint32_t mEntries;
+  uint32_t mInFlight;  // protected by mLock
+  bool mShutdown;      // protected by mLock
+
+  void* mSQRing;
+  size_t mSQRingSize;
+  void* mCQRing;
+  size_t mCQRingSize;
+  io_uring_sqe* mSQEs;
+  size_t mSQEsSize;
+
+  // Pointers into the shared rings.
+  uint32_t* mSQHead;
+  uint32_t* mSQTail;
+  uint32_t* mSQMask;
+  uint32_t* mSQArray;
+  uint32_t* mCQHead;
+  uint32_t* mCQTail;
+  uint32_t* mCQMask;
+  io_uring_cqe* mCQEs;
+
+  nsCOMPtr<nsIThread> mThread;
+};
+
+}  // namespace net
+}  // namespace mozilla
+
+#endif
@@ -16,6 +16,7 @@
 #include "nsPrintfCString.h"
 #include "mozilla/DebugOnly.h"
 #include "prinrval.h"
+#include "prthread.h"
 #include "nsIFile.h"
 #include "nsITimer.h"
 #include "mozilla/AutoRestore.h"
@@ -72,8 +73,8 @@ class FrecencyComparator {
 }  // namespace
 
 /**
- * This helper class is responsible for keeping CacheIndex::mIndexStats and
- * CacheIndex::mFrecencyArray up to date.
+ * This helper class is responsible for keeping CacheIndex::mIndexStats,
+ * CacheIndex::mFrecencyArray and CacheIndex::mLookupTable up to date.
  */
 class CacheIndexEntryAutoManage {
  public:
@@ -105,9 +106,11 @@ class CacheIndexEntryAutoManage {
 
     if (entry && !mOldRecord) {
       mIndex->mFrecencyArray.AppendRecord(entry->mRec);
+      mIndex->mLookupTable.Add(mHash);
       mIndex->AddRecordToIterators(entry->mRec);
     } else if (!entry && mOldRecord) {
       mIndex->mFrecencyArray.RemoveRecord(mOldRecord);
+      mIndex->mLookupTable.Remove(mHash);
       mIndex->RemoveRecordFromIterators(mOldRecord);
     } else if (entry && mOldRecord) {
       if (entry->mRec != mOldRecord) {
@@ -130,6 +133,9 @@ class CacheIndexEntryAutoManage {
     } else {
       // both entries were removed or not initialized, do nothing
     }
+
+    MOZ_ASSERT(mIndex->mLookupTable.Has(mHash) == !!entry,
+               "Lookup table out of sync with the index");
   }
 
   // We cannot rely on nsTHashtable::GetEntry() in case we are removing entries
@@ -424,6 +430,9 @@ nsresult CacheIndex::Shutdown() {
     return NS_ERROR_NOT_INITIALIZED;
   }
 
+  // Lock-free lookups must not outlive gInstance.
+  index->mLookupTable.Unpublish();
+
   bool sanitize = CacheObserver::ClearCacheOnShutdown();
 
   CacheObserver::SetCacheAmountWritten(index->mTotalBytesWritten >> 10);
@@ -1167,6 +1176,7 @@ nsresult CacheIndex::RemoveAll() {
 
     index->mIndexStats.Clear();
     index->mFrecencyArray.Clear();
+    index->mLookupTable.Clear();
     index->mIndex.Clear();
 
     for (uint32_t i = 0; i < index->mIterators.Length();) {
@@ -1209,6 +1219,16 @@ nsresult CacheIndex::HasEntry(
 nsresult CacheIndex::HasEntry(
     const SHA1Sum::Hash& hash, EntryStatus* _retval,
     const std::function<void(const CacheIndexEntry*)>& aCB) {
+  // The callback needs the entry, which can be accessed only under the lock.
+  // The table is only published while gInstance exists and the index is
+  // usable, and it holds exactly the entries the locked lookup below finds
+  // initialized and not removed, pending updates included.
+  if (!aCB && LookupTable::Contains(hash)) {
+    *_retval = EXISTS;
+    LOG(("CacheIndex::HasEntry() - result is %u (lock-free)", *_retval));
+    return NS_OK;
+  }
+
   StaticMutexAutoLock lock(sLock);
 
   RefPtr<CacheIndex> index = gInstance;
@@ -1265,6 +1285,11 @@ nsresult CacheIndex::HasEntry(
   return NS_OK;
 }
 
+// static
+bool CacheIndex::HasEntryLockFree(const SHA1Sum::Hash& aHash) {
+  return LookupTable::Contains(aHash);
+}
+
 // static
 nsresult CacheIndex::GetEntryForEviction(bool aIgnoreEmptyEntries,
                                          SHA1Sum::Hash* aHash, uint32_t* aCnt) {
@@ -3315,6 +3340,14 @@ void CacheIndex::ChangeState(EState aNewState) {
 
   mState = aNewState;
 
+  // HasEntry() may only answer from the lookup table when it would get past
+  // the IsIndexUsable() check.
+  if (IsIndexUsable()) {
+    mLookupTable.Publish();
+  } else {
+    mLookupTable.Unpublish();
+  }
+
   if (mState != SHUTDOWN) {
     CacheFileIOManager::CacheIndexStateChanged();
   }
@@ -3443,6 +3476,246 @@ void CacheIndex::FrecencyArray::SortIfNeeded() {
   }
 }
 
+Atomic<CacheIndex::LookupTable::Slots*> CacheIndex::LookupTable::sSlots(
+    nullptr);
+Atomic<uint32_t> CacheIndex::LookupTable::sReaders(0);
+
+// Initial number of slots, must be a power of two.
+static const uint32_t kLookupTableInitialCapacity = 1024;
+
+CacheIndex::LookupTable::Slots::Slots(uint32_t aCapacity)
+    : mMask(aCapacity - 1),
+      mKeys(new Atomic<uint64_t, ReleaseAcquire>[aCapacity]) {
+  MOZ_ASSERT((aCapacity & mMask) == 0, "Capacity must be a power of two");
+}
+
+CacheIndex::LookupTable::Slots::~Slots() { delete[] mKeys; }
+
+CacheIndex::LookupTable::LookupTable()
+    : mSlots(new Slots(kLookupTableInitialCapacity)),
+      mCount(0),
+      mPublished(false) {}
+
+CacheIndex::LookupTable::~LookupTable() {
+  Unpublish();
+
+  delete mSlots;
+  for (uint32_t i = 0; i < mRetiredSlots.Length(); ++i) {
+    delete mRetiredSlots[i];
+  }
+}
+
+// static
+uint64_t CacheIndex::LookupTable::Key(const SHA1Sum::Hash* aHash) {
+  uint64_t key;
+  memcpy(&key, aHash, sizeof(key));
+  // Zero marks an empty slot.
+  return key ? key : 1;
+}
+
+void CacheIndex::LookupTable::Add(const SHA1Sum::Hash* aHash) {
+  sLock.AssertCurrentThreadOwns();
+
+  // Keep the load factor under 3/4.
+  if ((mCount + 1) * 4 > Capacity() * 3) {
+    Resize(Capacity() * 2);
+  }
+
+  uint64_t key = Key(aHash);
+  for (uint32_t i = key & mSlots->mMask;; i = (i + 1) & mSlots->mMask) {
+    uint64_t slot = mSlots->mKeys[i];
+    if (slot == key) {
+      // The first 64 bits of two different hashes match, the table doesn't
+      // need to distinguish them.  Remove() of one of them makes the other
+      // one fall back to the locked lookup.
+      return;
+    }
+    if (!slot) {
+      mSlots->mKeys[i] = key;
+      ++mCount;
+      return;
+    }
+  }
+}
+
+void CacheIndex::LookupTable::Remove(const SHA1Sum::Hash* aHash) {
+  sLock.AssertCurrentThreadOwns();
+
+  uint64_t key = Key(aHash);
+  uint32_t mask = mSlots->mMask;
+  uint32_t i = key & mask;
+  for (;; i = (i + 1) & mask) {
+    uint64_t slot = mSlots->mKeys[i];
+    if (!slot) {
+      return;
+    }
+    if (slot == key) {
+      break;
+    }
+  }
+
+  // Shift back the following keys that would not be reachable from their
+  // home slot across the hole at |i|.
+  for (uint32_t j = (i + 1) & mask;; j = (j + 1) & mask) {
+    uint64_t slot = mSlots->mKeys[j];
+    if (!slot) {
+      break;
+    }
+    uint32_t home = slot & mask;
+    bool movable = i <= j ? (home <= i || home > j) : (home <= i && home > j);
+    if (movable) {
+      mSlots->mKeys[i] = slot;
+      i = j;
+    }
+  }
+
+  mSlots->mKeys[i] = 0;
+  --mCount;
+
+  // Give the memory back when most entries are gone.  The load factor is
+  // 1/4 after shrinking, far enough from both thresholds.
+  if (Capacity() > kLookupTableInitialCapacity && mCount * 8 < Capacity()) {
+    Resize(Capacity() / 2);
+    return;
+  }
+
+  FreeRetiredSlots();
+}
+
+void CacheIndex::LookupTable::Clear() {
+  sLock.AssertCurrentThreadOwns();
+
+  mCount = 0;
+  if (Capacity() > kLookupTableInitialCapacity) {
+    Resize(kLookupTableInitialCapacity);
+    return;
+  }
+
+  for (uint32_t i = 0; i <= mSlots->mMask; ++i) {
+    mSlots->mKeys[i] = 0;
+  }
+
+  FreeRetiredSlots();
+}
+
+void CacheIndex::LookupTable::Resize(uint32_t aCapacity) {
+  LOG(("CacheIndex::LookupTable::Resize() [capacity=%u]", aCapacity));
+
+  Slots* slots = new Slots(aCapacity);
+  for (uint32_t i = 0; mCount && i <= mSlots->mMask; ++i) {
+    uint64_t key = mSlots->mKeys[i];
+    if (!key) {
+      continue;
+    }
+    uint32_t j = key & slots->mMask;
+    while (slots->mKeys[j]) {
+      j = (j + 1) & slots->mMask;
+    }
+    slots->mKeys[j] = key;
+  }
+
+  mRetiredSlots.AppendElement(mSlots);
+  mSlots = slots;
+  if (mPublished) {
+    sSlots = mSlots;
+  }
+
+  FreeRetiredSlots();
+}
+
+void CacheIndex::LookupTable::FreeRetiredSlots() {
+  // A lookup increments sReaders before it loads sSlots, so once sSlots
+  // points to the new slots and there is no reader, nobody can be using
+  // the retired ones.
+  if (mRetiredSlots.IsEmpty() || sReaders) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < mRetiredSlots.Length(); ++i) {
+    delete mRetiredSlots[i];
+  }
+  mRetiredSlots.Clear();
+}
+
+void CacheIndex::LookupTable::Publish() {
+  sLock.AssertCurrentThreadOwns();
+
+  if (mPublished) {
+    return;
+  }
+
+  mPublished = true;
+  sSlots = mSlots;
+}
+
+void CacheIndex::LookupTable::Unpublish() {
+  if (!mPublished) {
+    return;
+  }
+
+  mPublished = false;
+  sSlots = nullptr;
+
+  // Lookups are a few memory reads, just spin.
+  while (sReaders) {
+    PR_Sleep(PR_INTERVAL_NO_WAIT);
+  }
+
+  FreeRetiredSlots();
+}
+
+#ifdef DEBUG
+bool CacheIndex::LookupTable::Has(const SHA1Sum::Hash* aHash) const {
+  sLock.AssertCurrentThreadOwns();
+
+  uint64_t key = Key(aHash);
+  for (uint32_t i = key & mSlots->mMask;; i = (i + 1) & mSlots->mMask) {
+    uint64_t slot = mSlots->mKeys[i];
+    if (!slot) {
+      return false;
+    }
+    if (slot == key) {
+      return true;
+    }
+  }
+}
+#endif
+
+// static
+bool CacheIndex::LookupTable::Contains(const SHA1Sum::Hash& aHash) {
+  bool found = false;
+
+  ++sReaders;
+  Slots* slots = sSlots;
+  if (slots) {
+    uint64_t key = Key(&aHash);
+    for (uint32_t i = key & slots->mMask;; i = (i + 1) & slots->mMask) {
+      uint64_t slot = slots->mKeys[i];
+      if (!slot) {
+        break;
+      }
+      if (slot == key) {
+        found = true;
+        break;
+      }
+    }
+  }
+  --sReaders;
+
+  return found;
+}
+
+size_t CacheIndex::LookupTable::SizeOfExcludingThis(
+    mozilla::MallocSizeOf mallocSizeOf) const {
+  size_t n = mallocSizeOf(mSlots) + mallocSizeOf(mSlots->mKeys);
+  for (uint32_t i = 0; i < mRetiredSlots.Length(); ++i) {
+    n += mallocSizeOf(mRetiredSlots[i]) +
+         mallocSizeOf(mRetiredSlots[i]->mKeys);
+  }
+  n += mRetiredSlots.ShallowSizeOfExcludingThis(mallocSizeOf);
+  return n;
+}
+
 void CacheIndex::AddRecordToIterators(CacheIndexRecord* aRecord) {
   sLock.AssertCurrentThreadOwns();
 
@@ -3815,6 +4088,7 @@ size_t CacheIndex::SizeOfExcludingThisInternal(
 
   // mFrecencyArray items are reported by mIndex/mPendingUpdates
   n += mFrecencyArray.mRecs.ShallowSizeOfExcludingThis(mallocSizeOf);
+  n += mLookupTable.SizeOfExcludingThis(mallocSizeOf);
   n += mDiskConsumptionObservers.ShallowSizeOfExcludingThis(mallocSizeOf);
 
   return n;
@@ -732,6 +732,10 @@ class CacheIndex final : public CacheFileIOListener, public nsIRunnable {
       const SHA1Sum::Hash& hash, EntryStatus* _retval,
       const std::function<void(const CacheIndexEntry*)>& aCB = nullptr);
 
+  // Returns true when HasEntry() answers EXISTS for the hash without taking
+  // the lock.  Used by tests to check the lock-free lookup table.
+  static bool HasEntryLockFree(const SHA1Sum::Hash& aHash);
+
   // Returns a hash of the least important entry that should be evicted if the
   // cache size is over limit and also returns a total number of all entries in
   // the index minus the number of forced valid entries and unpinned entries
@@ -1181,6 +1185,76 @@ class CacheIndex final : public CacheFileIOListener, public nsIRunnable {
 
   FrecencyArray mFrecencyArray;
 
+  // Set of hashes of initialized and not removed entries, i.e. the same
+  // entries that are in mFrecencyArray.  It is kept up to date by
+  // CacheIndexEntryAutoManage under sLock, but it can be queried from any
+  // thread without taking the lock.  HasEntry() uses it to answer EXISTS
+  // for the common case without contending with the IO thread; any other
+  // answer still needs the lock.
+  //
+  // It is an open addressing hash table of the first 64 bits of the hash
+  // with linear probing.  Removal shifts the following entries back instead
+  // of leaving tombstones.  A lookup racing with a removal may miss an entry
+  // that is being moved, which is fine since a miss only means falling back
+  // to the locked lookup.  The table grows at 3/4 load and shrinks back when
+  // it drops under 1/8, the replaced slots are freed as soon as no lookup is
+  // running.  It costs 10 to 21 bytes per entry, on top of the hashtable
+  // slot and the CacheIndexRecord that mIndex keeps for each one.
+  class LookupTable {
+   public:
+    LookupTable();
+    ~LookupTable();
+
+    // Methods used by CacheIndexEntryAutoManage to keep the table up to date.
+    void Add(const SHA1Sum::Hash* aHash);
+    void Remove(const SHA1Sum::Hash* aHash);
+    void Clear();
+
+    // Lets lookups use the table.  It is only published while the index is
+    // usable, see CacheIndex::ChangeState(); the answers would be wrong
+    // before the index is loaded or once it shut down.
+    void Publish();
+    // Stops lookups from using the table and waits for running lookups.
+    void Unpublish();
+
+    // Can be called on any thread.
+    static bool Contains(const SHA1Sum::Hash& aHash);
+
+#ifdef DEBUG
+    // Exact answer for the thread that updates the table.
+    bool Has(const SHA1Sum::Hash* aHash) const;
+#endif
+
+    size_t SizeOfExcludingThis(mozilla::MallocSizeOf mallocSizeOf) const;
+
+   private:
+    struct Slots {
+      explicit Slots(uint32_t aCapacity);
+      ~Slots();
+
+      uint32_t mMask;
+      Atomic<uint64_t, ReleaseAcquire>* mKeys;
+    };
+
+    static uint64_t Key(const SHA1Sum::Hash* aHash);
+    uint32_t Capacity() const { return mSlots->mMask + 1; }
+    void Resize(uint32_t aCapacity);
+    void FreeRetiredSlots();
+
+    // Slots used by lookups, null when the table is not published.
+    static Atomic<Slots*> sSlots;
+    // Number of lookups currently running.
+    static Atomic<uint32_t> sReaders;
+
+    Slots* mSlots;
+    uint32_t mCount;
+    bool mPublished;
+    // Slots replaced by Resize() that may still be used by running lookups.
+    nsTArray<Slots*> mRetiredSlots;
+  };
+
+  LookupTable mLookupTable;
+
   nsTArray<CacheIndexIterator*> mIterators;
 
   // This flag is true iff we are between CacheStorageService:Clear() and
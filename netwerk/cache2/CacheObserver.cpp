@@ -59,6 +59,12 @@ Atomic<bool, Relaxed> CacheObserver::sSmartCacheSizeEnabled(
 static uint32_t const kDefaultPreloadChunkCount = 4;
 uint32_t CacheObserver::sPreloadChunkCount = kDefaultPreloadChunkCount;
 
+static uint32_t const kDefaultParallelReadThreads = 4;
+uint32_t CacheObserver::sParallelReadThreads = kDefaultParallelReadThreads;
+
+static bool const kDefaultUseIOUring = false;
+bool CacheObserver::sUseIOUring = kDefaultUseIOUring;
+
 static int32_t const kDefaultMaxMemoryEntrySize = 4 * 1024;  // 4 MB
 int32_t CacheObserver::sMaxMemoryEntrySize = kDefaultMaxMemoryEntrySize;
 
@@ -176,6 +182,12 @@ void CacheObserver::AttachToPreferences() {
       &sPreloadChunkCount, "browser.cache.disk.preload_chunk_count",
       kDefaultPreloadChunkCount);
 
+  mozilla::Preferences::AddUintVarCache(
+      &sParallelReadThreads, "browser.cache.disk.parallel_read_threads",
+      kDefaultParallelReadThreads);
+  mozilla::Preferences::AddBoolVarCache(
+      &sUseIOUring, "browser.cache.disk.io_uring.enabled", kDefaultUseIOUring);
+
   mozilla::Preferences::AddIntVarCache(&sMaxDiskEntrySize,
                                        "browser.cache.disk.max_entry_size",
                                        kDefaultMaxDiskEntrySize);
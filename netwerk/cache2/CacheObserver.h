@@ -47,6 +47,8 @@ class CacheObserver : public nsIObserver, public nsSupportsWeakReference {
   }
   static bool SmartCacheSizeEnabled() { return sSmartCacheSizeEnabled; }
   static uint32_t PreloadChunkCount() { return sPreloadChunkCount; }
+  static uint32_t ParallelReadThreads() { return sParallelReadThreads; }
+  static bool UseIOUring() { return sUseIOUring; }
   static uint32_t MaxMemoryEntrySize()  // result in kilobytes.
   {
     return sMaxMemoryEntrySize;
@@ -108,6 +110,8 @@ class CacheObserver : public nsIObserver, public nsSupportsWeakReference {
   static uint32_t sDiskFreeSpaceHardLimit;
   static Atomic<bool, Relaxed> sSmartCacheSizeEnabled;
   static uint32_t sPreloadChunkCount;
+  static uint32_t sParallelReadThreads;
+  static bool sUseIOUring;
   static int32_t sMaxMemoryEntrySize;
   static int32_t sMaxDiskEntrySize;
   static uint32_t sMaxDiskChunksMemoryUsage;
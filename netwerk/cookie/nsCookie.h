@@ -94,6 +94,16 @@ class nsCookie final : public nsICookie {
   // Set the creation time manually, overriding the monotonicity checks in
   // Create(). Use with caution!
   inline void SetCreationTime(int64_t aTime) { mData.creationTime() = aTime; }
+  // Make this cookie use the string buffers of |aOther|'s host and path,
+  // which must be equal to its own.
+  inline void ShareHost(const nsCookie* aOther) {
+    MOZ_ASSERT(Host() == aOther->Host());
+    mData.host() = aOther->Host();
+  }
+  inline void SharePath(const nsCookie* aOther) {
+    MOZ_ASSERT(Path() == aOther->Path());
+    mData.path() = aOther->Path();
+  }
 
   bool IsStale() const;
 
@@ -504,10 +504,66 @@ class CompareCookiesByIndex {
 
 }  // namespace
 
+CookieMatchInfo::CookieMatchInfo(const nsCookie* aCookie)
+    : mExpiry(aCookie->Expiry()),
+      mHostHash(HashString(aCookie->RawHost())),
+      mPathLength(aCookie->Path().Length()),
+      mFlags(0),
+      mSameSite(aCookie->SameSite()),
+      mRawSameSite(aCookie->RawSameSite()) {
+  // Paths are at most kMaxBytesPerPath long.
+  MOZ_ASSERT(aCookie->Path().Length() <= UINT16_MAX);
+  if (mPathLength > 0 && aCookie->Path().Last() == '/') {
+    --mPathLength;
+  }
+  if (aCookie->IsSecure()) {
+    mFlags |= eSecure;
+  }
+  if (aCookie->IsHttpOnly()) {
+    mFlags |= eHttpOnly;
+  }
+  if (aCookie->IsDomain()) {
+    mFlags |= eDomain;
+  }
+}
+
+void nsCookieEntry::AppendCookie(nsCookie* aCookie) {
+  CookieMatchInfo info(aCookie);
+
+  // Most cookies of a base domain are set by a handful of hosts on a handful
+  // of paths, so keep one copy of each.
+  bool sharedHost = false;
+  bool sharedPath = false;
+  for (IndexType i = 0; i < mCookies.Length() && !(sharedHost && sharedPath);
+       ++i) {
+    const CookieMatchInfo& other = mMatchInfo[i];
+    nsCookie* otherCookie = mCookies[i];
+    if (!sharedHost && other.mHostHash == info.mHostHash &&
+        otherCookie->Host() == aCookie->Host()) {
+      aCookie->ShareHost(otherCookie);
+      sharedHost = true;
+    }
+    if (!sharedPath && other.mPathLength == info.mPathLength &&
+        otherCookie->Path() == aCookie->Path()) {
+      aCookie->SharePath(otherCookie);
+      sharedPath = true;
+    }
+  }
+
+  mCookies.AppendElement(aCookie);
+  mMatchInfo.AppendElement(info);
+}
+
+void nsCookieEntry::RemoveCookieAt(IndexType aIndex) {
+  mCookies.RemoveElementAt(aIndex);
+  mMatchInfo.RemoveElementAt(aIndex);
+}
+
 size_t nsCookieEntry::SizeOfExcludingThis(MallocSizeOf aMallocSizeOf) const {
   size_t amount = nsCookieKey::SizeOfExcludingThis(aMallocSizeOf);
 
   amount += mCookies.ShallowSizeOfExcludingThis(aMallocSizeOf);
+  amount += mMatchInfo.ShallowSizeOfExcludingThis(aMallocSizeOf);
   for (uint32_t i = 0; i < mCookies.Length(); ++i) {
     amount += mCookies[i]->SizeOfIncludingThis(aMallocSizeOf);
   }
@@ -3063,19 +3119,34 @@ void nsCookieService::GetCookiesForURI(
   nsCookieEntry* entry = mDBState->hostTable.GetEntry(key);
   if (!entry) return;
 
-  // iterate the cookies!
+  // the hosts a cookie may have been set for: the host itself, for host and
+  // domain cookies, and each of its parent domains, for domain cookies.
+  // e.g. for "mail.google.com", "mail.google.com", "google.com" and "com".
+  uint32_t hostHash = HashString(hostFromURI);
+  AutoTArray<uint32_t, 8> domainHashes;
+  for (int32_t dot = hostFromURI.FindChar('.'); dot != kNotFound;
+       dot = hostFromURI.FindChar('.', dot + 1)) {
+    domainHashes.AppendElement(HashString(Substring(hostFromURI, dot + 1)));
+  }
+
+  // iterate the cookies! the checks that can be made on the packed match
+  // info come first, so that most cookies are skipped without being read.
   const nsCookieEntry::ArrayType& cookies = entry->GetCookies();
+  const nsCookieEntry::MatchInfoArrayType& matchInfo = entry->GetMatchInfo();
+  // as in nsCookie::GetSameSite().
+  bool laxByDefault = StaticPrefs::network_cookie_sameSite_laxByDefault();
   for (nsCookieEntry::IndexType i = 0; i < cookies.Length(); ++i) {
-    cookie = cookies[i];
+    const CookieMatchInfo& info = matchInfo[i];
 
-    // check the host, since the base domain lookup is conservative.
-    if (!DomainMatches(cookie, hostFromURI)) continue;
+    // check if the cookie has expired
+    if (info.mExpiry <= currentTime) {
+      continue;
+    }
 
     // if the cookie is secure and the host scheme isn't, we can't send it
-    if (cookie->IsSecure() && !isSecure) continue;
+    if ((info.mFlags & CookieMatchInfo::eSecure) && !isSecure) continue;
 
-    int32_t sameSiteAttr = 0;
-    cookie->GetSameSite(&sameSiteAttr);
+    int32_t sameSiteAttr = laxByDefault ? info.mSameSite : info.mRawSameSite;
     if (aIsSameSiteForeign) {
       // it if's a cross origin request and the cookie is same site only
       // (strict) don't send it
@@ -3091,16 +3162,24 @@ void nsCookieService::GetCookiesForURI(
 
     // if the cookie is httpOnly and it's not going directly to the HTTP
     // connection, don't send it
-    if (cookie->IsHttpOnly() && !aHttpBound) continue;
+    if ((info.mFlags & CookieMatchInfo::eHttpOnly) && !aHttpBound) continue;
 
-    // if the nsIURI path doesn't match the cookie path, don't send it back
-    if (!PathMatches(cookie, pathFromURI)) continue;
+    // a cookie path longer than the nsIURI path can't match it
+    if (info.mPathLength > pathFromURI.Length()) continue;
 
-    // check if the cookie has expired
-    if (cookie->Expiry() <= currentTime) {
+    // check the host, since the base domain lookup is conservative.
+    if (info.mHostHash != hostHash &&
+        (!(info.mFlags & CookieMatchInfo::eDomain) ||
+         !domainHashes.Contains(info.mHostHash))) {
       continue;
     }
 
+    cookie = cookies[i];
+    if (!DomainMatches(cookie, hostFromURI)) continue;
+
+    // if the nsIURI path doesn't match the cookie path, don't send it back
+    if (!PathMatches(cookie, pathFromURI)) continue;
+
     // all checks passed - add to list and check if lastAccessed stamp needs
     // updating
     aCookieList.AppendElement(cookie);
@@ -3161,16 +3240,21 @@ void nsCookieService::GetCookieStringInternal(
     uint32_t aRejectedReason, bool aIsSafeTopLevelNav, bool aIsSameSiteForeign,
     bool aHttpBound, const OriginAttributes& aOriginAttrs,
     nsACString& aCookieString) {
-  AutoTArray<nsCookie*, 8> foundCookieList;
+  AutoTArray<nsCookie*, 32> foundCookieList;
   GetCookiesForURI(aHostURI, aChannel, aIsForeign, aIsTrackingResource,
                    aFirstPartyStorageAccessGranted, aRejectedReason,
                    aIsSafeTopLevelNav, aIsSameSiteForeign, aHttpBound,
                    aOriginAttrs, foundCookieList);
 
-  nsCookie* cookie;
-  for (uint32_t i = 0; i < foundCookieList.Length(); ++i) {
-    cookie = foundCookieList.ElementAt(i);
+  // size the string up front, so that it is allocated once.
+  uint32_t length = aCookieString.Length();
+  for (nsCookie* cookie : foundCookieList) {
+    // "; " + name + "=" + value
+    length += 3 + cookie->Name().Length() + cookie->Value().Length();
+  }
+  aCookieString.SetCapacity(length);
 
+  for (nsCookie* cookie : foundCookieList) {
     // check if we have anything to write
     if (!cookie->Name().IsEmpty() || !cookie->Value().IsEmpty()) {
       // if we've already added a cookie to the return list, append a "; " so
@@ -3181,12 +3265,10 @@ void nsCookieService::GetCookieStringInternal(
 
       if (!cookie->Name().IsEmpty()) {
         // we have a name and value - write both
-        aCookieString +=
-            cookie->Name() + NS_LITERAL_CSTRING("=") + cookie->Value();
-      } else {
-        // just write value
-        aCookieString += cookie->Value();
+        aCookieString.Append(cookie->Name());
+        aCookieString.Append('=');
       }
+      aCookieString.Append(cookie->Value());
     }
   }
 
@@ -4985,7 +5067,7 @@ void nsCookieService::RemoveCookieFromList(
 
   } else {
     // just remove the element from the list
-    aIter.entry->GetCookies().RemoveElementAt(aIter.index);
+    aIter.entry->RemoveCookieAt(aIter.index);
   }
 
   --mDBState->cookieCount;
@@ -5086,7 +5168,7 @@ void nsCookieService::AddCookieToList(
   nsCookieEntry* entry = aDBState->hostTable.PutEntry(aKey);
   NS_ASSERTION(entry, "can't insert element into a null entry!");
 
-  entry->GetCookies().AppendElement(aCookie);
+  entry->AppendCookie(aCookie);
   ++aDBState->cookieCount;
 
   // keep track of the oldest cookie, for when it comes time to purge
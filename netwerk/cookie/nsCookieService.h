@@ -62,6 +62,26 @@ class CookieServiceParent;
 }  // namespace mozilla
 
 using mozilla::net::nsCookieKey;
+
+// The attributes of a cookie that decide whether it is sent with a request,
+// packed so that the cookies of a base domain can be filtered without
+// touching each nsCookie. nsCookieEntry keeps one for each of its cookies,
+// at the same index.
+struct CookieMatchInfo {
+  enum : uint8_t { eSecure = 1 << 0, eHttpOnly = 1 << 1, eDomain = 1 << 2 };
+
+  explicit CookieMatchInfo(const nsCookie* aCookie);
+
+  int64_t mExpiry;  // in seconds
+  // HashString() of the cookie's RawHost().
+  uint32_t mHostHash;
+  // The length of the cookie path, excluding any trailing '/'.
+  uint16_t mPathLength;
+  uint8_t mFlags;
+  uint8_t mSameSite;
+  uint8_t mRawSameSite;
+};
+
 // Inherit from nsCookieKey so this can be stored in nsTHashTable
 // TODO: why aren't we using nsClassHashTable<nsCookieKey, ArrayType>?
 class nsCookieEntry : public nsCookieKey {
@@ -69,6 +89,7 @@ class nsCookieEntry : public nsCookieKey {
   // Hash methods
   typedef nsTArray<RefPtr<nsCookie> > ArrayType;
   typedef ArrayType::index_type IndexType;
+  typedef nsTArray<CookieMatchInfo> MatchInfoArrayType;
 
   explicit nsCookieEntry(KeyTypePointer aKey) : nsCookieKey(aKey) {}
 
@@ -80,12 +101,19 @@ class nsCookieEntry : public nsCookieKey {
 
   ~nsCookieEntry() = default;
 
-  inline ArrayType& GetCookies() { return mCookies; }
+  inline const ArrayType& GetCookies() const { return mCookies; }
+  inline const MatchInfoArrayType& GetMatchInfo() const { return mMatchInfo; }
+
+  // Adds a cookie, sharing its host and path strings with those of an
+  // existing cookie that has the same ones.
+  void AppendCookie(nsCookie* aCookie);
+  void RemoveCookieAt(IndexType aIndex);
 
   size_t SizeOfExcludingThis(mozilla::MallocSizeOf aMallocSizeOf) const;
 
  private:
   ArrayType mCookies;
+  MatchInfoArrayType mMatchInfo;
 };
 
 // encapsulates a (key, nsCookie) tuple for temporary storage purposes.
@@ -14,6 +14,7 @@
 
 #include <stdlib.h>
 #include <ctime>
+#include <algorithm>
 #include "nsHostResolver.h"
 #include "nsError.h"
 #include "nsISupportsBase.h"
@@ -215,6 +216,18 @@ nsHostRecord::ExpirationStatus nsHostRecord::CheckExpiration(
   return nsHostRecord::EXP_EXPIRED;
 }
 
+bool nsHostRecord::ShouldRefreshAhead(const mozilla::TimeStamp& now,
+                                      uint32_t percent) const {
+  if (!percent || negative || mValidStart.IsNull() || mGraceStart.IsNull()) {
+    return false;
+  }
+
+  TimeDuration lifetime = mGraceStart - mValidStart;
+  TimeDuration ahead =
+      TimeDuration::FromSeconds(lifetime.ToSeconds() * percent / 100);
+  return now < mGraceStart && now >= mGraceStart - ahead;
+}
+
 void nsHostRecord::SetExpiration(const mozilla::TimeStamp& now,
                                  unsigned int valid, unsigned int grace) {
   mValidStart = now;
@@ -547,7 +560,11 @@ static const char kPrefGetTtl[] = "network.dns.get-ttl";
 static const char kPrefNativeIsLocalhost[] = "network.dns.native-is-localhost";
 static const char kPrefThreadIdleTime[] =
     "network.dns.resolver-thread-extra-idle-time-seconds";
+static const char kPrefRefreshAhead[] = "network.dns.refresh-ahead-percent";
 static bool sGetTtlEnabled = false;
+// Share of a positive entry's lifetime, counted back from the start of its
+// grace period, during which cache hits renew it in the background.
+static Atomic<uint32_t, Relaxed> sRefreshAheadPercent(10);
 mozilla::Atomic<bool, mozilla::Relaxed> gNativeIsLocalhost;
 
 static void DnsPrefChanged(const char* aPref, nsHostResolver* aSelf) {
@@ -562,6 +579,9 @@ static void DnsPrefChanged(const char* aPref, nsHostResolver* aSelf) {
 #endif
   } else if (!strcmp(aPref, kPrefNativeIsLocalhost)) {
     gNativeIsLocalhost = Preferences::GetBool(kPrefNativeIsLocalhost);
+  } else if (!strcmp(aPref, kPrefRefreshAhead)) {
+    sRefreshAheadPercent =
+        std::min(Preferences::GetUint(kPrefRefreshAhead, 10), 100u);
   }
 }
 
@@ -613,6 +633,10 @@ nsresult nsHostResolver::Init() {
                                               kPrefNativeIsLocalhost, this);
     NS_WARNING_ASSERTION(NS_SUCCEEDED(rv),
                          "Could not register DNS pref callback.");
+    rv = Preferences::RegisterCallbackAndCall(&DnsPrefChanged,
+                                              kPrefRefreshAhead, this);
+    NS_WARNING_ASSERTION(NS_SUCCEEDED(rv),
+                         "Could not register DNS pref callback.");
   }
 
 #if defined(HAVE_RES_NINIT)
@@ -887,6 +911,7 @@ nsresult nsHostResolver::ResolveHost(const nsACString& aHost, uint16_t type,
         if (IS_ADDR_TYPE(type)) {
           Telemetry::Accumulate(Telemetry::DNS_LOOKUP_METHOD2, METHOD_HIT);
         }
+        TouchEvictionQ(rec);
 
         // For entries that are in the grace period
         // or all cached negative entries, use the cache but start a new
@@ -1009,6 +1034,9 @@ nsresult nsHostResolver::ResolveHost(const nsACString& aHost, uint16_t type,
                 status = NS_ERROR_UNKNOWN_HOST;
               }
               Telemetry::Accumulate(Telemetry::DNS_LOOKUP_METHOD2, METHOD_HIT);
+              // The AF_UNSPEC entry answered, keep it as well.
+              TouchEvictionQ(unspecRec);
+              TouchEvictionQ(rec);
               ConditionallyRefreshRecord(rec, host);
             } else if (af == PR_AF_INET6) {
               // For AF_INET6, a new lookup means another AF_UNSPEC
@@ -1429,9 +1457,12 @@ nsresult nsHostResolver::NameLookup(nsHostRecord* rec) {
 
 nsresult nsHostResolver::ConditionallyRefreshRecord(nsHostRecord* rec,
                                                     const nsACString& host) {
-  if ((rec->CheckExpiration(TimeStamp::NowLoRes()) != nsHostRecord::EXP_VALID ||
-       rec->negative) &&
-      !rec->mResolving) {
+  if (rec->mResolving) {
+    return NS_OK;
+  }
+
+  TimeStamp now = TimeStamp::NowLoRes();
+  if (rec->CheckExpiration(now) != nsHostRecord::EXP_VALID || rec->negative) {
     LOG(("  Using %s cache entry for host [%s] but starting async renewal.",
          rec->negative ? "negative" : "positive", host.BeginReading()));
     NameLookup(rec);
@@ -1441,6 +1472,12 @@ nsresult nsHostResolver::ConditionallyRefreshRecord(nsHostRecord* rec,
       // track positive grace period induced renewals
       Telemetry::Accumulate(Telemetry::DNS_LOOKUP_METHOD2, METHOD_RENEWAL);
     }
+  } else if (rec->ShouldRefreshAhead(now, sRefreshAheadPercent)) {
+    // Renew entries that are in use before they expire, so that the next
+    // lookup neither waits for the resolver nor lands in the grace period.
+    LOG(("  Using cache entry for host [%s] but renewing it ahead of expiry.",
+         host.BeginReading()));
+    NameLookup(rec);
   }
   return NS_OK;
 }
@@ -1653,6 +1690,19 @@ void nsHostResolver::AddToEvictionQ(nsHostRecord* rec) {
   }
 }
 
+void nsHostResolver::TouchEvictionQ(nsHostRecord* rec) {
+  // Records that are being resolved are on one of the pending queues instead
+  // and go back to mEvictionQ when the lookup completes.
+  if (rec->mResolving || !rec->isInList()) {
+    return;
+  }
+
+  AssertOnQ(rec, mEvictionQ);
+  RefPtr<nsHostRecord> kungFuDeathGrip(rec);
+  rec->remove();
+  mEvictionQ.insertBack(rec);
+}
+
 //
 // CompleteLookup() checks if the resolving should be redone and if so it
 // returns LOOKUP_RESOLVEAGAIN, but only if 'status' is not NS_ERROR_ABORT.
@@ -98,6 +98,12 @@ class nsHostRecord : public mozilla::LinkedListElement<RefPtr<nsHostRecord>>,
 
   ExpirationStatus CheckExpiration(const mozilla::TimeStamp& now) const;
 
+  // Checks if a valid positive record is within the last |percent| of its
+  // lifetime, when a cache hit should renew it before it enters the grace
+  // period.
+  bool ShouldRefreshAhead(const mozilla::TimeStamp& now,
+                          uint32_t percent) const;
+
   // Convenience function for setting the timestamps above (mValidStart,
   // mValidEnd, and mGraceStart). valid and grace are durations in seconds.
   void SetExpiration(const mozilla::TimeStamp& now, unsigned int valid,
@@ -518,12 +524,16 @@ class nsHostResolver : public nsISupports, public AHostResolver {
 
   /**
    * Starts a new lookup in the background for entries that are in the grace
-   * period with a failed connect or all cached entries are negative.
+   * period with a failed connect or all cached entries are negative, and for
+   * positive entries that are about to enter the grace period.
    */
   nsresult ConditionallyRefreshRecord(nsHostRecord* rec,
                                       const nsACString& host);
 
   void AddToEvictionQ(nsHostRecord* rec);
+  // Moves a cached record to the back of mEvictionQ after a cache hit, so
+  // that the least recently used records are evicted first.
+  void TouchEvictionQ(nsHostRecord* rec);
 
   void ThreadFunc();
 
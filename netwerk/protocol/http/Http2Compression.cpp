@@ -24,6 +24,10 @@ namespace mozilla {
 namespace net {
 
 static nsDeque* gStaticHeaders = nullptr;
+// Lowest static table index for a name and for a name+value key, see
+// nvFIFO::Find().
+static nsDataHashtable<nsCStringHashKey, uint32_t>* gStaticNames = nullptr;
+static nsTHashtable<nvPairHashKey>* gStaticPairs = nullptr;
 
 class HpackStaticTableReporter final : public nsIMemoryReporter {
  public:
@@ -36,7 +40,11 @@ class HpackStaticTableReporter final : public nsIMemoryReporter {
                  bool aAnonymize) override {
     MOZ_COLLECT_REPORT("explicit/network/hpack/static-table", KIND_HEAP,
                        UNITS_BYTES,
-                       gStaticHeaders->SizeOfIncludingThis(MallocSizeOf),
+                       gStaticHeaders->SizeOfIncludingThis(MallocSizeOf) +
+                           gStaticNames->ShallowSizeOfIncludingThis(
+                               MallocSizeOf) +
+                           gStaticPairs->ShallowSizeOfIncludingThis(
+                               MallocSizeOf),
                        "Memory usage of HPACK static table.");
 
     return NS_OK;
@@ -87,13 +95,26 @@ void Http2CompressionCleanup() {
   // this happens after the socket thread has been destroyed
   delete gStaticHeaders;
   gStaticHeaders = nullptr;
+  delete gStaticNames;
+  gStaticNames = nullptr;
+  delete gStaticPairs;
+  gStaticPairs = nullptr;
   UnregisterStrongMemoryReporter(gStaticReporter);
   gStaticReporter = nullptr;
 }
 
 static void AddStaticElement(const nsCString& name, const nsCString& value) {
+  uint32_t index = gStaticHeaders->GetSize();
   nvPair* pair = new nvPair(name, value);
   gStaticHeaders->Push(pair);
+
+  nvPairHashKey::Key key{pair->mName, pair->mValue};
+  if (!gStaticNames->Contains(name)) {
+    gStaticNames->Put(name, index);
+  }
+  if (!gStaticPairs->Contains(key)) {
+    gStaticPairs->PutEntry(key)->Set(pair, index);
+  }
 }
 
 static void AddStaticElement(const nsCString& name) {
@@ -104,6 +125,8 @@ static void InitializeStaticHeaders() {
   MOZ_ASSERT(OnSocketThread(), "not on socket thread");
   if (!gStaticHeaders) {
     gStaticHeaders = new nsDeque();
+    gStaticNames = new nsDataHashtable<nsCStringHashKey, uint32_t>();
+    gStaticPairs = new nsTHashtable<nvPairHashKey>();
     gStaticReporter = new HpackStaticTableReporter();
     RegisterStrongMemoryReporter(gStaticReporter);
     AddStaticElement(NS_LITERAL_CSTRING(":authority"));
@@ -182,7 +205,10 @@ size_t nvPair::SizeOfIncludingThis(MallocSizeOf aMallocSizeOf) const {
   return aMallocSizeOf(this) + SizeOfExcludingThis(aMallocSizeOf);
 }
 
-nvFIFO::nvFIFO() : mByteCount(0), mTable() { InitializeStaticHeaders(); }
+nvFIFO::nvFIFO()
+    : mByteCount(0), mTable(), mLookupsEnabled(false), mNextId(0) {
+  InitializeStaticHeaders();
+}
 
 nvFIFO::~nvFIFO() { Clear(); }
 
@@ -190,6 +216,15 @@ void nvFIFO::AddElement(const nsCString& name, const nsCString& value) {
   nvPair* pair = new nvPair(name, value);
   mByteCount += pair->Size();
   mTable.PushFront(pair);
+
+  uint32_t id = mNextId++;
+  if (mLookupsEnabled) {
+    nvPairHashKey::Key key{pair->mName, pair->mValue};
+    mNameIds.Put(name, id);
+    // Points an existing entry to the new element before the older one with
+    // the same name and value gets evicted.
+    mPairIds.PutEntry(key)->Set(pair, id);
+  }
 }
 
 void nvFIFO::AddElement(const nsCString& name) {
@@ -197,7 +232,19 @@ void nvFIFO::AddElement(const nsCString& name) {
 }
 
 void nvFIFO::RemoveElement() {
+  uint32_t id = mNextId - mTable.GetSize();
   nvPair* pair = static_cast<nvPair*>(mTable.Pop());
+  if (pair && mLookupsEnabled) {
+    uint32_t newest;
+    if (mNameIds.Get(pair->mName, &newest) && newest == id) {
+      mNameIds.Remove(pair->mName);
+    }
+    nvPairHashKey* entry =
+        mPairIds.GetEntry(nvPairHashKey::Key{pair->mName, pair->mValue});
+    if (entry && entry->Id() == id) {
+      mPairIds.RemoveEntry(entry);
+    }
+  }
   if (pair) {
     mByteCount -= pair->Size();
     delete pair;
@@ -217,6 +264,49 @@ size_t nvFIFO::StaticLength() const { return gStaticHeaders->GetSize(); }
 void nvFIFO::Clear() {
   mByteCount = 0;
   while (mTable.GetSize()) delete static_cast<nvPair*>(mTable.Pop());
+  mNameIds.Clear();
+  mPairIds.Clear();
+}
+
+void nvFIFO::EnableLookups() {
+  MOZ_ASSERT(!mTable.GetSize());
+  mLookupsEnabled = true;
+}
+
+void nvFIFO::Find(const nsACString& name, const nsACString& value,
+                  int32_t& matchIndex, int32_t& nameIndex) const {
+  matchIndex = -1;
+  nameIndex = -1;
+
+  nvPairHashKey::Key key{name, value};
+
+  // The static table comes first, so its indices are always the lowest.
+  if (nvPairHashKey* entry = gStaticPairs->GetEntry(key)) {
+    matchIndex = entry->Id();
+  }
+  uint32_t index;
+  if (gStaticNames->Get(name, &index)) {
+    nameIndex = index;
+  }
+
+  if (!mLookupsEnabled) {
+    return;
+  }
+
+  if (matchIndex == -1) {
+    if (nvPairHashKey* entry = mPairIds.GetEntry(key)) {
+      matchIndex = gStaticHeaders->GetSize() + (mNextId - 1 - entry->Id());
+    }
+  }
+  uint32_t id;
+  if (nameIndex == -1 && mNameIds.Get(name, &id)) {
+    nameIndex = gStaticHeaders->GetSize() + (mNextId - 1 - id);
+  }
+}
+
+size_t nvFIFO::LookupsSizeOfExcludingThis(MallocSizeOf aMallocSizeOf) const {
+  return mNameIds.ShallowSizeOfExcludingThis(aMallocSizeOf) +
+         mPairIds.ShallowSizeOfExcludingThis(aMallocSizeOf);
 }
 
 const nvPair* nvFIFO::operator[](size_t index) const {
@@ -267,6 +357,7 @@ size_t Http2BaseCompressor::SizeOfExcludingThis(
        ++i) {
     size += mHeaderTable[i]->SizeOfIncludingThis(aMallocSizeOf);
   }
+  size += mHeaderTable.LookupsSizeOfExcludingThis(aMallocSizeOf);
   return size;
 }
 
@@ -649,175 +740,93 @@ nsresult Http2Decompressor::CopyStringFromInput(uint32_t bytes,
   return NS_OK;
 }
 
-nsresult Http2Decompressor::DecodeFinalHuffmanCharacter(
-    const HuffmanIncomingTable* table, uint8_t& c, uint8_t& bitsLeft) {
-  MOZ_ASSERT(mOffset <= mDataLen);
-  if (mOffset > mDataLen) {
-    NS_WARNING("DecodeFinalHuffmanCharacter would read beyond end of buffer");
-    return NS_ERROR_FAILURE;
-  }
-  uint8_t mask = (1 << bitsLeft) - 1;
-  uint8_t idx = mData[mOffset - 1] & mask;
-  idx <<= (8 - bitsLeft);
-  // Don't update bitsLeft yet, because we need to check that value against the
-  // number of bits used by our encoding later on. We'll update when we are sure
-  // how many bits we've actually used.
-
-  if (table->IndexHasANextTable(idx)) {
-    // Can't chain to another table when we're all out of bits in the encoding
-    LOG(("DecodeFinalHuffmanCharacter trying to chain when we're out of bits"));
-    return NS_ERROR_FAILURE;
-  }
-
-  const HuffmanIncomingEntry* entry = table->Entry(idx);
-
-  if (bitsLeft < entry->mPrefixLen) {
-    // We don't have enough bits to actually make a match, this is some sort of
-    // invalid coding
-    LOG(("DecodeFinalHuffmanCharacter does't have enough bits to match"));
-    return NS_ERROR_FAILURE;
-  }
-
-  // This is a character!
-  if (entry->mValue == 256) {
-    // EOS
-    LOG(("DecodeFinalHuffmanCharacter actually decoded an EOS"));
+nsresult Http2Decompressor::CopyHuffmanStringFromInput(uint32_t bytes,
+                                                       nsACString& val) {
+  if (mOffset + bytes > mDataLen) {
+    LOG(("CopyHuffmanStringFromInput not enough data"));
     return NS_ERROR_FAILURE;
   }
-  c = static_cast<uint8_t>(entry->mValue & 0xFF);
-  bitsLeft -= entry->mPrefixLen;
-
-  return NS_OK;
-}
 
-uint8_t Http2Decompressor::ExtractByte(uint8_t bitsLeft,
-                                       uint32_t& bytesConsumed) {
-  MOZ_DIAGNOSTIC_ASSERT(mOffset < mDataLen);
-  uint8_t rv;
-
-  if (bitsLeft) {
-    // Need to extract bitsLeft bits from the previous byte, and 8 - bitsLeft
-    // bits from the current byte
-    uint8_t mask = (1 << bitsLeft) - 1;
-    rv = (mData[mOffset - 1] & mask) << (8 - bitsLeft);
-    rv |= (mData[mOffset] & ~mask) >> bitsLeft;
-  } else {
-    rv = mData[mOffset];
+  // The shortest code is 5 bits long, which bounds the decoded length.
+  uint32_t maxLength = (uint64_t(bytes) * 8) / 5;
+  if (!val.SetLength(maxLength, fallible)) {
+    return NS_ERROR_OUT_OF_MEMORY;
   }
+  char* out = val.BeginWriting();
+  char* outStart = out;
 
-  // We always update these here, under the assumption that all 8 bits we got
-  // here will be used. These may be re-adjusted later in the case that we don't
-  // use up all 8 bits of the byte.
-  ++mOffset;
-  ++bytesConsumed;
+  const uint8_t* in = mData + mOffset;
+  const uint8_t* inEnd = in + bytes;
 
-  return rv;
-}
+  // Undecoded bits, most significant first. The tables decode 8 bits per
+  // lookup, codes longer than 8 bits chain to the next table, so a single
+  // code never needs more than 32 bits in the accumulator.
+  uint64_t accum = 0;
+  uint32_t accumBits = 0;
 
-nsresult Http2Decompressor::DecodeHuffmanCharacter(
-    const HuffmanIncomingTable* table, uint8_t& c, uint32_t& bytesConsumed,
-    uint8_t& bitsLeft) {
-  uint8_t idx = ExtractByte(bitsLeft, bytesConsumed);
+  while (true) {
+    while (accumBits <= 56 && in < inEnd) {
+      accum |= uint64_t(*in++) << (56 - accumBits);
+      accumBits += 8;
+    }
+    if (!accumBits) {
+      break;
+    }
 
-  if (table->IndexHasANextTable(idx)) {
-    if (mOffset >= mDataLen) {
-      if (!bitsLeft || (mOffset > mDataLen)) {
-        // TODO - does this get me into trouble in the new world?
-        // No info left in input to try to consume, we're done
-        LOG(("DecodeHuffmanCharacter all out of bits to consume, can't chain"));
-        return NS_ERROR_FAILURE;
+    const HuffmanIncomingTable* table = &HuffmanIncomingRoot;
+    uint32_t used = 0;
+    const HuffmanIncomingEntry* entry = nullptr;
+    while (true) {
+      // Past the end of the input the index is padded with zero bits, the
+      // entry's prefix length tells whether the real bits were enough.
+      uint8_t idx = static_cast<uint8_t>((accum << used) >> 56);
+      if (!table->IndexHasANextTable(idx)) {
+        entry = table->Entry(idx);
+        if (used + entry->mPrefixLen > accumBits) {
+          entry = nullptr;
+        }
+        break;
       }
-
-      // We might get lucky here!
-      return DecodeFinalHuffmanCharacter(table->NextTable(idx), c, bitsLeft);
+      if (used + 8 >= accumBits) {
+        // Can't chain to another table when we're all out of bits
+        break;
+      }
+      table = table->NextTable(idx);
+      used += 8;
     }
 
-    // We're sorry, Mario, but your princess is in another castle
-    return DecodeHuffmanCharacter(table->NextTable(idx), c, bytesConsumed,
-                                  bitsLeft);
-  }
-
-  const HuffmanIncomingEntry* entry = table->Entry(idx);
-  if (entry->mValue == 256) {
-    LOG(("DecodeHuffmanCharacter found an actual EOS"));
-    return NS_ERROR_FAILURE;
-  }
-  c = static_cast<uint8_t>(entry->mValue & 0xFF);
-
-  // Need to adjust bitsLeft (and possibly other values) because we may not have
-  // consumed all of the bits of the byte we extracted.
-  if (entry->mPrefixLen <= bitsLeft) {
-    bitsLeft -= entry->mPrefixLen;
-    --mOffset;
-    --bytesConsumed;
-  } else {
-    bitsLeft = 8 - (entry->mPrefixLen - bitsLeft);
-  }
-  MOZ_ASSERT(bitsLeft < 8);
-
-  return NS_OK;
-}
-
-nsresult Http2Decompressor::CopyHuffmanStringFromInput(uint32_t bytes,
-                                                       nsACString& val) {
-  if (mOffset + bytes > mDataLen) {
-    LOG(("CopyHuffmanStringFromInput not enough data"));
-    return NS_ERROR_FAILURE;
-  }
-
-  uint32_t bytesRead = 0;
-  uint8_t bitsLeft = 0;
-  nsAutoCString buf;
-  nsresult rv;
-  uint8_t c;
-
-  while (bytesRead < bytes) {
-    uint32_t bytesConsumed = 0;
-    rv = DecodeHuffmanCharacter(&HuffmanIncomingRoot, c, bytesConsumed,
-                                bitsLeft);
-    if (NS_FAILED(rv)) {
-      LOG(("CopyHuffmanStringFromInput failed to decode a character"));
-      return rv;
+    if (!entry) {
+      // Not enough bits left for a code. Unless the tail is the padding, i.e.
+      // less than 8 bits, all ones, from the root table, this is invalid.
+      if (used || accumBits > 7) {
+        LOG(("CopyHuffmanStringFromInput failed to decode a character"));
+        return NS_ERROR_FAILURE;
+      }
+      uint64_t padding = accum >> (64 - accumBits);
+      if (padding != (uint64_t(1) << accumBits) - 1) {
+        LOG(
+            ("CopyHuffmanStringFromInput ran out of data but found possible "
+             "non-EOS symbol"));
+        return NS_ERROR_FAILURE;
+      }
+      break;
     }
 
-    bytesRead += bytesConsumed;
-    buf.Append(c);
-  }
-
-  if (bytesRead > bytes) {
-    LOG(("CopyHuffmanStringFromInput read more bytes than was allowed!"));
-    return NS_ERROR_FAILURE;
-  }
-
-  if (bitsLeft) {
-    // The shortest valid code is 4 bits, so we know there can be at most one
-    // character left that our loop didn't decode. Check to see if that's the
-    // case, and if so, add it to our output.
-    rv = DecodeFinalHuffmanCharacter(&HuffmanIncomingRoot, c, bitsLeft);
-    if (NS_SUCCEEDED(rv)) {
-      buf.Append(c);
+    if (entry->mValue == 256) {
+      LOG(("CopyHuffmanStringFromInput found an actual EOS"));
+      return NS_ERROR_FAILURE;
     }
-  }
 
-  if (bitsLeft > 7) {
-    LOG(("CopyHuffmanStringFromInput more than 7 bits of padding"));
-    return NS_ERROR_FAILURE;
-  }
+    MOZ_ASSERT(out < outStart + maxLength);
+    *out++ = static_cast<char>(entry->mValue & 0xFF);
 
-  if (bitsLeft) {
-    // Any bits left at this point must belong to the EOS symbol, so make sure
-    // they make sense (ie, are all ones)
-    uint8_t mask = (1 << bitsLeft) - 1;
-    uint8_t bits = mData[mOffset - 1] & mask;
-    if (bits != mask) {
-      LOG(
-          ("CopyHuffmanStringFromInput ran out of data but found possible "
-           "non-EOS symbol"));
-      return NS_ERROR_FAILURE;
-    }
+    uint32_t codeBits = used + entry->mPrefixLen;
+    accum <<= codeBits;
+    accumBits -= codeBits;
   }
 
-  val = buf;
+  mOffset += bytes;
+  val.SetLength(out - outStart);
   LOG(("CopyHuffmanStringFromInput decoded a full string!"));
   return NS_OK;
 }
@@ -1373,7 +1382,6 @@ void Http2Compressor::HuffmanAppend(const nsCString& value) {
 void Http2Compressor::ProcessHeader(const nvPair inputPair, bool noLocalIndex,
                                     bool neverIndex) {
   uint32_t newSize = inputPair.Size();
-  uint32_t headerTableSize = mHeaderTable.Length();
   uint32_t matchedIndex = 0u;
   uint32_t nameReference = 0u;
   bool match = false;
@@ -1381,17 +1389,15 @@ void Http2Compressor::ProcessHeader(const nvPair inputPair, bool noLocalIndex,
   LOG(("Http2Compressor::ProcessHeader %s %s", inputPair.mName.get(),
        inputPair.mValue.get()));
 
-  // NWGH - make this index = 1; index <= headerTableSize; ++index
-  for (uint32_t index = 0; index < headerTableSize; ++index) {
-    if (mHeaderTable[index]->mName.Equals(inputPair.mName)) {
-      // NWGH - make this nameReference = index
-      nameReference = index + 1;
-      if (mHeaderTable[index]->mValue.Equals(inputPair.mValue)) {
-        match = true;
-        matchedIndex = index;
-        break;
-      }
-    }
+  int32_t matchIndex, nameIndex;
+  mHeaderTable.Find(inputPair.mName, inputPair.mValue, matchIndex, nameIndex);
+  if (matchIndex != -1) {
+    match = true;
+    matchedIndex = matchIndex;
+  }
+  if (nameIndex != -1) {
+    // NWGH - make this nameReference = index
+    nameReference = nameIndex + 1;
   }
 
   // We need to emit a new literal
@@ -10,16 +10,18 @@
 // https://www.rfc-editor.org/rfc/rfc7541.txt
 
 #include "mozilla/Attributes.h"
+#include "mozilla/HashFunctions.h"
+#include "nsDataHashtable.h"
 #include "nsDeque.h"
+#include "nsHashKeys.h"
 #include "nsString.h"
+#include "nsTHashtable.h"
 #include "nsIMemoryReporter.h"
 #include "mozilla/Telemetry.h"
 
 namespace mozilla {
 namespace net {
 
-struct HuffmanIncomingTable;
-
 void Http2CompressionCleanup();
 
 class nvPair {
@@ -35,6 +37,48 @@ class nvPair {
   nsCString mValue;
 };
 
+// Hashtable entry mapping the name and value of a header table element to
+// the id of that element.  Lookups hash and compare the strings in place
+// instead of building a combined key.  The entry points to the strings of
+// the element it was last Set() to, which must stay alive as long as the
+// entry does.
+class nvPairHashKey : public PLDHashEntryHdr {
+ public:
+  struct Key {
+    const nsACString& mName;
+    const nsACString& mValue;
+  };
+  typedef const Key& KeyType;
+  typedef const Key* KeyTypePointer;
+
+  explicit nvPairHashKey(KeyTypePointer aKey)
+      : mName(&aKey->mName), mValue(&aKey->mValue), mId(0) {}
+  nvPairHashKey(nvPairHashKey&& aOther) = default;
+  ~nvPairHashKey() = default;
+
+  bool KeyEquals(KeyTypePointer aKey) const {
+    return mName->Equals(aKey->mName) && mValue->Equals(aKey->mValue);
+  }
+
+  static KeyTypePointer KeyToPointer(KeyType aKey) { return &aKey; }
+  static PLDHashNumber HashKey(KeyTypePointer aKey) {
+    return AddToHash(HashString(aKey->mName), HashString(aKey->mValue));
+  }
+  enum { ALLOW_MEMMOVE = true };
+
+  void Set(const nvPair* aPair, uint32_t aId) {
+    mName = &aPair->mName;
+    mValue = &aPair->mValue;
+    mId = aId;
+  }
+  uint32_t Id() const { return mId; }
+
+ private:
+  const nsACString* mName;
+  const nsACString* mValue;
+  uint32_t mId;
+};
+
 class nvFIFO {
  public:
   nvFIFO();
@@ -49,9 +93,30 @@ class nvFIFO {
   void Clear();
   const nvPair* operator[](size_t index) const;
 
+  // Hashed lookups for the compressor, so that it doesn't have to compare
+  // every header against the whole table. The dynamic part of the table is
+  // only indexed after EnableLookups().
+  void EnableLookups();
+  // Sets |matchIndex| to the lowest index of an entry with both |name| and
+  // |value|, and |nameIndex| to the lowest index of an entry with |name|.
+  // Indices are the same as for operator[], -1 when there is no such entry.
+  void Find(const nsACString& name, const nsACString& value,
+            int32_t& matchIndex, int32_t& nameIndex) const;
+  size_t LookupsSizeOfExcludingThis(MallocSizeOf aMallocSizeOf) const;
+
  private:
   uint32_t mByteCount;
   nsDeque mTable;
+
+  // Every element added to the dynamic table gets the next id, the index of
+  // an id is computed from the number of elements added since. The maps
+  // point to the newest element for a name or name+value key, which is also
+  // the one with the lowest index. When the newest element for a key is
+  // evicted, all older ones are gone too, so the key is removed.
+  bool mLookupsEnabled;
+  uint32_t mNextId;
+  nsDataHashtable<nsCStringHashKey, uint32_t> mNameIds;
+  nsTHashtable<nvPairHashKey> mPairIds;
 };
 
 class HpackDynamicTableReporter;
@@ -132,14 +197,8 @@ class Http2Decompressor final : public Http2BaseCompressor {
 
   MOZ_MUST_USE nsresult CopyHeaderString(uint32_t index, nsACString& name);
   MOZ_MUST_USE nsresult CopyStringFromInput(uint32_t index, nsACString& val);
-  uint8_t ExtractByte(uint8_t bitsLeft, uint32_t& bytesConsumed);
   MOZ_MUST_USE nsresult CopyHuffmanStringFromInput(uint32_t index,
                                                    nsACString& val);
-  MOZ_MUST_USE nsresult
-  DecodeHuffmanCharacter(const HuffmanIncomingTable* table, uint8_t& c,
-                         uint32_t& bytesConsumed, uint8_t& bitsLeft);
-  MOZ_MUST_USE nsresult DecodeFinalHuffmanCharacter(
-      const HuffmanIncomingTable* table, uint8_t& c, uint8_t& bitsLeft);
 
   nsCString mHeaderStatus;
   nsCString mHeaderHost;
@@ -163,6 +222,7 @@ class Http2Compressor final : public Http2BaseCompressor {
         mLowestBufferSizeWaiting(0) {
     mPeakSizeID = Telemetry::HPACK_PEAK_SIZE_COMPRESSOR;
     mPeakCountID = Telemetry::HPACK_PEAK_COUNT_COMPRESSOR;
+    mHeaderTable.EnableLookups();
   };
   virtual ~Http2Compressor() = default;
 
@@ -68,6 +68,7 @@ Http2Session::Http2Session(nsISocketTransport* aSocketTransport,
       mLastPushedID(0),
       mConcurrentHighWater(0),
       mDownstreamState(BUFFERING_OPENING_SETTINGS),
+      mWriteScheduler(gHttpHandler->UseH2WriteScheduling()),
       mInputFrameBufferSize(kDefaultBufferSize),
       mInputFrameBufferUsed(0),
       mInputFrameDataSize(0),
@@ -689,6 +690,18 @@ void Http2Session::FlushOutputQueue() {
   }
 }
 
+// Called where a flush is only an opportunity: when coalescing, the frames
+// already buffered wait for the next stream's.
+void Http2Session::MaybeFlushOutputQueue() {
+  if (!mAttemptingEarlyData &&
+      mWriteScheduler.CanHold(mOutputQueueUsed - mOutputQueueSent)) {
+    LOG3(("Http2Session::MaybeFlushOutputQueue %p holding %u bytes", this,
+          mOutputQueueUsed - mOutputQueueSent));
+    return;
+  }
+  FlushOutputQueue();
+}
+
 void Http2Session::DontReuse() {
   LOG3(("Http2Session::DontReuse %p\n", this));
   if (!OnSocketThread()) {
@@ -2910,7 +2923,10 @@ nsresult Http2Session::ReadSegmentsAgain(nsAHttpSegmentReader* reader,
 
   LOG3(("Http2Session::ReadSegments %p", this));
 
-  Http2Stream* stream = static_cast<Http2Stream*>(mReadyForWrite.PopFront());
+  Http2Stream* stream = mWriteScheduler.PopStream<Http2Stream>(
+      mReadyForWrite, [](Http2Stream* aStream) {
+        return aStream->WriteUrgency();
+      });
   if (!stream) {
     LOG3(("Http2Session %p could not identify a stream to write; suspending.",
           this));
@@ -2960,6 +2976,11 @@ nsresult Http2Session::ReadSegmentsAgain(nsAHttpSegmentReader* reader,
        this, stream, stream->StreamID(), stream->RequestBlockedOnRead(),
        stream->BlockedOnRwin()));
 
+  // With other streams waiting, this one gets a bounded turn, and the small
+  // frames it produces can wait to be written along with theirs.
+  Http2WriteScheduler::AutoTurn turn(
+      mWriteScheduler, GetWriteQueueSize() && !mAttemptingEarlyData, count);
+
   rv = stream->ReadSegments(this, count, countRead);
 
   if (earlyDataUsed) {
@@ -2978,8 +2999,15 @@ nsresult Http2Session::ReadSegmentsAgain(nsAHttpSegmentReader* reader,
   // Not every permutation of stream->ReadSegents produces data (and therefore
   // tries to flush the output queue) - SENDING_FIN_STREAM can be an example
   // of that. But we might still have old data buffered that would be good
-  // to flush.
-  FlushOutputQueue();
+  // to flush. When the stream can go on, or is done, and others are waiting,
+  // SetWriteCallbacks() below brings us back to write the held frames with
+  // theirs; otherwise flush now.
+  if (NS_SUCCEEDED(rv) && !stream->RequestBlockedOnRead() &&
+      !stream->BlockedOnRwin()) {
+    MaybeFlushOutputQueue();
+  } else {
+    FlushOutputQueue();
+  }
 
   // Allow new server reads - that might be data or control information
   // (e.g. window updates or http replies) that are responses to these writes
@@ -3982,7 +4010,7 @@ nsresult Http2Session::OnReadSegment(const char* buf, uint32_t count,
   mOutputQueueUsed += count;
   *countRead = count;
 
-  FlushOutputQueue();
+  MaybeFlushOutputQueue();
 
   return NS_OK;
 }
@@ -22,6 +22,7 @@
 #include "nsICacheEntryOpenCallback.h"
 
 #include "Http2Compression.h"
+#include "Http2WriteScheduler.h"
 
 class nsISocketTransport;
 
@@ -227,6 +228,7 @@ class Http2Session final : public ASpdySession,
   CommitToSegmentSize(uint32_t size, bool forceCommitment) override;
   MOZ_MUST_USE nsresult BufferOutput(const char*, uint32_t, uint32_t*);
   void FlushOutputQueue();
+  void MaybeFlushOutputQueue();
   uint32_t AmountOfOutputBuffered() {
     return mOutputQueueUsed - mOutputQueueSent;
   }
@@ -381,6 +383,7 @@ class Http2Session final : public ASpdySession,
       mStreamTransactionHash;
 
   nsDeque mReadyForWrite;
+  Http2WriteScheduler mWriteScheduler;
   nsDeque mQueuedStreams;
   nsDeque mPushesReadyForRead;
   nsDeque mSlowConsumersReadyForRead;
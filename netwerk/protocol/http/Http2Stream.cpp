@@ -1243,6 +1243,44 @@ static uint32_t GetPriorityDependencyFromTransaction(nsHttpTransaction* trans) {
   return Http2Session::kFollowerGroupID;  // unmarked followers
 }
 
+uint32_t Http2Stream::WriteUrgency() {
+  // The dependency group, when in use, already reflects the active tab.
+  uint32_t group = mPriorityDependency;
+  if (!group) {
+    nsHttpTransaction* trans =
+        mTransaction ? mTransaction->QueryHttpTransaction() : nullptr;
+    group = trans ? GetPriorityDependencyFromTransaction(trans)
+                  : Http2Session::kOtherGroupID;
+  }
+
+  uint32_t rank;
+  switch (group) {
+    case Http2Session::kUrgentStartGroupID:
+      rank = 0;
+      break;
+    case Http2Session::kLeaderGroupID:
+      rank = 1;
+      break;
+    case Http2Session::kFollowerGroupID:
+      rank = 3;
+      break;
+    case Http2Session::kBackgroundGroupID:
+      rank = 4;
+      break;
+    case Http2Session::kSpeculativeGroupID:
+      rank = 5;
+      break;
+    default:
+      // kOtherGroupID, or a pushed stream depending on its associated one.
+      rank = 2;
+      break;
+  }
+
+  // Within a group, by nsISupportsPriority; mPriority is clamped to
+  // [kBestPriority, kWorstPriority].
+  return (rank << 8) | (mPriority - kBestPriority);
+}
+
 void Http2Stream::UpdatePriorityDependency() {
   if (!mSession->UseH2Deps()) {
     return;
@@ -145,6 +145,8 @@ class Http2Stream : public nsAHttpSegmentReader,
   bool BlockedOnRwin() { return mBlockedOnRwin; }
 
   uint32_t Priority() { return mPriority; }
+  // Orders the streams waiting to write in the session; lower goes first.
+  uint32_t WriteUrgency();
   uint32_t PriorityDependency() { return mPriorityDependency; }
   uint8_t PriorityWeight() { return mPriorityWeight; }
   void SetPriority(uint32_t);
@@ -0,0 +1,110 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set sw=2 ts=8 et tw=80 : */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef mozilla_net_Http2WriteScheduler_h
+#define mozilla_net_Http2WriteScheduler_h
+
+#include "mozilla/Attributes.h"
+#include "nsDeque.h"
+
+namespace mozilla {
+namespace net {
+
+// How an Http2Session shares its connection among the streams that are
+// ready to write: which one goes next, how much it may write in a turn and
+// whether the frames it wrote can wait in the output queue for the next
+// stream's.  With network.http.spdy.write-scheduling off, streams take
+// turns in queue order and every frame is flushed right away.
+//
+// Lives on the socket thread with its session.
+class Http2WriteScheduler final {
+ public:
+  // While other streams are waiting to write, small frames are held in the
+  // output queue until this much is buffered, so they leave in one TLS
+  // record instead of one record each.
+  static const uint32_t kCoalesceWriteSize = 16384;
+  // ... and a stream gets to write at most this much per turn, so a large
+  // upload cannot hold back more urgent streams for long.
+  static const uint32_t kMaxStreamWriteBurst = 16384;
+
+  explicit Http2WriteScheduler(bool aEnabled)
+      : mEnabled(aEnabled), mCoalescing(false) {}
+
+  // Takes the stream to write next out of |aReady|: the most urgent one,
+  // the first queued among equals, so render-blocking requests go out
+  // first under contention rather than in the order their streams became
+  // writable.  |aUrgency(stream)| ranks a stream, lower goes first.
+  template <typename Stream, typename Urgency>
+  Stream* PopStream(nsDeque& aReady, Urgency aUrgency) const {
+    size_t size = aReady.GetSize();
+    Stream* best = nullptr;
+    uint32_t bestUrgency = 0;
+    for (size_t i = 0; mEnabled && i < size; ++i) {
+      Stream* stream = static_cast<Stream*>(aReady.ObjectAt(i));
+      uint32_t urgency = aUrgency(stream);
+      if (!best || urgency < bestUrgency) {
+        best = stream;
+        bestUrgency = urgency;
+      }
+    }
+
+    if (!best || best == aReady.PeekFront()) {
+      return static_cast<Stream*>(aReady.PopFront());
+    }
+
+    // Take out the first entry for |best| and keep the rest in order.
+    bool found = false;
+    for (size_t i = 0; i < size; ++i) {
+      Stream* stream = static_cast<Stream*>(aReady.PopFront());
+      if (!found && stream == best) {
+        found = true;
+        continue;
+      }
+      aReady.Push(stream);
+    }
+    return best;
+  }
+
+  // A stream's turn to write.  While others are waiting, |aCount| is capped
+  // to the burst size and output may be held until the turn ends.
+  class MOZ_STACK_CLASS AutoTurn final {
+   public:
+    AutoTurn(Http2WriteScheduler& aScheduler, bool aOthersWaiting,
+             uint32_t& aCount)
+        : mScheduler(aScheduler), mWasCoalescing(aScheduler.mCoalescing) {
+      if (mScheduler.mEnabled && aOthersWaiting) {
+        if (aCount > kMaxStreamWriteBurst) {
+          aCount = kMaxStreamWriteBurst;
+        }
+        mScheduler.mCoalescing = true;
+      }
+    }
+
+    ~AutoTurn() { mScheduler.mCoalescing = mWasCoalescing; }
+
+   private:
+    Http2WriteScheduler& mScheduler;
+    bool mWasCoalescing;
+  };
+
+  // Whether |aBuffered| bytes of frames can stay in the output queue for
+  // now, to be written along with the next stream's.  Once the turn is
+  // over the session either flushes them or comes back to write more.
+  bool CanHold(uint32_t aBuffered) const {
+    return mCoalescing && aBuffered < kCoalesceWriteSize;
+  }
+
+ private:
+  const bool mEnabled;
+  // Set during a turn while more streams are ready to write.
+  bool mCoalescing;
+};
+
+}  // namespace net
+}  // namespace mozilla
+
+#endif  // mozilla_net_Http2WriteScheduler_h
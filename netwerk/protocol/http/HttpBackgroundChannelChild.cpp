@@ -23,6 +23,33 @@ using mozilla::ipc::IPCResult;
 namespace mozilla {
 namespace net {
 
+// HttpBodySegment
+HttpBodySegment::HttpBodySegment(HttpBackgroundChannelChild* aOwner,
+                                 ipc::Shmem&& aShmem)
+    : mOwner(aOwner), mShmem(std::move(aShmem)) {}
+
+HttpBodySegment::~HttpBodySegment() {
+  if (OnSocketThread()) {
+    mOwner->RecycleBodySegment(mShmem);
+    return;
+  }
+
+  // The data is usually consumed on the main thread or the thread the
+  // channel was retargeted to.
+  if (!gSocketTransportService) {
+    return;
+  }
+
+  RefPtr<HttpBackgroundChannelChild> owner = mOwner.forget();
+  ipc::Shmem shmem = mShmem;
+  gSocketTransportService->Dispatch(
+      NS_NewRunnableFunction("net::HttpBodySegment::~HttpBodySegment",
+                             [owner, shmem]() mutable {
+                               owner->RecycleBodySegment(shmem);
+                             }),
+      NS_DISPATCH_NORMAL);
+}
+
 // HttpBackgroundChannelChild
 HttpBackgroundChannelChild::HttpBackgroundChannelChild() = default;
 
@@ -150,6 +177,63 @@ IPCResult HttpBackgroundChannelChild::RecvOnTransportAndData(
   return IPC_OK();
 }
 
+IPCResult HttpBackgroundChannelChild::RecvOnTransportAndDataShmem(
+    const nsresult& aChannelStatus, const nsresult& aTransportStatus,
+    const uint64_t& aOffset, const uint32_t& aCount, Shmem&& aData) {
+  LOG(("HttpBackgroundChannelChild::RecvOnTransportAndDataShmem [this=%p]\n",
+       this));
+  MOZ_ASSERT(OnSocketThread());
+
+  // The data is read in place as a null-terminated string.
+  if (NS_WARN_IF(aCount >= aData.Size<char>() ||
+                 aData.get<char>()[aCount] != '\0')) {
+    return IPC_FAIL_NO_REASON(this);
+  }
+
+  RefPtr<HttpBodySegment> segment =
+      new HttpBodySegment(this, std::move(aData));
+  OnTransportAndDataSegment(aChannelStatus, aTransportStatus, aOffset, aCount,
+                            segment);
+  return IPC_OK();
+}
+
+void HttpBackgroundChannelChild::OnTransportAndDataSegment(
+    const nsresult& aChannelStatus, const nsresult& aTransportStatus,
+    const uint64_t& aOffset, const uint32_t& aCount,
+    HttpBodySegment* aSegment) {
+  MOZ_ASSERT(OnSocketThread());
+
+  if (NS_WARN_IF(!mChannelChild)) {
+    return;
+  }
+
+  if (IsWaitingOnStartRequest()) {
+    LOG(("  > pending until OnStartRequest [offset=%" PRIu64 " count=%" PRIu32
+         "]\n",
+         aOffset, aCount));
+
+    mQueuedRunnables.AppendElement(
+        NewRunnableMethod<const nsresult, const nsresult, const uint64_t,
+                          const uint32_t, RefPtr<HttpBodySegment>>(
+            "HttpBackgroundChannelChild::OnTransportAndDataSegment", this,
+            &HttpBackgroundChannelChild::OnTransportAndDataSegment,
+            aChannelStatus, aTransportStatus, aOffset, aCount, aSegment));
+    return;
+  }
+
+  mChannelChild->ProcessOnTransportAndData(aChannelStatus, aTransportStatus,
+                                           aOffset, aCount, aSegment);
+}
+
+void HttpBackgroundChannelChild::RecycleBodySegment(Shmem& aSegment) {
+  MOZ_ASSERT(OnSocketThread());
+
+  // Once the actor is gone the segment is simply unmapped.
+  if (mIPCOpened) {
+    Unused << SendRecycleBodySegment(aSegment);
+  }
+}
+
 IPCResult HttpBackgroundChannelChild::RecvOnStopRequest(
     const nsresult& aChannelStatus, const ResourceTimingStruct& aTiming,
     const TimeStamp& aLastActiveTabOptHit,
@@ -428,6 +512,8 @@ void HttpBackgroundChannelChild::ActorDestroy(ActorDestroyReason aWhy) {
   MOZ_ASSERT(gSocketTransportService);
   MOZ_ASSERT(gSocketTransportService->IsOnCurrentThreadInfallible());
 
+  mIPCOpened = false;
+
   // Ensure all IPC messages received before ActorDestroy can be
   // handled correctly. If there is any pending IPC message, destroyed
   // mChannelChild until those messages are flushed.
@@ -19,10 +19,30 @@ namespace mozilla {
 namespace net {
 
 class HttpChannelChild;
+class HttpBackgroundChannelChild;
+
+// A segment of shared memory holding response body data from
+// OnTransportAndDataShmem.  It goes back to the parent to be filled again
+// once the last reference to it is dropped.
+class HttpBodySegment final {
+ public:
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(HttpBodySegment)
+
+  HttpBodySegment(HttpBackgroundChannelChild* aOwner, ipc::Shmem&& aShmem);
+
+  const char* Data() const { return mShmem.get<char>(); }
+
+ private:
+  ~HttpBodySegment();
+
+  RefPtr<HttpBackgroundChannelChild> mOwner;
+  ipc::Shmem mShmem;
+};
 
 class HttpBackgroundChannelChild final : public PHttpBackgroundChannelChild {
   friend class BackgroundChannelCreateCallback;
   friend class PHttpBackgroundChannelChild;
+  friend class HttpBodySegment;
 
  public:
   explicit HttpBackgroundChannelChild();
@@ -48,6 +68,12 @@ class HttpBackgroundChannelChild final : public PHttpBackgroundChannelChild {
                                    const uint32_t& aCount,
                                    const nsCString& aData);
 
+  IPCResult RecvOnTransportAndDataShmem(const nsresult& aChannelStatus,
+                                        const nsresult& aTransportStatus,
+                                        const uint64_t& aOffset,
+                                        const uint32_t& aCount,
+                                        Shmem&& aData);
+
   IPCResult RecvOnStopRequest(const nsresult& aChannelStatus,
                               const ResourceTimingStruct& aTiming,
                               const TimeStamp& aLastActiveTabOptHit,
@@ -99,6 +125,19 @@ class HttpBackgroundChannelChild final : public PHttpBackgroundChannelChild {
   // are invoked.
   bool IsWaitingOnStartRequest();
 
+  void OnTransportAndDataSegment(const nsresult& aChannelStatus,
+                                 const nsresult& aTransportStatus,
+                                 const uint64_t& aOffset,
+                                 const uint32_t& aCount,
+                                 HttpBodySegment* aSegment);
+
+  // Sends a segment back to the parent, on the STS thread.
+  void RecycleBodySegment(Shmem& aSegment);
+
+  // False once the actor has been destroyed.  Should only access on STS
+  // thread.
+  bool mIPCOpened = true;
+
   // Associated HttpChannelChild for handling the channel events.
   // Will be removed while failed to create background channel,
   // destruction of the background channel, or explicitly dissociation
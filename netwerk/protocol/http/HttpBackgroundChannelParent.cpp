@@ -67,7 +67,10 @@ class ContinueAsyncOpenRunnable final : public Runnable {
 
 HttpBackgroundChannelParent::HttpBackgroundChannelParent()
     : mIPCOpened(true),
-      mBgThreadMutex("HttpBackgroundChannelParent::BgThreadMutex") {
+      mBgThreadMutex("HttpBackgroundChannelParent::BgThreadMutex"),
+      mBodySegmentMutex("HttpBackgroundChannelParent::BodySegmentMutex"),
+      mBodyBytesSent(0),
+      mBodySegmentsAllocated(false) {
   AssertIsInMainProcess();
   AssertIsOnBackgroundThread();
 
@@ -191,10 +194,114 @@ bool HttpBackgroundChannelParent::OnTransportAndData(
     return NS_SUCCEEDED(rv);
   }
 
+  MaybeAllocateBodySegments(aCount);
+
   return SendOnTransportAndData(aChannelStatus, aTransportStatus, aOffset,
                                 aCount, aData);
 }
 
+bool HttpBackgroundChannelParent::TakeBodySegment(Shmem& aSegment) {
+  MutexAutoLock lock(mBodySegmentMutex);
+  return mBodySegments.Take(aSegment);
+}
+
+void HttpBackgroundChannelParent::ReturnBodySegment(Shmem& aSegment) {
+  MutexAutoLock lock(mBodySegmentMutex);
+  DebugOnly<bool> put = mBodySegments.Put(aSegment);
+  MOZ_ASSERT(put);
+}
+
+bool HttpBackgroundChannelParent::OnTransportAndData(
+    const nsresult& aChannelStatus, const nsresult& aTransportStatus,
+    const uint64_t& aOffset, const uint32_t& aCount, Shmem& aSegment) {
+  LOG(("HttpBackgroundChannelParent::OnTransportAndData [this=%p shmem]\n",
+       this));
+  AssertIsInMainProcess();
+  MOZ_ASSERT(aCount < aSegment.Size<char>());
+
+  if (NS_WARN_IF(!mIPCOpened)) {
+    return false;
+  }
+
+  // The child reads the data in place, as a string.
+  aSegment.get<char>()[aCount] = '\0';
+
+  if (!IsOnBackgroundThread()) {
+    MutexAutoLock lock(mBgThreadMutex);
+    RefPtr<HttpBackgroundChannelParent> self = this;
+    nsresult rv = mBackgroundThread->Dispatch(
+        NS_NewRunnableFunction(
+            "net::HttpBackgroundChannelParent::OnTransportAndData",
+            [self, aChannelStatus, aTransportStatus, aOffset, aCount,
+             aSegment]() mutable {
+              self->OnTransportAndData(aChannelStatus, aTransportStatus,
+                                       aOffset, aCount, aSegment);
+            }),
+        NS_DISPATCH_NORMAL);
+
+    MOZ_DIAGNOSTIC_ASSERT(NS_SUCCEEDED(rv));
+
+    return NS_SUCCEEDED(rv);
+  }
+
+  return SendOnTransportAndDataShmem(aChannelStatus, aTransportStatus, aOffset,
+                                     aCount, aSegment);
+}
+
+void HttpBackgroundChannelParent::MaybeAllocateBodySegments(uint32_t aCount) {
+  AssertIsOnBackgroundThread();
+
+  // Small bodies are not worth the shared memory.
+  static const uint64_t kBodySegmentThreshold = 256 * 1024;
+
+  mBodyBytesSent += aCount;
+  if (mBodySegmentsAllocated || mBodyBytesSent < kBodySegmentThreshold) {
+    return;
+  }
+
+  mBodySegmentsAllocated = true;
+
+  nsTArray<Shmem> segments;
+  for (uint32_t i = 0; i < kBodySegmentCount; ++i) {
+    Shmem segment;
+    // One more byte for the terminating null.
+    if (!AllocShmem(kBodySegmentSize + 1, Shmem::SharedMemory::TYPE_BASIC,
+                    &segment)) {
+      LOG(("  failed to allocate body segment [this=%p]\n", this));
+      break;
+    }
+    segments.AppendElement(segment);
+  }
+
+  LOG(("HttpBackgroundChannelParent::MaybeAllocateBodySegments [this=%p "
+       "count=%zu]\n",
+       this, segments.Length()));
+
+  MutexAutoLock lock(mBodySegmentMutex);
+  for (const Shmem& segment : segments) {
+    mBodySegments.Add(segment);
+  }
+}
+
+IPCResult HttpBackgroundChannelParent::RecvRecycleBodySegment(
+    Shmem&& aSegment) {
+  AssertIsOnBackgroundThread();
+
+  if (NS_WARN_IF(aSegment.Size<char>() <= kBodySegmentSize)) {
+    return IPC_FAIL_NO_REASON(this);
+  }
+
+  // Only a segment of ours that is in use can come back; anything else, e.g.
+  // a segment sent back twice, means the child is misbehaving.
+  MutexAutoLock lock(mBodySegmentMutex);
+  MOZ_ASSERT(mBodySegments.Length() <= kBodySegmentCount);
+  if (NS_WARN_IF(mBodySegments.FreeLength() >= kBodySegmentCount) ||
+      NS_WARN_IF(!mBodySegments.Put(aSegment))) {
+    return IPC_FAIL_NO_REASON(this);
+  }
+  return IPC_OK();
+}
+
 bool HttpBackgroundChannelParent::OnStopRequest(
     const nsresult& aChannelStatus, const ResourceTimingStruct& aTiming,
     const nsHttpHeaderArray& aResponseTrailers) {
@@ -539,6 +646,11 @@ void HttpBackgroundChannelParent::ActorDestroy(ActorDestroyReason aWhy) {
 
   mIPCOpened = false;
 
+  {
+    MutexAutoLock lock(mBodySegmentMutex);
+    mBodySegments.Clear();
+  }
+
   RefPtr<HttpBackgroundChannelParent> self = this;
   DebugOnly<nsresult> rv = NS_DispatchToMainThread(NS_NewRunnableFunction(
       "net::HttpBackgroundChannelParent::ActorDestroy", [self]() {
@@ -8,11 +8,13 @@
 #ifndef mozilla_net_HttpBackgroundChannelParent_h
 #define mozilla_net_HttpBackgroundChannelParent_h
 
+#include "mozilla/net/HttpBodySegmentRing.h"
 #include "mozilla/net/PHttpBackgroundChannelParent.h"
 #include "mozilla/Atomics.h"
 #include "mozilla/Mutex.h"
 #include "nsID.h"
 #include "nsISupportsImpl.h"
+#include "nsTArray.h"
 
 class nsIEventTarget;
 
@@ -22,9 +24,17 @@ namespace net {
 class HttpChannelParent;
 
 class HttpBackgroundChannelParent final : public PHttpBackgroundChannelParent {
+  friend class PHttpBackgroundChannelParent;
+
  public:
   explicit HttpBackgroundChannelParent();
 
+  // Room for data in each shared memory segment used for large bodies.
+  static const uint32_t kBodySegmentSize = 128 * 1024;
+  // Number of segments, enough for the parent to keep filling segments while
+  // the child consumes others.
+  static const uint32_t kBodySegmentCount = 4;
+
   NS_INLINE_DECL_THREADSAFE_REFCOUNTING(HttpBackgroundChannelParent)
 
   // Try to find associated HttpChannelParent with the same
@@ -48,6 +58,20 @@ class HttpBackgroundChannelParent final : public PHttpBackgroundChannelParent {
                           const uint64_t& aOffset, const uint32_t& aCount,
                           const nsCString& aData);
 
+  // Takes a free body segment, if the channel has started using them and one
+  // is not in use by the child.  Can be called on any thread.
+  bool TakeBodySegment(Shmem& aSegment);
+
+  // Gives back a segment from TakeBodySegment that was not sent.
+  void ReturnBodySegment(Shmem& aSegment);
+
+  // To send OnTransportAndData message over background channel, with the
+  // first |aCount| bytes of |aSegment|, which came from TakeBodySegment.
+  bool OnTransportAndData(const nsresult& aChannelStatus,
+                          const nsresult& aTransportStatus,
+                          const uint64_t& aOffset, const uint32_t& aCount,
+                          Shmem& aSegment);
+
   // To send OnStopRequest message over background channel.
   bool OnStopRequest(const nsresult& aChannelStatus,
                      const ResourceTimingStruct& aTiming,
@@ -90,11 +114,17 @@ class HttpBackgroundChannelParent final : public PHttpBackgroundChannelParent {
                                           const nsACString& aFullHashes);
 
  protected:
+  mozilla::ipc::IPCResult RecvRecycleBodySegment(Shmem&& aSegment);
+
   void ActorDestroy(ActorDestroyReason aWhy) override;
 
  private:
   virtual ~HttpBackgroundChannelParent();
 
+  // Once a channel has sent enough data to look like a large download,
+  // allocates the segments that the rest of its body is sent in.
+  void MaybeAllocateBodySegments(uint32_t aCount);
+
   Atomic<bool> mIPCOpened;
 
   // Used to ensure atomicity of mBackgroundThread
@@ -102,6 +132,16 @@ class HttpBackgroundChannelParent final : public PHttpBackgroundChannelParent {
 
   nsCOMPtr<nsIEventTarget> mBackgroundThread;
 
+  // Protects mBodySegments, whose segments are allocated and given back on
+  // the background thread and taken on the main thread.
+  Mutex mBodySegmentMutex;
+  HttpBodySegmentRing<Shmem> mBodySegments;
+
+  // Body bytes sent in messages so far, and whether the segments were
+  // allocated.  Background thread only.
+  uint64_t mBodyBytesSent;
+  bool mBodySegmentsAllocated;
+
   // associated HttpChannelParent for generating the channel events
   RefPtr<HttpChannelParent> mChannelParent;
 };
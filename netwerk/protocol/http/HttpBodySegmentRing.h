@@ -0,0 +1,72 @@
+/* -*- Mode: C++; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set sw=2 ts=8 et tw=80 : */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef mozilla_net_HttpBodySegmentRing_h
+#define mozilla_net_HttpBodySegmentRing_h
+
+#include "nsTArray.h"
+
+namespace mozilla {
+namespace net {
+
+// The segments of shared memory a channel sends large response bodies in,
+// and which of them are free to be filled.  A segment is taken to send data
+// in, and put back once the child is done with it.  Segments are compared
+// with operator==; for Shmem that compares the underlying memory, so a
+// segment the child sends back matches the one that was allocated.
+//
+// Not thread-safe; HttpBackgroundChannelParent holds a lock around it.
+template <typename Segment>
+class HttpBodySegmentRing final {
+ public:
+  // Adds a newly allocated segment, free to be taken.
+  void Add(const Segment& aSegment) {
+    mSegments.AppendElement(aSegment);
+    mFree.AppendElement(aSegment);
+  }
+
+  // Takes a free segment.  Returns false when every segment is in use,
+  // including before any were added, and the data has to be sent some
+  // other way.
+  bool Take(Segment& aSegment) {
+    if (mFree.IsEmpty()) {
+      return false;
+    }
+
+    aSegment = mFree.PopLastElement();
+    return true;
+  }
+
+  // Puts back a segment from Take().  Returns false, and changes nothing,
+  // for a segment that is not one of ours or that is already free.
+  bool Put(const Segment& aSegment) {
+    if (mFree.Length() >= mSegments.Length() ||
+        !mSegments.Contains(aSegment) || mFree.Contains(aSegment)) {
+      return false;
+    }
+
+    mFree.AppendElement(aSegment);
+    return true;
+  }
+
+  uint32_t Length() const { return mSegments.Length(); }
+  uint32_t FreeLength() const { return mFree.Length(); }
+
+  void Clear() {
+    mSegments.Clear();
+    mFree.Clear();
+  }
+
+ private:
+  nsTArray<Segment> mSegments;
+  nsTArray<Segment> mFree;
+};
+
+}  // namespace net
+}  // namespace mozilla
+
+#endif  // mozilla_net_HttpBodySegmentRing_h
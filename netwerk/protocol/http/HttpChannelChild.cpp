@@ -45,6 +45,7 @@
 #include "mozilla/ipc/BackgroundUtils.h"
 #include "mozilla/net/ChannelDiverterChild.h"
 #include "mozilla/net/DNS.h"
+#include "mozilla/net/NetworkTrace.h"
 #include "SerializedLoadContext.h"
 #include "nsInputStreamPump.h"
 #include "InterceptedChannel.h"
@@ -731,7 +732,27 @@ class TransportAndDataEvent : public ChannelEvent {
         mOffset(offset),
         mCount(count) {}
 
+  TransportAndDataEvent(HttpChannelChild* child, const nsresult& channelStatus,
+                        const nsresult& transportStatus,
+                        HttpBodySegment* segment, const uint64_t& offset,
+                        const uint32_t& count)
+      : mChild(child),
+        mChannelStatus(channelStatus),
+        mTransportStatus(transportStatus),
+        mSegment(segment),
+        mOffset(offset),
+        mCount(count) {}
+
   void Run() override {
+    if (mSegment) {
+      // Read the data in place; the segment goes back to the parent once
+      // this event is done with it.
+      nsDependentCString data(mSegment->Data(), mCount);
+      mChild->OnTransportAndData(mChannelStatus, mTransportStatus, mOffset,
+                                 mCount, data);
+      return;
+    }
+
     mChild->OnTransportAndData(mChannelStatus, mTransportStatus, mOffset,
                                mCount, mData);
   }
@@ -747,10 +768,26 @@ class TransportAndDataEvent : public ChannelEvent {
   nsresult mChannelStatus;
   nsresult mTransportStatus;
   nsCString mData;
+  RefPtr<HttpBodySegment> mSegment;
   uint64_t mOffset;
   uint32_t mCount;
 };
 
+void HttpChannelChild::ProcessOnTransportAndData(
+    const nsresult& aChannelStatus, const nsresult& aTransportStatus,
+    const uint64_t& aOffset, const uint32_t& aCount,
+    HttpBodySegment* aSegment) {
+  LOG(("HttpChannelChild::ProcessOnTransportAndData [this=%p segment=%p]\n",
+       this, aSegment));
+  MOZ_ASSERT(OnSocketThread());
+  MOZ_RELEASE_ASSERT(!mFlushedForDiversion,
+                     "Should not be receiving any more callbacks from parent!");
+  mEventQ->RunOrEnqueue(
+      new TransportAndDataEvent(this, aChannelStatus, aTransportStatus,
+                                aSegment, aOffset, aCount),
+      mDivertingToParent);
+}
+
 void HttpChannelChild::ProcessOnTransportAndData(
     const nsresult& aChannelStatus, const nsresult& aTransportStatus,
     const uint64_t& aOffset, const uint32_t& aCount, const nsCString& aData) {
@@ -1113,6 +1150,16 @@ void HttpChannelChild::OnStopRequest(
   mCacheReadStart = timing.cacheReadStart;
   mCacheReadEnd = timing.cacheReadEnd;
 
+  // The parent finished with the response at the later of these; the rest
+  // is the hop over to us (see the XXX above about comparing time stamps).
+  TimeStamp parentEnd = timing.responseEnd;
+  if (parentEnd.IsNull() ||
+      (!timing.cacheReadEnd.IsNull() && timing.cacheReadEnd > parentEnd)) {
+    parentEnd = timing.cacheReadEnd;
+  }
+  NetworkTrace::Record(mChannelId, NetworkTracePhase::IPC, parentEnd,
+                       TimeStamp::Now());
+
 #ifdef MOZ_GECKO_PROFILER
   if (profiler_is_active()) {
     int32_t priority = PRIORITY_NORMAL;
@@ -51,6 +51,7 @@ namespace mozilla {
 namespace net {
 
 class HttpBackgroundChannelChild;
+class HttpBodySegment;
 class InterceptedChannelContent;
 class InterceptStreamListener;
 class SyntheticDiversionListener;
@@ -256,6 +257,11 @@ class HttpChannelChild final : public PHttpChannelChild,
                                  const uint64_t& aOffset,
                                  const uint32_t& aCount,
                                  const nsCString& aData);
+  void ProcessOnTransportAndData(const nsresult& aChannelStatus,
+                                 const nsresult& aStatus,
+                                 const uint64_t& aOffset,
+                                 const uint32_t& aCount,
+                                 HttpBodySegment* aSegment);
   void ProcessOnStopRequest(const nsresult& aStatusCode,
                             const ResourceTimingStruct& aTiming,
                             const nsHttpHeaderArray& aResponseTrailers);
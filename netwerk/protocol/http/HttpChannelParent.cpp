@@ -1606,7 +1606,8 @@ HttpChannelParent::OnDataAvailable(nsIRequest* aRequest,
     transportStatus = NS_NET_STATUS_READING;
   }
 
-  static uint32_t const kCopyChunkSize = 128 * 1024;
+  static uint32_t const kCopyChunkSize =
+      HttpBackgroundChannelParent::kBodySegmentSize;
   uint32_t toRead = std::min<uint32_t>(aCount, kCopyChunkSize);
 
   nsCString data;
@@ -1614,21 +1615,41 @@ HttpChannelParent::OnDataAvailable(nsIRequest* aRequest,
   int32_t count = static_cast<int32_t>(aCount);
 
   while (aCount) {
-    nsresult rv = NS_ReadInputStreamToString(aInputStream, data, toRead);
-    if (NS_FAILED(rv)) {
-      return rv;
-    }
-
     // Either IPC channel is closed or background channel
     // is ready to send OnTransportAndData.
     MOZ_ASSERT(mIPCClosed || mBgParent);
 
-    if (mIPCClosed || !mBgParent || mDoingCrossProcessRedirect ||
-        !mBgParent->OnTransportAndData(channelStatus, transportStatus, aOffset,
-                                       toRead, data)) {
+    if (mIPCClosed || !mBgParent || mDoingCrossProcessRedirect) {
       return NS_ERROR_UNEXPECTED;
     }
 
+    // Once the body turns out to be large, it is read straight into shared
+    // memory that the child reads in place, rather than copied into messages.
+    Shmem segment;
+    if (mBgParent->TakeBodySegment(segment)) {
+      void* buffer = segment.get<char>();
+      nsresult rv = NS_ReadInputStreamToBuffer(aInputStream, &buffer, toRead);
+      if (NS_FAILED(rv)) {
+        mBgParent->ReturnBodySegment(segment);
+        return rv;
+      }
+
+      if (!mBgParent->OnTransportAndData(channelStatus, transportStatus,
+                                         aOffset, toRead, segment)) {
+        return NS_ERROR_UNEXPECTED;
+      }
+    } else {
+      nsresult rv = NS_ReadInputStreamToString(aInputStream, data, toRead);
+      if (NS_FAILED(rv)) {
+        return rv;
+      }
+
+      if (!mBgParent->OnTransportAndData(channelStatus, transportStatus,
+                                         aOffset, toRead, data)) {
+        return NS_ERROR_UNEXPECTED;
+      }
+    }
+
     aOffset += toRead;
     aCount -= toRead;
     toRead = std::min<uint32_t>(aCount, kCopyChunkSize);
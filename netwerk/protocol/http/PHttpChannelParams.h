@@ -85,99 +85,80 @@ struct ParamTraits<mozilla::net::nsHttpAtom> {
   }
 };
 
+// Headers are sent flat: one string with all names and values back to back,
+// and one array with the name length, value length and variety of each
+// entry, rather than a pair of strings per entry.
 template <>
-struct ParamTraits<mozilla::net::nsHttpHeaderArray::nsEntry> {
-  typedef mozilla::net::nsHttpHeaderArray::nsEntry paramType;
+struct ParamTraits<mozilla::net::nsHttpHeaderArray> {
+  typedef mozilla::net::nsHttpHeaderArray paramType;
 
   static void Write(Message* aMsg, const paramType& aParam) {
-    if (aParam.headerNameOriginal.IsEmpty()) {
-      WriteParam(aMsg, aParam.header);
-    } else {
-      WriteParam(aMsg, aParam.headerNameOriginal);
-    }
-    WriteParam(aMsg, aParam.value);
-    switch (aParam.variety) {
-      case mozilla::net::nsHttpHeaderArray::eVarietyUnknown:
-        WriteParam(aMsg, (uint8_t)0);
-        break;
-      case mozilla::net::nsHttpHeaderArray::eVarietyRequestOverride:
-        WriteParam(aMsg, (uint8_t)1);
-        break;
-      case mozilla::net::nsHttpHeaderArray::eVarietyRequestDefault:
-        WriteParam(aMsg, (uint8_t)2);
-        break;
-      case mozilla::net::nsHttpHeaderArray::
-          eVarietyResponseNetOriginalAndResponse:
-        WriteParam(aMsg, (uint8_t)3);
-        break;
-      case mozilla::net::nsHttpHeaderArray::eVarietyResponseNetOriginal:
-        WriteParam(aMsg, (uint8_t)4);
-        break;
-      case mozilla::net::nsHttpHeaderArray::eVarietyResponse:
-        WriteParam(aMsg, (uint8_t)5);
+    uint32_t count = aParam.mHeaders.Length();
+    nsTArray<uint32_t> layout(count * 3);
+    nsAutoCString strings;
+    for (uint32_t i = 0; i < count; ++i) {
+      const paramType::nsEntry& entry = aParam.mHeaders[i];
+      if (entry.headerNameOriginal.IsEmpty()) {
+        nsDependentCString name(entry.header.get());
+        layout.AppendElement(name.Length());
+        strings.Append(name);
+      } else {
+        layout.AppendElement(entry.headerNameOriginal.Length());
+        strings.Append(entry.headerNameOriginal);
+      }
+      layout.AppendElement(entry.value.Length());
+      layout.AppendElement(static_cast<uint32_t>(entry.variety));
+      strings.Append(entry.value);
     }
+
+    WriteParam(aMsg, layout);
+    WriteParam(aMsg, strings);
   }
 
   static bool Read(const Message* aMsg, PickleIterator* aIter,
                    paramType* aResult) {
-    uint8_t variety;
-    nsAutoCString header;
-    if (!ReadParam(aMsg, aIter, &header) ||
-        !ReadParam(aMsg, aIter, &aResult->value) ||
-        !ReadParam(aMsg, aIter, &variety))
+    nsTArray<uint32_t> layout;
+    nsAutoCString strings;
+    if (!ReadParam(aMsg, aIter, &layout) ||
+        !ReadParam(aMsg, aIter, &strings) || layout.Length() % 3) {
       return false;
-
-    mozilla::net::nsHttpAtom atom = mozilla::net::nsHttp::ResolveAtom(header);
-    aResult->header = atom;
-    if (!header.Equals(atom.get())) {
-      aResult->headerNameOriginal = header;
     }
 
-    switch (variety) {
-      case 0:
-        aResult->variety = mozilla::net::nsHttpHeaderArray::eVarietyUnknown;
-        break;
-      case 1:
-        aResult->variety =
-            mozilla::net::nsHttpHeaderArray::eVarietyRequestOverride;
-        break;
-      case 2:
-        aResult->variety =
-            mozilla::net::nsHttpHeaderArray::eVarietyRequestDefault;
-        break;
-      case 3:
-        aResult->variety = mozilla::net::nsHttpHeaderArray::
-            eVarietyResponseNetOriginalAndResponse;
-        break;
-      case 4:
-        aResult->variety =
-            mozilla::net::nsHttpHeaderArray::eVarietyResponseNetOriginal;
-        break;
-      case 5:
-        aResult->variety = mozilla::net::nsHttpHeaderArray::eVarietyResponse;
-        break;
-      default:
+    uint32_t count = layout.Length() / 3;
+    aResult->mHeaders.Clear();
+    aResult->mHeaders.SetCapacity(count);
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      uint32_t nameLength = layout[i * 3];
+      uint32_t valueLength = layout[i * 3 + 1];
+      uint32_t variety = layout[i * 3 + 2];
+      if (variety > mozilla::net::nsHttpHeaderArray::eVarietyResponse ||
+          nameLength > strings.Length() - offset ||
+          valueLength > strings.Length() - offset - nameLength) {
         return false;
-    }
+      }
 
-    return true;
-  }
-};
-
-template <>
-struct ParamTraits<mozilla::net::nsHttpHeaderArray> {
-  typedef mozilla::net::nsHttpHeaderArray paramType;
-
-  static void Write(Message* aMsg, const paramType& aParam) {
-    paramType& p = const_cast<paramType&>(aParam);
-
-    WriteParam(aMsg, p.mHeaders);
-  }
+      const nsDependentCSubstring name(strings, offset, nameLength);
+      mozilla::net::nsHttpAtom atom = mozilla::net::nsHttp::ResolveAtom(name);
+      if (!atom) {
+        return false;
+      }
+
+      paramType::nsEntry* entry = aResult->mHeaders.AppendElement();
+      entry->header = atom;
+      if (!name.Equals(atom.get())) {
+        entry->headerNameOriginal = name;
+      }
+      entry->value = Substring(strings, offset + nameLength, valueLength);
+      entry->variety = static_cast<paramType::HeaderVariety>(variety);
+      offset += nameLength + valueLength;
+    }
 
-  static bool Read(const Message* aMsg, PickleIterator* aIter,
-                   paramType* aResult) {
-    if (!ReadParam(aMsg, aIter, &aResult->mHeaders)) return false;
+    if (offset != strings.Length()) {
+      return false;
+    }
 
+    aResult->RebuildIndex();
     return true;
   }
 };
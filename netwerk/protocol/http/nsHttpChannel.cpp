@@ -124,6 +124,7 @@
 #include "mozilla/net/AsyncUrlChannelClassifier.h"
 #include "mozilla/net/CookieSettings.h"
 #include "mozilla/net/NeckoChannelParams.h"
+#include "mozilla/net/NetworkTrace.h"
 #include "mozilla/net/UrlClassifierFeatureFactory.h"
 #include "nsIWebNavigation.h"
 #include "HttpTrafficAnalyzer.h"
@@ -1303,6 +1304,7 @@ nsresult nsHttpChannel::SetupTransaction() {
   }
 
   mTransaction->SetClassOfService(mClassOfService);
+  mTransaction->SetChannelId(mChannelId);
   if (EnsureRequestContext()) {
     mTransaction->SetRequestContext(mRequestContext);
   }
@@ -4108,6 +4110,7 @@ nsresult nsHttpChannel::OpenCacheEntryInternal(
     if (mNetworkTriggered) {
       mRaceCacheWithNetwork = sRCWNEnabled;
     }
+    mCacheOpenStart = TimeStamp::Now();
     rv = cacheStorage->AsyncOpenURI(openURI, extension, cacheEntryOpenFlags,
                                     this);
   } else {
@@ -4116,6 +4119,7 @@ nsresult nsHttpChannel::OpenCacheEntryInternal(
     mCacheOpenFunc = [openURI, extension, cacheEntryOpenFlags,
                       cacheStorage](nsHttpChannel* self) -> void {
       MOZ_ASSERT(NS_IsMainThread(), "Should be called on the main thread");
+      self->mCacheOpenStart = TimeStamp::Now();
       cacheStorage->AsyncOpenURI(openURI, extension, cacheEntryOpenFlags, self);
     };
 
@@ -4192,6 +4196,13 @@ nsHttpChannel::OnCacheEntryCheck(nsICacheEntry* entry,
 
   mozilla::MutexAutoLock lock(mRCWNLock);
 
+  // Usually called on the cache I/O thread once the entry's metadata is in.
+  if (!mCacheOpenStart.IsNull()) {
+    NetworkTrace::Record(mChannelId, NetworkTracePhase::CacheOpen,
+                         mCacheOpenStart, TimeStamp::Now());
+    mCacheOpenStart = TimeStamp();
+  }
+
   if (mRaceCacheWithNetwork && mFirstResponseSource == RESPONSE_FROM_NETWORK) {
     LOG(
         ("Not using cached response because we've already got one from the "
@@ -8270,6 +8281,9 @@ nsresult nsHttpChannel::ContinueOnStopRequest(nsresult aStatus, bool aIsFromNet,
   // Register entry to the PerformanceStorage resource timing
   MaybeReportTimingData();
 
+  NetworkTrace::Record(mChannelId, NetworkTracePhase::CacheRead,
+                       mCacheReadStart, mCacheReadEnd);
+
 #ifdef MOZ_GECKO_PROFILER
   if (profiler_is_active() && !mRedirectURI) {
     // Don't include this if we already redirected
@@ -638,6 +638,8 @@ class nsHttpChannel final : public HttpBaseChannel,
   // Timestamp of the time the channel was suspended.
   mozilla::TimeStamp mSuspendTimestamp;
   mozilla::TimeStamp mOnCacheEntryCheckTimestamp;
+  // When the cache entry was asked for; cleared once it is traced.
+  mozilla::TimeStamp mCacheOpenStart;
 #ifdef MOZ_GECKO_PROFILER
   // For the profiler markers
   mozilla::TimeStamp mLastStatusReported;
@@ -25,6 +25,7 @@
 #include "mozilla/Services.h"
 #include "mozilla/Telemetry.h"
 #include "mozilla/net/DashboardTypes.h"
+#include "mozilla/net/NetworkTrace.h"
 #include "NullHttpTransaction.h"
 #include "nsIDNSRecord.h"
 #include "nsITransport.h"
@@ -1764,8 +1765,11 @@ nsresult nsHttpConnectionMgr::DispatchTransaction(nsConnectionEntry* ent,
     rv = conn->Activate(trans, caps, priority);
     MOZ_ASSERT(NS_SUCCEEDED(rv), "SPDY Cannot Fail Dispatch");
     if (NS_SUCCEEDED(rv) && !trans->GetPendingTime().IsNull()) {
+      TimeStamp now = TimeStamp::Now();
       AccumulateTimeDelta(Telemetry::TRANSACTION_WAIT_TIME_SPDY,
-                          trans->GetPendingTime(), TimeStamp::Now());
+                          trans->GetPendingTime(), now);
+      NetworkTrace::Record(trans->ChannelId(), NetworkTracePhase::Queue,
+                           trans->GetPendingTime(), now);
       trans->SetPendingTime(false);
     }
     return rv;
@@ -1777,8 +1781,11 @@ nsresult nsHttpConnectionMgr::DispatchTransaction(nsConnectionEntry* ent,
   rv = DispatchAbstractTransaction(ent, trans, caps, conn, priority);
 
   if (NS_SUCCEEDED(rv) && !trans->GetPendingTime().IsNull()) {
+    TimeStamp now = TimeStamp::Now();
     AccumulateTimeDelta(Telemetry::TRANSACTION_WAIT_TIME_HTTP,
-                        trans->GetPendingTime(), TimeStamp::Now());
+                        trans->GetPendingTime(), now);
+    NetworkTrace::Record(trans->ChannelId(), NetworkTracePhase::Queue,
+                         trans->GetPendingTime(), now);
     trans->SetPendingTime(false);
   }
   return rv;
@@ -225,6 +225,7 @@ nsHttpHandler::nsHttpHandler()
       mPhishyUserPassLength(1),
       mQoSBits(0x00),
       mEnforceAssocReq(false),
+      mZstdEnabled(true),
       mLastUniqueID(NowInSeconds()),
       mSessionStartTime(0),
       mLegacyAppName("Mozilla"),
@@ -242,6 +243,7 @@ nsHttpHandler::nsHttpHandler()
       mEnableSpdy(false),
       mHttp2Enabled(true),
       mUseH2Deps(true),
+      mUseH2WriteScheduling(true),
       mEnforceHttp2TlsProfile(true),
       mCoalesceSpdy(true),
       mSpdyPersistentSettings(false),
@@ -1349,7 +1351,13 @@ void nsHttpHandler::PrefsChanged(const char* pref) {
     }
   }
 
-  if (PREF_CHANGED(HTTP_PREF("accept-encoding.secure"))) {
+  if (PREF_CHANGED(HTTP_PREF("accept-encoding.zstd"))) {
+    mZstdEnabled =
+        Preferences::GetBool(HTTP_PREF("accept-encoding.zstd"), true);
+  }
+
+  if (PREF_CHANGED(HTTP_PREF("accept-encoding.secure")) ||
+      PREF_CHANGED(HTTP_PREF("accept-encoding.zstd"))) {
     nsAutoCString acceptEncodings;
     rv = Preferences::GetCString(HTTP_PREF("accept-encoding.secure"),
                                  acceptEncodings);
@@ -1422,6 +1430,11 @@ void nsHttpHandler::PrefsChanged(const char* pref) {
     if (NS_SUCCEEDED(rv)) mUseH2Deps = cVar;
   }
 
+  if (PREF_CHANGED(HTTP_PREF("spdy.write-scheduling"))) {
+    rv = Preferences::GetBool(HTTP_PREF("spdy.write-scheduling"), &cVar);
+    if (NS_SUCCEEDED(rv)) mUseH2WriteScheduling = cVar;
+  }
+
   if (PREF_CHANGED(HTTP_PREF("spdy.enforce-tls-profile"))) {
     rv = Preferences::GetBool(HTTP_PREF("spdy.enforce-tls-profile"), &cVar);
     if (NS_SUCCEEDED(rv)) mEnforceHttp2TlsProfile = cVar;
@@ -1947,6 +1960,15 @@ nsresult nsHttpHandler::SetAcceptEncodings(const char* aAcceptEncodings,
     }
   }
 
+#ifdef MOZ_ZSTD
+  // Like brotli, zstd is only offered over TLS, where intermediaries cannot
+  // get in the way.
+  if (mZstdEnabled && !mHttpsAcceptEncodings.IsEmpty() &&
+      !nsHttp::FindToken(mHttpsAcceptEncodings.get(), "zstd", HTTP_LWS ",")) {
+    mHttpsAcceptEncodings.AppendLiteral(", zstd");
+  }
+#endif
+
   return NS_OK;
 }
 
@@ -158,6 +158,7 @@ class nsHttpHandler final : public nsIHttpProtocolHandler,
     return mCriticalRequestPrioritization;
   }
   bool UseH2Deps() { return mUseH2Deps; }
+  bool UseH2WriteScheduling() { return mUseH2WriteScheduling; }
   bool IsH2WebsocketsEnabled() { return mEnableH2Websockets; }
 
   uint32_t MaxConnectionsPerOrigin() {
@@ -558,6 +559,8 @@ class nsHttpHandler final : public nsIHttpProtocolHandler,
   nsCString mAcceptLanguages;
   nsCString mHttpAcceptEncodings;
   nsCString mHttpsAcceptEncodings;
+  // Whether zstd is added to mHttpsAcceptEncodings, when it is supported.
+  bool mZstdEnabled;
 
   nsCString mDefaultSocketType;
 
@@ -604,6 +607,7 @@ class nsHttpHandler final : public nsIHttpProtocolHandler,
   uint32_t mEnableSpdy : 1;
   uint32_t mHttp2Enabled : 1;
   uint32_t mUseH2Deps : 1;
+  uint32_t mUseH2WriteScheduling : 1;
   uint32_t mEnforceHttp2TlsProfile : 1;
   uint32_t mCoalesceSpdy : 1;
   uint32_t mSpdyPersistentSettings : 1;
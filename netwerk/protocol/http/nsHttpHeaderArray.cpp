@@ -11,6 +11,8 @@
 #include "nsURLHelper.h"
 #include "nsIHttpHeaderVisitor.h"
 #include "nsHttpHandler.h"
+#include "mozilla/HashFunctions.h"
+#include "mozilla/MathAlgorithms.h"
 
 namespace mozilla {
 namespace net {
@@ -56,8 +58,10 @@ nsresult nsHttpHeaderArray::SetHeader(
       if (entry->variety == eVarietyResponseNetOriginalAndResponse) {
         MOZ_ASSERT(variety == eVarietyResponse);
         entry->variety = eVarietyResponseNetOriginal;
+        ReindexHeader(header);
       } else {
         mHeaders.RemoveElementAt(index);
+        RebuildIndex();
       }
     }
     return NS_OK;
@@ -74,7 +78,12 @@ nsresult nsHttpHeaderArray::SetHeader(
     if (entry->variety == eVarietyResponseNetOriginalAndResponse) {
       MOZ_ASSERT(variety == eVarietyResponse);
       entry->variety = eVarietyResponseNetOriginal;
-      return SetHeader_internal(header, headerName, value, variety);
+      nsresult rv = SetHeader_internal(header, headerName, value, variety);
+      if (NS_FAILED(rv)) {
+        return rv;
+      }
+      ReindexHeader(header);
+      return NS_OK;
     }
     entry->value = value;
     entry->variety = variety;
@@ -98,6 +107,7 @@ nsresult nsHttpHeaderArray::SetHeader_internal(
   }
   entry->value = value;
   entry->variety = variety;
+  IndexAppendedEntry();
   return NS_OK;
 }
 
@@ -120,12 +130,20 @@ nsresult nsHttpHeaderArray::SetEmptyHeader(const nsACString& headerName,
   if (entry && entry->variety != eVarietyResponseNetOriginalAndResponse) {
     entry->value.Truncate();
     return NS_OK;
-  } else if (entry) {
+  }
+
+  bool reindex = false;
+  if (entry) {
     MOZ_ASSERT(variety == eVarietyResponse);
     entry->variety = eVarietyResponseNetOriginal;
+    reindex = true;
   }
 
-  return SetHeader_internal(header, headerName, EmptyCString(), variety);
+  nsresult rv = SetHeader_internal(header, headerName, EmptyCString(), variety);
+  if (NS_SUCCEEDED(rv) && reindex) {
+    ReindexHeader(header);
+  }
+  return rv;
 }
 
 nsresult nsHttpHeaderArray::SetHeaderFromNet(
@@ -202,6 +220,7 @@ nsresult nsHttpHeaderArray::SetResponseHeaderFromCache(
             "This array must contain only eVarietyResponseNetOriginal"
             " and eVarietyResponseNetOriginalAndRespons headers!");
         entry.variety = eVarietyResponseNetOriginalAndResponse;
+        ReindexHeader(header);
         return NS_OK;
       }
       index++;
@@ -218,8 +237,10 @@ void nsHttpHeaderArray::ClearHeader(nsHttpAtom header) {
   if (entry) {
     if (entry->variety == eVarietyResponseNetOriginalAndResponse) {
       entry->variety = eVarietyResponseNetOriginal;
+      ReindexHeader(header);
     } else {
       mHeaders.RemoveElementAt(index);
+      RebuildIndex();
     }
   }
 }
@@ -258,12 +279,9 @@ nsresult nsHttpHeaderArray::GetOriginalHeader(nsHttpAtom aHeader,
         continue;
       }
 
-      nsAutoCString hdr;
-      if (entry.headerNameOriginal.IsEmpty()) {
-        hdr = nsDependentCString(entry.header);
-      } else {
-        hdr = entry.headerNameOriginal;
-      }
+      nsDependentCString hdr(entry.headerNameOriginal.IsEmpty()
+                                 ? entry.header.get()
+                                 : entry.headerNameOriginal.get());
 
       rv = NS_OK;
       if (NS_FAILED(aVisitor->VisitHeader(hdr, entry.value))) {
@@ -303,12 +321,9 @@ nsresult nsHttpHeaderArray::VisitHeaders(
       continue;
     }
 
-    nsAutoCString hdr;
-    if (entry.headerNameOriginal.IsEmpty()) {
-      hdr = nsDependentCString(entry.header);
-    } else {
-      hdr = entry.headerNameOriginal;
-    }
+    nsDependentCString hdr(entry.headerNameOriginal.IsEmpty()
+                               ? entry.header.get()
+                               : entry.headerNameOriginal.get());
     rv = visitor->VisitHeader(hdr, entry.value);
     if (NS_FAILED(rv)) {
       return rv;
@@ -444,7 +459,117 @@ const char* nsHttpHeaderArray::PeekHeaderAt(
   return entry.value.get();
 }
 
-void nsHttpHeaderArray::Clear() { mHeaders.Clear(); }
+void nsHttpHeaderArray::Clear() {
+  mHeaders.Clear();
+  mIndex.Clear();
+}
+
+//-----------------------------------------------------------------------------
+// nsHttpHeaderArray <private>: atom index
+//-----------------------------------------------------------------------------
+
+uint32_t nsHttpHeaderArray::FindEntryIndex(nsHttpAtom header) const {
+  if (mIndex.IsEmpty()) {
+    uint32_t count = mHeaders.Length();
+    for (uint32_t i = 0; i < count; ++i) {
+      const nsEntry& entry = mHeaders[i];
+      if (entry.header == header &&
+          entry.variety != eVarietyResponseNetOriginal) {
+        return i;
+      }
+    }
+    return UINT32_MAX;
+  }
+
+  uint32_t mask = mIndex.Length() - 1;
+  uint32_t slot = HashGeneric(header.get()) & mask;
+  while (mIndex[slot].mAtom) {
+    if (mIndex[slot].mAtom == header.get()) {
+      return mIndex[slot].mIndex;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return UINT32_MAX;
+}
+
+void nsHttpHeaderArray::IndexAppendedEntry() {
+  uint32_t count = mHeaders.Length();
+  if (count * 2 > mIndex.Length()) {
+    RebuildIndex();
+    return;
+  }
+
+  const nsEntry& entry = mHeaders[count - 1];
+  if (entry.variety == eVarietyResponseNetOriginal) {
+    return;
+  }
+
+  // An earlier entry of the same header stays the one found.
+  uint32_t mask = mIndex.Length() - 1;
+  uint32_t slot = HashGeneric(entry.header.get()) & mask;
+  while (mIndex[slot].mAtom) {
+    if (mIndex[slot].mAtom == entry.header.get()) {
+      return;
+    }
+    slot = (slot + 1) & mask;
+  }
+  mIndex[slot].mAtom = entry.header.get();
+  mIndex[slot].mIndex = count - 1;
+}
+
+void nsHttpHeaderArray::ReindexHeader(nsHttpAtom header) {
+  if (mIndex.IsEmpty()) {
+    return;
+  }
+
+  uint32_t mask = mIndex.Length() - 1;
+  uint32_t slot = HashGeneric(header.get()) & mask;
+  while (mIndex[slot].mAtom && mIndex[slot].mAtom != header.get()) {
+    slot = (slot + 1) & mask;
+  }
+
+  uint32_t count = mHeaders.Length();
+  for (uint32_t i = 0; i < count; ++i) {
+    const nsEntry& entry = mHeaders[i];
+    if (entry.header == header &&
+        entry.variety != eVarietyResponseNetOriginal) {
+      mIndex[slot].mAtom = header.get();
+      mIndex[slot].mIndex = i;
+      return;
+    }
+  }
+
+  // Only originals are left.  Removing a slot from a linear probing table
+  // would break the chains running through it, start over instead.
+  if (mIndex[slot].mAtom) {
+    RebuildIndex();
+  }
+}
+
+void nsHttpHeaderArray::RebuildIndex() {
+  mIndex.Clear();
+  uint32_t count = mHeaders.Length();
+  if (count <= kIndexThreshold) {
+    return;
+  }
+
+  mIndex.SetLength(RoundUpPow2(count * 2));
+  uint32_t mask = mIndex.Length() - 1;
+  for (uint32_t i = 0; i < count; ++i) {
+    const nsEntry& entry = mHeaders[i];
+    if (entry.variety == eVarietyResponseNetOriginal) {
+      continue;
+    }
+    uint32_t slot = HashGeneric(entry.header.get()) & mask;
+    while (mIndex[slot].mAtom && mIndex[slot].mAtom != entry.header.get()) {
+      slot = (slot + 1) & mask;
+    }
+    if (!mIndex[slot].mAtom) {
+      mIndex[slot].mAtom = entry.header.get();
+      mIndex[slot].mIndex = i;
+    }
+  }
+}
 
 }  // namespace net
 }  // namespace mozilla
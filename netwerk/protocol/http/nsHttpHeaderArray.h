@@ -136,6 +136,7 @@ class nsHttpHeaderArray {
     }
   };
 
+  // The index is derived from mHeaders and not compared.
   bool operator==(const nsHttpHeaderArray& aOther) const {
     return mHeaders == aOther.mHeaders;
   }
@@ -163,9 +164,38 @@ class nsHttpHeaderArray {
   // injection)
   bool IsSuspectDuplicateHeader(nsHttpAtom header);
 
+  // Appends |value| to the merged value |dest| of |header|.
+  static void AppendMergedValue(nsHttpAtom header, nsACString& dest,
+                                const nsACString& value);
+
+  // Position in mHeaders of the entry LookupEntry() finds, or UINT32_MAX.
+  uint32_t FindEntryIndex(nsHttpAtom header) const;
+
+  // Keep mIndex in sync with mHeaders.  IndexAppendedEntry must be called
+  // after an entry is appended, ReindexHeader after an entry of |header|
+  // changed to or from eVarietyResponseNetOriginal, and RebuildIndex after
+  // entries are removed.
+  void IndexAppendedEntry();
+  void ReindexHeader(nsHttpAtom header);
+  void RebuildIndex();
+
+  // Arrays with up to this many entries are not indexed, scanning them is
+  // cheaper than hashing.
+  static const uint32_t kIndexThreshold = 12;
+
+  struct IndexSlot {
+    const char* mAtom = nullptr;  // null for an empty slot
+    uint32_t mIndex = 0;
+  };
+
   // All members must be copy-constructable and assignable
   nsTArray<nsEntry> mHeaders;
 
+  // Open-addressed hash table (linear probing, at most half full) mapping
+  // header atoms to the position of the entry LookupEntry() returns for
+  // them.  Empty while mHeaders is small.
+  nsTArray<IndexSlot> mIndex;
+
   friend struct IPC::ParamTraits<nsHttpHeaderArray>;
   friend class nsHttpRequestHead;
 };
@@ -176,33 +206,18 @@ class nsHttpHeaderArray {
 
 inline int32_t nsHttpHeaderArray::LookupEntry(nsHttpAtom header,
                                               const nsEntry** entry) const {
-  uint32_t index = 0;
-  while (index != UINT32_MAX) {
-    index = mHeaders.IndexOf(header, index, nsEntry::MatchHeader());
-    if (index != UINT32_MAX) {
-      if ((&mHeaders[index])->variety != eVarietyResponseNetOriginal) {
-        *entry = &mHeaders[index];
-        return index;
-      }
-      index++;
-    }
+  uint32_t index = FindEntryIndex(header);
+  if (index != UINT32_MAX) {
+    *entry = &mHeaders[index];
   }
-
   return index;
 }
 
 inline int32_t nsHttpHeaderArray::LookupEntry(nsHttpAtom header,
                                               nsEntry** entry) {
-  uint32_t index = 0;
-  while (index != UINT32_MAX) {
-    index = mHeaders.IndexOf(header, index, nsEntry::MatchHeader());
-    if (index != UINT32_MAX) {
-      if ((&mHeaders[index])->variety != eVarietyResponseNetOriginal) {
-        *entry = &mHeaders[index];
-        return index;
-      }
-      index++;
-    }
+  uint32_t index = FindEntryIndex(header);
+  if (index != UINT32_MAX) {
+    *entry = &mHeaders[index];
   }
   return index;
 }
@@ -233,42 +248,50 @@ inline bool nsHttpHeaderArray::IsIgnoreMultipleHeader(nsHttpAtom header) {
   return header == nsHttp::Strict_Transport_Security;
 }
 
-inline MOZ_MUST_USE nsresult nsHttpHeaderArray::MergeHeader(
-    nsHttpAtom header, nsEntry* entry, const nsACString& value,
-    nsHttpHeaderArray::HeaderVariety variety) {
-  if (value.IsEmpty()) return NS_OK;  // merge of empty header = no-op
-
-  nsCString newValue = entry->value;
-  if (!newValue.IsEmpty()) {
+inline void nsHttpHeaderArray::AppendMergedValue(nsHttpAtom header,
+                                                 nsACString& dest,
+                                                 const nsACString& value) {
+  if (!dest.IsEmpty()) {
     // Append the new value to the existing value
     if (header == nsHttp::Set_Cookie || header == nsHttp::WWW_Authenticate ||
         header == nsHttp::Proxy_Authenticate) {
       // Special case these headers and use a newline delimiter to
       // delimit the values from one another as commas may appear
       // in the values of these headers contrary to what the spec says.
-      newValue.Append('\n');
+      dest.Append('\n');
     } else {
       // Delimit each value from the others using a comma (per HTTP spec)
-      newValue.AppendLiteral(", ");
+      dest.AppendLiteral(", ");
     }
   }
+  dest.Append(value);
+}
 
-  newValue.Append(value);
-  if (entry->variety == eVarietyResponseNetOriginalAndResponse) {
-    MOZ_ASSERT(variety == eVarietyResponse);
-    entry->variety = eVarietyResponseNetOriginal;
-    // Copy entry->headerNameOriginal because in SetHeader_internal we are going
-    // to a new one and a realocation can happen.
-    nsCString headerNameOriginal = entry->headerNameOriginal;
-    nsresult rv = SetHeader_internal(header, headerNameOriginal, newValue,
-                                     eVarietyResponse);
-    if (NS_FAILED(rv)) {
-      return rv;
-    }
-  } else {
-    entry->value = newValue;
+inline MOZ_MUST_USE nsresult nsHttpHeaderArray::MergeHeader(
+    nsHttpAtom header, nsEntry* entry, const nsACString& value,
+    nsHttpHeaderArray::HeaderVariety variety) {
+  if (value.IsEmpty()) return NS_OK;  // merge of empty header = no-op
+
+  if (entry->variety != eVarietyResponseNetOriginalAndResponse) {
+    // No original to preserve, merge in place.
+    AppendMergedValue(header, entry->value, value);
     entry->variety = variety;
+    return NS_OK;
+  }
+
+  MOZ_ASSERT(variety == eVarietyResponse);
+  nsCString newValue = entry->value;
+  AppendMergedValue(header, newValue, value);
+  entry->variety = eVarietyResponseNetOriginal;
+  // Copy entry->headerNameOriginal because in SetHeader_internal we are going
+  // to a new one and a realocation can happen.
+  nsCString headerNameOriginal = entry->headerNameOriginal;
+  nsresult rv = SetHeader_internal(header, headerNameOriginal, newValue,
+                                   eVarietyResponse);
+  if (NS_FAILED(rv)) {
+    return rv;
   }
+  ReindexHeader(header);
   return NS_OK;
 }
 
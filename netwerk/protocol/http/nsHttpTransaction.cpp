@@ -25,6 +25,7 @@
 #include "nsIPipe.h"
 #include "nsCRT.h"
 #include "mozilla/Tokenizer.h"
+#include "mozilla/net/NetworkTrace.h"
 #include "TCPFastOpenLayer.h"
 
 #include "nsISeekableStream.h"
@@ -1204,6 +1205,7 @@ void nsHttpTransaction::Close(nsresult reason) {
     if (timings.responseEnd.IsNull() && !timings.responseStart.IsNull()) {
       SetResponseEnd(TimeStamp::Now());
     }
+    NetworkTrace::RecordTimings(mChannelId, Timings());
   }
 
   if (mTrafficCategory != HttpTrafficCategory::eInvalid) {
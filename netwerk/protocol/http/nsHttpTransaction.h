@@ -433,10 +433,14 @@ class nsHttpTransaction final : public nsAHttpTransaction,
 
  public:
   void SetClassOfService(uint32_t cos);
+  void SetChannelId(uint64_t aChannelId) { mChannelId = aChannelId; }
+  uint64_t ChannelId() { return mChannelId; }
   uint32_t ClassOfService() { return mClassOfService; }
 
  private:
   uint32_t mClassOfService;
+  // Only used to tag the phases recorded in NetworkTrace.
+  uint64_t mChannelId = 0;
 
  public:
   // setting TunnelProvider to non-null means the transaction should only
@@ -13,8 +13,11 @@
 #include "nsStringStream.h"
 #include "nsComponentManagerUtils.h"
 #include "nsThreadUtils.h"
+#include "mozilla/ClearOnShutdown.h"
 #include "mozilla/Preferences.h"
 #include "mozilla/Logging.h"
+#include "mozilla/StaticMutex.h"
+#include "mozilla/StaticPtr.h"
 #include "nsIForcePendingChannel.h"
 #include "nsIRequest.h"
 
@@ -29,6 +32,102 @@ extern LazyLogModule gHttpLog;
 #define LOG(args) \
   MOZ_LOG(mozilla::net::gHttpLog, mozilla::LogLevel::Debug, args)
 
+#ifdef MOZ_ZSTD
+// Bounds the memory a response can make the decoder use for its window, at
+// the 8MB that RFC 8878 asks HTTP encoders to stay within.
+static const int kZstdWindowLogMax = 23;
+
+class ZstdDictionary final {
+ public:
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(ZstdDictionary)
+
+  ZstdDictionary(ZSTD_DDict* aDict, uint32_t aID) : mDict(aDict), mID(aID) {}
+
+  ZSTD_DDict* const mDict;
+  const uint32_t mID;
+
+ private:
+  ~ZstdDictionary() { ZSTD_freeDDict(mDict); }
+};
+
+static StaticMutex sZstdDictionaryMutex;
+static StaticAutoPtr<nsTArray<RefPtr<ZstdDictionary>>> sZstdDictionaries;
+
+static already_AddRefed<ZstdDictionary> FindZstdDictionary(uint32_t aID) {
+  StaticMutexAutoLock lock(sZstdDictionaryMutex);
+  if (!sZstdDictionaries) {
+    return nullptr;
+  }
+  for (const auto& dict : *sZstdDictionaries) {
+    if (dict->mID == aID) {
+      RefPtr<ZstdDictionary> found = dict;
+      return found.forget();
+    }
+  }
+  return nullptr;
+}
+
+/* static */
+uint32_t nsHTTPCompressConv::AddZstdDictionary(const nsACString& aDictionary) {
+  MOZ_ASSERT(NS_IsMainThread());
+
+  uint32_t id =
+      ZSTD_getDictID_fromDict(aDictionary.BeginReading(), aDictionary.Length());
+  if (!id) {
+    return 0;
+  }
+
+  ZSTD_DDict* ddict =
+      ZSTD_createDDict(aDictionary.BeginReading(), aDictionary.Length());
+  if (!ddict) {
+    return 0;
+  }
+
+  RefPtr<ZstdDictionary> dict = new ZstdDictionary(ddict, id);
+
+  StaticMutexAutoLock lock(sZstdDictionaryMutex);
+  if (!sZstdDictionaries) {
+    sZstdDictionaries = new nsTArray<RefPtr<ZstdDictionary>>();
+    ClearOnShutdown(&sZstdDictionaries);
+  }
+  for (auto& existing : *sZstdDictionaries) {
+    if (existing->mID == id) {
+      existing = dict;
+      return id;
+    }
+  }
+  sZstdDictionaries->AppendElement(dict);
+  return id;
+}
+
+/* static */
+void nsHTTPCompressConv::ClearZstdDictionaries() {
+  MOZ_ASSERT(NS_IsMainThread());
+
+  StaticMutexAutoLock lock(sZstdDictionaryMutex);
+  if (sZstdDictionaries) {
+    sZstdDictionaries->Clear();
+  }
+}
+
+ZstdWrapper::ZstdWrapper()
+    : mContext(ZSTD_createDCtx()),
+      mOutBufferLen(ZSTD_DStreamOutSize()),
+      mStatus(NS_OK),
+      mStarted(false),
+      mFrameEnded(false),
+      mHasOutput(false),
+      mRequest(nullptr),
+      mSourceOffset(0) {
+  if (mContext) {
+    ZSTD_DCtx_setParameter(mContext, ZSTD_d_windowLogMax, kZstdWindowLogMax);
+  }
+  mOutBuffer = MakeUniqueFallible<char[]>(mOutBufferLen);
+}
+
+ZstdWrapper::~ZstdWrapper() { ZSTD_freeDCtx(mContext); }
+#endif
+
 // nsISupports implementation
 NS_IMPL_ISUPPORTS(nsHTTPCompressConv, nsIStreamConverter, nsIStreamListener,
                   nsIRequestObserver, nsICompressConvStats,
@@ -104,6 +203,11 @@ nsHTTPCompressConv::AsyncConvertData(const char* aFromType, const char* aToType,
   } else if (!PL_strncasecmp(aFromType, HTTP_BROTLI_TYPE,
                              sizeof(HTTP_BROTLI_TYPE) - 1)) {
     mMode = HTTP_COMPRESS_BROTLI;
+#ifdef MOZ_ZSTD
+  } else if (!PL_strncasecmp(aFromType, HTTP_ZSTD_TYPE,
+                             sizeof(HTTP_ZSTD_TYPE) - 1)) {
+    mMode = HTTP_COMPRESS_ZSTD;
+#endif
   }
   LOG(("nsHttpCompresssConv %p AsyncConvertData %s %s mode %d\n", this,
        aFromType, aToType, (CompressMode)mMode));
@@ -160,6 +264,20 @@ nsHTTPCompressConv::OnStopRequest(nsIRequest* request, nsresult aStatus) {
       fpChannel->ForcePending(false);
     }
   }
+#ifdef MOZ_ZSTD
+  if (NS_SUCCEEDED(status) && mMode == HTTP_COMPRESS_ZSTD &&
+      (!mZstd || !mZstd->mFrameEnded)) {
+    // Like brotli, nothing decoded at all is an error; like gzip, a stream
+    // cut short mid-frame is one when framing is enforced.
+    if (!mZstd || !mZstd->mHasOutput) {
+      status = NS_ERROR_INVALID_CONTENT_ENCODING;
+    } else if (mFailUncleanStops) {
+      status = NS_ERROR_NET_PARTIAL_TRANSFER;
+    }
+    LOG(("nsHttpCompresssConv %p onstop zstd unfinished rv %" PRIx32 "\n",
+         this, static_cast<uint32_t>(status)));
+  }
+#endif
 
   nsCOMPtr<nsIStreamListener> listener;
   {
@@ -255,6 +373,93 @@ nsresult nsHTTPCompressConv::BrotliHandler(nsIInputStream* stream,
   return self->mBrotli->mStatus;
 }
 
+#ifdef MOZ_ZSTD
+/* static */
+nsresult nsHTTPCompressConv::ZstdHandler(nsIInputStream* stream, void* closure,
+                                         const char* dataIn, uint32_t,
+                                         uint32_t aAvail, uint32_t* countRead) {
+  MOZ_ASSERT(stream);
+  nsHTTPCompressConv* self = static_cast<nsHTTPCompressConv*>(closure);
+  ZstdWrapper* zstd = self->mZstd.get();
+  *countRead = 0;
+
+  ZSTD_inBuffer input = {dataIn, aAvail, 0};
+
+  nsCString header;
+  if (!zstd->mStarted) {
+    // A frame made with a dictionary names it in its header.  The header
+    // may be split across reads, so keep the input until it is complete.
+    zstd->mHeader.Append(dataIn, aAvail);
+    ZSTD_frameHeader frameHeader;
+    size_t ret = ZSTD_getFrameHeader(&frameHeader, zstd->mHeader.get(),
+                                     zstd->mHeader.Length());
+    if (ZSTD_isError(ret)) {
+      LOG(("nsHttpCompresssConv %p bad zstd frame header %s\n", self,
+           ZSTD_getErrorName(ret)));
+      zstd->mStatus = NS_ERROR_INVALID_CONTENT_ENCODING;
+      return zstd->mStatus;
+    }
+    if (ret) {
+      // |ret| more bytes are needed.
+      *countRead = aAvail;
+      return NS_OK;
+    }
+
+    zstd->mStarted = true;
+    if (frameHeader.dictID) {
+      zstd->mDictionary = FindZstdDictionary(frameHeader.dictID);
+      if (!zstd->mDictionary) {
+        LOG(("nsHttpCompresssConv %p unknown zstd dictionary %" PRIu32 "\n",
+             self, frameHeader.dictID));
+        zstd->mStatus = NS_ERROR_INVALID_CONTENT_ENCODING;
+        return zstd->mStatus;
+      }
+      ZSTD_DCtx_refDDict(zstd->mContext, zstd->mDictionary->mDict);
+    }
+
+    // Decode everything received so far.
+    header = std::move(zstd->mHeader);
+    input = {header.get(), header.Length(), 0};
+  }
+
+  ZSTD_outBuffer output;
+  do {
+    output = {zstd->mOutBuffer.get(), zstd->mOutBufferLen, 0};
+    size_t consumed = input.pos;
+    size_t ret = ZSTD_decompressStream(zstd->mContext, &output, &input);
+    if (ZSTD_isError(ret)) {
+      LOG(("nsHttpCompresssConv %p zstd error %s\n", self,
+           ZSTD_getErrorName(ret)));
+      zstd->mStatus = NS_ERROR_INVALID_CONTENT_ENCODING;
+      return zstd->mStatus;
+    }
+    // 0 means a frame was completely decoded and flushed.  Only reading the
+    // header of another frame starts a new one: when a frame ends as the
+    // output buffer fills, the next call has no input and asks for one.
+    if (!ret) {
+      zstd->mFrameEnded = true;
+    } else if (input.pos != consumed) {
+      zstd->mFrameEnded = false;
+    }
+
+    if (output.pos) {
+      zstd->mHasOutput = true;
+      nsresult rv =
+          self->do_OnDataAvailable(zstd->mRequest, nullptr, zstd->mSourceOffset,
+                                   zstd->mOutBuffer.get(), output.pos);
+      if (NS_FAILED(rv)) {
+        zstd->mStatus = rv;
+        return zstd->mStatus;
+      }
+    }
+    // A full output buffer may mean more is waiting to be flushed.
+  } while (input.pos < input.size || output.pos == output.size);
+
+  *countRead = aAvail;
+  return NS_OK;
+}
+#endif
+
 NS_IMETHODIMP
 nsHTTPCompressConv::OnDataAvailable(nsIRequest* request, nsIInputStream* iStr,
                                     uint64_t aSourceOffset, uint32_t aCount) {
@@ -484,6 +689,29 @@ nsHTTPCompressConv::OnDataAvailable(nsIRequest* request, nsIInputStream* iStr,
       }
     } break;
 
+#ifdef MOZ_ZSTD
+    case HTTP_COMPRESS_ZSTD: {
+      if (!mZstd) {
+        mZstd = MakeUnique<ZstdWrapper>();
+        if (!mZstd->mContext || !mZstd->mOutBuffer) {
+          return NS_ERROR_OUT_OF_MEMORY;
+        }
+      }
+
+      mZstd->mRequest = request;
+      mZstd->mSourceOffset = aSourceOffset;
+
+      uint32_t countRead;
+      rv = iStr->ReadSegments(ZstdHandler, this, streamLen, &countRead);
+      if (NS_SUCCEEDED(rv)) {
+        rv = mZstd->mStatus;
+      }
+      if (NS_FAILED(rv)) {
+        return rv;
+      }
+    } break;
+#endif
+
     default:
       nsCOMPtr<nsIStreamListener> listener;
       {
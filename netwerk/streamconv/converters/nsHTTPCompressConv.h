@@ -14,6 +14,8 @@
 #  include "nsAutoPtr.h"
 #  include "mozilla/Atomics.h"
 #  include "mozilla/Mutex.h"
+#  include "mozilla/RefPtr.h"
+#  include "mozilla/UniquePtr.h"
 
 #  include "zlib.h"
 
@@ -22,6 +24,12 @@
 #  include "assert.h"
 #  include "state.h"
 
+#  ifdef MOZ_ZSTD
+// For ZSTD_getFrameHeader().
+#    define ZSTD_STATIC_LINKING_ONLY
+#    include "zstd.h"
+#  endif
+
 class nsIStringInputStream;
 
 #  define NS_HTTPCOMPRESSCONVERTER_CID                 \
@@ -38,6 +46,7 @@ class nsIStringInputStream;
 #  define HTTP_COMPRESS_TYPE "compress"
 #  define HTTP_X_COMPRESS_TYPE "x-compress"
 #  define HTTP_BROTLI_TYPE "br"
+#  define HTTP_ZSTD_TYPE "zstd"
 #  define HTTP_IDENTITY_TYPE "identity"
 #  define HTTP_UNCOMPRESSED_TYPE "uncompressed"
 
@@ -49,6 +58,7 @@ typedef enum {
   HTTP_COMPRESS_DEFLATE,
   HTTP_COMPRESS_COMPRESS,
   HTTP_COMPRESS_BROTLI,
+  HTTP_COMPRESS_ZSTD,
   HTTP_COMPRESS_IDENTITY
 } CompressMode;
 
@@ -75,6 +85,33 @@ class BrotliWrapper {
   uint64_t mSourceOffset;
 };
 
+#  ifdef MOZ_ZSTD
+class ZstdDictionary;
+
+class ZstdWrapper {
+ public:
+  ZstdWrapper();
+  ~ZstdWrapper();
+
+  ZSTD_DCtx* mContext;
+  // Holds the decoded output until it is passed on.
+  UniquePtr<char[]> mOutBuffer;
+  size_t mOutBufferLen;
+  // The dictionary named by the first frame, if any.
+  RefPtr<ZstdDictionary> mDictionary;
+  // The input received before the first frame header was complete.
+  nsCString mHeader;
+  nsresult mStatus;
+  bool mStarted;
+  // True when the input so far ends with a complete frame.
+  bool mFrameEnded;
+  bool mHasOutput;
+
+  nsIRequest* mRequest;
+  uint64_t mSourceOffset;
+};
+#  endif
+
 class nsHTTPCompressConv : public nsIStreamConverter,
                            public nsICompressConvStats,
                            public nsIThreadRetargetableStreamListener {
@@ -91,6 +128,15 @@ class nsHTTPCompressConv : public nsIStreamConverter,
 
   nsHTTPCompressConv();
 
+#  ifdef MOZ_ZSTD
+  // Makes a zstd dictionary available to decode responses whose frames name
+  // it by its ID, and returns that ID, or 0 if |aDictionary| is not a zstd
+  // dictionary.  Main thread only.  Nothing provisions dictionaries yet, so
+  // only tests call this.
+  static uint32_t AddZstdDictionary(const nsACString& aDictionary);
+  static void ClearZstdDictionaries();
+#  endif
+
  private:
   virtual ~nsHTTPCompressConv();
 
@@ -112,6 +158,14 @@ class nsHTTPCompressConv : public nsIStreamConverter,
                                 const char* dataIn, uint32_t, uint32_t avail,
                                 uint32_t* countRead);
 
+#  ifdef MOZ_ZSTD
+  UniquePtr<ZstdWrapper> mZstd;
+
+  static nsresult ZstdHandler(nsIInputStream* stream, void* closure,
+                              const char* dataIn, uint32_t, uint32_t avail,
+                              uint32_t* countRead);
+#  endif
+
   nsresult do_OnDataAvailable(nsIRequest* request, nsISupports* aContext,
                               uint64_t aSourceOffset, const char* buffer,
                               uint32_t aCount);
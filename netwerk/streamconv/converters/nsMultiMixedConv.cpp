@@ -16,11 +16,16 @@
 #include "nsICacheInfoChannel.h"
 #include <algorithm>
 #include "nsContentSecurityManager.h"
+#include "nsContentUtils.h"
 #include "nsHttp.h"
 #include "nsNetUtil.h"
 #include "nsIURI.h"
 #include "nsHttpHeaderArray.h"
 #include "mozilla/AutoRestore.h"
+#include "mozilla/Preferences.h"
+#include "nsIThreadRetargetableRequest.h"
+#include "nsStringStream.h"
+#include "nsThreadUtils.h"
 
 nsPartChannel::nsPartChannel(nsIChannel* aMultipartChannel, uint32_t aPartID,
                              nsIStreamListener* aListener)
@@ -375,7 +380,7 @@ nsPartChannel::GetBaseChannel(nsIChannel** aReturn) {
 
 // nsISupports implementation
 NS_IMPL_ISUPPORTS(nsMultiMixedConv, nsIStreamConverter, nsIStreamListener,
-                  nsIRequestObserver)
+                  nsIThreadRetargetableStreamListener, nsIRequestObserver)
 
 // nsIStreamConverter implementation
 
@@ -490,6 +495,30 @@ nsMultiMixedConv::OnStartRequest(nsIRequest* request) {
   mBoundaryTokenWithDashes = mTokenizer.AddCustomToken(
       NS_LITERAL_CSTRING("--") + mBoundary, mTokenizer.CASE_SENSITIVE);
 
+  // The part listeners cannot ask for off-main-thread delivery themselves,
+  // their request is the part channel.  When the response is content encoded
+  // ask for it here, so the decoder ahead of us runs on a stream transport
+  // thread; see OnDataAvailable.
+  nsAutoCString contentEncoding;
+  if (httpChannel &&
+      Preferences::GetBool("network.multipart.retarget_decoding", true) &&
+      NS_SUCCEEDED(httpChannel->GetResponseHeader(
+          NS_LITERAL_CSTRING("content-encoding"), contentEncoding)) &&
+      !contentEncoding.IsEmpty()) {
+    nsCOMPtr<nsIThreadRetargetableRequest> retargetable =
+        do_QueryInterface(request);
+    nsCOMPtr<nsIEventTarget> sts =
+        do_GetService(NS_STREAMTRANSPORTSERVICE_CONTRACTID);
+    if (retargetable && sts) {
+      mMainThreadTarget = nsContentUtils::GetEventTargetByLoadInfo(
+          mChannel->LoadInfo(), mozilla::TaskCategory::Network);
+      if (!mMainThreadTarget) {
+        mMainThreadTarget = GetMainThreadEventTarget();
+      }
+      Unused << retargetable->RetargetDeliveryTo(sts);
+    }
+  }
+
   return NS_OK;
 }
 
@@ -497,6 +526,52 @@ nsMultiMixedConv::OnStartRequest(nsIRequest* request) {
 NS_IMETHODIMP
 nsMultiMixedConv::OnDataAvailable(nsIRequest* request, nsIInputStream* inStr,
                                   uint64_t sourceOffset, uint32_t count) {
+  if (!NS_IsMainThread()) {
+    // Delivery was retargeted, so whatever decodes the content ahead of us
+    // ran off the main thread.  Splitting the parts and notifying their
+    // listeners stays on the main thread, in order: the data is handed over
+    // in runnables on the channel's event target, which run before the
+    // request's OnStopRequest is dispatched there after them.
+    MOZ_ASSERT(mMainThreadTarget);
+    nsCString data;
+    nsresult rv = NS_ReadInputStreamToString(inStr, data, count);
+    if (NS_FAILED(rv)) {
+      return rv;
+    }
+
+    RefPtr<nsMultiMixedConv> self = this;
+    nsCOMPtr<nsIRequest> req = request;
+    ++mPendingData;
+    rv = mMainThreadTarget->Dispatch(
+        NS_NewRunnableFunction(
+            "nsMultiMixedConv::OnDataAvailable",
+            [self, req, data, sourceOffset]() {
+              --self->mPendingData;
+
+              nsresult status;
+              if (NS_SUCCEEDED(req->GetStatus(&status)) &&
+                  NS_FAILED(status)) {
+                return;  // canceled while this was in flight
+              }
+
+              nsCOMPtr<nsIInputStream> stream;
+              nsresult rv =
+                  NS_NewCStringInputStream(getter_AddRefs(stream), data);
+              if (NS_SUCCEEDED(rv)) {
+                rv = self->OnDataAvailable(req, stream, sourceOffset,
+                                           data.Length());
+              }
+              if (NS_FAILED(rv)) {
+                req->Cancel(rv);
+              }
+            }),
+        NS_DISPATCH_NORMAL);
+    if (NS_FAILED(rv)) {
+      --mPendingData;
+    }
+    return rv;
+  }
+
   // Failing these assertions may indicate that some of the target listeners of
   // this converter is looping the thead queue, which is harmful to how we
   // collect the raw (content) data.
@@ -522,10 +597,36 @@ nsMultiMixedConv::OnDataAvailable(nsIRequest* request, nsIInputStream* inStr,
   return NS_FAILED(rv_send) ? rv_send : rv_feed;
 }
 
+// nsIThreadRetargetableStreamListener implementation
+
+NS_IMETHODIMP
+nsMultiMixedConv::CheckListenerChain() {
+  MOZ_ASSERT(NS_IsMainThread(), "Should be on the main thread!");
+  // Our listeners are only ever called on the main thread, see
+  // OnDataAvailable, so they need not support retargeting themselves.
+  return NS_OK;
+}
+
 NS_IMETHODIMP
 nsMultiMixedConv::OnStopRequest(nsIRequest* request, nsresult aStatus) {
   nsresult rv;
 
+  // With delivery retargeted, the data still in flight to the main thread
+  // must have been handed to the part listeners by now; see OnDataAvailable.
+  MOZ_ASSERT(!mPendingData,
+             "nsMultiMixedConv::OnStopRequest ahead of its data!");
+  if (mPendingData) {
+    // Don't lose the end of the last part: stop after the data.
+    RefPtr<nsMultiMixedConv> self = this;
+    nsCOMPtr<nsIRequest> req = request;
+    return mMainThreadTarget->Dispatch(
+        NS_NewRunnableFunction("nsMultiMixedConv::OnStopRequest",
+                               [self, req, aStatus]() {
+                                 Unused << self->OnStopRequest(req, aStatus);
+                               }),
+        NS_DISPATCH_NORMAL);
+  }
+
   if (mBoundary.IsEmpty()) {  // no token, no love.
     return NS_ERROR_FAILURE;
   }
@@ -752,6 +853,7 @@ void nsMultiMixedConv::SwitchToControlParsing() {
 nsMultiMixedConv::nsMultiMixedConv()
     : mCurrentPartID(0),
       mInOnDataAvailable(false),
+      mPendingData(0),
       mResponseHeader(HEADER_UNKNOWN),
       // XXX: This is a hack to bypass the raw pointer to refcounted object in
       // lambda analysis. It should be removed and replaced when the
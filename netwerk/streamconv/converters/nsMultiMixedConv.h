@@ -6,6 +6,7 @@
 #define __nsmultimixedconv__h__
 
 #include "nsIStreamConverter.h"
+#include "nsIThreadRetargetableStreamListener.h"
 #include "nsIChannel.h"
 #include "nsString.h"
 #include "nsCOMPtr.h"
@@ -13,6 +14,7 @@
 #include "nsILoadInfo.h"
 #include "nsIMultiPartChannel.h"
 #include "nsAutoPtr.h"
+#include "mozilla/Atomics.h"
 #include "mozilla/Attributes.h"
 #include "mozilla/IncrementalTokenizer.h"
 #include "nsHttpResponseHead.h"
@@ -126,12 +128,14 @@ class nsPartChannel final : public nsIChannel,
 //
 //
 
-class nsMultiMixedConv : public nsIStreamConverter {
+class nsMultiMixedConv : public nsIStreamConverter,
+                         public nsIThreadRetargetableStreamListener {
  public:
-  NS_DECL_ISUPPORTS
+  NS_DECL_THREADSAFE_ISUPPORTS
   NS_DECL_NSISTREAMCONVERTER
   NS_DECL_NSISTREAMLISTENER
   NS_DECL_NSIREQUESTOBSERVER
+  NS_DECL_NSITHREADRETARGETABLESTREAMLISTENER
 
   explicit nsMultiMixedConv();
 
@@ -179,6 +183,13 @@ class nsMultiMixedConv : public nsIStreamConverter {
   // ends up spinning the event loop.
   bool mInOnDataAvailable;
 
+  // Where the data is handed back to when delivery was retargeted off the
+  // main thread: the channel's labeled main thread event target.
+  nsCOMPtr<nsIEventTarget> mMainThreadTarget;
+  // Number of OnDataAvailable runnables dispatched to mMainThreadTarget that
+  // haven't run yet.
+  mozilla::Atomic<uint32_t> mPendingData;
+
   // Current state of the incremental parser
   enum EParserState {
     PREAMBLE,
@@ -23,6 +23,7 @@
 #include "mozilla/Unused.h"
 #include "mozilla/net/CookieSettings.h"
 #include "nsIURI.h"
+#include "nsPrintfCString.h"
 
 using mozilla::Unused;
 
@@ -1120,3 +1121,59 @@ TEST(TestCookie, TestCookieMain)
   // *** IP address tests
   // *** speed tests
 }
+
+TEST(TestCookie, ManyCookiesPerBaseDomain)
+{
+  nsresult rv;
+
+  nsCOMPtr<nsICookieService> cookieService =
+      do_GetService(kCookieServiceCID, &rv);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  nsCOMPtr<nsIPrefBranch> prefBranch = do_GetService(kPrefServiceCID, &rv);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  InitPrefs(prefBranch);
+
+  nsCOMPtr<nsICookieManager> cookieMgr =
+      do_GetService(NS_COOKIEMANAGER_CONTRACTID, &rv);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  EXPECT_TRUE(NS_SUCCEEDED(cookieMgr->RemoveAll()));
+
+  // cookies for many hosts and paths of one base domain, which all share
+  // one entry in the cookie table.
+  for (uint32_t i = 0; i < 10; ++i) {
+    nsPrintfCString host("http://host%u.many.com/dir%u/file", i, i);
+    SetACookie(cookieService, host.get(), nullptr,
+               nsPrintfCString("host%u=1; path=/", i).get(), nullptr);
+    SetACookie(cookieService, host.get(), nullptr,
+               nsPrintfCString("path%u=1; path=/dir%u", i, i).get(),
+               nullptr);
+  }
+  SetACookie(cookieService, "http://www.many.com/", nullptr,
+             "domain=1; domain=.many.com", nullptr);
+  SetACookie(cookieService, "https://www.many.com/", nullptr,
+             "secure=1; domain=.many.com; secure", nullptr);
+  SetACookie(cookieService, "https://sub.host3.many.com/", nullptr,
+             "subdomain=1; domain=.sub.host3.many.com", nullptr);
+
+  nsCString cookie;
+  GetACookie(cookieService, "http://host3.many.com/dir3/file", nullptr,
+             cookie);
+  EXPECT_TRUE(CheckResult(cookie.get(), MUST_EQUAL,
+                          "path3=1; host3=1; domain=1"));
+
+  GetACookie(cookieService, "https://a.sub.host3.many.com/dir3", nullptr,
+             cookie);
+  EXPECT_TRUE(CheckResult(cookie.get(), MUST_EQUAL,
+                          "domain=1; secure=1; subdomain=1"));
+
+  // a host that merely ends with another cookie's host doesn't match it.
+  GetACookie(cookieService, "http://xhost3.many.com/dir3", nullptr, cookie);
+  EXPECT_TRUE(CheckResult(cookie.get(), MUST_EQUAL, "domain=1"));
+
+  GetACookie(cookieService, "http://many.com/", nullptr, cookie);
+  EXPECT_TRUE(CheckResult(cookie.get(), MUST_EQUAL, "domain=1"));
+
+  EXPECT_TRUE(NS_SUCCEEDED(cookieMgr->RemoveAll()));
+}
@@ -396,3 +396,106 @@ close:
   // Wait for client and server to see closing
   waiter->Wait(2);
 }
+
+/*
+ * UDPBurstListener: counts the datagrams of a burst as they arrive
+ */
+class UDPBurstListener : public nsIUDPSocketListener {
+ protected:
+  virtual ~UDPBurstListener() = default;
+
+ public:
+  UDPBurstListener(WaitForCondition* waiter, uint32_t expected)
+      : mWaiter(waiter) {
+    for (uint32_t i = 0; i < expected; i++) {
+      mSeen.AppendElement(false);
+    }
+  }
+
+  NS_DECL_THREADSAFE_ISUPPORTS
+  NS_DECL_NSIUDPSOCKETLISTENER
+
+  uint32_t mReceived = 0;
+  RefPtr<WaitForCondition> mWaiter;
+  nsTArray<bool> mSeen;
+};
+
+NS_IMPL_ISUPPORTS(UDPBurstListener, nsIUDPSocketListener)
+
+NS_IMETHODIMP
+UDPBurstListener::OnPacketReceived(nsIUDPSocket* socket,
+                                   nsIUDPMessage* message) {
+  FallibleTArray<uint8_t>& data = message->GetDataAsTArray();
+  uint32_t sequence;
+  if (data.Length() != sizeof(sequence)) {
+    ADD_FAILURE() << "Unexpected datagram length " << data.Length();
+    return NS_OK;
+  }
+  memcpy(&sequence, data.Elements(), sizeof(sequence));
+  if (sequence >= mSeen.Length() || mSeen[sequence]) {
+    ADD_FAILURE() << "Unexpected datagram " << sequence;
+    return NS_OK;
+  }
+  mSeen[sequence] = true;
+  if (++mReceived == mSeen.Length()) {
+    mWaiter->Notify();
+  }
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+UDPBurstListener::OnStopListening(nsIUDPSocket*, nsresult) {
+  mWaiter->Notify();
+  return NS_OK;
+}
+
+// Datagrams sent from the main thread are queued for the socket thread and
+// sent in batches, and the receiving socket reads them in batches too; every
+// one of them must still arrive.
+TEST(TestUDPSocket, TestUDPSocketBurst)
+{
+  const uint32_t kBurst = 100;
+  nsresult rv;
+
+  nsCOMPtr<nsIUDPSocket> server, client;
+  server = do_CreateInstance("@mozilla.org/network/udp-socket;1", &rv);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  client = do_CreateInstance("@mozilla.org/network/udp-socket;1", &rv);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  RefPtr<WaitForCondition> waiter = new WaitForCondition();
+  RefPtr<UDPBurstListener> serverListener =
+      new UDPBurstListener(waiter, kBurst);
+
+  nsCOMPtr<nsIPrincipal> systemPrincipal = nsContentUtils::GetSystemPrincipal();
+
+  rv = server->Init(0, true, systemPrincipal, true, 0);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+  rv = server->AsyncListen(serverListener);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  rv = client->Init(0, true, systemPrincipal, true, 0);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  mozilla::net::NetAddr serverAddr;
+  rv = server->GetAddress(&serverAddr);
+  ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+  for (uint32_t i = 0; i < kBurst; i++) {
+    nsTArray<uint8_t> data;
+    data.AppendElements((const uint8_t*)&i, sizeof(i));
+    uint32_t count;
+    rv = client->SendWithAddress(&serverAddr, data, &count);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+    EXPECT_EQ(count, sizeof(i));
+  }
+
+  waiter->Wait(1);
+  EXPECT_EQ(serverListener->mReceived, kBurst);
+
+  server->Close();
+  client->Close();
+
+  // Only the server was listening.
+  waiter->Wait(1);
+}
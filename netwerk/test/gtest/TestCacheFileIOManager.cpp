@@ -0,0 +1,473 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim:set ts=2 sw=2 sts=2 et cindent: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+
+#include <functional>
+#include <string.h>
+
+#include "CacheFileIOManager.h"
+#include "CacheIndex.h"
+#include "mozilla/Atomics.h"
+#include "mozilla/Monitor.h"
+#include "mozilla/SHA1.h"
+#include "mozilla/SyncRunnable.h"
+#include "mozilla/TimeStamp.h"
+#include "mozilla/UniquePtr.h"
+#include "nsAppDirectoryServiceDefs.h"
+#include "nsCOMPtr.h"
+#include "nsDirectoryServiceDefs.h"
+#include "nsDirectoryServiceUtils.h"
+#include "nsIDirectoryService.h"
+#include "nsIFile.h"
+#include "nsPrintfCString.h"
+#include "nsServiceManagerUtils.h"
+#include "nsTArray.h"
+#include "nsThreadUtils.h"
+#include "prthread.h"
+
+using namespace mozilla;
+using namespace mozilla::net;
+
+namespace {
+
+// Answers the local profile directory with a temporary directory when the
+// test runs without a profile, the cache needs one for its files.
+class TestProfileProvider final : public nsIDirectoryServiceProvider {
+ public:
+  NS_DECL_ISUPPORTS
+
+  explicit TestProfileProvider(nsIFile* aDir) : mDir(aDir) {}
+
+  NS_IMETHOD GetFile(const char* aKey, bool* aPersistent,
+                     nsIFile** aResult) override {
+    if (strcmp(aKey, NS_APP_USER_PROFILE_LOCAL_50_DIR)) {
+      return NS_ERROR_FAILURE;
+    }
+    *aPersistent = false;
+    return mDir->Clone(aResult);
+  }
+
+ private:
+  ~TestProfileProvider() = default;
+
+  nsCOMPtr<nsIFile> mDir;
+};
+
+NS_IMPL_ISUPPORTS(TestProfileProvider, nsIDirectoryServiceProvider)
+
+// Records the outcome of a single CacheFileIOManager operation.
+class TestListener final : public CacheFileIOListener {
+ public:
+  NS_DECL_THREADSAFE_ISUPPORTS
+
+  explicit TestListener(Monitor* aMonitor)
+      : mMonitor(aMonitor),
+        mResult(NS_ERROR_UNEXPECTED),
+        mDone(false),
+        mOnIOThread(false) {}
+
+  NS_IMETHOD OnFileOpened(CacheFileHandle* aHandle,
+                          nsresult aResult) override {
+    MonitorAutoLock lock(*mMonitor);
+    mHandle = aHandle;
+    return Done(lock, aResult);
+  }
+
+  NS_IMETHOD OnDataWritten(CacheFileHandle* aHandle, const char* aBuf,
+                           nsresult aResult) override {
+    MonitorAutoLock lock(*mMonitor);
+    return Done(lock, aResult);
+  }
+
+  NS_IMETHOD OnDataRead(CacheFileHandle* aHandle, char* aBuf,
+                        nsresult aResult) override {
+    MonitorAutoLock lock(*mMonitor);
+    mOnIOThread = CacheFileIOManager::IsOnIOThread();
+    return Done(lock, aResult);
+  }
+
+  NS_IMETHOD OnFileDoomed(CacheFileHandle* aHandle,
+                          nsresult aResult) override {
+    return NS_OK;
+  }
+
+  NS_IMETHOD OnEOFSet(CacheFileHandle* aHandle, nsresult aResult) override {
+    return NS_OK;
+  }
+
+  NS_IMETHOD OnFileRenamed(CacheFileHandle* aHandle,
+                           nsresult aResult) override {
+    return NS_OK;
+  }
+
+  // Protected by the monitor.
+  RefPtr<CacheFileHandle> mHandle;
+  nsresult mResult;
+  bool mDone;
+  bool mOnIOThread;
+
+ private:
+  ~TestListener() = default;
+
+  nsresult Done(MonitorAutoLock& aLock, nsresult aResult) {
+    mResult = aResult;
+    mDone = true;
+    aLock.NotifyAll();
+    return NS_OK;
+  }
+
+  Monitor* mMonitor;
+};
+
+NS_IMPL_ISUPPORTS(TestListener, CacheFileIOListener)
+
+class CacheFileIOManagerTest : public ::testing::Test {
+ protected:
+  CacheFileIOManagerTest() : mMonitor("CacheFileIOManagerTest") {}
+
+  // Returns false when the cache has no directory to work in.
+  static bool EnsureCache() {
+    static bool sInitialized = false;
+    static bool sUsable = false;
+    if (sInitialized) {
+      return sUsable;
+    }
+    sInitialized = true;
+
+    nsresult rv = CacheFileIOManager::Init();
+    if (rv == NS_ERROR_ALREADY_INITIALIZED) {
+      sUsable = true;
+      return sUsable;
+    }
+    if (NS_FAILED(rv)) {
+      return false;
+    }
+
+    nsCOMPtr<nsIFile> dir;
+    rv = NS_GetSpecialDirectory(NS_APP_USER_PROFILE_LOCAL_50_DIR,
+                                getter_AddRefs(dir));
+    if (NS_FAILED(rv)) {
+      rv = NS_GetSpecialDirectory(NS_OS_TEMP_DIR, getter_AddRefs(dir));
+      if (NS_FAILED(rv)) {
+        return false;
+      }
+      dir->AppendNative(NS_LITERAL_CSTRING("cache-io-test"));
+      rv = dir->CreateUnique(nsIFile::DIRECTORY_TYPE, 0700);
+      if (NS_FAILED(rv)) {
+        return false;
+      }
+
+      nsCOMPtr<nsIDirectoryService> dirService =
+          do_GetService(NS_DIRECTORY_SERVICE_CONTRACTID);
+      if (!dirService) {
+        return false;
+      }
+      RefPtr<TestProfileProvider> provider = new TestProfileProvider(dir);
+      dirService->RegisterProvider(provider);
+    }
+
+    sUsable = NS_SUCCEEDED(CacheFileIOManager::OnProfile());
+    return sUsable;
+  }
+
+  static char Pattern(uint32_t aFile, uint32_t aOffset) {
+    return static_cast<char>((aFile * 31 + aOffset * 7 + aOffset / 251) &
+                             0xff);
+  }
+
+  bool Wait(const nsTArray<RefPtr<TestListener>>& aListeners) {
+    TimeStamp deadline = TimeStamp::Now() + TimeDuration::FromSeconds(60);
+    MonitorAutoLock lock(mMonitor);
+    for (auto& listener : aListeners) {
+      while (!listener->mDone) {
+        TimeStamp now = TimeStamp::Now();
+        if (now >= deadline) {
+          return false;
+        }
+        lock.Wait(deadline - now);
+      }
+    }
+    return true;
+  }
+
+  // Opens |aCount| new files and fills each with |aSize| bytes of Pattern().
+  void CreateFiles(uint32_t aCount, uint32_t aSize) {
+    nsTArray<RefPtr<TestListener>> opens;
+    for (uint32_t i = 0; i < aCount; ++i) {
+      RefPtr<TestListener> listener = new TestListener(&mMonitor);
+      nsPrintfCString key(":http://parallel-read.test/%u/%p", i, this);
+      ASSERT_TRUE(NS_SUCCEEDED(CacheFileIOManager::OpenFile(
+          key, CacheFileIOManager::CREATE_NEW, listener)));
+      opens.AppendElement(listener);
+    }
+    ASSERT_TRUE(Wait(opens));
+    for (auto& listener : opens) {
+      ASSERT_TRUE(NS_SUCCEEDED(listener->mResult));
+      mHandles.AppendElement(listener->mHandle);
+    }
+
+    nsTArray<RefPtr<TestListener>> writes;
+    for (uint32_t i = 0; i < aCount; ++i) {
+      UniquePtr<char[]> buf(new char[aSize]);
+      for (uint32_t j = 0; j < aSize; ++j) {
+        buf[j] = Pattern(i, j);
+      }
+      RefPtr<TestListener> listener = new TestListener(&mMonitor);
+      ASSERT_TRUE(NS_SUCCEEDED(CacheFileIOManager::Write(
+          mHandles[i], 0, buf.get(), aSize, false, false, listener)));
+      writes.AppendElement(listener);
+      mWriteBuffers.AppendElement(std::move(buf));
+    }
+    ASSERT_TRUE(Wait(writes));
+    for (auto& listener : writes) {
+      ASSERT_TRUE(NS_SUCCEEDED(listener->mResult));
+    }
+  }
+
+  // Reads every file in |aChunk| sized pieces with all reads in flight at
+  // once and checks the data and that every callback came on the IO thread.
+  void ReadFiles(uint32_t aSize, uint32_t aChunk) {
+    struct PendingRead {
+      uint32_t mFile;
+      uint32_t mOffset;
+      UniquePtr<char[]> mBuf;
+      RefPtr<TestListener> mListener;
+    };
+    nsTArray<PendingRead> reads;
+    nsTArray<RefPtr<TestListener>> listeners;
+
+    for (uint32_t offset = 0; offset < aSize; offset += aChunk) {
+      for (uint32_t i = 0; i < mHandles.Length(); ++i) {
+        PendingRead* read = reads.AppendElement();
+        read->mFile = i;
+        read->mOffset = offset;
+        read->mBuf.reset(new char[aChunk]);
+        read->mListener = new TestListener(&mMonitor);
+        ASSERT_TRUE(NS_SUCCEEDED(
+            CacheFileIOManager::Read(mHandles[i], offset, read->mBuf.get(),
+                                     aChunk, read->mListener)));
+        listeners.AppendElement(read->mListener);
+      }
+    }
+    ASSERT_TRUE(Wait(listeners));
+
+    MonitorAutoLock lock(mMonitor);
+    for (auto& read : reads) {
+      ASSERT_TRUE(NS_SUCCEEDED(read.mListener->mResult));
+      EXPECT_TRUE(read.mListener->mOnIOThread);
+      for (uint32_t j = 0; j < aChunk; ++j) {
+        ASSERT_EQ(Pattern(read.mFile, read.mOffset + j), read.mBuf[j]);
+      }
+    }
+  }
+
+  // Returns false when the index didn't get ready in time.
+  static bool WaitForIndex() {
+    TimeStamp deadline = TimeStamp::Now() + TimeDuration::FromSeconds(60);
+    while (TimeStamp::Now() < deadline) {
+      bool upToDate = false;
+      if (NS_SUCCEEDED(CacheIndex::IsUpToDate(&upToDate)) && upToDate) {
+        return true;
+      }
+      PR_Sleep(PR_MillisecondsToInterval(50));
+    }
+    return false;
+  }
+
+  static void RunOnIOThread(const std::function<void()>& aFunc) {
+    nsCOMPtr<nsIEventTarget> target = CacheFileIOManager::IOTarget();
+    ASSERT_TRUE(target);
+    RefPtr<SyncRunnable> runnable = new SyncRunnable(
+        NS_NewRunnableFunction("CacheFileIOManagerTest", aFunc));
+    runnable->DispatchToThread(target);
+  }
+
+  static void Hash(const char* aPrefix, uint32_t aIndex, const void* aTest,
+                   SHA1Sum::Hash* aHash) {
+    nsPrintfCString key(":http://%s.test/%u/%p", aPrefix, aIndex, aTest);
+    SHA1Sum sum;
+    sum.update(key.BeginReading(), key.Length());
+    sum.finish(*aHash);
+  }
+
+  // Checks that the lock-free answer of CacheIndex::HasEntry() for each
+  // hash is |aInTable| and agrees with the answer under the lock.
+  static void CheckIndex(const nsTArray<SHA1Sum::Hash>& aHashes,
+                         const nsTArray<bool>& aInTable) {
+    for (uint32_t i = 0; i < aHashes.Length(); ++i) {
+      bool lockFree = CacheIndex::HasEntryLockFree(aHashes[i]);
+      ASSERT_EQ(aInTable[i], lockFree) << "entry " << i;
+
+      // A callback makes HasEntry() skip the lookup table.
+      CacheIndex::EntryStatus locked;
+      ASSERT_TRUE(NS_SUCCEEDED(CacheIndex::HasEntry(
+          aHashes[i], &locked, [](const CacheIndexEntry*) {})));
+      CacheIndex::EntryStatus status;
+      ASSERT_TRUE(NS_SUCCEEDED(CacheIndex::HasEntry(aHashes[i], &status)));
+      ASSERT_EQ(locked, status) << "entry " << i;
+      if (lockFree) {
+        ASSERT_EQ(CacheIndex::EXISTS, status) << "entry " << i;
+      }
+    }
+  }
+
+  void TearDown() override {
+    for (auto& handle : mHandles) {
+      CacheFileIOManager::DoomFile(handle, nullptr);
+    }
+    mHandles.Clear();
+  }
+
+  Monitor mMonitor;
+  nsTArray<RefPtr<CacheFileHandle>> mHandles;
+  nsTArray<UniquePtr<char[]>> mWriteBuffers;
+};
+
+}  // namespace
+
+// Many concurrent reads of a few files, spread over the read threads.
+TEST_F(CacheFileIOManagerTest, ParallelReads) {
+  if (!EnsureCache()) {
+    printf("Skipping, the cache has no directory\n");
+    return;
+  }
+
+  const uint32_t kSize = 256 * 1024;
+  CreateFiles(8, kSize);
+  ReadFiles(kSize, 16 * 1024);
+}
+
+// A read past the end of the file fails, also on the parallel path.
+TEST_F(CacheFileIOManagerTest, ParallelReadPastEOF) {
+  if (!EnsureCache()) {
+    printf("Skipping, the cache has no directory\n");
+    return;
+  }
+
+  const uint32_t kSize = 4096;
+  CreateFiles(1, kSize);
+
+  char buf[100];
+  RefPtr<TestListener> listener = new TestListener(&mMonitor);
+  ASSERT_TRUE(NS_SUCCEEDED(CacheFileIOManager::Read(
+      mHandles[0], kSize - 10, buf, sizeof(buf), listener)));
+  nsTArray<RefPtr<TestListener>> listeners;
+  listeners.AppendElement(listener);
+  ASSERT_TRUE(Wait(listeners));
+
+  MonitorAutoLock lock(mMonitor);
+  EXPECT_TRUE(NS_FAILED(listener->mResult));
+  EXPECT_TRUE(listener->mOnIOThread);
+}
+
+// More files than the open handle limit (128) with reads in flight on all
+// of them.  Pinned descriptors must not push the number of open handles
+// over the limit (asserted in OpenNSPRHandle), reads over the pinning
+// budget fall back to the IO thread.
+TEST_F(CacheFileIOManagerTest, ParallelReadsOverHandleLimit) {
+  if (!EnsureCache()) {
+    printf("Skipping, the cache has no directory\n");
+    return;
+  }
+
+  const uint32_t kSize = 8192;
+  CreateFiles(200, kSize);
+  ReadFiles(kSize, 2048);
+}
+
+// The lock-free lookup table of CacheIndex has to follow mIndex through
+// adding, initializing, updating and removing entries, across growing and
+// shrinking the table, while other threads keep looking entries up.
+TEST_F(CacheFileIOManagerTest, IndexLookupTable) {
+  if (!EnsureCache() || !WaitForIndex()) {
+    printf("Skipping, the cache index is not available\n");
+    return;
+  }
+
+  // Enough entries for the table to grow a few times from its initial size.
+  const uint32_t kEntries = 5000;
+  nsTArray<SHA1Sum::Hash> hashes;
+  hashes.SetLength(kEntries);
+  nsTArray<bool> inTable;
+  inTable.SetLength(kEntries);
+  for (uint32_t i = 0; i < kEntries; ++i) {
+    Hash("lookup-table", i, this, &hashes[i]);
+    inTable[i] = false;
+  }
+
+  // Hashes that are never added must never be found, also by lookups
+  // racing with updates and resizes of the table.
+  const uint32_t kAbsent = 64;
+  nsTArray<SHA1Sum::Hash> absent;
+  absent.SetLength(kAbsent);
+  for (uint32_t i = 0; i < kAbsent; ++i) {
+    Hash("lookup-table-absent", i, this, &absent[i]);
+  }
+  Atomic<bool> stop(false);
+  Atomic<uint32_t> falsePositives(0);
+  nsCOMPtr<nsIThread> reader;
+  ASSERT_TRUE(NS_SUCCEEDED(NS_NewNamedThread(
+      "IndexLookupTable", getter_AddRefs(reader),
+      NS_NewRunnableFunction("IndexLookupTable", [&]() {
+        while (!stop) {
+          for (uint32_t i = 0; i < kAbsent; ++i) {
+            if (CacheIndex::HasEntryLockFree(absent[i])) {
+              ++falsePositives;
+            }
+          }
+        }
+      }))));
+
+  // Entries that are added but not initialized yet are not in the table.
+  RunOnIOThread([&] {
+    for (uint32_t i = 0; i < kEntries; ++i) {
+      ASSERT_TRUE(NS_SUCCEEDED(CacheIndex::AddEntry(&hashes[i])));
+    }
+    CheckIndex(hashes, inTable);
+  });
+
+  RunOnIOThread([&] {
+    for (uint32_t i = 0; i < kEntries; ++i) {
+      ASSERT_TRUE(NS_SUCCEEDED(
+          CacheIndex::InitEntry(&hashes[i], 0, false, false)));
+      inTable[i] = true;
+    }
+    CheckIndex(hashes, inTable);
+  });
+
+  RunOnIOThread([&] {
+    for (uint32_t i = 0; i < kEntries; ++i) {
+      uint32_t frecency = i + 1;
+      uint32_t size = 1;
+      ASSERT_TRUE(NS_SUCCEEDED(
+          CacheIndex::UpdateEntry(&hashes[i], &frecency, nullptr, nullptr,
+                                  nullptr, nullptr, nullptr, 0, &size)));
+    }
+    CheckIndex(hashes, inTable);
+  });
+
+  // Remove every other entry, then the rest, which shrinks the table.
+  RunOnIOThread([&] {
+    for (uint32_t i = 0; i < kEntries; i += 2) {
+      ASSERT_TRUE(NS_SUCCEEDED(CacheIndex::RemoveEntry(&hashes[i])));
+      inTable[i] = false;
+    }
+    CheckIndex(hashes, inTable);
+  });
+
+  RunOnIOThread([&] {
+    for (uint32_t i = 1; i < kEntries; i += 2) {
+      ASSERT_TRUE(NS_SUCCEEDED(CacheIndex::RemoveEntry(&hashes[i])));
+      inTable[i] = false;
+    }
+    CheckIndex(hashes, inTable);
+  });
+
+  stop = true;
+  reader->Shutdown();
+  EXPECT_EQ(0u, uint32_t(falsePositives));
+}
@@ -0,0 +1,287 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim:set ts=2 sw=2 sts=2 et cindent: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CacheFileIOUring.h"
+#include "mozilla/Monitor.h"
+#include "mozilla/TimeStamp.h"
+#include "mozilla/UniquePtr.h"
+#include "nsCOMPtr.h"
+#include "nsDirectoryServiceDefs.h"
+#include "nsDirectoryServiceUtils.h"
+#include "nsIFile.h"
+#include "nsString.h"
+#include "nsTArray.h"
+#include "nsThreadUtils.h"
+
+using namespace mozilla;
+using namespace mozilla::net;
+
+namespace {
+
+// One read submitted to the ring.  Lives in a UniquePtr so that the
+// buffer and the result the ring writes to don't move.
+struct RingRead {
+  int64_t mOffset;
+  int32_t mCount;
+  UniquePtr<char[]> mBuf;
+  nsresult mResult;
+  bool mSubmitted;
+  bool mDone;
+};
+
+class CacheFileIOUringTest : public ::testing::Test {
+ protected:
+  CacheFileIOUringTest()
+      : mMonitor("CacheFileIOUringTest"), mFD(-1), mSize(0) {}
+
+  void SetUp() override {
+    mRing = CacheFileIOUring::Create();
+    if (!mRing) {
+      return;
+    }
+
+    nsresult rv = NS_GetSpecialDirectory(NS_OS_TEMP_DIR, getter_AddRefs(mFile));
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+    mFile->AppendNative(NS_LITERAL_CSTRING("cache-io-uring-test"));
+    rv = mFile->CreateUnique(nsIFile::NORMAL_FILE_TYPE, 0600);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+
+    nsAutoCString path;
+    ASSERT_TRUE(NS_SUCCEEDED(mFile->GetNativePath(path)));
+    mFD = open(path.get(), O_RDWR);
+    ASSERT_NE(-1, mFD);
+  }
+
+  void TearDown() override {
+    if (mRing) {
+      mRing->Shutdown();
+      mRing = nullptr;
+    }
+    if (mFD != -1) {
+      close(mFD);
+    }
+    if (mFile) {
+      mFile->Remove(false);
+    }
+  }
+
+  // Returns false, and the test should end, when the kernel has no
+  // io_uring.
+  bool HasRing() {
+    if (!mRing) {
+      printf("Skipping, io_uring is not supported\n");
+      return false;
+    }
+    return true;
+  }
+
+  static char Pattern(uint32_t aOffset) {
+    return static_cast<char>((aOffset * 13 + aOffset / 509) & 0xff);
+  }
+
+  void Fill(uint32_t aSize) {
+    UniquePtr<char[]> buf(new char[aSize]);
+    for (uint32_t i = 0; i < aSize; ++i) {
+      buf[i] = Pattern(i);
+    }
+    ASSERT_EQ(static_cast<ssize_t>(aSize), pwrite(mFD, buf.get(), aSize, 0));
+    mSize = aSize;
+  }
+
+  // Queues a read of |aCount| bytes at |aOffset|, returns what
+  // CacheFileIOUring::Read() returned.
+  nsresult Submit(int64_t aOffset, int32_t aCount) {
+    UniquePtr<RingRead>* slot = mReads.AppendElement();
+    *slot = MakeUnique<RingRead>();
+    RingRead* read = slot->get();
+    read->mOffset = aOffset;
+    read->mCount = aCount;
+    read->mBuf.reset(new char[aCount]);
+    read->mResult = NS_ERROR_UNEXPECTED;
+    read->mDone = false;
+
+    Monitor* monitor = &mMonitor;
+    nsCOMPtr<nsIRunnable> completion =
+        NS_NewRunnableFunction("CacheFileIOUringTest::Completion",
+                               [read, monitor]() {
+                                 MonitorAutoLock lock(*monitor);
+                                 read->mDone = true;
+                                 lock.NotifyAll();
+                               });
+    nsresult rv = mRing->Read(mFD, aOffset, read->mBuf.get(), aCount,
+                              &read->mResult, completion);
+    read->mSubmitted = NS_SUCCEEDED(rv);
+    return rv;
+  }
+
+  // Submits the queued reads and waits for all of them.
+  bool WaitForReads() {
+    mRing->Submit();
+
+    TimeStamp deadline = TimeStamp::Now() + TimeDuration::FromSeconds(30);
+    MonitorAutoLock lock(mMonitor);
+    for (auto& read : mReads) {
+      while (read->mSubmitted && !read->mDone) {
+        TimeStamp now = TimeStamp::Now();
+        if (now >= deadline) {
+          return false;
+        }
+        lock.Wait(deadline - now);
+      }
+    }
+    return true;
+  }
+
+  // Checks that every submitted read got what pread() returns for the same
+  // range: the same bytes, or a failure when the range goes past the end of
+  // the file.
+  void CheckPreadParity() {
+    MonitorAutoLock lock(mMonitor);
+    for (auto& read : mReads) {
+      if (!read->mSubmitted) {
+        EXPECT_FALSE(read->mDone);
+        continue;
+      }
+
+      UniquePtr<char[]> expected(new char[read->mCount]);
+      ssize_t n = pread(mFD, expected.get(), read->mCount, read->mOffset);
+      if (n == read->mCount) {
+        ASSERT_TRUE(NS_SUCCEEDED(read->mResult));
+        ASSERT_EQ(0, memcmp(expected.get(), read->mBuf.get(), read->mCount));
+      } else {
+        ASSERT_TRUE(NS_FAILED(read->mResult));
+      }
+    }
+  }
+
+  Monitor mMonitor;
+  RefPtr<CacheFileIOUring> mRing;
+  nsCOMPtr<nsIFile> mFile;
+  int mFD;
+  uint32_t mSize;
+  nsTArray<UniquePtr<RingRead>> mReads;
+};
+
+}  // namespace
+
+// Reads of various sizes and alignments return what pread() does.
+TEST_F(CacheFileIOUringTest, PreadParity) {
+  if (!HasRing()) {
+    return;
+  }
+
+  const uint32_t kSize = 1024 * 1024;
+  Fill(kSize);
+
+  const int32_t kCounts[] = {1, 511, 4096, 16 * 1024, 256 * 1024};
+  for (int32_t count : kCounts) {
+    for (int64_t offset = 0; offset + count <= kSize;
+         offset += count * 3 + 7) {
+      if (NS_FAILED(Submit(offset, count))) {
+        // The ring is full, let it drain and try again.
+        mReads.RemoveLastElement();
+        ASSERT_TRUE(WaitForReads());
+        ASSERT_TRUE(NS_SUCCEEDED(Submit(offset, count)));
+      }
+    }
+  }
+  ASSERT_TRUE(WaitForReads());
+  CheckPreadParity();
+
+  MonitorAutoLock lock(mMonitor);
+  for (auto& read : mReads) {
+    EXPECT_TRUE(read->mSubmitted);
+  }
+}
+
+// A read that ends past the end of the file comes back short from the
+// kernel.  The ring asks for the rest, gets end of file and fails the read
+// like pread() based reads do, a read that ends exactly at the end of the
+// file succeeds.
+TEST_F(CacheFileIOUringTest, ShortReads) {
+  if (!HasRing()) {
+    return;
+  }
+
+  const uint32_t kSize = 10000;
+  Fill(kSize);
+
+  ASSERT_TRUE(NS_SUCCEEDED(Submit(kSize - 100, 100)));
+  ASSERT_TRUE(NS_SUCCEEDED(Submit(kSize - 100, 200)));
+  ASSERT_TRUE(NS_SUCCEEDED(Submit(kSize, 1)));
+  ASSERT_TRUE(NS_SUCCEEDED(Submit(kSize + 4096, 4096)));
+  ASSERT_TRUE(WaitForReads());
+  CheckPreadParity();
+
+  MonitorAutoLock lock(mMonitor);
+  EXPECT_TRUE(NS_SUCCEEDED(mReads[0]->mResult));
+  EXPECT_TRUE(NS_FAILED(mReads[1]->mResult));
+  EXPECT_TRUE(NS_FAILED(mReads[2]->mResult));
+  EXPECT_TRUE(NS_FAILED(mReads[3]->mResult));
+}
+
+// More reads than the ring holds.  Read() refuses the ones that don't fit,
+// without running their completion, so the caller can fall back to
+// blocking reads.  The accepted ones all complete.  After Shutdown()
+// every read is refused.
+TEST_F(CacheFileIOUringTest, Fallback) {
+  if (!HasRing()) {
+    return;
+  }
+
+  const uint32_t kSize = 64 * 1024;
+  Fill(kSize);
+
+  uint32_t refused = 0;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    nsresult rv = Submit((i * 4096) % kSize, 4096);
+    if (NS_FAILED(rv)) {
+      EXPECT_EQ(NS_ERROR_NOT_AVAILABLE, rv);
+      ++refused;
+    }
+  }
+  ASSERT_TRUE(WaitForReads());
+  CheckPreadParity();
+  // Nothing was submitted while the reads were queued, so the ring filled.
+  EXPECT_GT(refused, 0u);
+
+  mRing->Shutdown();
+  EXPECT_EQ(NS_ERROR_NOT_AVAILABLE, Submit(0, 4096));
+  MonitorAutoLock lock(mMonitor);
+  EXPECT_FALSE(mReads.LastElement()->mDone);
+}
+
+// Queued reads only start with Submit(), which hands all of them to the
+// kernel at once.
+TEST_F(CacheFileIOUringTest, Batching) {
+  if (!HasRing()) {
+    return;
+  }
+
+  const uint32_t kSize = 64 * 1024;
+  Fill(kSize);
+
+  for (uint32_t offset = 0; offset < kSize; offset += 4096) {
+    ASSERT_TRUE(NS_SUCCEEDED(Submit(offset, 4096)));
+  }
+
+  {
+    MonitorAutoLock lock(mMonitor);
+    lock.Wait(TimeDuration::FromMilliseconds(100));
+    for (auto& read : mReads) {
+      EXPECT_FALSE(read->mDone);
+    }
+  }
+
+  ASSERT_TRUE(WaitForReads());
+  CheckPreadParity();
+}
@@ -0,0 +1,263 @@
+#include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH
+
+#include "mozilla/Preferences.h"
+#include "nsCOMPtr.h"
+#include "nsComponentManagerUtils.h"
+#include "nsHTTPCompressConv.h"
+#include "nsIStreamConverter.h"
+#include "nsIStreamListener.h"
+#include "nsStreamUtils.h"
+#include "nsStringStream.h"
+#include "zlib.h"
+
+#ifdef MOZ_ZSTD
+#  include "zdict.h"
+#endif
+
+using namespace mozilla;
+using namespace mozilla::net;
+
+namespace {
+
+class DecodedListener final : public nsIStreamListener {
+ public:
+  NS_DECL_ISUPPORTS
+
+  NS_IMETHOD OnStartRequest(nsIRequest* aRequest) override { return NS_OK; }
+
+  NS_IMETHOD OnDataAvailable(nsIRequest* aRequest, nsIInputStream* aStream,
+                             uint64_t aOffset, uint32_t aCount) override {
+    nsAutoCString data;
+    nsresult rv = NS_ReadInputStreamToString(aStream, data, aCount);
+    NS_ENSURE_SUCCESS(rv, rv);
+    mData.Append(data);
+    return NS_OK;
+  }
+
+  NS_IMETHOD OnStopRequest(nsIRequest* aRequest, nsresult aStatus) override {
+    mStatus = aStatus;
+    return NS_OK;
+  }
+
+  nsCString mData;
+  nsresult mStatus = NS_ERROR_NOT_INITIALIZED;
+
+ private:
+  ~DecodedListener() = default;
+};
+
+NS_IMPL_ISUPPORTS(DecodedListener, nsIStreamListener, nsIRequestObserver)
+
+// A JSON-ish payload like the API responses the encodings are meant for.
+nsCString MakePayload(uint32_t aRecords) {
+  nsCString payload("[");
+  for (uint32_t i = 0; i < aRecords; ++i) {
+    payload.AppendPrintf(
+        "{\"id\":%u,\"name\":\"item-%u\",\"price\":%u.%02u,"
+        "\"tags\":[\"tag-%u\",\"tag-%u\"],\"available\":%s},",
+        i, i, i % 97, i % 100, i % 13, i % 7, i % 3 ? "true" : "false");
+  }
+  payload.Append("{}]");
+  return payload;
+}
+
+nsCString GzipEncode(const nsACString& aData) {
+  z_stream stream{};
+  // 16 + MAX_WBITS asks for a gzip wrapper.
+  deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8,
+               Z_DEFAULT_STRATEGY);
+  nsCString out;
+  out.SetLength(deflateBound(&stream, aData.Length()));
+  stream.next_in = (Bytef*)aData.BeginReading();
+  stream.avail_in = aData.Length();
+  stream.next_out = (Bytef*)out.BeginWriting();
+  stream.avail_out = out.Length();
+  deflate(&stream, Z_FINISH);
+  out.SetLength(stream.total_out);
+  deflateEnd(&stream);
+  return out;
+}
+
+// Feeds |aEncoded| to a converter in |aChunkSize| pieces.
+already_AddRefed<DecodedListener> Decode(const char* aEncoding,
+                                         const nsACString& aEncoded,
+                                         uint32_t aChunkSize) {
+  nsAutoCString contractID("@mozilla.org/streamconv;1?from=");
+  contractID.Append(aEncoding);
+  contractID.AppendLiteral("&to=uncompressed");
+  nsCOMPtr<nsIStreamConverter> converter = do_CreateInstance(contractID.get());
+  if (!converter) {
+    return nullptr;
+  }
+
+  RefPtr<DecodedListener> listener = new DecodedListener();
+  converter->AsyncConvertData(aEncoding, "uncompressed", listener, nullptr);
+  converter->OnStartRequest(nullptr);
+
+  nsresult status = NS_OK;
+  for (uint32_t offset = 0; offset < aEncoded.Length() && NS_SUCCEEDED(status);
+       offset += aChunkSize) {
+    uint32_t count = std::min<uint32_t>(aChunkSize, aEncoded.Length() - offset);
+    nsCOMPtr<nsIInputStream> stream;
+    NS_NewByteInputStream(getter_AddRefs(stream),
+                          MakeSpan(aEncoded.BeginReading() + offset, count),
+                          NS_ASSIGNMENT_DEPEND);
+    status = converter->OnDataAvailable(nullptr, stream, offset, count);
+  }
+  converter->OnStopRequest(nullptr, status);
+  return listener.forget();
+}
+
+}  // namespace
+
+TEST(TestHTTPCompressConv, Gzip)
+{
+  nsCString payload = MakePayload(1000);
+  RefPtr<DecodedListener> listener =
+      Decode("gzip", GzipEncode(payload), 1000);
+  ASSERT_TRUE(listener);
+  EXPECT_EQ(NS_OK, listener->mStatus);
+  EXPECT_TRUE(listener->mData.Equals(payload));
+}
+
+#ifdef MOZ_ZSTD
+namespace {
+
+nsCString ZstdEncode(const nsACString& aData,
+                     const nsACString& aDictionary = EmptyCString()) {
+  nsCString out;
+  out.SetLength(ZSTD_compressBound(aData.Length()));
+  ZSTD_CCtx* cctx = ZSTD_createCCtx();
+  size_t size =
+      aDictionary.IsEmpty()
+          ? ZSTD_compressCCtx(cctx, out.BeginWriting(), out.Length(),
+                              aData.BeginReading(), aData.Length(), 3)
+          : ZSTD_compress_usingDict(cctx, out.BeginWriting(), out.Length(),
+                                    aData.BeginReading(), aData.Length(),
+                                    aDictionary.BeginReading(),
+                                    aDictionary.Length(), 3);
+  ZSTD_freeCCtx(cctx);
+  out.SetLength(ZSTD_isError(size) ? 0 : size);
+  return out;
+}
+
+}  // namespace
+
+TEST(TestHTTPCompressConv, Zstd)
+{
+  nsCString payload = MakePayload(1000);
+  nsCString encoded = ZstdEncode(payload);
+  ASSERT_FALSE(encoded.IsEmpty());
+
+  // Chunks small enough to split the frame header from the blocks.
+  for (uint32_t chunkSize : {7u, 1000u, 65536u}) {
+    RefPtr<DecodedListener> listener = Decode("zstd", encoded, chunkSize);
+    ASSERT_TRUE(listener);
+    EXPECT_EQ(NS_OK, listener->mStatus);
+    EXPECT_TRUE(listener->mData.Equals(payload));
+  }
+
+  // Cut short mid-frame.
+  RefPtr<DecodedListener> listener =
+      Decode("zstd", Substring(encoded, 0, encoded.Length() / 2), 1000);
+  ASSERT_TRUE(listener);
+  EXPECT_TRUE(!listener->mData.IsEmpty());
+
+  listener = Decode("zstd", NS_LITERAL_CSTRING("not zstd at all"), 1000);
+  ASSERT_TRUE(listener);
+  EXPECT_EQ(NS_ERROR_INVALID_CONTENT_ENCODING, listener->mStatus);
+}
+
+// Frames that end exactly as the output buffer of the decoder fills are
+// complete, also when the converter fails unclean stops.
+TEST(TestHTTPCompressConv, ZstdFullOutputBuffer)
+{
+  Preferences::SetBool("network.http.enforce-framing.http", true);
+
+  const uint32_t outSize = ZSTD_DStreamOutSize();
+  nsCString all = MakePayload(10000);
+  ASSERT_GT(all.Length(), 2 * outSize);
+  for (uint32_t size : {outSize, 2 * outSize}) {
+    nsCString payload(Substring(all, 0, size));
+    nsCString encoded = ZstdEncode(payload);
+    ASSERT_FALSE(encoded.IsEmpty());
+
+    for (uint32_t chunkSize : {1000u, encoded.Length()}) {
+      RefPtr<DecodedListener> listener = Decode("zstd", encoded, chunkSize);
+      ASSERT_TRUE(listener);
+      EXPECT_EQ(NS_OK, listener->mStatus) << size << " " << chunkSize;
+      EXPECT_TRUE(listener->mData.Equals(payload)) << size << " " << chunkSize;
+    }
+
+    // While a frame cut short still fails.
+    RefPtr<DecodedListener> listener =
+        Decode("zstd", Substring(encoded, 0, encoded.Length() - 1), 1000);
+    ASSERT_TRUE(listener);
+    EXPECT_TRUE(NS_FAILED(listener->mStatus)) << size;
+  }
+
+  Preferences::ClearUser("network.http.enforce-framing.http");
+}
+
+TEST(TestHTTPCompressConv, ZstdDictionary)
+{
+  // Train a dictionary on earlier responses.
+  nsCString samples;
+  nsTArray<size_t> sampleSizes;
+  for (uint32_t i = 0; i < 200; ++i) {
+    nsCString sample = MakePayload(20 + i % 10);
+    samples.Append(sample);
+    sampleSizes.AppendElement(sample.Length());
+  }
+  nsCString dictionary;
+  dictionary.SetLength(16 * 1024);
+  size_t dictSize = ZDICT_trainFromBuffer(
+      dictionary.BeginWriting(), dictionary.Length(), samples.BeginReading(),
+      sampleSizes.Elements(), sampleSizes.Length());
+  ASSERT_FALSE(ZDICT_isError(dictSize));
+  dictionary.SetLength(dictSize);
+
+  nsCString payload = MakePayload(25);
+  nsCString encoded = ZstdEncode(payload, dictionary);
+  EXPECT_LT(encoded.Length(), ZstdEncode(payload).Length());
+
+  // Without the dictionary the response cannot be decoded.
+  nsHTTPCompressConv::ClearZstdDictionaries();
+  RefPtr<DecodedListener> listener = Decode("zstd", encoded, 1000);
+  ASSERT_TRUE(listener);
+  EXPECT_EQ(NS_ERROR_INVALID_CONTENT_ENCODING, listener->mStatus);
+
+  // The dictionary is found also when the frame header, which names it, is
+  // split across reads.
+  EXPECT_NE(0u, nsHTTPCompressConv::AddZstdDictionary(dictionary));
+  for (uint32_t chunkSize : {1u, 3u, 1000u}) {
+    listener = Decode("zstd", encoded, chunkSize);
+    ASSERT_TRUE(listener);
+    EXPECT_EQ(NS_OK, listener->mStatus) << chunkSize;
+    EXPECT_TRUE(listener->mData.Equals(payload)) << chunkSize;
+  }
+
+  nsHTTPCompressConv::ClearZstdDictionaries();
+}
+#endif
+
+// Decodes a couple of megabytes in network-sized chunks, to compare the
+// codecs' decoding throughput.
+MOZ_GTEST_BENCH(TestHTTPCompressConv, DISABLED_GzipThroughput, [] {
+  nsCString encoded = GzipEncode(MakePayload(20000));
+  for (uint32_t i = 0; i < 20; ++i) {
+    RefPtr<DecodedListener> listener = Decode("gzip", encoded, 32 * 1024);
+    ASSERT_TRUE(listener);
+  }
+});
+
+#ifdef MOZ_ZSTD
+MOZ_GTEST_BENCH(TestHTTPCompressConv, DISABLED_ZstdThroughput, [] {
+  nsCString encoded = ZstdEncode(MakePayload(20000));
+  for (uint32_t i = 0; i < 20; ++i) {
+    RefPtr<DecodedListener> listener = Decode("zstd", encoded, 32 * 1024);
+    ASSERT_TRUE(listener);
+  }
+});
+#endif
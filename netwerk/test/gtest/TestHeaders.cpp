@@ -1,6 +1,19 @@
 #include "gtest/gtest.h"
 
+#include "nsCOMPtr.h"
 #include "nsHttpHeaderArray.h"
+#include "nsIProtocolHandler.h"
+#include "nsNetCID.h"
+#include "nsPrintfCString.h"
+#include "nsServiceManagerUtils.h"
+
+// Headers that are not known atoms need the atom table, which the HTTP
+// handler creates.
+static void EnsureAtomTable() {
+  nsCOMPtr<nsIProtocolHandler> handler =
+      do_GetService(NS_NETWORK_PROTOCOL_CONTRACTID_PREFIX "http");
+  ASSERT_TRUE(handler);
+}
 
 TEST(TestHeaders, DuplicateHSTS)
 {
@@ -28,3 +41,95 @@ TEST(TestHeaders, DuplicateHSTS)
   ASSERT_EQ(rv, NS_OK);
   ASSERT_EQ(h.get(), "max-age=360");
 }
+
+TEST(TestHeaders, ManyHeaders)
+{
+  using namespace mozilla::net;
+
+  EnsureAtomTable();
+
+  // Enough headers for lookups to go through the atom index.
+  nsHttpHeaderArray headers;
+  for (uint32_t i = 0; i < 40; ++i) {
+    nsPrintfCString name("X-Test-%u", i);
+    nsPrintfCString value("value %u", i);
+    ASSERT_EQ(
+        headers.SetHeaderFromNet(nsHttp::ResolveAtom(name), name, value, true),
+        NS_OK);
+  }
+  ASSERT_EQ(headers.SetHeaderFromNet(nsHttp::Set_Cookie,
+                                     NS_LITERAL_CSTRING("Set-Cookie"),
+                                     NS_LITERAL_CSTRING("a=1"), true),
+            NS_OK);
+  ASSERT_EQ(headers.SetHeaderFromNet(nsHttp::Set_Cookie,
+                                     NS_LITERAL_CSTRING("Set-Cookie"),
+                                     NS_LITERAL_CSTRING("b=2"), true),
+            NS_OK);
+
+  nsAutoCString h;
+  for (uint32_t i = 0; i < 40; ++i) {
+    nsPrintfCString name("X-Test-%u", i);
+    ASSERT_EQ(headers.GetHeader(nsHttp::ResolveAtom(name), h), NS_OK);
+    ASSERT_TRUE(h.Equals(nsPrintfCString("value %u", i)));
+  }
+
+  // The merged value replaces the network originals.
+  ASSERT_EQ(headers.GetHeader(nsHttp::Set_Cookie, h), NS_OK);
+  ASSERT_TRUE(h.EqualsLiteral("a=1\nb=2"));
+  ASSERT_EQ(headers.Count(), 43u);
+
+  // Clearing a response header from the network only hides it.
+  headers.ClearHeader(nsHttp::ResolveAtom("X-Test-3"));
+  ASSERT_FALSE(headers.HasHeader(nsHttp::ResolveAtom("X-Test-3")));
+  ASSERT_EQ(headers.Count(), 43u);
+
+  // A replaced response header keeps its original.
+  ASSERT_EQ(headers.SetHeader(nsHttp::ResolveAtom("X-Test-7"),
+                              NS_LITERAL_CSTRING("changed"), false,
+                              nsHttpHeaderArray::eVarietyResponse),
+            NS_OK);
+  ASSERT_EQ(headers.GetHeader(nsHttp::ResolveAtom("X-Test-7"), h), NS_OK);
+  ASSERT_TRUE(h.EqualsLiteral("changed"));
+
+  headers.Clear();
+  ASSERT_FALSE(headers.HasHeader(nsHttp::ResolveAtom("X-Test-7")));
+}
+
+TEST(TestHeaders, ManyRequestHeaders)
+{
+  using namespace mozilla::net;
+
+  EnsureAtomTable();
+
+  nsHttpHeaderArray headers;
+  for (uint32_t i = 0; i < 40; ++i) {
+    nsPrintfCString name("X-Test-%u", i);
+    ASSERT_EQ(headers.SetHeader(name, nsPrintfCString("value %u", i), false,
+                                nsHttpHeaderArray::eVarietyRequestOverride),
+              NS_OK);
+  }
+
+  // Removing entries moves the ones after them.
+  headers.ClearHeader(nsHttp::ResolveAtom("X-Test-3"));
+  ASSERT_EQ(headers.SetHeader(nsHttp::ResolveAtom("X-Test-5"), EmptyCString(),
+                              false,
+                              nsHttpHeaderArray::eVarietyRequestOverride),
+            NS_OK);
+  ASSERT_EQ(headers.Count(), 38u);
+  ASSERT_FALSE(headers.HasHeader(nsHttp::ResolveAtom("X-Test-3")));
+  ASSERT_FALSE(headers.HasHeader(nsHttp::ResolveAtom("X-Test-5")));
+
+  nsAutoCString h;
+  for (uint32_t i = 6; i < 40; ++i) {
+    nsPrintfCString name("X-Test-%u", i);
+    ASSERT_EQ(headers.GetHeader(nsHttp::ResolveAtom(name), h), NS_OK);
+    ASSERT_TRUE(h.Equals(nsPrintfCString("value %u", i)));
+  }
+
+  ASSERT_EQ(headers.SetHeader(nsHttp::ResolveAtom("X-Test-9"),
+                              NS_LITERAL_CSTRING("more"), true,
+                              nsHttpHeaderArray::eVarietyRequestOverride),
+            NS_OK);
+  ASSERT_EQ(headers.GetHeader(nsHttp::ResolveAtom("X-Test-9"), h), NS_OK);
+  ASSERT_TRUE(h.EqualsLiteral("value 9, more"));
+}
@@ -0,0 +1,204 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim:set ts=2 sw=2 sts=2 et cindent: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+
+#include "mozilla/BasePrincipal.h"
+#include "mozilla/Monitor.h"
+#include "mozilla/Preferences.h"
+#include "mozilla/TimeStamp.h"
+#include "nsHostResolver.h"
+#include "nsIDNSService.h"
+#include "nsString.h"
+#include "prthread.h"
+
+using namespace mozilla;
+
+namespace {
+
+// Records the status of the last lookup it was called back for.  Cache hits
+// call back from within ResolveHost(), lookups from a resolver thread.
+class DNSCacheTestCallback final : public nsResolveHostCallback {
+ public:
+  NS_DECL_THREADSAFE_ISUPPORTS
+
+  DNSCacheTestCallback()
+      : mMonitor("DNSCacheTestCallback"),
+        mDone(false),
+        mStatus(NS_ERROR_UNEXPECTED) {}
+
+  void OnResolveHostComplete(nsHostResolver* aResolver, nsHostRecord* aRecord,
+                             nsresult aStatus) override {
+    MonitorAutoLock lock(mMonitor);
+    mDone = true;
+    mStatus = aStatus;
+    lock.Notify();
+  }
+
+  bool EqualsAsyncListener(nsIDNSListener* aListener) override {
+    return false;
+  }
+
+  size_t SizeOfIncludingThis(MallocSizeOf aMallocSizeOf) const override {
+    return aMallocSizeOf(this);
+  }
+
+  // Returns the status of the lookup, or NS_ERROR_NET_TIMEOUT when there was
+  // no callback within 30 seconds.
+  nsresult Wait() {
+    TimeStamp deadline = TimeStamp::Now() + TimeDuration::FromSeconds(30);
+    MonitorAutoLock lock(mMonitor);
+    while (!mDone) {
+      TimeStamp now = TimeStamp::Now();
+      if (now >= deadline) {
+        return NS_ERROR_NET_TIMEOUT;
+      }
+      lock.Wait(deadline - now);
+    }
+    return mStatus;
+  }
+
+ private:
+  ~DNSCacheTestCallback() = default;
+
+  Monitor mMonitor;
+  bool mDone;
+  nsresult mStatus;
+};
+
+NS_IMPL_ISUPPORTS0(DNSCacheTestCallback)
+
+// Runs the resolver against a fake native resolver: with
+// network.dns.native-is-localhost every name resolves to 127.0.0.1, without
+// touching the network.  TRR is disabled for every request.
+class HostResolverTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Preferences::SetBool("network.dns.native-is-localhost", true);
+    Preferences::SetBool("network.dns.get-ttl", false);
+  }
+
+  void TearDown() override {
+    if (mResolver) {
+      mResolver->Shutdown();
+      mResolver = nullptr;
+    }
+    Preferences::ClearUser("network.dns.native-is-localhost");
+    Preferences::ClearUser("network.dns.get-ttl");
+    Preferences::ClearUser("network.dns.refresh-ahead-percent");
+  }
+
+  void Create(uint32_t aMaxEntries, uint32_t aLifetime, uint32_t aGrace) {
+    ASSERT_TRUE(NS_SUCCEEDED(nsHostResolver::Create(
+        aMaxEntries, aLifetime, aGrace, getter_AddRefs(mResolver))));
+  }
+
+  // Resolves |aHost| and waits for the result, a cache hit returns right
+  // away.
+  nsresult Resolve(const char* aHost, uint16_t aFlags = 0,
+                   uint16_t aAf = PR_AF_UNSPEC) {
+    RefPtr<DNSCacheTestCallback> callback = new DNSCacheTestCallback();
+    nsresult rv = mResolver->ResolveHost(
+        nsDependentCString(aHost), nsIDNSService::RESOLVE_TYPE_DEFAULT,
+        OriginAttributes(), aFlags | nsHostResolver::RES_DISABLE_TRR, aAf,
+        callback);
+    if (NS_FAILED(rv)) {
+      return rv;
+    }
+    return callback->Wait();
+  }
+
+  // Checks if |aHost| is in the cache.  Offline requests fail with
+  // NS_ERROR_OFFLINE instead of starting a lookup.
+  bool IsCached(const char* aHost) {
+    nsresult rv = Resolve(aHost, nsHostResolver::RES_OFFLINE);
+    EXPECT_TRUE(NS_SUCCEEDED(rv) || rv == NS_ERROR_OFFLINE);
+    return NS_SUCCEEDED(rv);
+  }
+
+  static void SleepUntil(const TimeStamp& aWhen) {
+    TimeStamp now = TimeStamp::Now();
+    if (aWhen > now) {
+      PR_Sleep(PR_MillisecondsToInterval(
+          static_cast<uint32_t>((aWhen - now).ToMilliseconds()) + 1));
+    }
+  }
+
+  RefPtr<nsHostResolver> mResolver;
+};
+
+}  // namespace
+
+// A full cache evicts the least recently used entry, not the oldest one.
+TEST_F(HostResolverTest, EvictionOrder) {
+  Create(3, 600, 60);
+
+  ASSERT_EQ(NS_OK, Resolve("a.dns.test"));
+  ASSERT_EQ(NS_OK, Resolve("b.dns.test"));
+  ASSERT_EQ(NS_OK, Resolve("c.dns.test"));
+
+  // A hit moves a to the back, so d evicts b.
+  ASSERT_EQ(NS_OK, Resolve("a.dns.test"));
+  ASSERT_EQ(NS_OK, Resolve("d.dns.test"));
+  EXPECT_FALSE(IsCached("b.dns.test"));
+
+  // Then e evicts c, which is older than the a that was just used.
+  ASSERT_EQ(NS_OK, Resolve("e.dns.test"));
+  EXPECT_FALSE(IsCached("c.dns.test"));
+  EXPECT_TRUE(IsCached("a.dns.test"));
+  EXPECT_TRUE(IsCached("d.dns.test"));
+  EXPECT_TRUE(IsCached("e.dns.test"));
+}
+
+// A hit answered from the AF_UNSPEC entry of a name, for a request of a
+// single address family, counts as a use of that entry too.
+TEST_F(HostResolverTest, EvictionOrderByFamily) {
+  Create(3, 600, 60);
+
+  ASSERT_EQ(NS_OK, Resolve("a.dns.test"));
+  ASSERT_EQ(NS_OK, Resolve("b.dns.test"));
+  ASSERT_EQ(NS_OK, Resolve("c.dns.test"));
+
+  ASSERT_EQ(NS_OK, Resolve("a.dns.test", 0, PR_AF_INET));
+  ASSERT_EQ(NS_OK, Resolve("d.dns.test"));
+  EXPECT_FALSE(IsCached("b.dns.test"));
+  EXPECT_TRUE(IsCached("a.dns.test"));
+}
+
+// A hit in the last network.dns.refresh-ahead-percent of an entry's
+// lifetime renews it, so it is still valid after its first lifetime ran
+// out.  Entries here have no grace period and are gone once they expire.
+TEST_F(HostResolverTest, RefreshAhead) {
+  Preferences::SetUint("network.dns.refresh-ahead-percent", 50);
+  Create(10, 2, 0);
+
+  ASSERT_EQ(NS_OK, Resolve("refresh.dns.test"));
+  ASSERT_EQ(NS_OK, Resolve("idle.dns.test"));
+  TimeStamp start = TimeStamp::Now();
+
+  // Within the last half of the two second lifetime.
+  SleepUntil(start + TimeDuration::FromMilliseconds(1300));
+  ASSERT_EQ(NS_OK, Resolve("refresh.dns.test"));
+
+  SleepUntil(start + TimeDuration::FromMilliseconds(2600));
+  EXPECT_TRUE(IsCached("refresh.dns.test"));
+  EXPECT_FALSE(IsCached("idle.dns.test"));
+}
+
+// With the pref at 0 a hit before the end of the lifetime renews nothing.
+TEST_F(HostResolverTest, RefreshAheadDisabled) {
+  Preferences::SetUint("network.dns.refresh-ahead-percent", 0);
+  Create(10, 2, 0);
+
+  ASSERT_EQ(NS_OK, Resolve("refresh.dns.test"));
+  TimeStamp start = TimeStamp::Now();
+
+  SleepUntil(start + TimeDuration::FromMilliseconds(1300));
+  ASSERT_EQ(NS_OK, Resolve("refresh.dns.test"));
+
+  SleepUntil(start + TimeDuration::FromMilliseconds(2600));
+  EXPECT_FALSE(IsCached("refresh.dns.test"));
+}
@@ -0,0 +1,221 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim:set ts=2 sw=2 sts=2 et cindent: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <algorithm>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "Http2WriteScheduler.h"
+#include "nsTArray.h"
+
+using namespace mozilla::net;
+
+namespace {
+
+struct SchedulerTestStream {
+  char mTag;
+  uint32_t mUrgency;
+  uint32_t mFrameSize;
+  // Bytes left to send.
+  uint32_t mRemaining;
+  // Bytes it can send before it has to wait for more request body.
+  uint32_t mAvailable;
+};
+
+// Writes streams the way Http2Session::ReadSegmentsAgain() does: one stream
+// per turn, each frame added to the output queue and then flushed unless
+// the scheduler lets it wait.  Each flush is one TLS record on the wire.
+class SchedulerTestSession {
+ public:
+  explicit SchedulerTestSession(bool aEnabled) : mScheduler(aEnabled) {}
+
+  void Ready(SchedulerTestStream* aStream) { mReady.Push(aStream); }
+  void Cancel() { mReady.Pop(); }
+
+  // One ReadSegments() call.  Returns false when no stream was ready,
+  // which is when the session goes idle.
+  bool WriteTurn(uint32_t aCount = 65536) {
+    SchedulerTestStream* stream =
+        mScheduler.PopStream<SchedulerTestStream>(
+            mReady,
+            [](SchedulerTestStream* aStream) { return aStream->mUrgency; });
+    if (!stream) {
+      Flush();
+      return false;
+    }
+
+    Http2WriteScheduler::AutoTurn turn(mScheduler, mReady.GetSize() > 0,
+                                       aCount);
+    while (aCount && stream->mRemaining && stream->mAvailable) {
+      uint32_t frame = std::min({aCount, stream->mFrameSize,
+                                 stream->mRemaining, stream->mAvailable});
+      mQueue.append(frame, stream->mTag);
+      aCount -= frame;
+      stream->mRemaining -= frame;
+      stream->mAvailable -= frame;
+      MaybeFlush();
+    }
+
+    if (!stream->mRemaining) {
+      MaybeFlush();
+    } else if (!stream->mAvailable) {
+      // Blocked on read: it is not queued again until it has more.
+      Flush();
+    } else {
+      MaybeFlush();
+      mReady.Push(stream);
+    }
+    return true;
+  }
+
+  void WriteUntilIdle() {
+    while (WriteTurn()) {
+      EXPECT_TRUE(mQueue.size() < Http2WriteScheduler::kCoalesceWriteSize);
+    }
+    EXPECT_TRUE(mQueue.empty());
+  }
+
+  uint32_t Buffered() const { return mQueue.size(); }
+
+  // Bytes of each stream in the order they went out.
+  std::string mWire;
+  nsTArray<uint32_t> mRecords;
+
+ private:
+  void MaybeFlush() {
+    if (!mScheduler.CanHold(mQueue.size())) {
+      Flush();
+    }
+  }
+
+  void Flush() {
+    if (mQueue.empty()) {
+      return;
+    }
+    mWire.append(mQueue);
+    mRecords.AppendElement(mQueue.size());
+    mQueue.clear();
+  }
+
+  Http2WriteScheduler mScheduler;
+  nsDeque mReady;
+  std::string mQueue;
+};
+
+}  // namespace
+
+// A render-blocking request that becomes ready while a large upload is
+// being written goes out before the rest of the upload.
+TEST(TestHttp2WriteScheduler, UrgentBeforeUpload)
+{
+  for (bool enabled : {true, false}) {
+    SchedulerTestSession session(enabled);
+    SchedulerTestStream upload = {'u', 2 << 8, 16384, 1 << 20, 1 << 20};
+    SchedulerTestStream urgent = {'r', 0, 1024, 2048, 2048};
+
+    session.Ready(&upload);
+    ASSERT_TRUE(session.WriteTurn());
+    uint32_t before = session.mWire.size();
+    EXPECT_EQ(65536u, before);
+
+    session.Ready(&urgent);
+    session.WriteUntilIdle();
+    EXPECT_EQ(0u, upload.mRemaining);
+    EXPECT_EQ(0u, urgent.mRemaining);
+
+    // Right after what was written before it was ready, or behind another
+    // full turn of the upload.
+    size_t urgentAt = session.mWire.find('r');
+    EXPECT_EQ(enabled ? before : 2 * before, urgentAt);
+  }
+}
+
+// Streams of the same urgency take turns of at most one burst while the
+// others wait, and whole turns when the scheduler is off.
+TEST(TestHttp2WriteScheduler, BurstLimit)
+{
+  for (bool enabled : {true, false}) {
+    SchedulerTestSession session(enabled);
+    SchedulerTestStream first = {'a', 2 << 8, 16384, 65536, 65536};
+    SchedulerTestStream second = {'b', 2 << 8, 16384, 65536, 65536};
+    session.Ready(&first);
+    session.Ready(&second);
+
+    ASSERT_TRUE(session.WriteTurn());
+    ASSERT_TRUE(session.WriteTurn());
+    uint32_t turn = enabled ? Http2WriteScheduler::kMaxStreamWriteBurst
+                            : 65536;
+    EXPECT_EQ(std::string(turn, 'a') + std::string(turn, 'b'),
+              session.mWire);
+
+    session.WriteUntilIdle();
+    EXPECT_EQ(0u, first.mRemaining);
+    EXPECT_EQ(0u, second.mRemaining);
+  }
+}
+
+// Small frames written while other streams wait leave in fewer records, and
+// whatever is held is written once the session has nothing else to do.
+TEST(TestHttp2WriteScheduler, Coalescing)
+{
+  for (bool enabled : {true, false}) {
+    SchedulerTestSession session(enabled);
+    SchedulerTestStream streams[8];
+    for (uint32_t i = 0; i < 8; ++i) {
+      streams[i] = {char('a' + i), 2 << 8, 16384, 500, 500};
+      session.Ready(&streams[i]);
+    }
+
+    session.WriteUntilIdle();
+    EXPECT_EQ(4000u, session.mWire.size());
+    EXPECT_EQ(enabled ? 1u : 8u, session.mRecords.Length());
+  }
+}
+
+// Held frames are never left behind: not when a stream blocks, not when the
+// buffer fills up and not when the streams they waited for go away.
+TEST(TestHttp2WriteScheduler, HeldFramesFlushed)
+{
+  SchedulerTestSession session(true);
+  SchedulerTestStream small = {'s', 0, 1000, 1000, 1000};
+  SchedulerTestStream blocked = {'b', 1 << 8, 1000, 4000, 1000};
+  SchedulerTestStream other = {'o', 2 << 8, 1000, 1000, 1000};
+  session.Ready(&small);
+  session.Ready(&blocked);
+  session.Ready(&other);
+
+  // Waits for the others.
+  ASSERT_TRUE(session.WriteTurn());
+  EXPECT_EQ(1000u, session.Buffered());
+
+  // Blocks on its request body, so everything goes out.
+  ASSERT_TRUE(session.WriteTurn());
+  EXPECT_EQ(0u, session.Buffered());
+  EXPECT_EQ(2000u, session.mWire.size());
+
+  // Never more than a record's worth is held.
+  SchedulerTestStream many[20];
+  for (uint32_t i = 0; i < 20; ++i) {
+    many[i] = {'m', 0, 1000, 1000, 1000};
+    session.Ready(&many[i]);
+  }
+  for (uint32_t i = 0; i < 20; ++i) {
+    ASSERT_TRUE(session.WriteTurn());
+    EXPECT_TRUE(session.Buffered() <
+                Http2WriteScheduler::kCoalesceWriteSize);
+  }
+  // One record for the first two streams, one once the buffer filled up.
+  ASSERT_EQ(2u, session.mRecords.Length());
+  EXPECT_EQ(17000u, session.mRecords[1]);
+
+  // The stream the last frames waited for is cancelled before its turn.
+  session.Cancel();
+  EXPECT_TRUE(session.Buffered() > 0);
+  EXPECT_FALSE(session.WriteTurn());
+  EXPECT_EQ(0u, session.Buffered());
+  EXPECT_EQ(22000u, session.mWire.size());
+}
@@ -0,0 +1,91 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim:set ts=2 sw=2 sts=2 et cindent: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+
+#include "mozilla/net/HttpBodySegmentRing.h"
+
+using namespace mozilla::net;
+
+// Segments are handed out until all are in use, when the data has to go in
+// a string message instead, and can be handed out again once they are back.
+TEST(TestHttpBodySegmentRing, HandOff)
+{
+  HttpBodySegmentRing<int> ring;
+  int segment = 0;
+
+  // Before a channel has sent enough to get segments, everything goes in
+  // strings.
+  EXPECT_FALSE(ring.Take(segment));
+
+  for (int i = 1; i <= 4; ++i) {
+    ring.Add(i);
+  }
+  EXPECT_EQ(4u, ring.Length());
+
+  bool taken[5] = {};
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(ring.Take(segment));
+    ASSERT_TRUE(segment >= 1 && segment <= 4);
+    EXPECT_FALSE(taken[segment]);
+    taken[segment] = true;
+  }
+  EXPECT_EQ(0u, ring.FreeLength());
+
+  // All are with the child: fall back to a string.
+  EXPECT_FALSE(ring.Take(segment));
+
+  EXPECT_TRUE(ring.Put(3));
+  ASSERT_TRUE(ring.Take(segment));
+  EXPECT_EQ(3, segment);
+  EXPECT_FALSE(ring.Take(segment));
+
+  for (int i = 1; i <= 4; ++i) {
+    EXPECT_TRUE(ring.Put(i));
+  }
+  EXPECT_EQ(4u, ring.FreeLength());
+
+  ring.Clear();
+  EXPECT_FALSE(ring.Take(segment));
+  EXPECT_FALSE(ring.Put(1));
+}
+
+// Only segments of the ring that are in use can be put back, so a child
+// can't grow the free list or get a segment handed out twice.
+TEST(TestHttpBodySegmentRing, RejectsUnknownSegments)
+{
+  HttpBodySegmentRing<int> ring;
+  ring.Add(1);
+  ring.Add(2);
+
+  // All free already.
+  EXPECT_FALSE(ring.Put(1));
+  EXPECT_EQ(2u, ring.FreeLength());
+
+  int first = 0;
+  int second = 0;
+  ASSERT_TRUE(ring.Take(first));
+  ASSERT_TRUE(ring.Take(second));
+
+  // Not ours.
+  EXPECT_FALSE(ring.Put(7));
+  EXPECT_EQ(0u, ring.FreeLength());
+
+  // Back twice.
+  EXPECT_TRUE(ring.Put(first));
+  EXPECT_FALSE(ring.Put(first));
+  EXPECT_EQ(1u, ring.FreeLength());
+
+  int segment = 0;
+  ASSERT_TRUE(ring.Take(segment));
+  EXPECT_EQ(first, segment);
+  EXPECT_FALSE(ring.Take(segment));
+
+  EXPECT_TRUE(ring.Put(second));
+  EXPECT_TRUE(ring.Put(first));
+  EXPECT_FALSE(ring.Put(second));
+  EXPECT_EQ(2u, ring.FreeLength());
+}
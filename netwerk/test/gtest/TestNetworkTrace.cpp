@@ -0,0 +1,99 @@
+#include "gtest/gtest.h"
+
+#include "json/json.h"
+#include "json/reader.h"
+#include "mozilla/ArrayUtils.h"
+#include "mozilla/TimeStamp.h"
+#include "mozilla/net/NetworkTrace.h"
+#include "mozilla/net/TimingStruct.h"
+
+using namespace mozilla;
+using namespace mozilla::net;
+
+namespace {
+
+// Returns the dumped entries recorded for |aChannelId|.
+Json::Value EntriesFor(uint64_t aChannelId) {
+  nsAutoCString json;
+  NetworkTrace::DumpJSON(json);
+
+  Json::Reader reader;
+  Json::Value root;
+  Json::Value entries(Json::arrayValue);
+  EXPECT_TRUE(reader.parse(json.BeginReading(), json.EndReading(), root));
+  EXPECT_TRUE(root.isArray());
+  for (uint32_t i = 0; i < root.size(); ++i) {
+    if (root[i]["channelId"].asUInt64() == aChannelId) {
+      entries.append(root[i]);
+    }
+  }
+  return entries;
+}
+
+}  // namespace
+
+TEST(TestNetworkTrace, Record)
+{
+  const uint64_t channelId = 0x7e57001;
+  TimeStamp start = TimeStamp::Now();
+  TimeStamp end = start + TimeDuration::FromMilliseconds(5);
+
+  NetworkTrace::Record(channelId, NetworkTracePhase::CacheOpen, start, end);
+  // Phases with a missing end, or ending before they start, are dropped.
+  NetworkTrace::Record(channelId, NetworkTracePhase::CacheRead, start,
+                       TimeStamp());
+  NetworkTrace::Record(channelId, NetworkTracePhase::IPC, end, start);
+
+  Json::Value entries = EntriesFor(channelId);
+  ASSERT_EQ(1u, entries.size());
+  EXPECT_EQ("cache-open", entries[0]["phase"].asString());
+  EXPECT_EQ("main", entries[0]["thread"].asString());
+  EXPECT_NEAR(5.0, entries[0]["duration"].asDouble(), 0.01);
+  EXPECT_GE(entries[0]["start"].asDouble(), 0.0);
+}
+
+TEST(TestNetworkTrace, RecordTimings)
+{
+  const uint64_t channelId = 0x7e57002;
+  TimeStamp now = TimeStamp::Now();
+  auto at = [&](double aMs) {
+    return now + TimeDuration::FromMilliseconds(aMs);
+  };
+
+  TimingStruct timings;
+  timings.domainLookupStart = at(0);
+  timings.domainLookupEnd = at(1);
+  timings.connectStart = at(1);
+  timings.tcpConnectEnd = at(2);
+  timings.secureConnectionStart = at(2);
+  timings.connectEnd = at(4);
+  timings.requestStart = at(4);
+  timings.responseStart = at(8);
+  timings.responseEnd = at(16);
+  NetworkTrace::RecordTimings(channelId, timings);
+
+  Json::Value entries = EntriesFor(channelId);
+  const char* phases[] = {"dns", "connect", "tls", "wait", "receive"};
+  const double durations[] = {1, 1, 2, 4, 8};
+  ASSERT_EQ(ArrayLength(phases), entries.size());
+  for (uint32_t i = 0; i < entries.size(); ++i) {
+    EXPECT_EQ(phases[i], entries[i]["phase"].asString());
+    EXPECT_NEAR(durations[i], entries[i]["duration"].asDouble(), 0.01);
+  }
+}
+
+TEST(TestNetworkTrace, RingWraps)
+{
+  const uint64_t channelId = 0x7e57003;
+  TimeStamp now = TimeStamp::Now();
+  for (uint32_t i = 0; i < 5000; ++i) {
+    NetworkTrace::Record(channelId, NetworkTracePhase::Queue, now,
+                         now + TimeDuration::FromMilliseconds(i));
+  }
+
+  // Only the newest entries are kept, oldest first.
+  Json::Value entries = EntriesFor(channelId);
+  ASSERT_EQ(4096u, entries.size());
+  EXPECT_NEAR(5000 - 4096, entries[0]["duration"].asDouble(), 0.01);
+  EXPECT_NEAR(4999, entries[4095]["duration"].asDouble(), 0.01);
+}
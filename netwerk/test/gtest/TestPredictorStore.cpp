@@ -0,0 +1,312 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim:set ts=2 sw=2 sts=2 et cindent: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include "PredictorStore.h"
+#include "nsAppDirectoryServiceDefs.h"
+#include "nsCOMPtr.h"
+#include "nsDirectoryServiceUtils.h"
+#include "nsIFile.h"
+#include "nsPrintfCString.h"
+#include "prio.h"
+
+using namespace mozilla;
+using namespace mozilla::net;
+
+namespace {
+
+already_AddRefed<nsIFile> GetStoreFile() {
+  nsCOMPtr<nsIFile> file;
+  nsresult rv = NS_GetSpecialDirectory(NS_OS_TEMP_DIR, getter_AddRefs(file));
+  if (NS_FAILED(rv)) {
+    return nullptr;
+  }
+  file->AppendNative(NS_LITERAL_CSTRING("TestPredictorStore.bin"));
+  file->Remove(false);
+  return file.forget();
+}
+
+uint32_t HitCount(const nsTArray<PredictorStore::Resource>& aResources,
+                  const char* aOrigin) {
+  for (const PredictorStore::Resource& resource : aResources) {
+    if (resource.mOrigin.Equals(aOrigin)) {
+      return resource.mHitCount;
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+TEST(TestPredictorStore, LoadsAndHits)
+{
+  nsCOMPtr<nsIFile> file = GetStoreFile();
+  ASSERT_TRUE(file);
+
+  RefPtr<PredictorStore> store;
+  ASSERT_EQ(NS_OK, PredictorStore::Open(file, getter_AddRefs(store)));
+
+  NS_NAMED_LITERAL_CSTRING(page, "https://www.example.com/");
+  NS_NAMED_LITERAL_CSTRING(cdn, "https://cdn.example.net/");
+  NS_NAMED_LITERAL_CSTRING(ads, "https://ads.example.org/");
+
+  uint32_t loadCount, lastLoad;
+  nsTArray<PredictorStore::Resource> resources;
+
+  // The first load has nothing before it to predict from.
+  store->NoteLoad(page, 100);
+  EXPECT_FALSE(store->GetResources(page, &loadCount, &lastLoad, resources));
+  // An origin used many times by one load counts once.
+  store->NoteSubresource(page, cdn, 101);
+  store->NoteSubresource(page, cdn, 102);
+  store->NoteSubresource(page, ads, 102);
+
+  store->NoteLoad(page, 200);
+  store->NoteSubresource(page, cdn, 201);
+  store->NoteLoad(page, 300);
+
+  ASSERT_TRUE(store->GetResources(page, &loadCount, &lastLoad, resources));
+  EXPECT_EQ(2u, loadCount);
+  EXPECT_EQ(200u, lastLoad);
+  EXPECT_EQ(2u, HitCount(resources, cdn.get()));
+  EXPECT_EQ(1u, HitCount(resources, ads.get()));
+
+  // What the current load uses is left out.
+  store->NoteSubresource(page, ads, 301);
+  resources.Clear();
+  ASSERT_TRUE(store->GetResources(page, &loadCount, &lastLoad, resources));
+  EXPECT_EQ(1u, HitCount(resources, ads.get()));
+
+  // The store survives being reopened.
+  store->Close();
+  store = nullptr;
+  ASSERT_EQ(NS_OK, PredictorStore::Open(file, getter_AddRefs(store)));
+  resources.Clear();
+  ASSERT_TRUE(store->GetResources(page, &loadCount, &lastLoad, resources));
+  EXPECT_EQ(2u, loadCount);
+  EXPECT_EQ(2u, HitCount(resources, cdn.get()));
+
+  store->Clear();
+  EXPECT_FALSE(store->GetResources(page, &loadCount, &lastLoad, resources));
+
+  store->Close();
+  file->Remove(false);
+}
+
+TEST(TestPredictorStore, Eviction)
+{
+  nsCOMPtr<nsIFile> file = GetStoreFile();
+  ASSERT_TRUE(file);
+
+  RefPtr<PredictorStore> store;
+  ASSERT_EQ(NS_OK, PredictorStore::Open(file, getter_AddRefs(store)));
+
+  // Far more origins than the store has room for; each is loaded twice so
+  // that it can be predicted from.
+  for (uint32_t i = 0; i < 2000; ++i) {
+    nsPrintfCString origin("https://site%u.example.com/", i);
+    store->NoteLoad(origin, i);
+    store->NoteLoad(origin, i);
+  }
+
+  uint32_t loadCount, lastLoad;
+  nsTArray<PredictorStore::Resource> resources;
+  EXPECT_TRUE(store->GetResources(
+      NS_LITERAL_CSTRING("https://site1999.example.com/"), &loadCount,
+      &lastLoad, resources));
+  EXPECT_FALSE(store->GetResources(
+      NS_LITERAL_CSTRING("https://site0.example.com/"), &loadCount, &lastLoad,
+      resources));
+
+  // A source origin keeps the resources it used most recently.
+  NS_NAMED_LITERAL_CSTRING(page, "https://www.example.com/");
+  store->NoteLoad(page, 5000);
+  for (uint32_t i = 0; i < 40; ++i) {
+    store->NoteSubresource(
+        page, nsPrintfCString("https://cdn%u.example.net/", i), 5000 + i);
+  }
+  store->NoteLoad(page, 6000);
+  resources.Clear();
+  ASSERT_TRUE(store->GetResources(page, &loadCount, &lastLoad, resources));
+  EXPECT_EQ(15u, resources.Length());
+  EXPECT_EQ(1u, HitCount(resources, "https://cdn39.example.net/"));
+  EXPECT_EQ(0u, HitCount(resources, "https://cdn0.example.net/"));
+
+  store->Close();
+  file->Remove(false);
+}
+
+// Origins can be forgotten by key, e.g. the ones learned under some origin
+// attributes, while the others, also those further along a probe sequence
+// than a removed one, are still found.
+TEST(TestPredictorStore, RemoveOrigins)
+{
+  nsCOMPtr<nsIFile> file = GetStoreFile();
+  ASSERT_TRUE(file);
+
+  RefPtr<PredictorStore> store;
+  ASSERT_EQ(NS_OK, PredictorStore::Open(file, getter_AddRefs(store)));
+
+  const uint32_t kOrigins = 150;
+  for (uint32_t i = 0; i < kOrigins; ++i) {
+    nsPrintfCString origin("https://site%u.example.com/%s", i,
+                           i % 2 ? "" : "^userContextId=1");
+    store->NoteLoad(origin, i);
+    store->NoteLoad(origin, i);
+  }
+
+  uint32_t loadCount, lastLoad;
+  nsTArray<PredictorStore::Resource> resources;
+  nsTArray<bool> stored;
+  for (uint32_t i = 0; i < kOrigins; ++i) {
+    nsPrintfCString origin("https://site%u.example.com/%s", i,
+                           i % 2 ? "" : "^userContextId=1");
+    stored.AppendElement(
+        store->GetResources(origin, &loadCount, &lastLoad, resources));
+  }
+
+  store->RemoveOrigins([](const nsACString& aKey) {
+    return aKey.Find("^userContextId=1") != kNotFound;
+  });
+
+  for (uint32_t i = 0; i < kOrigins; ++i) {
+    nsPrintfCString origin("https://site%u.example.com/%s", i,
+                           i % 2 ? "" : "^userContextId=1");
+    bool found = store->GetResources(origin, &loadCount, &lastLoad, resources);
+    EXPECT_EQ(i % 2 ? stored[i] : false, found) << origin.get();
+  }
+
+  // The same origin under other attributes is another origin.
+  NS_NAMED_LITERAL_CSTRING(page, "https://www.example.com/");
+  store->NoteLoad(page, 1000);
+  store->NoteLoad(page, 1001);
+  EXPECT_FALSE(store->GetResources(
+      NS_LITERAL_CSTRING("https://www.example.com/^userContextId=1"),
+      &loadCount, &lastLoad, resources));
+
+  store->Close();
+  file->Remove(false);
+}
+
+// A file whose origin names fill their fields without a terminating null,
+// as a damaged or foreign file might, is read without going past them and
+// those records are not used.
+TEST(TestPredictorStore, UnterminatedOrigins)
+{
+  nsCOMPtr<nsIFile> file = GetStoreFile();
+  ASSERT_TRUE(file);
+
+  NS_NAMED_LITERAL_CSTRING(page, "https://www.example.com/");
+  NS_NAMED_LITERAL_CSTRING(cdn, "https://cdn.example.net/");
+  NS_NAMED_LITERAL_CSTRING(other, "https://other.example.net/");
+
+  RefPtr<PredictorStore> store;
+  ASSERT_EQ(NS_OK, PredictorStore::Open(file, getter_AddRefs(store)));
+  store->NoteLoad(page, 100);
+  store->NoteSubresource(page, cdn, 101);
+  store->NoteSubresource(page, other, 101);
+  store->NoteLoad(page, 200);
+  store->Close();
+  store = nullptr;
+
+  // Fill the rest of the name field of the cdn resource.  Names are kept in
+  // fields of 108 bytes.
+  int64_t fileSize;
+  ASSERT_EQ(NS_OK, file->GetFileSize(&fileSize));
+  int32_t size = static_cast<int32_t>(fileSize);
+  PRFileDesc* fd;
+  ASSERT_EQ(NS_OK, file->OpenNSPRFileDesc(PR_RDWR, 0600, &fd));
+  nsTArray<char> data;
+  data.SetLength(size);
+  ASSERT_EQ(size, PR_Read(fd, data.Elements(), size));
+  const char* found = nullptr;
+  for (size_t i = 0; i + cdn.Length() < data.Length(); ++i) {
+    if (!memcmp(&data[i], cdn.get(), cdn.Length() + 1)) {
+      found = &data[i];
+      break;
+    }
+  }
+  ASSERT_TRUE(found);
+  size_t offset = found - data.Elements();
+  memset(&data[offset + cdn.Length()], 'x', 108 - cdn.Length());
+  ASSERT_EQ(0, PR_Seek64(fd, 0, PR_SEEK_SET));
+  ASSERT_EQ(size, PR_Write(fd, data.Elements(), size));
+  PR_Close(fd);
+
+  ASSERT_EQ(NS_OK, PredictorStore::Open(file, getter_AddRefs(store)));
+  uint32_t loadCount, lastLoad;
+  nsTArray<PredictorStore::Resource> resources;
+  ASSERT_TRUE(store->GetResources(page, &loadCount, &lastLoad, resources));
+  EXPECT_EQ(1u, resources.Length());
+  EXPECT_EQ(1u, HitCount(resources, other.get()));
+
+  store->Close();
+  file->Remove(false);
+}
+
+// A record claiming more resources than it has room for, as a damaged file
+// might, is started over instead of being read or written past its end.
+TEST(TestPredictorStore, BadResourceCount)
+{
+  nsCOMPtr<nsIFile> file = GetStoreFile();
+  ASSERT_TRUE(file);
+
+  NS_NAMED_LITERAL_CSTRING(page, "https://www.example.com/");
+  NS_NAMED_LITERAL_CSTRING(cdn, "https://cdn.example.net/");
+
+  RefPtr<PredictorStore> store;
+  ASSERT_EQ(NS_OK, PredictorStore::Open(file, getter_AddRefs(store)));
+  store->NoteLoad(page, 100);
+  store->NoteSubresource(page, cdn, 101);
+  store->NoteLoad(page, 200);
+  store->Close();
+  store = nullptr;
+
+  // The origin name follows five 32-bit fields of its record, the resource
+  // count being the last of them.
+  int64_t fileSize;
+  ASSERT_EQ(NS_OK, file->GetFileSize(&fileSize));
+  int32_t size = static_cast<int32_t>(fileSize);
+  PRFileDesc* fd;
+  ASSERT_EQ(NS_OK, file->OpenNSPRFileDesc(PR_RDWR, 0600, &fd));
+  nsTArray<char> data;
+  data.SetLength(size);
+  ASSERT_EQ(size, PR_Read(fd, data.Elements(), size));
+  size_t offset = 0;
+  for (size_t i = 0; i + page.Length() < data.Length(); ++i) {
+    if (!memcmp(&data[i], page.get(), page.Length() + 1)) {
+      offset = i;
+      break;
+    }
+  }
+  ASSERT_TRUE(offset >= 4);
+  const uint32_t count = 0xFFFFFFF0;
+  memcpy(&data[offset - 4], &count, sizeof(count));
+  ASSERT_EQ(0, PR_Seek64(fd, 0, PR_SEEK_SET));
+  ASSERT_EQ(size, PR_Write(fd, data.Elements(), size));
+  PR_Close(fd);
+
+  ASSERT_EQ(NS_OK, PredictorStore::Open(file, getter_AddRefs(store)));
+  uint32_t loadCount, lastLoad;
+  nsTArray<PredictorStore::Resource> resources;
+  EXPECT_FALSE(store->GetResources(page, &loadCount, &lastLoad, resources));
+  EXPECT_TRUE(resources.IsEmpty());
+
+  // The origin is recorded again from scratch.
+  store->NoteLoad(page, 300);
+  store->NoteSubresource(page, cdn, 301);
+  store->NoteLoad(page, 400);
+  ASSERT_TRUE(store->GetResources(page, &loadCount, &lastLoad, resources));
+  EXPECT_EQ(1u, loadCount);
+  EXPECT_EQ(1u, resources.Length());
+  EXPECT_EQ(1u, HitCount(resources, cdn.get()));
+
+  store->Close();
+  file->Remove(false);
+}
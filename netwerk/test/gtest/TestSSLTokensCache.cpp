@@ -0,0 +1,208 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim:set ts=2 sw=2 sts=2 et cindent: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <string.h>
+
+#include "gtest/gtest.h"
+
+#include "mozilla/net/SSLTokensCache.h"
+#include "nsString.h"
+#include "prtime.h"
+
+namespace mozilla {
+namespace net {
+
+// Runs a cache of its own, not the one the socket transport uses, and
+// without NSS: tokens are stored as they are and never sealed.
+class SSLTokensCacheTest : public ::testing::Test {
+ protected:
+  using Token = SSLTokensCache::PersistedToken;
+
+  static const PRTime kHour = PRTime(PR_USEC_PER_SEC) * 60 * 60;
+
+  void SetUp() override {
+    mCapacity = SSLTokensCache::sCapacity;
+    mCache = new SSLTokensCache();
+  }
+
+  void TearDown() override {
+    mCache = nullptr;
+    SSLTokensCache::sCapacity = mCapacity;
+  }
+
+  static void SetCapacity(uint32_t aKilobytes) {
+    SSLTokensCache::sCapacity = aKilobytes;
+  }
+
+  // Stores a token of |aLength| bytes that expires |aLifetime| from now.
+  void Put(const char* aHost, uint32_t aLength, PRTime aLifetime = kHour) {
+    nsTArray<uint8_t> token;
+    token.AppendElements(aLength);
+    memset(token.Elements(), 0, aLength);
+
+    StaticMutexAutoLock lock(SSLTokensCache::sLock);
+    EXPECT_EQ(NS_OK, mCache->PutLocked(nsDependentCString(aHost),
+                                       token.Elements(), token.Length(),
+                                       PR_Now() + aLifetime, 0));
+  }
+
+  // Looks |aHost| up, which also makes it the most recently used.
+  bool Get(const char* aHost) {
+    nsTArray<uint8_t> token;
+    StaticMutexAutoLock lock(SSLTokensCache::sLock);
+    return NS_SUCCEEDED(
+        mCache->GetLocked(nsDependentCString(aHost), token, nullptr));
+  }
+
+  uint32_t CacheSize() {
+    StaticMutexAutoLock lock(SSLTokensCache::sLock);
+    return mCache->mCacheSize;
+  }
+
+  void Collect(nsTArray<Token>& aTokens) {
+    StaticMutexAutoLock lock(SSLTokensCache::sLock);
+    mCache->CollectPersistedTokens(aTokens);
+  }
+
+  void Add(nsTArray<Token>& aTokens) {
+    StaticMutexAutoLock lock(SSLTokensCache::sLock);
+    mCache->AddPersistedTokens(aTokens);
+  }
+
+  static Token MakeToken(const char* aHost, PRTime aExpirationTime,
+                         uint32_t aMaxEarlyDataSize, uint8_t aFill) {
+    Token token;
+    token.mHost = aHost;
+    token.mExpirationTime = aExpirationTime;
+    token.mMaxEarlyDataSize = aMaxEarlyDataSize;
+    token.mToken.AppendElements(16);
+    memset(token.mToken.Elements(), aFill, 16);
+    return token;
+  }
+
+  static void Encode(const nsTArray<Token>& aTokens, nsACString& aData) {
+    SSLTokensCache::Encode(aTokens, aData);
+  }
+
+  static void Decode(const nsACString& aData, PRTime aNow,
+                     nsTArray<Token>& aTokens) {
+    SSLTokensCache::Decode(aData, aNow, aTokens);
+  }
+
+  RefPtr<SSLTokensCache> mCache;
+  uint32_t mCapacity;
+};
+
+// Tokens read back are the ones that were written, in the same order.
+TEST_F(SSLTokensCacheTest, RoundTrip) {
+  PRTime now = PR_Now();
+  nsTArray<Token> tokens;
+  tokens.AppendElement(MakeToken("a.tokens.test", now + kHour, 0, 1));
+  tokens.AppendElement(MakeToken("b.tokens.test:8443", now + 2 * kHour,
+                                 16384, 2));
+
+  nsAutoCString data;
+  Encode(tokens, data);
+  ASSERT_FALSE(data.IsEmpty());
+
+  nsTArray<Token> decoded;
+  Decode(data, now, decoded);
+  ASSERT_EQ(tokens.Length(), decoded.Length());
+  for (uint32_t i = 0; i < tokens.Length(); ++i) {
+    EXPECT_TRUE(tokens[i].mHost.Equals(decoded[i].mHost));
+    EXPECT_EQ(tokens[i].mExpirationTime, decoded[i].mExpirationTime);
+    EXPECT_EQ(tokens[i].mMaxEarlyDataSize, decoded[i].mMaxEarlyDataSize);
+    EXPECT_TRUE(tokens[i].mToken == decoded[i].mToken);
+  }
+
+  // No tokens, no file.
+  Encode(nsTArray<Token>(), data);
+  EXPECT_TRUE(data.IsEmpty());
+
+  // A file cut short keeps the tokens before the cut.
+  Encode(tokens, data);
+  data.Truncate(data.Length() - 1);
+  decoded.Clear();
+  Decode(data, now, decoded);
+  ASSERT_EQ(1u, decoded.Length());
+  EXPECT_TRUE(decoded[0].mHost.EqualsLiteral("a.tokens.test"));
+
+  // Anything else is ignored.
+  decoded.Clear();
+  Decode(NS_LITERAL_CSTRING("not a tokens file"), now, decoded);
+  EXPECT_TRUE(decoded.IsEmpty());
+}
+
+// Tokens that expired while the browser was closed are not loaded.
+TEST_F(SSLTokensCacheTest, SkipsExpired) {
+  PRTime now = PR_Now();
+  nsTArray<Token> tokens;
+  tokens.AppendElement(MakeToken("old.tokens.test", now - kHour, 0, 1));
+  tokens.AppendElement(MakeToken("due.tokens.test", now, 0, 2));
+  tokens.AppendElement(MakeToken("new.tokens.test", now + kHour, 0, 3));
+
+  nsAutoCString data;
+  Encode(tokens, data);
+
+  nsTArray<Token> decoded;
+  Decode(data, now, decoded);
+  ASSERT_EQ(1u, decoded.Length());
+  EXPECT_TRUE(decoded[0].mHost.EqualsLiteral("new.tokens.test"));
+
+  // A token stored in this session wins over the one from the file.
+  Put("new.tokens.test", 32);
+  Add(decoded);
+  EXPECT_EQ(32u, CacheSize());
+
+  // And what is persisted leaves out what expired since.
+  Put("stale.tokens.test", 8);
+  Put("gone.tokens.test", 8, 0);
+  nsTArray<Token> collected;
+  Collect(collected);
+  ASSERT_EQ(2u, collected.Length());
+  EXPECT_TRUE(collected[0].mHost.EqualsLiteral("new.tokens.test"));
+  EXPECT_TRUE(collected[1].mHost.EqualsLiteral("stale.tokens.test"));
+  EXPECT_FALSE(Get("gone.tokens.test"));
+}
+
+// A full cache drops the least recently used tokens, counting each token's
+// bytes once.
+TEST_F(SSLTokensCacheTest, EvictionOrder) {
+  SetCapacity(1);  // 1024 bytes
+
+  Put("a.tokens.test", 300);
+  Put("b.tokens.test", 300);
+  Put("c.tokens.test", 300);
+  EXPECT_EQ(900u, CacheSize());
+
+  // Using a keeps it, so d evicts b.
+  EXPECT_TRUE(Get("a.tokens.test"));
+  Put("d.tokens.test", 300);
+  EXPECT_EQ(900u, CacheSize());
+  EXPECT_FALSE(Get("b.tokens.test"));
+
+  // Replacing a token only counts the new one.
+  Put("c.tokens.test", 100);
+  EXPECT_EQ(700u, CacheSize());
+
+  // e evicts both d and a, which were used before c was replaced.
+  Put("e.tokens.test", 800);
+  EXPECT_EQ(900u, CacheSize());
+  EXPECT_FALSE(Get("a.tokens.test"));
+  EXPECT_FALSE(Get("d.tokens.test"));
+  EXPECT_TRUE(Get("c.tokens.test"));
+  EXPECT_TRUE(Get("e.tokens.test"));
+
+  // Loaded tokens are counted the same way, and evicted like the others.
+  nsTArray<Token> loaded;
+  loaded.AppendElement(MakeToken("f.tokens.test", PR_Now() + kHour, 0, 6));
+  Add(loaded);
+  EXPECT_EQ(916u, CacheSize());
+  EXPECT_TRUE(Get("f.tokens.test"));
+}
+
+}  // namespace net
+}  // namespace mozilla
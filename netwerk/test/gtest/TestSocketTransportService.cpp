@@ -0,0 +1,275 @@
+/* -*- Mode: C++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim:set ts=2 sw=2 sts=2 et cindent: */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "gtest/MozGTestBench.h"  // For MOZ_GTEST_BENCH_F
+
+#include <functional>
+
+#include "mozilla/Monitor.h"
+#include "mozilla/Preferences.h"
+#include "mozilla/SyncRunnable.h"
+#include "mozilla/TimeStamp.h"
+#include "nsASocketHandler.h"
+#include "nsCOMPtr.h"
+#include "nsISocketTransportService.h"
+#include "nsNetCID.h"
+#include "nsServiceManagerUtils.h"
+#include "nsTArray.h"
+#include "nsThreadUtils.h"
+#include "prio.h"
+
+using namespace mozilla;
+
+namespace {
+
+// Handler for one end of a TCP socket pair attached to the socket transport
+// service.  It counts the bytes written to its peer and the timeouts it is
+// notified about, and wakes up the waiting test thread on either.
+class TestSocketHandler final : public nsASocketHandler {
+ public:
+  NS_DECL_THREADSAFE_ISUPPORTS
+
+  TestSocketHandler(PRFileDesc* aPeer, Monitor* aMonitor, uint16_t aFlags)
+      : mPeer(aPeer), mMonitor(aMonitor), mBytes(0), mTimeouts(0) {
+    mPollFlags = aFlags;
+  }
+
+  void OnSocketReady(PRFileDesc* fd, int16_t outFlags) override {
+    MonitorAutoLock lock(*mMonitor);
+    if (outFlags == -1) {
+      // Only report the first timeout, the service would otherwise keep
+      // timing the socket out every mPollTimeout seconds.
+      mPollTimeout = UINT16_MAX;
+      ++mTimeouts;
+      lock.Notify();
+      return;
+    }
+
+    char buf[64];
+    int32_t n = PR_Recv(fd, buf, sizeof(buf), 0, PR_INTERVAL_NO_WAIT);
+    if (n <= 0) {
+      return;
+    }
+    mBytes += n;
+    lock.Notify();
+  }
+
+  void OnSocketDetached(PRFileDesc* fd) override {
+    PR_Close(fd);
+    PR_Close(mPeer);
+  }
+
+  void IsLocal(bool* aIsLocal) override { *aIsLocal = true; }
+  uint64_t ByteCountSent() override { return 0; }
+  uint64_t ByteCountReceived() override { return 0; }
+
+  PRFileDesc* Peer() const { return mPeer; }
+  // Protected by the monitor.
+  uint32_t Bytes() const { return mBytes; }
+  uint32_t Timeouts() const { return mTimeouts; }
+
+ private:
+  ~TestSocketHandler() = default;
+
+  PRFileDesc* mPeer;
+  Monitor* mMonitor;
+  uint32_t mBytes;
+  uint32_t mTimeouts;
+};
+
+NS_IMPL_ISUPPORTS0(TestSocketHandler)
+
+class SocketTransportServiceTest : public ::testing::Test {
+ protected:
+  SocketTransportServiceTest() : mMonitor("SocketTransportServiceTest") {}
+
+  void SetUp() override {
+    nsresult rv;
+    mService = do_GetService(NS_SOCKETTRANSPORTSERVICE_CONTRACTID, &rv);
+    ASSERT_TRUE(NS_SUCCEEDED(rv));
+    mTarget = do_QueryInterface(mService);
+    ASSERT_TRUE(mTarget);
+  }
+
+  void TearDown() override {
+    // Let the service detach and close everything on its next iteration.
+    RunOnSocketThread([&] {
+      for (auto& handler : mHandlers) {
+        handler->mCondition = NS_ERROR_ABORT;
+      }
+    });
+    Preferences::ClearUser("network.sts.epoll.enabled");
+  }
+
+  void RunOnSocketThread(const std::function<void()>& aFunc) {
+    RefPtr<SyncRunnable> runnable = new SyncRunnable(
+        NS_NewRunnableFunction("SocketTransportServiceTest", aFunc));
+    runnable->DispatchToThread(mTarget);
+  }
+
+  // Attaches |aCount| socket pairs, returns the number attached.
+  uint32_t Attach(uint32_t aCount, uint16_t aFlags) {
+    uint32_t attached = 0;
+    RunOnSocketThread([&] {
+      for (uint32_t i = 0; i < aCount; ++i) {
+        PRFileDesc* fds[2];
+        if (PR_NewTCPSocketPair(fds) != PR_SUCCESS) {
+          return;
+        }
+        RefPtr<TestSocketHandler> handler =
+            new TestSocketHandler(fds[1], &mMonitor, aFlags);
+        if (NS_FAILED(mService->AttachSocket(fds[0], handler))) {
+          PR_Close(fds[0]);
+          PR_Close(fds[1]);
+          return;
+        }
+        mHandlers.AppendElement(handler);
+        ++attached;
+      }
+    });
+    return attached;
+  }
+
+  // Waits until |aDone| returns true or |aSeconds| passed.
+  bool WaitFor(const std::function<bool()>& aDone, uint32_t aSeconds) {
+    TimeStamp deadline =
+        TimeStamp::Now() + TimeDuration::FromSeconds(aSeconds);
+    MonitorAutoLock lock(mMonitor);
+    while (!aDone()) {
+      TimeStamp now = TimeStamp::Now();
+      if (now >= deadline) {
+        return false;
+      }
+      lock.Wait(deadline - now);
+    }
+    return true;
+  }
+
+  static void Ping(TestSocketHandler* aHandler) {
+    ASSERT_EQ(1, PR_Send(aHandler->Peer(), "p", 1, 0, PR_INTERVAL_NO_TIMEOUT));
+  }
+
+  // Pings one socket |aPings| times, each time waiting for the socket
+  // thread to read the byte, while |aIdle| other sockets are attached and
+  // never become ready.  No event runs on the socket thread meanwhile, so
+  // with epoll the iterations only look at the ready socket.
+  void PingWithIdleSockets(bool aEpoll, uint32_t aIdle, uint32_t aPings) {
+    Preferences::SetBool("network.sts.epoll.enabled", aEpoll);
+    ASSERT_EQ(aIdle + 1, Attach(aIdle + 1, PR_POLL_READ | PR_POLL_EXCEPT));
+
+    RefPtr<TestSocketHandler> handler = mHandlers[0];
+    for (uint32_t i = 1; i <= aPings; ++i) {
+      Ping(handler);
+      ASSERT_TRUE(WaitFor([&] { return handler->Bytes() == i; }, 10));
+    }
+  }
+
+  Monitor mMonitor;
+  nsCOMPtr<nsISocketTransportService> mService;
+  nsCOMPtr<nsIEventTarget> mTarget;
+  nsTArray<RefPtr<TestSocketHandler>> mHandlers;
+};
+
+}  // namespace
+
+// Readiness has to reach the handler whose socket became readable, also
+// after sockets in front of it were detached and it moved in the active
+// list.
+TEST_F(SocketTransportServiceTest, ReadinessAfterDetach) {
+  const uint32_t kSockets = 40;
+  ASSERT_EQ(kSockets, Attach(kSockets, PR_POLL_READ | PR_POLL_EXCEPT));
+
+  for (uint32_t i = 0; i < kSockets; ++i) {
+    RefPtr<TestSocketHandler> handler = mHandlers[i];
+    Ping(handler);
+    ASSERT_TRUE(WaitFor([&] { return handler->Bytes() == 1; }, 10));
+  }
+
+  // Detach every other socket, the remaining ones get new indices.
+  nsTArray<RefPtr<TestSocketHandler>> detached;
+  RunOnSocketThread([&] {
+    for (uint32_t i = 0; i < kSockets; i += 2) {
+      mHandlers[i]->mCondition = NS_ERROR_ABORT;
+    }
+  });
+  for (uint32_t i = 0; i < kSockets; i += 2) {
+    detached.AppendElement(mHandlers[i]);
+  }
+  for (auto& handler : detached) {
+    mHandlers.RemoveElement(handler);
+  }
+
+  for (uint32_t i = mHandlers.Length(); i > 0; --i) {
+    RefPtr<TestSocketHandler> handler = mHandlers[i - 1];
+    Ping(handler);
+    ASSERT_TRUE(WaitFor([&] { return handler->Bytes() == 2; }, 10));
+  }
+
+  MonitorAutoLock lock(mMonitor);
+  for (auto& handler : mHandlers) {
+    EXPECT_EQ(2u, handler->Bytes());
+  }
+}
+
+// A socket that is not polled for reading must not be reported readable,
+// and must be reported as soon as its handler starts polling it.
+TEST_F(SocketTransportServiceTest, ReadinessAfterInterestChange) {
+  ASSERT_EQ(2u, Attach(2, PR_POLL_EXCEPT));
+  RefPtr<TestSocketHandler> handler = mHandlers[0];
+  RefPtr<TestSocketHandler> other = mHandlers[1];
+
+  Ping(handler);
+  RunOnSocketThread([&] { other->mPollFlags = PR_POLL_READ; });
+  Ping(other);
+  ASSERT_TRUE(WaitFor([&] { return other->Bytes() == 1; }, 10));
+  {
+    MonitorAutoLock lock(mMonitor);
+    EXPECT_EQ(0u, handler->Bytes());
+  }
+
+  RunOnSocketThread([&] { handler->mPollFlags = PR_POLL_READ; });
+  EXPECT_TRUE(WaitFor([&] { return handler->Bytes() == 1; }, 10));
+}
+
+// Sockets with a poll timeout are notified once it expires, sockets
+// without one or with pending data are not.
+TEST_F(SocketTransportServiceTest, Timeouts) {
+  ASSERT_EQ(3u, Attach(3, PR_POLL_READ | PR_POLL_EXCEPT));
+  RefPtr<TestSocketHandler> timed = mHandlers[0];
+  RefPtr<TestSocketHandler> untimed = mHandlers[1];
+  RefPtr<TestSocketHandler> later = mHandlers[2];
+
+  TimeStamp start = TimeStamp::Now();
+  RunOnSocketThread([&] {
+    timed->mPollTimeout = 1;
+    later->mPollTimeout = 3;
+  });
+
+  ASSERT_TRUE(WaitFor([&] { return timed->Timeouts() == 1; }, 10));
+  EXPECT_GE((TimeStamp::Now() - start).ToSeconds(), 0.9);
+  {
+    MonitorAutoLock lock(mMonitor);
+    EXPECT_EQ(0u, later->Timeouts());
+  }
+
+  // Shortening a timeout that is already running takes effect.
+  RunOnSocketThread([&] { later->mPollTimeout = 1; });
+  ASSERT_TRUE(WaitFor([&] { return later->Timeouts() == 1; }, 10));
+  EXPECT_LT((TimeStamp::Now() - start).ToSeconds(), 3.0);
+
+  MonitorAutoLock lock(mMonitor);
+  EXPECT_EQ(0u, untimed->Timeouts());
+}
+
+// Readiness latency with many idle sockets attached.  PR_Poll hands every
+// socket to the kernel on each iteration, epoll only deals with the ready
+// one; compare the two.
+MOZ_GTEST_BENCH_F(SocketTransportServiceTest, DISABLED_IdleSocketsPoll,
+                  [this] { PingWithIdleSockets(false, 900, 2000); });
+
+MOZ_GTEST_BENCH_F(SocketTransportServiceTest, DISABLED_IdleSocketsEpoll,
+                  [this] { PingWithIdleSockets(true, 900, 2000); });
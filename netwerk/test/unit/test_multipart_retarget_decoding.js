@@ -0,0 +1,150 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// A content encoded multipart response is decoded off the main thread, and
+// its parts still reach the listener whole and in order, on the main thread.
+
+"use strict";
+
+const { HttpServer } = ChromeUtils.import("resource://testing-common/httpd.js");
+const { NetUtil } = ChromeUtils.import("resource://gre/modules/NetUtil.jsm");
+const { Services } = ChromeUtils.import("resource://gre/modules/Services.jsm");
+
+const kPref = "network.multipart.retarget_decoding";
+
+var httpserver = null;
+
+function getURI() {
+  return "http://localhost:" + httpserver.identity.primaryPort + "/multipart";
+}
+
+// Large enough for the decoder to hand the data over in several chunks.
+const testData = [];
+for (let i = 0; i < 8; i++) {
+  testData.push(("part " + i + " ").repeat(4096 + i));
+}
+
+function makeBody() {
+  let body = "";
+  for (let data of testData) {
+    body += "--boundary\r\nContent-Type: text/plain\r\n\r\n" + data + "\r\n";
+  }
+  return body + "--boundary--\r\n";
+}
+
+function gzip(str) {
+  let out = "";
+  let listener = {
+    QueryInterface: ChromeUtils.generateQI([
+      "nsIStreamListener",
+      "nsIRequestObserver",
+    ]),
+    onStartRequest(request) {},
+    onDataAvailable(request, stream, offset, count) {
+      out += NetUtil.readInputStreamToString(stream, count);
+    },
+    onStopRequest(request, status) {},
+  };
+
+  let conv = Cc[
+    "@mozilla.org/streamconv;1?from=uncompressed&to=gzip"
+  ].createInstance(Ci.nsIStreamConverter);
+  conv.asyncConvertData("uncompressed", "gzip", listener, null);
+
+  let stream = Cc["@mozilla.org/io/string-input-stream;1"].createInstance(
+    Ci.nsIStringInputStream
+  );
+  stream.setData(str, str.length);
+  conv.onStartRequest(null);
+  conv.onDataAvailable(null, stream, 0, str.length);
+  conv.onStopRequest(null, Cr.NS_OK);
+  return out;
+}
+
+var encodedBody = gzip(makeBody());
+
+function contentHandler(metadata, response) {
+  response.setHeader(
+    "Content-Type",
+    'multipart/x-mixed-replace; boundary="boundary"'
+  );
+  response.setHeader("Content-Encoding", "gzip");
+  response.bodyOutputStream.write(encodedBody, encodedBody.length);
+}
+
+function makeListener(retargeted, callback) {
+  return {
+    _buffer: "",
+    _parts: [],
+
+    QueryInterface: ChromeUtils.generateQI([
+      "nsIStreamListener",
+      "nsIRequestObserver",
+    ]),
+
+    onStartRequest(request) {
+      Assert.ok(Services.tm.isMainThread);
+      this._buffer = "";
+
+      // The response itself, which the multipart converter retargeted.
+      let base = request.QueryInterface(Ci.nsIMultiPartChannel).baseChannel;
+      let target = base.QueryInterface(Ci.nsIThreadRetargetableRequest)
+        .deliveryTarget;
+      Assert.equal(target.isOnCurrentThread(), !retargeted);
+    },
+
+    onDataAvailable(request, stream, offset, count) {
+      Assert.ok(Services.tm.isMainThread);
+      this._buffer += NetUtil.readInputStreamToString(stream, count);
+    },
+
+    onStopRequest(request, status) {
+      Assert.ok(Services.tm.isMainThread);
+      Assert.ok(Components.isSuccessCode(status));
+
+      let part = request.QueryInterface(Ci.nsIMultiPartChannel);
+      Assert.equal(part.partID, this._parts.length);
+      this._parts.push(this._buffer);
+      if (part.isLastPart) {
+        callback(this._parts);
+      }
+    },
+  };
+}
+
+function load(retargeted) {
+  return new Promise(resolve => {
+    let listener = makeListener(retargeted, resolve);
+    let conv = Cc["@mozilla.org/streamConverters;1"]
+      .getService(Ci.nsIStreamConverterService)
+      .asyncConvertData("multipart/x-mixed-replace", "*/*", listener, null);
+    let chan = NetUtil.newChannel({
+      uri: getURI(),
+      loadUsingSystemPrincipal: true,
+    });
+    chan.asyncOpen(conv);
+  });
+}
+
+add_task(async function setup() {
+  httpserver = new HttpServer();
+  httpserver.registerPathHandler("/multipart", contentHandler);
+  httpserver.start(-1);
+  registerCleanupFunction(async () => {
+    Services.prefs.clearUserPref(kPref);
+    await new Promise(resolve => httpserver.stop(resolve));
+  });
+});
+
+add_task(async function test_retarget_decoding() {
+  Services.prefs.setBoolPref(kPref, true);
+  let parts = await load(true);
+  Assert.deepEqual(parts, testData);
+});
+
+add_task(async function test_main_thread_decoding() {
+  Services.prefs.setBoolPref(kPref, false);
+  let parts = await load(false);
+  Assert.deepEqual(parts, testData);
+});
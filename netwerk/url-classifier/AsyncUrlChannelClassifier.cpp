@@ -5,13 +5,18 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "Classifier.h"
+#include "mozilla/ClearOnShutdown.h"
 #include "mozilla/Components.h"
 #include "mozilla/ErrorNames.h"
+#include "mozilla/Mutex.h"
+#include "mozilla/StaticPtr.h"
 #include "mozilla/net/AsyncUrlChannelClassifier.h"
 #include "mozilla/net/UrlClassifierCommon.h"
 #include "mozilla/net/UrlClassifierFeatureFactory.h"
 #include "mozilla/net/UrlClassifierFeatureResult.h"
+#include "nsClassHashtable.h"
 #include "nsContentUtils.h"
+#include "nsDataHashtable.h"
 #include "nsIChannel.h"
 #include "nsIHttpChannel.h"
 #include "nsIHttpChannelInternal.h"
@@ -56,12 +61,18 @@ namespace {
 //
 // The creation of these classes happens on the main-thread. The classification
 // happens on the worker thread.
+//
+// FeatureTasks are not dispatched to the worker thread one at a time: they
+// wait in the FeatureTaskQueue, which the worker thread empties in one go.
+// The tasks of such a batch share a LookupBatch object, so that a URL
+// fragment is hashed, and a URI is looked up in a table, only once per batch
+// even when many channels of a page load from the same hosts.
 
 // URIData
 // -----------------------------------------------------------------------------
 
 // In order to avoid multiple URI parsing, we have this class which contains
-// nsIURI and its fragments.
+// nsIURI and its spec.
 class URIData {
  public:
   NS_INLINE_DECL_THREADSAFE_REFCOUNTING(URIData);
@@ -70,7 +81,9 @@ class URIData {
 
   bool IsEqual(nsIURI* aURI) const;
 
-  const nsTArray<nsCString>& Fragments();
+  // The spec doesn't change once created, so this can be called on any
+  // thread.
+  const nsACString& Spec() const;
 
   nsIURI* URI() const;
 
@@ -80,7 +93,6 @@ class URIData {
 
   nsCOMPtr<nsIURI> mURI;
   nsCString mURISpec;
-  nsTArray<nsCString> mFragments;
 };
 
 /* static */
@@ -128,20 +140,115 @@ bool URIData::IsEqual(nsIURI* aURI) const {
   return isEqual;
 }
 
-const nsTArray<nsCString>& URIData::Fragments() {
+const nsACString& URIData::Spec() const { return mURISpec; }
+
+nsIURI* URIData::URI() const {
+  MOZ_ASSERT(NS_IsMainThread());
+  return mURI;
+}
+
+// LookupBatch
+// ----------------------------------------------------------------------------
+
+// The lookups of the FeatureTasks classified together go through this class,
+// which remembers the fragment hashes and the lookup results of the batch.
+// It lives on the worker thread for the time of one batch.
+class LookupBatch final {
+ public:
+  explicit LookupBatch(nsUrlClassifierDBServiceWorker* aWorkerClassifier);
+
+  // Appends the results of looking up |aSpec| in |aTable| to |aResults|.
+  nsresult Lookup(const nsACString& aSpec, const nsACString& aTable,
+                  LookupResultArray& aResults);
+
+ private:
+  nsresult GetFragmentHashes(const nsACString& aSpec,
+                             const nsTArray<Completion>** aHashes);
+
+  RefPtr<nsUrlClassifierDBServiceWorker> mWorkerClassifier;
+
+  // URI spec -> the hashes of its lookup fragments.
+  nsClassHashtable<nsCStringHashKey, nsTArray<Completion>> mSpecHashes;
+  // Lookup fragment -> its hash. Different URIs share most fragments.
+  nsDataHashtable<nsCStringHashKey, Completion> mFragmentHashes;
+  // Table and URI spec -> the lookup results.
+  nsClassHashtable<nsCStringHashKey, LookupResultArray> mResults;
+};
+
+LookupBatch::LookupBatch(nsUrlClassifierDBServiceWorker* aWorkerClassifier)
+    : mWorkerClassifier(aWorkerClassifier) {
+  MOZ_ASSERT(!NS_IsMainThread());
+  MOZ_ASSERT(aWorkerClassifier);
+}
+
+nsresult LookupBatch::GetFragmentHashes(const nsACString& aSpec,
+                                        const nsTArray<Completion>** aHashes) {
   MOZ_ASSERT(!NS_IsMainThread());
 
-  if (mFragments.IsEmpty()) {
-    nsresult rv = LookupCache::GetLookupFragments(mURISpec, &mFragments);
-    Unused << NS_WARN_IF(NS_FAILED(rv));
+  nsTArray<Completion>* hashes = mSpecHashes.Get(aSpec);
+  if (hashes) {
+    *aHashes = hashes;
+    return NS_OK;
   }
 
-  return mFragments;
+  nsTArray<nsCString> fragments;
+  nsresult rv = LookupCache::GetLookupFragments(aSpec, &fragments);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  hashes = mSpecHashes.LookupOrAdd(aSpec);
+  hashes->SetCapacity(fragments.Length());
+
+  for (const nsCString& fragment : fragments) {
+    Completion* hash = hashes->AppendElement();
+    if (!mFragmentHashes.Get(fragment, hash)) {
+      rv = hash->FromPlaintext(fragment);
+      if (NS_WARN_IF(NS_FAILED(rv))) {
+        mSpecHashes.Remove(aSpec);
+        return rv;
+      }
+      mFragmentHashes.Put(fragment, *hash);
+    }
+  }
+
+  *aHashes = hashes;
+  return NS_OK;
 }
 
-nsIURI* URIData::URI() const {
-  MOZ_ASSERT(NS_IsMainThread());
-  return mURI;
+nsresult LookupBatch::Lookup(const nsACString& aSpec, const nsACString& aTable,
+                             LookupResultArray& aResults) {
+  MOZ_ASSERT(!NS_IsMainThread());
+
+  // Table names don't contain spaces.
+  nsAutoCString key(aTable);
+  key.Append(' ');
+  key.Append(aSpec);
+
+  LookupResultArray* results = mResults.Get(key);
+  if (results) {
+    UC_LOG(("LookupBatch::Lookup[%p] - reusing the lookup of %s in %s", this,
+            PromiseFlatCString(aSpec).get(), PromiseFlatCString(aTable).get()));
+    aResults.AppendElements(*results);
+    return NS_OK;
+  }
+
+  const nsTArray<Completion>* hashes;
+  nsresult rv = GetFragmentHashes(aSpec, &hashes);
+  if (NS_FAILED(rv)) {
+    return rv;
+  }
+
+  results = mResults.LookupOrAdd(key);
+  rv = mWorkerClassifier->DoSingleLocalLookupWithURIFragmentHashes(
+      *hashes, aTable, *results);
+  if (NS_FAILED(rv)) {
+    mResults.Remove(key);
+    return rv;
+  }
+
+  aResults.AppendElements(*results);
+  return NS_OK;
 }
 
 // TableData
@@ -173,7 +280,7 @@ class TableData {
 
   // Returns true if the table classifies the URI. This method must be called
   // on hte classifier worker thread.
-  bool DoLookup(nsUrlClassifierDBServiceWorker* aWorkerClassifier);
+  bool DoLookup(LookupBatch* aBatch);
 
  private:
   ~TableData();
@@ -221,16 +328,14 @@ bool TableData::IsEqual(URIData* aURIData, const nsACString& aTable) const {
   return mURIData == aURIData && mTable == aTable;
 }
 
-bool TableData::DoLookup(nsUrlClassifierDBServiceWorker* aWorkerClassifier) {
+bool TableData::DoLookup(LookupBatch* aBatch) {
   MOZ_ASSERT(!NS_IsMainThread());
-  MOZ_ASSERT(aWorkerClassifier);
+  MOZ_ASSERT(aBatch);
 
   if (mState == TableData::eUnclassified) {
     UC_LOG(("TableData::DoLookup[%p] - starting lookup", this));
 
-    const nsTArray<nsCString>& fragments = mURIData->Fragments();
-    nsresult rv = aWorkerClassifier->DoSingleLocalLookupWithURIFragments(
-        fragments, mTable, mResults);
+    nsresult rv = aBatch->Lookup(mURIData->Spec(), mTable, mResults);
     Unused << NS_WARN_IF(NS_FAILED(rv));
 
     mState = mResults.IsEmpty() ? TableData::eNoMatch : TableData::eMatch;
@@ -263,7 +368,7 @@ class FeatureData {
   nsresult Initialize(FeatureTask* aTask, nsIChannel* aChannel,
                       nsIUrlClassifierFeature* aFeature);
 
-  void DoLookup(nsUrlClassifierDBServiceWorker* aWorkerClassifier);
+  void DoLookup(LookupBatch* aBatch);
 
   // Returns true if the next feature should be processed.
   bool MaybeCompleteClassification(nsIChannel* aChannel);
@@ -318,9 +423,9 @@ nsresult FeatureData::Initialize(FeatureTask* aTask, nsIChannel* aChannel,
   return NS_OK;
 }
 
-void FeatureData::DoLookup(nsUrlClassifierDBServiceWorker* aWorkerClassifier) {
+void FeatureData::DoLookup(LookupBatch* aBatch) {
   MOZ_ASSERT(!NS_IsMainThread());
-  MOZ_ASSERT(aWorkerClassifier);
+  MOZ_ASSERT(aBatch);
   MOZ_ASSERT(mState == eUnclassified);
 
   UC_LOG(("FeatureData::DoLookup[%p] - lookup starting", this));
@@ -347,7 +452,7 @@ void FeatureData::DoLookup(nsUrlClassifierDBServiceWorker* aWorkerClassifier) {
     // with the others: the feature is blacklisted (but maybe also
     // whitelisted).
     for (TableData* tableData : mBlacklistTables) {
-      if (tableData->DoLookup(aWorkerClassifier)) {
+      if (tableData->DoLookup(aBatch)) {
         isBlacklisted = true;
         break;
       }
@@ -367,7 +472,7 @@ void FeatureData::DoLookup(nsUrlClassifierDBServiceWorker* aWorkerClassifier) {
   for (TableData* tableData : mWhitelistTables) {
     // If one of the whitelist table matches the URI, we don't need to continue
     // with the others: the feature is whitelisted.
-    if (tableData->DoLookup(aWorkerClassifier)) {
+    if (tableData->DoLookup(aBatch)) {
       UC_LOG(("FeatureData::DoLookup[%p] - whitelisted by table", this));
       mState = eMatchWhitelist;
       return;
@@ -500,7 +605,7 @@ class FeatureTask {
                          FeatureTask** aTask);
 
   // Called on the classifier thread.
-  void DoLookup(nsUrlClassifierDBServiceWorker* aWorkerClassifier);
+  void DoLookup(LookupBatch* aBatch);
 
   // Called on the main-thread to process the channel.
   void CompleteClassification();
@@ -649,14 +754,14 @@ nsresult FeatureTask::GetOrCreateTableData(URIData* aURIData,
   return NS_OK;
 }
 
-void FeatureTask::DoLookup(nsUrlClassifierDBServiceWorker* aWorkerClassifier) {
+void FeatureTask::DoLookup(LookupBatch* aBatch) {
   MOZ_ASSERT(!NS_IsMainThread());
-  MOZ_ASSERT(aWorkerClassifier);
+  MOZ_ASSERT(aBatch);
 
   UC_LOG(("FeatureTask::DoLookup[%p] - starting lookup", this));
 
   for (FeatureData& feature : mFeatures) {
-    feature.DoLookup(aWorkerClassifier);
+    feature.DoLookup(aBatch);
   }
 
   UC_LOG(("FeatureTask::DoLookup[%p] - lookup completed", this));
@@ -750,6 +855,120 @@ nsresult FeatureData::InitializeList(
   return NS_OK;
 }
 
+// FeatureTaskQueue
+// ----------------------------------------------------------------------------
+
+// The FeatureTasks waiting for the worker thread. Only the first task queued
+// dispatches a runnable; the ones created before the worker thread gets to it
+// (bursts of channels while a page loads, or while the worker thread is busy)
+// are classified along with it. This costs one wakeup of the worker thread,
+// and one of the main thread to complete the classifications, per batch
+// rather than per channel, and adds no delay.
+class FeatureTaskQueue final {
+ public:
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(FeatureTaskQueue);
+
+  static FeatureTaskQueue* GetOrCreate();
+
+  nsresult Queue(FeatureTask* aTask,
+                 nsUrlClassifierDBServiceWorker* aWorkerClassifier);
+
+ private:
+  FeatureTaskQueue() : mMutex("FeatureTaskQueue::mMutex") {}
+  ~FeatureTaskQueue() = default;
+
+  void ProcessTasks(nsUrlClassifierDBServiceWorker* aWorkerClassifier);
+
+  static StaticRefPtr<FeatureTaskQueue> sQueue;
+
+  Mutex mMutex;
+  nsTArray<RefPtr<FeatureTask>> mTasks;
+};
+
+StaticRefPtr<FeatureTaskQueue> FeatureTaskQueue::sQueue;
+
+/* static */
+FeatureTaskQueue* FeatureTaskQueue::GetOrCreate() {
+  MOZ_ASSERT(NS_IsMainThread());
+
+  if (!sQueue) {
+    if (nsUrlClassifierDBService::ShutdownHasStarted()) {
+      return nullptr;
+    }
+
+    sQueue = new FeatureTaskQueue();
+    ClearOnShutdown(&sQueue);
+  }
+
+  return sQueue;
+}
+
+nsresult FeatureTaskQueue::Queue(
+    FeatureTask* aTask, nsUrlClassifierDBServiceWorker* aWorkerClassifier) {
+  MOZ_ASSERT(NS_IsMainThread());
+  MOZ_ASSERT(aTask);
+  MOZ_ASSERT(aWorkerClassifier);
+
+  {
+    MutexAutoLock lock(mMutex);
+    mTasks.AppendElement(aTask);
+    if (mTasks.Length() > 1) {
+      UC_LOG(("FeatureTaskQueue::Queue[%p] - task %p joins a batch of %zu",
+              this, aTask, mTasks.Length()));
+      return NS_OK;
+    }
+  }
+
+  RefPtr<FeatureTaskQueue> self = this;
+  RefPtr<nsUrlClassifierDBServiceWorker> workerClassifier = aWorkerClassifier;
+  nsCOMPtr<nsIRunnable> r =
+      NS_NewRunnableFunction("FeatureTaskQueue::ProcessTasks",
+                             [self, workerClassifier]() -> void {
+                               self->ProcessTasks(workerClassifier);
+                             });
+
+  nsresult rv = nsUrlClassifierDBService::BackgroundThread()->Dispatch(
+      r, NS_DISPATCH_NORMAL);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    // Nothing else was queued since, as only the main thread queues.
+    MutexAutoLock lock(mMutex);
+    mTasks.RemoveElement(aTask);
+  }
+
+  return rv;
+}
+
+void FeatureTaskQueue::ProcessTasks(
+    nsUrlClassifierDBServiceWorker* aWorkerClassifier) {
+  MOZ_ASSERT(!NS_IsMainThread());
+
+  nsTArray<RefPtr<FeatureTask>> tasks;
+  {
+    MutexAutoLock lock(mMutex);
+    tasks.SwapElements(mTasks);
+  }
+
+  UC_LOG(("FeatureTaskQueue::ProcessTasks[%p] - classifying %zu channels",
+          this, tasks.Length()));
+
+  {
+    LookupBatch batch(aWorkerClassifier);
+    for (FeatureTask* task : tasks) {
+      task->DoLookup(&batch);
+    }
+  }
+
+  nsCOMPtr<nsIRunnable> r = NS_NewRunnableFunction(
+      "AsyncUrlChannelClassifier::CheckChannel - return",
+      [tasks = std::move(tasks)]() -> void {
+        for (FeatureTask* task : tasks) {
+          task->CompleteClassification();
+        }
+      });
+
+  NS_DispatchToMainThread(r);
+}
+
 }  // namespace
 
 /* static */
@@ -786,21 +1005,12 @@ nsresult AsyncUrlChannelClassifier::CheckChannel(
     return NS_ERROR_FAILURE;
   }
 
-  nsCOMPtr<nsIRunnable> r = NS_NewRunnableFunction(
-      "AsyncUrlChannelClassifier::CheckChannel",
-      [task, workerClassifier]() -> void {
-        MOZ_ASSERT(!NS_IsMainThread());
-        task->DoLookup(workerClassifier);
-
-        nsCOMPtr<nsIRunnable> r = NS_NewRunnableFunction(
-            "AsyncUrlChannelClassifier::CheckChannel - return",
-            [task]() -> void { task->CompleteClassification(); });
-
-        NS_DispatchToMainThread(r);
-      });
+  RefPtr<FeatureTaskQueue> queue = FeatureTaskQueue::GetOrCreate();
+  if (NS_WARN_IF(!queue)) {
+    return NS_ERROR_FAILURE;
+  }
 
-  return nsUrlClassifierDBService::BackgroundThread()->Dispatch(
-      r, NS_DISPATCH_NORMAL);
+  return queue->Queue(task, workerClassifier);
 }
 
 }  // namespace net
@@ -290,6 +290,13 @@ void nsNSSSocketInfo::SetHandshakeCompleted() {
     Telemetry::AccumulateTimeDelta(
         Telemetry::SSL_TIME_UNTIL_HANDSHAKE_FINISHED_KEYED_BY_KA, mKeaGroup,
         mSocketCreationTimestamp, TimeStamp::Now());
+    // The same time split by whether a session was resumed, which is what
+    // the persisted SSL tokens cache saves on the first connections after a
+    // restart.
+    nsAutoCString resumed(handshakeType == Resumption ? "resumed" : "full");
+    Telemetry::AccumulateTimeDelta(
+        Telemetry::SSL_TIME_UNTIL_HANDSHAKE_FINISHED_KEYED_BY_RESUMPTION,
+        resumed, mSocketCreationTimestamp, TimeStamp::Now());
 
     // If the handshake is completed for the first time from just 1 callback
     // that means that TLS session resumption must have been used.
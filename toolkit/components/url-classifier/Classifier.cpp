@@ -424,16 +424,28 @@ nsresult Classifier::CheckURIFragments(
          aSpecFragments[urlIdx].get()));
   }
 
+  nsTArray<Completion> hashes;
+  if (!hashes.SetLength(aSpecFragments.Length(), fallible)) {
+    return NS_ERROR_OUT_OF_MEMORY;
+  }
+  for (uint32_t i = 0; i < aSpecFragments.Length(); i++) {
+    nsresult rv = hashes[i].FromPlaintext(aSpecFragments[i]);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  return CheckURIFragmentHashes(hashes, aTable, aResults);
+}
+
+nsresult Classifier::CheckURIFragmentHashes(
+    const nsTArray<Completion>& aHashes, const nsACString& aTable,
+    LookupResultArray& aResults) {
   RefPtr<LookupCache> cache = GetLookupCache(aTable);
   if (NS_WARN_IF(!cache)) {
     return NS_ERROR_FAILURE;
   }
 
   // Now check each lookup fragment against the entries in the DB.
-  for (uint32_t i = 0; i < aSpecFragments.Length(); i++) {
-    Completion lookupHash;
-    lookupHash.FromPlaintext(aSpecFragments[i]);
-
+  for (const Completion& lookupHash : aHashes) {
     bool has, confirmed;
     uint32_t matchLength;
 
@@ -447,8 +459,8 @@ nsresult Classifier::CheckURIFragments(
       if (LOG_ENABLED()) {
         nsAutoCString checking;
         lookupHash.ToHexString(checking);
-        LOG(("Found a result in fragment %s, hash %s (%X)",
-             aSpecFragments[i].get(), checking.get(), lookupHash.ToUint32()));
+        LOG(("Found a result in table %s, hash %s (%X)",
+             aTable.BeginReading(), checking.get(), lookupHash.ToUint32()));
         LOG(("Result %s, match %d-bytes prefix",
              confirmed ? "confirmed." : "Not confirmed.", matchLength));
       }
@@ -64,6 +64,13 @@ class Classifier {
                              const nsACString& table,
                              LookupResultArray& aResults);
 
+  /**
+   * Same as above, for fragments that have already been hashed.
+   */
+  nsresult CheckURIFragmentHashes(const nsTArray<Completion>& aHashes,
+                                  const nsACString& aTable,
+                                  LookupResultArray& aResults);
+
   /**
    * Asynchronously apply updates to the in-use databases. When the
    * update is complete, the caller can be notified by |aCallback|, which
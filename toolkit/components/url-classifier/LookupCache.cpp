@@ -5,6 +5,7 @@
 
 #include "LookupCache.h"
 #include "HashStore.h"
+#include "nsISafeOutputStream.h"
 #include "nsISeekableStream.h"
 #include "mozilla/ArrayUtils.h"
 #include "mozilla/Telemetry.h"
@@ -653,10 +654,12 @@ nsresult LookupCacheV2::ClearPrefixes() {
 }
 
 nsresult LookupCacheV2::StoreToFile(nsCOMPtr<nsIFile>& aFile) {
+  // The current prefix set may be mapped from this very file, so never
+  // truncate it in place; write a new one and swap it in when complete.
   nsCOMPtr<nsIOutputStream> localOutFile;
   nsresult rv =
-      NS_NewLocalFileOutputStream(getter_AddRefs(localOutFile), aFile,
-                                  PR_WRONLY | PR_TRUNCATE | PR_CREATE_FILE);
+      NS_NewSafeLocalFileOutputStream(getter_AddRefs(localOutFile), aFile,
+                                      PR_WRONLY | PR_TRUNCATE | PR_CREATE_FILE);
   NS_ENSURE_SUCCESS(rv, rv);
 
   uint32_t fileSize;
@@ -682,6 +685,12 @@ nsresult LookupCacheV2::StoreToFile(nsCOMPtr<nsIFile>& aFile) {
   rv = mPrefixSet->WritePrefixes(out);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  nsCOMPtr<nsISafeOutputStream> safeOut = do_QueryInterface(out, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = safeOut->Finish();
+  NS_ENSURE_SUCCESS(rv, rv);
+
   LOG(("[%s] Storing PrefixSet successful", mTableName.get()));
   return NS_OK;
 }
@@ -691,6 +700,22 @@ nsresult LookupCacheV2::LoadLegacyFile() { return NS_ERROR_NOT_IMPLEMENTED; }
 nsresult LookupCacheV2::LoadFromFile(nsCOMPtr<nsIFile>& aFile) {
   Telemetry::AutoTimer<Telemetry::URLCLASSIFIER_PS_FILELOAD_TIME> timer;
 
+#ifndef XP_WIN
+  // Use the prefix set straight from a mapping of the file. Windows can't
+  // rename the store directories while files in them are mapped, so it
+  // keeps reading the file into memory.
+  RefPtr<PrefixSetFileMap> map;
+  nsresult rv = PrefixSetFileMap::Open(aFile, getter_AddRefs(map));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  uint32_t offset = 0;
+  rv = mPrefixSet->LoadPrefixes(map, &offset);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (offset != map->Size()) {
+    return NS_ERROR_FILE_CORRUPTED;
+  }
+#else
   nsCOMPtr<nsIInputStream> localInFile;
   nsresult rv = NS_NewLocalFileInputStream(getter_AddRefs(localInFile), aFile,
                                            PR_RDONLY | nsIFile::OS_READAHEAD);
@@ -717,6 +742,7 @@ nsresult LookupCacheV2::LoadFromFile(nsCOMPtr<nsIFile>& aFile) {
 
   rv = mPrefixSet->LoadPrefixes(in);
   NS_ENSURE_SUCCESS(rv, rv);
+#endif
 
   mPrimed = true;
   LOG(("[%s] Loading PrefixSet successful", mTableName.get()));
@@ -254,7 +254,7 @@ nsresult LookupCacheV4::StoreToFile(nsCOMPtr<nsIFile>& aFile) {
   NS_ENSURE_ARG_POINTER(aFile);
 
   uint32_t fileSize = sizeof(Header) +
-                      mVLPrefixSet->CalculatePreallocateSize() +
+                      mVLPrefixSet->CalculatePreallocateSize(sizeof(Header)) +
                       nsCrc32CheckSumedOutputStream::CHECKSUM_SIZE;
 
   nsCOMPtr<nsIOutputStream> localOutFile;
@@ -285,7 +285,7 @@ nsresult LookupCacheV4::StoreToFile(nsCOMPtr<nsIFile>& aFile) {
   }
 
   // Write prefixes
-  rv = mVLPrefixSet->WritePrefixes(out);
+  rv = mVLPrefixSet->WritePrefixes(out, sizeof(Header));
   if (NS_WARN_IF(NS_FAILED(rv))) {
     return rv;
   }
@@ -405,6 +405,45 @@ nsresult LookupCacheV4::LoadFromFile(nsCOMPtr<nsIFile>& aFile) {
 
   Telemetry::AutoTimer<Telemetry::URLCLASSIFIER_VLPS_FILELOAD_TIME> timer;
 
+#ifndef XP_WIN
+  // See LookupCacheV2::LoadFromFile for why Windows doesn't map the file.
+  RefPtr<PrefixSetFileMap> map;
+  nsresult rv = PrefixSetFileMap::Open(aFile, getter_AddRefs(map));
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  const uint32_t checksumSize = nsCrc32CheckSumedOutputStream::CHECKSUM_SIZE;
+  if (map->Size() < sizeof(Header) + checksumSize) {
+    return NS_ERROR_FILE_CORRUPTED;
+  }
+
+  // Verifying the checksum now would fault in the whole mapping, which
+  // lookups only touch a few blocks of. It is verified once all of the
+  // prefixes are read, see PrefixSetFileMap::Verify(). Until then, only the
+  // sanity checks below guard the data.
+  uint32_t dataSize = map->Size() - checksumSize;
+  uint32_t checksum;
+  memcpy(&checksum, map->Data() + dataSize, sizeof(checksum));
+  map->SetChecksum(dataSize, checksum);
+
+  Header header;
+  memcpy(&header, map->Data(), sizeof(Header));
+  rv = SanityCheck(header);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  uint32_t offset = sizeof(Header);
+  rv = mVLPrefixSet->LoadPrefixes(map, &offset);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  if (offset != dataSize) {
+    return NS_ERROR_FILE_CORRUPTED;
+  }
+#else
   nsCOMPtr<nsIInputStream> localInFile;
   nsresult rv = NS_NewLocalFileInputStream(getter_AddRefs(localInFile), aFile,
                                            PR_RDONLY | nsIFile::OS_READAHEAD);
@@ -458,6 +497,7 @@ nsresult LookupCacheV4::LoadFromFile(nsCOMPtr<nsIFile>& aFile) {
   if (NS_WARN_IF(NS_FAILED(rv))) {
     return rv;
   }
+#endif
 
   mPrimed = true;
 
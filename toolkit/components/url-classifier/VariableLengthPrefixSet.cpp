@@ -7,6 +7,7 @@
 #include "VariableLengthPrefixSet.h"
 #include "nsUrlClassifierPrefixSet.h"
 #include "nsPrintfCString.h"
+#include "nsStringStream.h"
 #include "nsThreadUtils.h"
 #include "mozilla/ScopeExit.h"
 #include "mozilla/EndianUtils.h"
@@ -206,10 +207,46 @@ nsresult VariableLengthPrefixSet::LoadPrefixes(nsCOMPtr<nsIInputStream>& in) {
   NS_ENSURE_SUCCESS(rv, rv);
 
   // Then read prefixes from variable-length prefix set
+  return LoadVariableLengthPrefixes(in);
+}
+
+nsresult VariableLengthPrefixSet::LoadPrefixes(PrefixSetFileMap* aMap,
+                                               uint32_t* aOffset) {
+  MutexAutoLock lock(mLock);
+
+  // The fixed-length prefixes, by far the most, are used from the mapping.
+  nsresult rv = mFixedPrefixSet->LoadPrefixes(aMap, aOffset);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // The variable-length ones are few, and copied.
+  uint32_t size = aMap->Size() - *aOffset;
+  nsCOMPtr<nsIInputStream> in;
+  rv = NS_NewByteInputStream(
+      getter_AddRefs(in),
+      MakeSpan(reinterpret_cast<const char*>(aMap->Data() + *aOffset), size),
+      NS_ASSIGNMENT_DEPEND);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = LoadVariableLengthPrefixes(in);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  uint64_t available;
+  rv = in->Available(&available);
+  NS_ENSURE_SUCCESS(rv, rv);
+  *aOffset += size - available;
+
+  return NS_OK;
+}
+
+nsresult VariableLengthPrefixSet::LoadVariableLengthPrefixes(
+    nsIInputStream* in) {
+  mLock.AssertCurrentThreadOwns();
+
   uint32_t magic;
   uint32_t read;
 
-  rv = in->Read(reinterpret_cast<char*>(&magic), sizeof(uint32_t), &read);
+  nsresult rv =
+      in->Read(reinterpret_cast<char*>(&magic), sizeof(uint32_t), &read);
   NS_ENSURE_SUCCESS(rv, rv);
   NS_ENSURE_TRUE(read == sizeof(uint32_t), NS_ERROR_FAILURE);
 
@@ -267,11 +304,12 @@ nsresult VariableLengthPrefixSet::LoadPrefixes(nsCOMPtr<nsIInputStream>& in) {
   return NS_OK;
 }
 
-uint32_t VariableLengthPrefixSet::CalculatePreallocateSize() const {
+uint32_t VariableLengthPrefixSet::CalculatePreallocateSize(
+    uint32_t aFileOffset) const {
   uint32_t fileSize = 0;
 
   // Size of fixed length prefix set.
-  fileSize += mFixedPrefixSet->CalculatePreallocateSize();
+  fileSize += mFixedPrefixSet->CalculatePreallocateSize(aFileOffset);
 
   // Size of variable length prefix set.
   // Store how many prefix string.
@@ -287,11 +325,11 @@ uint32_t VariableLengthPrefixSet::CalculatePreallocateSize() const {
 }
 
 nsresult VariableLengthPrefixSet::WritePrefixes(
-    nsCOMPtr<nsIOutputStream>& out) const {
+    nsCOMPtr<nsIOutputStream>& out, uint32_t aFileOffset) const {
   MutexAutoLock lock(mLock);
 
   // First, write fixed length prefix set
-  nsresult rv = mFixedPrefixSet->WritePrefixes(out);
+  nsresult rv = mFixedPrefixSet->WritePrefixes(out, aFileOffset);
   NS_ENSURE_SUCCESS(rv, rv);
 
   // Then, write variable length prefix set
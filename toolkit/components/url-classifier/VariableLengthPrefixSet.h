@@ -19,6 +19,8 @@ class nsUrlClassifierPrefixSet;
 namespace mozilla {
 namespace safebrowsing {
 
+class PrefixSetFileMap;
+
 class VariableLengthPrefixSet final : public nsIMemoryReporter {
  public:
   VariableLengthPrefixSet();
@@ -30,9 +32,14 @@ class VariableLengthPrefixSet final : public nsIMemoryReporter {
   nsresult Matches(const nsACString& aFullHash, uint32_t* aLength) const;
   nsresult IsEmpty(bool* aEmpty) const;
 
-  nsresult WritePrefixes(nsCOMPtr<nsIOutputStream>& out) const;
+  // |aFileOffset| is where in the file the prefix set starts.
+  nsresult WritePrefixes(nsCOMPtr<nsIOutputStream>& out,
+                         uint32_t aFileOffset = 0) const;
   nsresult LoadPrefixes(nsCOMPtr<nsIInputStream>& in);
-  uint32_t CalculatePreallocateSize() const;
+  // Loads the prefix set stored at |*aOffset| in |aMap|, and advances
+  // |*aOffset| past it.
+  nsresult LoadPrefixes(PrefixSetFileMap* aMap, uint32_t* aOffset);
+  uint32_t CalculatePreallocateSize(uint32_t aFileOffset = 0) const;
 
   size_t SizeOfIncludingThis(mozilla::MallocSizeOf mallocSizeOf) const;
 
@@ -44,6 +51,8 @@ class VariableLengthPrefixSet final : public nsIMemoryReporter {
 
   static const uint32_t PREFIXSET_VERSION_MAGIC = 1;
 
+  nsresult LoadVariableLengthPrefixes(nsIInputStream* in);
+
   bool BinarySearch(const nsACString& aFullHash, const nsACString& aPrefixes,
                     uint32_t aPrefixSize) const;
 
@@ -359,6 +359,32 @@ nsresult nsUrlClassifierDBServiceWorker::DoSingleLocalLookupWithURIFragments(
   return NS_OK;
 }
 
+nsresult
+nsUrlClassifierDBServiceWorker::DoSingleLocalLookupWithURIFragmentHashes(
+    const nsTArray<Completion>& aHashes, const nsACString& aTable,
+    LookupResultArray& aResults) {
+  if (gShuttingDownThread) {
+    return NS_ERROR_ABORT;
+  }
+
+  MOZ_ASSERT(!NS_IsMainThread(),
+             "DoSingleLocalLookupWithURIFragmentHashes must be on background "
+             "thread");
+
+  // Bail if we haven't been initialized on the background thread.
+  if (!mClassifier) {
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  nsresult rv = mClassifier->CheckURIFragmentHashes(aHashes, aTable, aResults);
+  if (NS_WARN_IF(NS_FAILED(rv))) {
+    return rv;
+  }
+
+  LOG(("Found %zu results.", aResults.Length()));
+  return NS_OK;
+}
+
 /**
  * Lookup up a key in the database is a two step process:
  *
@@ -179,6 +179,12 @@ class nsUrlClassifierDBServiceWorker final : public nsIUrlClassifierDBService {
       const nsTArray<nsCString>& aSpecFragments, const nsACString& aTable,
       LookupResultArray& aResults);
 
+  // Same as above, for fragments that have already been hashed. Callers
+  // looking up many URLs at once use this to hash each fragment only once.
+  nsresult DoSingleLocalLookupWithURIFragmentHashes(
+      const nsTArray<Completion>& aHashes, const nsACString& aTable,
+      LookupResultArray& aResults);
+
   // Open the DB connection
   nsresult GCC_MANGLING_WORKAROUND OpenDb();
 
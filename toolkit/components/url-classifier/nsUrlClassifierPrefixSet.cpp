@@ -16,14 +16,22 @@
 #include "nsNetUtil.h"
 #include "nsISeekableStream.h"
 #include "nsIBufferedStreams.h"
+#include "nsStringStream.h"
+#include "crc32c.h"
+#include "mozilla/CheckedInt.h"
 #include "mozilla/MemoryReporting.h"
-#include "mozilla/StaticPrefs.h"
+#include "mozilla/SSE.h"
 #include "mozilla/Telemetry.h"
 #include "mozilla/Logging.h"
 #include "mozilla/Unused.h"
 #include <algorithm>
 
+#ifdef MOZILLA_PRESUME_SSE2
+#  include <emmintrin.h>
+#endif
+
 using namespace mozilla;
+using namespace mozilla::safebrowsing;
 
 // MOZ_LOG=UrlClassifierPrefixSet:5
 static LazyLogModule gUrlClassifierPrefixSetLog("UrlClassifierPrefixSet");
@@ -36,7 +44,9 @@ NS_IMPL_ISUPPORTS(nsUrlClassifierPrefixSet, nsIUrlClassifierPrefixSet,
                   nsIMemoryReporter)
 
 nsUrlClassifierPrefixSet::nsUrlClassifierPrefixSet()
-    : mLock("nsUrlClassifierPrefixSet.mLock"), mTotalPrefixes(0) {}
+    : mLock("nsUrlClassifierPrefixSet.mLock"),
+      mBlocks(nullptr),
+      mTotalPrefixes(0) {}
 
 NS_IMETHODIMP
 nsUrlClassifierPrefixSet::Init(const nsACString& aName) {
@@ -56,8 +66,10 @@ nsUrlClassifierPrefixSet::~nsUrlClassifierPrefixSet() {
 
 void nsUrlClassifierPrefixSet::Clear() {
   LOG(("[%s] Clearing PrefixSet", mName.get()));
-  mIndexDeltas.Clear();
   mIndexPrefixes.Clear();
+  mOwnedBlocks.Clear();
+  mBlocks = nullptr;
+  mMap = nullptr;
   mTotalPrefixes = 0;
 }
 
@@ -76,13 +88,27 @@ nsUrlClassifierPrefixSet::SetPrefixes(const uint32_t* aArray,
     }
   }
 
-  MOZ_ASSERT_IF(mIndexDeltas.IsEmpty(),
-                mIndexPrefixes.Length() == mTotalPrefixes);
-  MOZ_ASSERT_IF(!mIndexDeltas.IsEmpty(),
-                mIndexPrefixes.Length() == mIndexDeltas.Length());
   return rv;
 }
 
+nsresult nsUrlClassifierPrefixSet::AllocateBlocks(uint32_t aBlockCount,
+                                                  uint32_t** aBlocks) {
+  mLock.AssertCurrentThreadOwns();
+
+  // One block more than needed, to be able to start on a cache line.
+  CheckedUint32 length = CheckedUint32(aBlockCount) + 1;
+  length *= PREFIXES_PER_BLOCK;
+  if (!length.isValid() || !mOwnedBlocks.SetLength(length.value(), fallible)) {
+    return NS_ERROR_OUT_OF_MEMORY;
+  }
+
+  uintptr_t start = reinterpret_cast<uintptr_t>(mOwnedBlocks.Elements());
+  start = (start + BLOCK_SIZE - 1) & ~uintptr_t(BLOCK_SIZE - 1);
+  *aBlocks = reinterpret_cast<uint32_t*>(start);
+  mBlocks = *aBlocks;
+  return NS_OK;
+}
+
 nsresult nsUrlClassifierPrefixSet::MakePrefixSet(const uint32_t* aPrefixes,
                                                  uint32_t aLength) {
   mLock.AssertCurrentThreadOwns();
@@ -96,91 +122,26 @@ nsresult nsUrlClassifierPrefixSet::MakePrefixSet(const uint32_t* aPrefixes,
   }
 #endif
 
-  uint32_t totalDeltas = 0;
-
-  // Request one memory space to store all the prefixes may lead to
-  // memory allocation failure on certain platforms(See Bug 1046038).
-  // So if required size to store all the prefixes exceeds defined
-  // threshold(512k), we divide prefixes into delta chunks instead. Note that
-  // the potential overhead of this approach is that it may reuqire more memory
-  // compared to store all prefixes in one array because of jemalloc's
-  // implementation.
-  if (aLength * sizeof(uint32_t) <
-      StaticPrefs::browser_safebrowsing_prefixset_max_array_size()) {
-    // Not over the threshold, store all prefixes into mIndexPrefixes.
-    // mIndexDeltas is empty in this case.
-    mIndexPrefixes.SetCapacity(aLength);
-    for (uint32_t i = 0; i < aLength; i++) {
-      mIndexPrefixes.AppendElement(aPrefixes[i]);
-    }
-  } else {
-    // Apply delta algorithm to split prefixes into smaller delta chunk.
-
-    // We estimate the capacity of mIndexPrefixes & mIndexDeltas by assuming
-    // each element in mIndexDeltas stores DELTAS_LIMITS deltas, so the
-    // number of indexed prefixes is round up of
-    // TotalPrefixes / (DELTA_LIMIT + 1)
-    // The estimation only works when the number of prefixes are over a
-    // certain limit, which means, arrays in mIndexDeltas are always full.
-    uint32_t estimateCapacity =
-        (aLength + (DELTAS_LIMIT + 1) - 1) / (DELTAS_LIMIT + 1);
-    mIndexPrefixes.SetCapacity(estimateCapacity);
-    mIndexDeltas.SetCapacity(estimateCapacity);
-
-    mIndexPrefixes.AppendElement(aPrefixes[0]);
-    mIndexDeltas.AppendElement();
-    mIndexDeltas.LastElement().SetCapacity(DELTAS_LIMIT);
-
-    uint32_t numOfDeltas = 0;
-    uint32_t previousItem = aPrefixes[0];
-    for (uint32_t i = 1; i < aLength; i++) {
-      if ((numOfDeltas >= DELTAS_LIMIT) ||
-          (aPrefixes[i] - previousItem >= MAX_INDEX_DIFF)) {
-        // Compact the previous element.
-        // Note there is always at least one element when we get here,
-        // because we created the first element before the loop.
-        mIndexDeltas.LastElement().Compact();
-        if (!mIndexDeltas.AppendElement(fallible)) {
-          return NS_ERROR_OUT_OF_MEMORY;
-        }
-        mIndexDeltas.LastElement().SetCapacity(DELTAS_LIMIT);
-
-        if (!mIndexPrefixes.AppendElement(aPrefixes[i], fallible)) {
-          return NS_ERROR_OUT_OF_MEMORY;
-        }
-
-        numOfDeltas = 0;
-      } else {
-        uint16_t delta = aPrefixes[i] - previousItem;
-        if (!mIndexDeltas.LastElement().AppendElement(delta, fallible)) {
-          return NS_ERROR_OUT_OF_MEMORY;
-        }
-
-        numOfDeltas++;
-        totalDeltas++;
-      }
-      previousItem = aPrefixes[i];
-    }
-
-    mIndexDeltas.LastElement().Compact();
-    mIndexDeltas.Compact();
-    mIndexPrefixes.Compact();
-
-    MOZ_ASSERT(mIndexPrefixes.Length() == mIndexDeltas.Length());
+  uint32_t blockCount = (aLength - 1) / PREFIXES_PER_BLOCK + 1;
+  uint32_t* blocks;
+  nsresult rv = AllocateBlocks(blockCount, &blocks);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (!mIndexPrefixes.SetCapacity(blockCount, fallible)) {
+    return NS_ERROR_OUT_OF_MEMORY;
   }
 
-  if (totalDeltas == 0) {
-    // We have to clear mIndexDeltas here because it is still possible
-    // that the delta generation algorithm produces no deltas at all. When that
-    // happens, mIndexDeltas is not empty, which conflicts with the assumption
-    // that when there is no delta, mIndexDeltas is empty.
-    mIndexDeltas.Clear();
+  memcpy(blocks, aPrefixes, aLength * sizeof(uint32_t));
+  // Repeating the last prefix keeps the padding from matching anything else.
+  for (uint32_t i = aLength; i < blockCount * PREFIXES_PER_BLOCK; i++) {
+    blocks[i] = aPrefixes[aLength - 1];
+  }
+  for (uint32_t i = 0; i < blockCount; i++) {
+    mIndexPrefixes.AppendElement(blocks[i * PREFIXES_PER_BLOCK]);
   }
   mTotalPrefixes = aLength;
 
-  LOG(("Total number of indices: %d", aLength));
-  LOG(("Total number of deltas: %d", totalDeltas));
-  LOG(("Total number of delta chunks: %zu", mIndexDeltas.Length()));
+  LOG(("Total number of prefixes: %u", aLength));
+  LOG(("Total number of blocks: %u", blockCount));
 
   return NS_OK;
 }
@@ -189,35 +150,20 @@ nsresult nsUrlClassifierPrefixSet::GetPrefixesNative(
     FallibleTArray<uint32_t>& outArray) {
   MutexAutoLock lock(mLock);
 
+  // All of a mapped file is about to be read, check it first.
+  if (mMap) {
+    nsresult rv = mMap->Verify();
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
   if (!outArray.SetLength(mTotalPrefixes, fallible)) {
     return NS_ERROR_OUT_OF_MEMORY;
   }
 
-  uint32_t prefixIdxLength = mIndexPrefixes.Length();
-  uint32_t prefixCnt = 0;
-
-  for (uint32_t i = 0; i < prefixIdxLength; i++) {
-    uint32_t prefix = mIndexPrefixes[i];
-
-    if (prefixCnt >= mTotalPrefixes) {
-      return NS_ERROR_FAILURE;
-    }
-    outArray[prefixCnt++] = prefix;
-
-    if (mIndexDeltas.IsEmpty()) {
-      continue;
-    }
-
-    for (uint32_t j = 0; j < mIndexDeltas[i].Length(); j++) {
-      prefix += mIndexDeltas[i][j];
-      if (prefixCnt >= mTotalPrefixes) {
-        return NS_ERROR_FAILURE;
-      }
-      outArray[prefixCnt++] = prefix;
-    }
+  if (mTotalPrefixes) {
+    memcpy(outArray.Elements(), mBlocks, mTotalPrefixes * sizeof(uint32_t));
   }
 
-  NS_ASSERTION(mTotalPrefixes == prefixCnt, "Lengths are inconsistent");
   return NS_OK;
 }
 
@@ -249,22 +195,26 @@ nsUrlClassifierPrefixSet::GetPrefixes(uint32_t* aCount, uint32_t** aPrefixes) {
   return NS_OK;
 }
 
-uint32_t nsUrlClassifierPrefixSet::BinSearch(uint32_t start, uint32_t end,
-                                             uint32_t target) const {
-  mLock.AssertCurrentThreadOwns();
-
-  while (start != end && end >= start) {
-    uint32_t i = start + ((end - start) >> 1);
-    uint32_t value = mIndexPrefixes[i];
-    if (value < target) {
-      start = i + 1;
-    } else if (value > target) {
-      end = i - 1;
-    } else {
-      return i;
-    }
+// Whether any of the PREFIXES_PER_BLOCK prefixes of |aBlock| is |aPrefix|.
+static inline bool BlockContains(const uint32_t* aBlock, uint32_t aPrefix) {
+#ifdef MOZILLA_PRESUME_SSE2
+  // Mapped blocks may not be aligned, so use unaligned loads.
+  const __m128i* block = reinterpret_cast<const __m128i*>(aBlock);
+  const __m128i prefix = _mm_set1_epi32(aPrefix);
+  __m128i match = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi32(_mm_loadu_si128(block), prefix),
+                   _mm_cmpeq_epi32(_mm_loadu_si128(block + 1), prefix)),
+      _mm_or_si128(_mm_cmpeq_epi32(_mm_loadu_si128(block + 2), prefix),
+                   _mm_cmpeq_epi32(_mm_loadu_si128(block + 3), prefix)));
+  return _mm_movemask_epi8(match) != 0;
+#else
+  // Without the early exit, compilers can vectorize this.
+  bool found = false;
+  for (uint32_t i = 0; i < 16; i++) {
+    found |= aBlock[i] == aPrefix;
   }
-  return end;
+  return found;
+#endif
 }
 
 NS_IMETHODIMP
@@ -277,43 +227,18 @@ nsUrlClassifierPrefixSet::Contains(uint32_t aPrefix, bool* aFound) {
     return NS_OK;
   }
 
-  uint32_t target = aPrefix;
+  static_assert(PREFIXES_PER_BLOCK == 16, "BlockContains() compares 16");
 
-  // We want to do a "Price is Right" binary search, that is, we want to find
-  // the index of the value either equal to the target or the closest value
-  // that is less than the target.
-  //
-  if (target < mIndexPrefixes[0]) {
+  // The prefix can only be in the last block that starts at or before it.
+  const uint32_t* index = mIndexPrefixes.Elements();
+  const uint32_t* next =
+      std::upper_bound(index, index + mIndexPrefixes.Length(), aPrefix);
+  if (next == index) {
     return NS_OK;
   }
 
-  // |binsearch| does not necessarily return the correct index (when the
-  // target is not found) but rather it returns an index at least one away
-  // from the correct index.
-  // Because of this, we need to check if the target lies before the beginning
-  // of the indices.
-
-  uint32_t i = BinSearch(0, mIndexPrefixes.Length() - 1, target);
-  if (mIndexPrefixes[i] > target && i > 0) {
-    i--;
-  }
-
-  // Now search through the deltas for the target.
-  uint32_t diff = target - mIndexPrefixes[i];
-
-  if (!mIndexDeltas.IsEmpty()) {
-    uint32_t deltaSize = mIndexDeltas[i].Length();
-    uint32_t deltaIndex = 0;
-
-    while (diff > 0 && deltaIndex < deltaSize) {
-      diff -= mIndexDeltas[i][deltaIndex];
-      deltaIndex++;
-    }
-  }
-
-  if (diff == 0) {
-    *aFound = true;
-  }
+  size_t block = next - index - 1;
+  *aFound = BlockContains(mBlocks + block * PREFIXES_PER_BLOCK, aPrefix);
 
   return NS_OK;
 }
@@ -341,24 +266,24 @@ size_t nsUrlClassifierPrefixSet::SizeOfIncludingThis(
     mozilla::MallocSizeOf aMallocSizeOf) const {
   MutexAutoLock lock(mLock);
 
+  // Blocks in a mapped file are not on the heap.
   size_t n = 0;
   n += aMallocSizeOf(this);
-  n += mIndexDeltas.ShallowSizeOfExcludingThis(aMallocSizeOf);
-  for (uint32_t i = 0; i < mIndexDeltas.Length(); i++) {
-    n += mIndexDeltas[i].ShallowSizeOfExcludingThis(aMallocSizeOf);
-  }
   n += mIndexPrefixes.ShallowSizeOfExcludingThis(aMallocSizeOf);
+  n += mOwnedBlocks.ShallowSizeOfExcludingThis(aMallocSizeOf);
   return n;
 }
 
 bool nsUrlClassifierPrefixSet::IsEmptyInternal() const {
   if (mIndexPrefixes.IsEmpty()) {
-    MOZ_ASSERT(mIndexDeltas.IsEmpty() && mTotalPrefixes == 0,
+    MOZ_ASSERT(mTotalPrefixes == 0,
                "If we're empty, there should be no leftovers.");
     return true;
   }
 
-  MOZ_ASSERT(mTotalPrefixes >= mIndexPrefixes.Length());
+  MOZ_ASSERT(mBlocks);
+  MOZ_ASSERT(mTotalPrefixes > (mIndexPrefixes.Length() - 1) *
+                                  PREFIXES_PER_BLOCK);
   return false;
 }
 
@@ -370,213 +295,382 @@ nsUrlClassifierPrefixSet::IsEmpty(bool* aEmpty) {
   return NS_OK;
 }
 
+static nsresult ReadArray(nsIInputStream* aIn, void* aData, uint32_t aSize) {
+  uint32_t read;
+  nsresult rv = aIn->Read(reinterpret_cast<char*>(aData), aSize, &read);
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(read == aSize, NS_ERROR_FAILURE);
+  return NS_OK;
+}
+
+static nsresult WriteArray(nsIOutputStream* aOut, const void* aData,
+                           uint32_t aSize) {
+  uint32_t written;
+  nsresult rv =
+      aOut->Write(reinterpret_cast<const char*>(aData), aSize, &written);
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(written == aSize, NS_ERROR_FAILURE);
+  return NS_OK;
+}
+
+// The stored format is
+//
+//   uint32_t magic, total prefixes, block count, padding size
+//   uint32_t index prefixes[block count]
+//   uint8_t  padding[padding size]
+//   uint32_t blocks[block count][PREFIXES_PER_BLOCK]
+//
+// in native byte order, where the padding puts the blocks on a cache line
+// of the file, so that a mapping of the file can be used as it is.
+static const uint32_t kHeaderSize = 4 * sizeof(uint32_t);
+
+// static
+uint32_t nsUrlClassifierPrefixSet::BlockPadding(uint32_t aFileOffset,
+                                                uint32_t aBlockCount) {
+  uint32_t indexEnd =
+      aFileOffset + kHeaderSize + aBlockCount * sizeof(uint32_t);
+  return (BLOCK_SIZE - indexEnd % BLOCK_SIZE) % BLOCK_SIZE;
+}
+
+nsresult nsUrlClassifierPrefixSet::CheckLoadedPrefixes() const {
+  uint32_t blockCount = mIndexPrefixes.Length();
+  if (blockCount != (uint64_t(mTotalPrefixes) + PREFIXES_PER_BLOCK - 1) /
+                        PREFIXES_PER_BLOCK) {
+    return NS_ERROR_FILE_CORRUPTED;
+  }
+
+  // Lookups rely on the index being sorted. The blocks themselves are not
+  // read, which would fault in the whole of a mapped file.
+  for (uint32_t i = 1; i < blockCount; i++) {
+    if (mIndexPrefixes[i] < mIndexPrefixes[i - 1]) {
+      return NS_ERROR_FILE_CORRUPTED;
+    }
+  }
+
+  return NS_OK;
+}
+
 nsresult nsUrlClassifierPrefixSet::LoadPrefixes(nsCOMPtr<nsIInputStream>& in) {
   MutexAutoLock lock(mLock);
 
+  nsresult rv = LoadPrefixesInternal(in);
+  if (NS_FAILED(rv)) {
+    Clear();
+  }
+  return rv;
+}
+
+nsresult nsUrlClassifierPrefixSet::LoadPrefixesInternal(nsIInputStream* in) {
+  mLock.AssertCurrentThreadOwns();
+
   mCanary.Check();
   Clear();
 
   uint32_t magic;
-  uint32_t read;
+  nsresult rv = ReadArray(in, &magic, sizeof(magic));
+  NS_ENSURE_SUCCESS(rv, rv);
 
-  nsresult rv =
-      in->Read(reinterpret_cast<char*>(&magic), sizeof(uint32_t), &read);
+  if (magic == PREFIXSET_DELTA_VERSION_MAGIC) {
+    return LoadDeltaPrefixes(in);
+  }
+  if (magic != PREFIXSET_VERSION_MAGIC) {
+    LOG(("[%s] Version magic mismatch, not loading", mName.get()));
+    return NS_ERROR_FILE_CORRUPTED;
+  }
+
+  // The rest of the header
+  uint32_t header[3];
+  rv = ReadArray(in, header, sizeof(header));
   NS_ENSURE_SUCCESS(rv, rv);
-  NS_ENSURE_TRUE(read == sizeof(uint32_t), NS_ERROR_FAILURE);
 
-  if (magic == PREFIXSET_VERSION_MAGIC) {
-    // Read the number of indexed prefixes
-    uint32_t indexSize;
-    rv = in->Read(reinterpret_cast<char*>(&indexSize), sizeof(uint32_t), &read);
+  uint32_t totalPrefixes = header[0];
+  uint32_t blockCount = header[1];
+  uint32_t padding = header[2];
+  if (padding >= BLOCK_SIZE || blockCount > UINT32_MAX / BLOCK_SIZE - 1) {
+    return NS_ERROR_FILE_CORRUPTED;
+  }
+
+  if (blockCount) {
+    if (!mIndexPrefixes.SetLength(blockCount, fallible)) {
+      return NS_ERROR_OUT_OF_MEMORY;
+    }
+    rv = ReadArray(in, mIndexPrefixes.Elements(),
+                   blockCount * sizeof(uint32_t));
     NS_ENSURE_SUCCESS(rv, rv);
-    NS_ENSURE_TRUE(read == sizeof(uint32_t), NS_ERROR_FAILURE);
+  }
 
-    // Read the number of delta prefixes
-    uint32_t deltaSize;
-    rv = in->Read(reinterpret_cast<char*>(&deltaSize), sizeof(uint32_t), &read);
+  char skipped[BLOCK_SIZE];
+  rv = ReadArray(in, skipped, padding);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (blockCount) {
+    uint32_t* blocks;
+    rv = AllocateBlocks(blockCount, &blocks);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = ReadArray(in, blocks, blockCount * BLOCK_SIZE);
     NS_ENSURE_SUCCESS(rv, rv);
-    NS_ENSURE_TRUE(read == sizeof(uint32_t), NS_ERROR_FAILURE);
+  }
+  mTotalPrefixes = totalPrefixes;
 
-    if (indexSize == 0) {
-      LOG(("[%s] Stored PrefixSet is empty!", mName.get()));
-      return NS_OK;
-    }
+  rv = CheckLoadedPrefixes();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  LOG(("[%s] Loading PrefixSet successful (%u total prefixes)", mName.get(),
+       mTotalPrefixes));
+  return NS_OK;
+}
+
+// Reads the delta-encoded format written by earlier versions, which stores
+// runs of up to DELTAS_LIMIT 16-bit deltas after a prefix stored in full.
+nsresult nsUrlClassifierPrefixSet::LoadDeltaPrefixes(nsIInputStream* in) {
+  mLock.AssertCurrentThreadOwns();
 
-    if (!mIndexPrefixes.SetLength(indexSize, fallible)) {
+  // Read the number of indexed prefixes and of delta prefixes
+  uint32_t sizes[2];
+  nsresult rv = ReadArray(in, sizes, sizeof(sizes));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  uint32_t indexSize = sizes[0];
+  uint32_t deltaSize = sizes[1];
+  if (indexSize == 0) {
+    LOG(("[%s] Stored PrefixSet is empty!", mName.get()));
+    return NS_OK;
+  }
+  if (uint64_t(deltaSize) > uint64_t(indexSize) * DELTAS_LIMIT ||
+      indexSize > UINT32_MAX / sizeof(uint32_t)) {
+    return NS_ERROR_FILE_CORRUPTED;
+  }
+
+  FallibleTArray<uint32_t> indexPrefixes;
+  if (!indexPrefixes.SetLength(indexSize, fallible)) {
+    return NS_ERROR_OUT_OF_MEMORY;
+  }
+  rv = ReadArray(in, indexPrefixes.Elements(), indexSize * sizeof(uint32_t));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  FallibleTArray<uint32_t> prefixes;
+  if (deltaSize) {
+    FallibleTArray<uint32_t> indexStarts;
+    if (!indexStarts.SetLength(indexSize, fallible) ||
+        !prefixes.SetCapacity(indexSize + deltaSize, fallible)) {
       return NS_ERROR_OUT_OF_MEMORY;
     }
+    rv = ReadArray(in, indexStarts.Elements(), indexSize * sizeof(uint32_t));
+    NS_ENSURE_SUCCESS(rv, rv);
 
-    mTotalPrefixes = indexSize;
-    if (deltaSize > (indexSize * DELTAS_LIMIT)) {
+    if (indexStarts[0] != 0) {
       return NS_ERROR_FILE_CORRUPTED;
     }
 
-    // Read index prefixes
-    uint32_t toRead = indexSize * sizeof(uint32_t);
-    rv = in->Read(reinterpret_cast<char*>(mIndexPrefixes.Elements()), toRead,
-                  &read);
-    NS_ENSURE_SUCCESS(rv, rv);
-    NS_ENSURE_TRUE(read == toRead, NS_ERROR_FAILURE);
-
-    if (deltaSize) {
-      nsTArray<uint32_t> indexStarts;
-
-      if (!indexStarts.SetLength(indexSize, fallible) ||
-          !mIndexDeltas.SetLength(indexSize, fallible)) {
-        return NS_ERROR_OUT_OF_MEMORY;
+    uint16_t deltas[DELTAS_LIMIT];
+    for (uint32_t i = 0; i < indexSize; i++) {
+      uint32_t numInDelta = i == indexSize - 1
+                                ? deltaSize - indexStarts[i]
+                                : indexStarts[i + 1] - indexStarts[i];
+      if (numInDelta > DELTAS_LIMIT) {
+        return NS_ERROR_FILE_CORRUPTED;
       }
 
-      // Read index start array to construct mIndexDeltas
-      rv = in->Read(reinterpret_cast<char*>(indexStarts.Elements()), toRead,
-                    &read);
+      rv = ReadArray(in, deltas, numInDelta * sizeof(uint16_t));
       NS_ENSURE_SUCCESS(rv, rv);
-      NS_ENSURE_TRUE(read == toRead, NS_ERROR_FAILURE);
-
-      if (indexStarts[0] != 0) {
-        return NS_ERROR_FILE_CORRUPTED;
-      }
 
-      for (uint32_t i = 0; i < indexSize; i++) {
-        uint32_t numInDelta = i == indexSize - 1
-                                  ? deltaSize - indexStarts[i]
-                                  : indexStarts[i + 1] - indexStarts[i];
-        if (numInDelta > DELTAS_LIMIT) {
-          return NS_ERROR_FILE_CORRUPTED;
-        }
-        if (numInDelta > 0) {
-          if (!mIndexDeltas[i].SetLength(numInDelta, fallible)) {
-            return NS_ERROR_OUT_OF_MEMORY;
-          }
-          mTotalPrefixes += numInDelta;
-          toRead = numInDelta * sizeof(uint16_t);
-          rv = in->Read(reinterpret_cast<char*>(mIndexDeltas[i].Elements()),
-                        toRead, &read);
-          NS_ENSURE_SUCCESS(rv, rv);
-          NS_ENSURE_TRUE(read == toRead, NS_ERROR_FAILURE);
-        }
+      // The capacity set above is enough for all of these.
+      uint32_t prefix = indexPrefixes[i];
+      prefixes.AppendElement(prefix);
+      for (uint32_t j = 0; j < numInDelta; j++) {
+        prefix += deltas[j];
+        prefixes.AppendElement(prefix);
       }
-    } else {
-      mIndexDeltas.Clear();
+    }
+    if (prefixes.Length() != indexSize + deltaSize) {
+      return NS_ERROR_FILE_CORRUPTED;
     }
   } else {
-    LOG(("[%s] Version magic mismatch, not loading", mName.get()));
-    return NS_ERROR_FILE_CORRUPTED;
+    prefixes.SwapElements(indexPrefixes);
   }
 
-  MOZ_ASSERT_IF(mIndexDeltas.IsEmpty(),
-                mIndexPrefixes.Length() == mTotalPrefixes);
-  MOZ_ASSERT_IF(!mIndexDeltas.IsEmpty(),
-                mIndexPrefixes.Length() == mIndexDeltas.Length());
-  LOG(("[%s] Loading PrefixSet successful (%u total prefixes)", mName.get(),
-       mTotalPrefixes));
+  for (uint32_t i = 1; i < prefixes.Length(); i++) {
+    if (prefixes[i] < prefixes[i - 1]) {
+      return NS_ERROR_FILE_CORRUPTED;
+    }
+  }
+
+  rv = MakePrefixSet(prefixes.Elements(), prefixes.Length());
+  NS_ENSURE_SUCCESS(rv, rv);
 
+  LOG(("[%s] Loading delta-encoded PrefixSet successful (%u total prefixes)",
+       mName.get(), mTotalPrefixes));
   return NS_OK;
 }
 
-uint32_t nsUrlClassifierPrefixSet::CalculatePreallocateSize() const {
-  uint32_t fileSize = 4 * sizeof(uint32_t);
-  MOZ_RELEASE_ASSERT(mTotalPrefixes >= mIndexPrefixes.Length());
-  uint32_t deltas = mTotalPrefixes - mIndexPrefixes.Length();
-  fileSize += mIndexPrefixes.Length() * sizeof(uint32_t);
-  if (deltas) {
-    MOZ_ASSERT(mIndexPrefixes.Length() == mIndexDeltas.Length());
+nsresult nsUrlClassifierPrefixSet::LoadPrefixes(PrefixSetFileMap* aMap,
+                                                uint32_t* aOffset) {
+  MutexAutoLock lock(mLock);
 
-    fileSize += mIndexPrefixes.Length() * sizeof(uint32_t);
-    fileSize += mIndexDeltas.Length() * sizeof(uint32_t);
-    fileSize += deltas * sizeof(uint16_t);
-  }
-  return fileSize;
-}
+  mCanary.Check();
+  Clear();
 
-nsresult nsUrlClassifierPrefixSet::WritePrefixes(
-    nsCOMPtr<nsIOutputStream>& out) const {
-  MutexAutoLock lock(mLock);
+  if (*aOffset > aMap->Size()) {
+    return NS_ERROR_FILE_CORRUPTED;
+  }
+  const uint8_t* data = aMap->Data() + *aOffset;
+  uint32_t size = aMap->Size() - *aOffset;
 
-  MOZ_ASSERT_IF(mIndexDeltas.IsEmpty(),
-                mIndexPrefixes.Length() == mTotalPrefixes);
-  MOZ_ASSERT_IF(!mIndexDeltas.IsEmpty(),
-                mIndexPrefixes.Length() == mIndexDeltas.Length());
+  uint32_t header[4];
+  if (size >= kHeaderSize) {
+    memcpy(header, data, kHeaderSize);
+  }
 
-  mCanary.Check();
+  if (size < kHeaderSize || header[0] != PREFIXSET_VERSION_MAGIC) {
+    // Other formats are copied to the heap, like from any stream.
+    nsCOMPtr<nsIInputStream> in;
+    nsresult rv = NS_NewByteInputStream(
+        getter_AddRefs(in), MakeSpan(reinterpret_cast<const char*>(data), size),
+        NS_ASSIGNMENT_DEPEND);
+    NS_ENSURE_SUCCESS(rv, rv);
 
-  uint32_t written;
-  uint32_t writelen = sizeof(uint32_t);
-  const uint32_t magic = PREFIXSET_VERSION_MAGIC;
-  nsresult rv =
-      out->Write(reinterpret_cast<const char*>(&magic), writelen, &written);
-  NS_ENSURE_SUCCESS(rv, rv);
-  NS_ENSURE_TRUE(written == writelen, NS_ERROR_FAILURE);
-
-  const uint32_t indexSize = mIndexPrefixes.Length();
-  if (mIndexDeltas.IsEmpty()) {
-    if (NS_WARN_IF(mTotalPrefixes != indexSize)) {
-      LOG(("[%s] mIndexPrefixes doesn't have the same length as mTotalPrefixes",
-           mName.get()));
-      return NS_ERROR_FAILURE;
-    }
-  } else {
-    if (NS_WARN_IF(mIndexDeltas.Length() != indexSize)) {
-      LOG(("[%s] mIndexPrefixes doesn't have the same length as mIndexDeltas",
-           mName.get()));
-      return NS_ERROR_FAILURE;
+    rv = LoadPrefixesInternal(in);
+    if (NS_FAILED(rv)) {
+      Clear();
+      return rv;
     }
+
+    uint64_t available;
+    rv = in->Available(&available);
+    NS_ENSURE_SUCCESS(rv, rv);
+    *aOffset += size - available;
+    return NS_OK;
   }
-  uint32_t totalDeltas = 0;
 
-  // Store the shape of mIndexDeltas by noting at which "count" of total
-  // indexes a new subarray starts. This is slightly cumbersome but keeps
-  // file format compatibility.
-  // If we ever update the format, we can gain space by storing the delta
-  // subarray sizes, which fit in bytes.
-  nsTArray<uint32_t> indexStarts;
-  if (!mIndexDeltas.IsEmpty()) {
-    if (!indexStarts.SetCapacity(indexSize + 1, fallible)) {
-      return NS_ERROR_OUT_OF_MEMORY;
-    }
-    indexStarts.AppendElement(0);
+  uint32_t totalPrefixes = header[1];
+  uint32_t blockCount = header[2];
+  uint32_t padding = header[3];
 
-    for (uint32_t i = 0; i < indexSize; i++) {
-      uint32_t deltaLength = mIndexDeltas[i].Length();
-      totalDeltas += deltaLength;
-      indexStarts.AppendElement(totalDeltas);
+  CheckedUint32 blocksStart = CheckedUint32(blockCount) * sizeof(uint32_t);
+  blocksStart += kHeaderSize + padding;
+  CheckedUint32 end = CheckedUint32(blockCount) * BLOCK_SIZE + blocksStart;
+  if (padding >= BLOCK_SIZE || !end.isValid() || end.value() > size) {
+    return NS_ERROR_FILE_CORRUPTED;
+  }
+
+  // The index is small, and is read by every lookup.
+  if (!mIndexPrefixes.SetLength(blockCount, fallible)) {
+    return NS_ERROR_OUT_OF_MEMORY;
+  }
+  memcpy(mIndexPrefixes.Elements(), data + kHeaderSize,
+         blockCount * sizeof(uint32_t));
+
+  const uint8_t* blocks = data + blocksStart.value();
+  if (blockCount &&
+      reinterpret_cast<uintptr_t>(blocks) % alignof(uint32_t)) {
+    // Not written for this offset.
+    uint32_t* ownedBlocks;
+    nsresult rv = AllocateBlocks(blockCount, &ownedBlocks);
+    if (NS_FAILED(rv)) {
+      Clear();
+      return rv;
     }
-    indexStarts.RemoveElementAt(indexSize);  // we don't use the last element
-    MOZ_ASSERT(indexStarts.Length() == indexSize);
+    memcpy(ownedBlocks, blocks, blockCount * BLOCK_SIZE);
+  } else if (blockCount) {
+    mBlocks = reinterpret_cast<const uint32_t*>(blocks);
+    mMap = aMap;
   }
+  mTotalPrefixes = totalPrefixes;
 
-  rv =
-      out->Write(reinterpret_cast<const char*>(&indexSize), writelen, &written);
-  NS_ENSURE_SUCCESS(rv, rv);
-  NS_ENSURE_TRUE(written == writelen, NS_ERROR_FAILURE);
+  nsresult rv = CheckLoadedPrefixes();
+  if (NS_FAILED(rv)) {
+    Clear();
+    return rv;
+  }
 
-  rv = out->Write(reinterpret_cast<const char*>(&totalDeltas), writelen,
-                  &written);
-  NS_ENSURE_SUCCESS(rv, rv);
-  NS_ENSURE_TRUE(written == writelen, NS_ERROR_FAILURE);
+  *aOffset += end.value();
+  LOG(("[%s] Mapping PrefixSet successful (%u total prefixes)", mName.get(),
+       mTotalPrefixes));
+  return NS_OK;
+}
+
+uint32_t nsUrlClassifierPrefixSet::CalculatePreallocateSize(
+    uint32_t aFileOffset) const {
+  uint32_t blockCount = mIndexPrefixes.Length();
+  return kHeaderSize + blockCount * sizeof(uint32_t) +
+         BlockPadding(aFileOffset, blockCount) + blockCount * BLOCK_SIZE;
+}
+
+nsresult nsUrlClassifierPrefixSet::WritePrefixes(
+    nsCOMPtr<nsIOutputStream>& out, uint32_t aFileOffset) const {
+  MutexAutoLock lock(mLock);
+
+  mCanary.Check();
 
-  writelen = indexSize * sizeof(uint32_t);
-  rv = out->Write(reinterpret_cast<const char*>(mIndexPrefixes.Elements()),
-                  writelen, &written);
+  // Don't store corrupted blocks again with a new checksum.
+  if (mMap) {
+    nsresult rv = mMap->Verify();
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  const uint32_t blockCount = mIndexPrefixes.Length();
+  const uint32_t padding = BlockPadding(aFileOffset, blockCount);
+  const uint32_t header[4] = {PREFIXSET_VERSION_MAGIC, mTotalPrefixes,
+                              blockCount, padding};
+  nsresult rv = WriteArray(out, header, kHeaderSize);
   NS_ENSURE_SUCCESS(rv, rv);
-  NS_ENSURE_TRUE(written == writelen, NS_ERROR_FAILURE);
 
-  if (!mIndexDeltas.IsEmpty()) {
-    MOZ_ASSERT(!indexStarts.IsEmpty() && totalDeltas > 0);
-    rv = out->Write(reinterpret_cast<const char*>(indexStarts.Elements()),
-                    writelen, &written);
+  if (blockCount) {
+    rv = WriteArray(out, mIndexPrefixes.Elements(),
+                    blockCount * sizeof(uint32_t));
     NS_ENSURE_SUCCESS(rv, rv);
-    NS_ENSURE_TRUE(written == writelen, NS_ERROR_FAILURE);
+  }
 
-    for (uint32_t i = 0; i < indexSize; i++) {
-      writelen = mIndexDeltas[i].Length() * sizeof(uint16_t);
-      rv = out->Write(reinterpret_cast<const char*>(mIndexDeltas[i].Elements()),
-                      writelen, &written);
-      NS_ENSURE_SUCCESS(rv, rv);
-      NS_ENSURE_TRUE(written == writelen, NS_ERROR_FAILURE);
-    }
+  static const char zeroes[BLOCK_SIZE] = {};
+  rv = WriteArray(out, zeroes, padding);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (blockCount) {
+    rv = WriteArray(out, mBlocks, blockCount * BLOCK_SIZE);
+    NS_ENSURE_SUCCESS(rv, rv);
   }
 
   LOG(("[%s] Writing PrefixSet successful", mName.get()));
 
   return NS_OK;
 }
+
+namespace mozilla {
+namespace safebrowsing {
+
+PrefixSetFileMap::PrefixSetFileMap()
+    : mChecksumSize(0), mChecksum(0), mVerifyState(eValid) {}
+
+// static
+nsresult PrefixSetFileMap::Open(nsIFile* aFile, PrefixSetFileMap** aMap) {
+  RefPtr<PrefixSetFileMap> map = new PrefixSetFileMap();
+  auto result = map->mMap.init(aFile);
+  if (result.isErr()) {
+    return result.unwrapErr();
+  }
+
+  map.forget(aMap);
+  return NS_OK;
+}
+
+void PrefixSetFileMap::SetChecksum(uint32_t aDataSize, uint32_t aChecksum) {
+  MOZ_ASSERT(aDataSize <= Size());
+
+  mChecksumSize = aDataSize;
+  mChecksum = aChecksum;
+  mVerifyState = eUnverified;
+}
+
+nsresult PrefixSetFileMap::Verify() const {
+  if (mVerifyState == eUnverified) {
+    // Racing threads compute the same result.
+    mVerifyState = ComputeCrc32c(~0, Data(), mChecksumSize) == mChecksum
+                       ? eValid
+                       : eCorrupted;
+  }
+
+  return mVerifyState == eValid ? NS_OK : NS_ERROR_FILE_CORRUPTED;
+}
+
+}  // namespace safebrowsing
+}  // namespace mozilla
@@ -16,16 +16,52 @@
 #include "nsIUrlClassifierPrefixSet.h"
 #include "nsTArray.h"
 #include "nsToolkitCompsCID.h"
+#include "mozilla/Atomics.h"
 #include "mozilla/FileUtils.h"
 #include "mozilla/MemoryReporting.h"
 #include "mozilla/Mutex.h"
 #include "mozilla/Poison.h"
+#include "mozilla/RefPtr.h"
+#include "mozilla/loader/AutoMemMap.h"
 
 namespace mozilla {
 namespace safebrowsing {
 
 class VariableLengthPrefixSet;
 
+// A read-only mapping of a stored prefix set file. Prefix sets loaded from
+// it point into the mapping instead of copying the prefixes, and keep it
+// alive.
+class PrefixSetFileMap final {
+ public:
+  NS_INLINE_DECL_THREADSAFE_REFCOUNTING(PrefixSetFileMap)
+
+  static nsresult Open(nsIFile* aFile, PrefixSetFileMap** aMap);
+
+  const uint8_t* Data() const { return mMap.get<uint8_t>().get(); }
+  uint32_t Size() const { return mMap.size(); }
+
+  // Sets the CRC32C of the first |aDataSize| bytes. It isn't verified right
+  // away, which would fault in every page of the mapping, but by Verify().
+  void SetChecksum(uint32_t aDataSize, uint32_t aChecksum);
+
+  // Returns NS_ERROR_FILE_CORRUPTED if the data doesn't match the checksum
+  // set by SetChecksum(). Called before all the data is read anyway, like
+  // when the prefixes are copied for an update. Only verifies once.
+  nsresult Verify() const;
+
+ private:
+  PrefixSetFileMap();
+  ~PrefixSetFileMap() = default;
+
+  enum VerifyState : uint32_t { eUnverified, eValid, eCorrupted };
+
+  mozilla::loader::AutoMemMap mMap;
+  uint32_t mChecksumSize;
+  uint32_t mChecksum;
+  mutable mozilla::Atomic<uint32_t> mVerifyState;
+};
+
 }  // namespace safebrowsing
 }  // namespace mozilla
 
@@ -41,9 +77,16 @@ class nsUrlClassifierPrefixSet final : public nsIUrlClassifierPrefixSet,
   NS_IMETHOD IsEmpty(bool* aEmpty) override;
 
   nsresult GetPrefixesNative(FallibleTArray<uint32_t>& outArray);
-  nsresult WritePrefixes(nsCOMPtr<nsIOutputStream>& out) const;
+  // |aFileOffset| is where in the file the prefix set starts, so that the
+  // blocks can be aligned to cache lines in the file as well.
+  nsresult WritePrefixes(nsCOMPtr<nsIOutputStream>& out,
+                         uint32_t aFileOffset = 0) const;
   nsresult LoadPrefixes(nsCOMPtr<nsIInputStream>& in);
-  uint32_t CalculatePreallocateSize() const;
+  // Loads the prefix set stored at |*aOffset| in |aMap|, and advances
+  // |*aOffset| past it.
+  nsresult LoadPrefixes(mozilla::safebrowsing::PrefixSetFileMap* aMap,
+                        uint32_t* aOffset);
+  uint32_t CalculatePreallocateSize(uint32_t aFileOffset = 0) const;
 
   size_t SizeOfIncludingThis(mozilla::MallocSizeOf mallocSizeOf) const;
 
@@ -55,30 +98,38 @@ class nsUrlClassifierPrefixSet final : public nsIUrlClassifierPrefixSet,
  private:
   virtual ~nsUrlClassifierPrefixSet();
 
+  // Prefixes are stored in blocks of one cache line each, which a lookup
+  // compares all at once.
+  static const uint32_t PREFIXES_PER_BLOCK = 16;
+  static const uint32_t BLOCK_SIZE = PREFIXES_PER_BLOCK * sizeof(uint32_t);
+  // Limits from the delta-encoded format, which is still read.
   static const uint32_t DELTAS_LIMIT = 120;
-  static const uint32_t MAX_INDEX_DIFF = (1 << 16);
-  static const uint32_t PREFIXSET_VERSION_MAGIC = 1;
+  static const uint32_t PREFIXSET_DELTA_VERSION_MAGIC = 1;
+  static const uint32_t PREFIXSET_VERSION_MAGIC = 2;
 
   void Clear();
   nsresult MakePrefixSet(const uint32_t* aArray, uint32_t aLength);
-  uint32_t BinSearch(uint32_t start, uint32_t end, uint32_t target) const;
+  nsresult AllocateBlocks(uint32_t aBlockCount, uint32_t** aBlocks);
+  nsresult LoadPrefixesInternal(nsIInputStream* in);
+  nsresult LoadDeltaPrefixes(nsIInputStream* in);
+  nsresult CheckLoadedPrefixes() const;
   bool IsEmptyInternal() const;
+  static uint32_t BlockPadding(uint32_t aFileOffset, uint32_t aBlockCount);
 
   // Lock to prevent races between the url-classifier thread (which does most
   // of the operations) and the main thread (which does memory reporting).
   // It should be held for all operations between Init() and destruction that
   // touch this class's data members.
   mutable mozilla::Mutex mLock;
-  // list of fully stored prefixes, that also form the
-  // start of a run of deltas in mIndexDeltas.
+  // The first prefix of each block, to find the block a prefix would be in.
   nsTArray<uint32_t> mIndexPrefixes;
-  // array containing arrays of deltas from indices.
-  // Index to the place that matches the closest lower
-  // prefix from mIndexPrefix. Then every "delta" corresponds
-  // to a prefix in the PrefixSet.
-  // This array could be empty when we decide to store all the prefixes
-  // in mIndexPrefixes.
-  nsTArray<nsTArray<uint16_t> > mIndexDeltas;
+  // All the prefixes, in order, in mIndexPrefixes.Length() blocks. The last
+  // block is padded by repeating its last prefix. This points either into
+  // mOwnedBlocks or into mMap.
+  const uint32_t* mBlocks;
+  // Heap storage for the blocks, with room to align them to a cache line.
+  FallibleTArray<uint32_t> mOwnedBlocks;
+  RefPtr<mozilla::safebrowsing::PrefixSetFileMap> mMap;
 
   // how many prefixes we have.
   uint32_t mTotalPrefixes;
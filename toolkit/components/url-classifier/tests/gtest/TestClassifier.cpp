@@ -137,3 +137,47 @@ TEST(UrlClassifier, ReadNoiseEntriesV2)
   TestReadNoiseEntries(classifier, array, GTEST_TABLE_V2,
                        _Fragment("helloworld.com/"));
 }
+
+TEST(UrlClassifier, CheckURIFragmentHashes)
+{
+  RefPtr<Classifier> classifier = GetClassifier();
+  _PrefixArray array = {
+      GeneratePrefix(_Fragment("tracker.com/"), 4),
+      GeneratePrefix(_Fragment("ads.example.com/banner/"), 4),
+  };
+  array.Sort();
+
+  nsresult rv = SetupLookupCacheV4(classifier, array, GTEST_TABLE_V4);
+  ASSERT_TRUE(rv == NS_OK);
+
+  for (const char* spec :
+       {"tracker.com/pixel.gif", "ads.example.com/banner/1.png",
+        "www.example.com/index.html"}) {
+    nsTArray<nsCString> fragments;
+    rv = LookupCache::GetLookupFragments(nsDependentCString(spec), &fragments);
+    ASSERT_TRUE(rv == NS_OK);
+
+    nsTArray<Completion> hashes;
+    for (const nsCString& fragment : fragments) {
+      hashes.AppendElement()->FromPlaintext(fragment);
+    }
+
+    LookupResultArray fromFragments;
+    rv = classifier->CheckURIFragments(fragments, GTEST_TABLE_V4,
+                                       fromFragments);
+    ASSERT_TRUE(rv == NS_OK);
+
+    LookupResultArray fromHashes;
+    rv = classifier->CheckURIFragmentHashes(hashes, GTEST_TABLE_V4,
+                                            fromHashes);
+    ASSERT_TRUE(rv == NS_OK);
+
+    ASSERT_EQ(fromFragments.Length(), fromHashes.Length());
+    for (uint32_t i = 0; i < fromHashes.Length(); i++) {
+      EXPECT_EQ(fromFragments[i]->hash.complete, fromHashes[i]->hash.complete);
+      EXPECT_EQ(fromFragments[i]->mPartialHashLength,
+                fromHashes[i]->mPartialHashLength);
+    }
+    EXPECT_EQ(strncmp(spec, "www.", 4) != 0, !fromHashes.IsEmpty());
+  }
+}
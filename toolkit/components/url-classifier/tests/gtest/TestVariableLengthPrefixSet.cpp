@@ -7,8 +7,14 @@
 #include "nsTArray.h"
 #include "nsClassHashtable.h"
 #include "VariableLengthPrefixSet.h"
+#include "nsUrlClassifierPrefixSet.h"
+#include "nsStringStream.h"
 #include "nsAppDirectoryServiceDefs.h"
 #include "nsIFile.h"
+#include "nsISafeOutputStream.h"
+#include "nsIStorageStream.h"
+#include "nsCheckSummedOutputStream.h"
+#include "nsNetUtil.h"
 #include "mozilla/Preferences.h"
 #include "gtest/gtest.h"
 
@@ -495,3 +501,225 @@ TEST_P(UrlClassifierPrefixSetTest, LoadSaveNoDelta) {
 // "browser_safebrowsing_prefixset_max_array_size"
 INSTANTIATE_TEST_CASE_P(UrlClassifierPrefixSetTest, UrlClassifierPrefixSetTest,
                         ::testing::Values(0, UINT32_MAX));
+
+// Prefix sets stored by earlier versions are delta-encoded, and still load.
+TEST(UrlClassifierPrefixSet, LoadDeltaEncoded)
+{
+  // Two runs: a prefix stored in full followed by 119 deltas of 7, then a
+  // prefix stored in full followed by nothing.
+  nsTArray<uint32_t> prefixes;
+  for (uint32_t i = 0; i < 120; i++) {
+    prefixes.AppendElement(1000 + 7 * i);
+  }
+  prefixes.AppendElement(0x80000000);
+
+  const uint32_t header[] = {1 /* magic */, 2 /* index size */,
+                             119 /* delta size */, prefixes[0], prefixes[120],
+                             0 /* index starts */, 119};
+  nsCString stored;
+  stored.Append(reinterpret_cast<const char*>(header), sizeof(header));
+  for (uint32_t i = 0; i < 119; i++) {
+    uint16_t delta = 7;
+    stored.Append(reinterpret_cast<const char*>(&delta), sizeof(delta));
+  }
+
+  nsCOMPtr<nsIInputStream> in;
+  ASSERT_EQ(NS_OK, NS_NewCStringInputStream(getter_AddRefs(in), stored));
+
+  RefPtr<nsUrlClassifierPrefixSet> prefixSet = new nsUrlClassifierPrefixSet();
+  prefixSet->Init(NS_LITERAL_CSTRING("test"));
+  ASSERT_EQ(NS_OK, prefixSet->LoadPrefixes(in));
+
+  FallibleTArray<uint32_t> loaded;
+  ASSERT_EQ(NS_OK, prefixSet->GetPrefixesNative(loaded));
+  ASSERT_EQ(prefixes.Length(), loaded.Length());
+  for (uint32_t i = 0; i < prefixes.Length(); i++) {
+    EXPECT_EQ(prefixes[i], loaded[i]);
+
+    bool found;
+    prefixSet->Contains(prefixes[i], &found);
+    EXPECT_TRUE(found);
+    prefixSet->Contains(prefixes[i] + 1, &found);
+    EXPECT_FALSE(found);
+  }
+}
+
+namespace {
+
+// Stores a prefix set of |aPrefixes| |aOffset| bytes into a file, followed by
+// the CRC32C of the whole, the way LookupCacheV4 stores it after its header.
+// The blocks are padded for |aWrittenOffset|, so that they end up misaligned
+// if that isn't |aOffset|.
+already_AddRefed<nsIFile> WriteMappedPrefixSetFile(
+    const nsTArray<uint32_t>& aPrefixes, uint32_t aOffset,
+    uint32_t aWrittenOffset) {
+  RefPtr<nsUrlClassifierPrefixSet> prefixSet = new nsUrlClassifierPrefixSet();
+  prefixSet->Init(NS_LITERAL_CSTRING("test"));
+  EXPECT_EQ(NS_OK,
+            prefixSet->SetPrefixes(aPrefixes.Elements(), aPrefixes.Length()));
+
+  nsCOMPtr<nsIFile> file;
+  NS_GetSpecialDirectory(NS_APP_USER_PROFILE_50_DIR, getter_AddRefs(file));
+  file->Append(NS_LITERAL_STRING("test-mapped.pset"));
+
+  nsCOMPtr<nsIOutputStream> localOutFile;
+  EXPECT_EQ(NS_OK, NS_NewSafeLocalFileOutputStream(
+                       getter_AddRefs(localOutFile), file,
+                       PR_WRONLY | PR_TRUNCATE | PR_CREATE_FILE));
+
+  nsCOMPtr<nsIOutputStream> out;
+  EXPECT_EQ(NS_OK, NS_NewCrc32OutputStream(getter_AddRefs(out),
+                                           localOutFile.forget(), 4096));
+
+  // Stands in for the LookupCacheV4 header.
+  nsCString header;
+  header.SetLength(aOffset);
+  memset(header.BeginWriting(), 0xab, aOffset);
+  uint32_t written;
+  EXPECT_EQ(NS_OK, out->Write(header.get(), aOffset, &written));
+  EXPECT_EQ(aOffset, written);
+
+  EXPECT_EQ(NS_OK, prefixSet->WritePrefixes(out, aWrittenOffset));
+
+  nsCOMPtr<nsISafeOutputStream> safeOut = do_QueryInterface(out);
+  EXPECT_EQ(NS_OK, safeOut->Finish());
+
+  return file.forget();
+}
+
+// Loads the prefix set stored |aOffset| bytes into |aFile|, like
+// LookupCacheV4::LoadFromFile.
+already_AddRefed<nsUrlClassifierPrefixSet> LoadMappedPrefixSetFile(
+    nsIFile* aFile, uint32_t aOffset, bool aBadChecksum = false) {
+  RefPtr<PrefixSetFileMap> map;
+  EXPECT_EQ(NS_OK, PrefixSetFileMap::Open(aFile, getter_AddRefs(map)));
+  if (!map) {
+    return nullptr;
+  }
+
+  const uint32_t checksumSize = nsCrc32CheckSumedOutputStream::CHECKSUM_SIZE;
+  uint32_t dataSize = map->Size() - checksumSize;
+  uint32_t checksum;
+  memcpy(&checksum, map->Data() + dataSize, sizeof(checksum));
+  map->SetChecksum(dataSize, aBadChecksum ? ~checksum : checksum);
+
+  RefPtr<nsUrlClassifierPrefixSet> prefixSet = new nsUrlClassifierPrefixSet();
+  prefixSet->Init(NS_LITERAL_CSTRING("test"));
+
+  uint32_t offset = aOffset;
+  EXPECT_EQ(NS_OK, prefixSet->LoadPrefixes(map, &offset));
+  EXPECT_EQ(dataSize, offset);
+
+  return prefixSet.forget();
+}
+
+void CheckMappedPrefixSet(nsUrlClassifierPrefixSet* aPrefixSet,
+                          const nsTArray<uint32_t>& aPrefixes) {
+  for (uint32_t prefix : aPrefixes) {
+    bool found;
+    aPrefixSet->Contains(prefix, &found);
+    EXPECT_TRUE(found);
+    aPrefixSet->Contains(prefix + 1, &found);
+    EXPECT_FALSE(found);
+  }
+}
+
+void MakeMappedPrefixSetPrefixes(uint32_t aCount,
+                                 nsTArray<uint32_t>& aPrefixes) {
+  // Sorted, and never adjacent.
+  for (uint32_t i = 0; i < aCount; i++) {
+    aPrefixes.AppendElement(i * 2654435 + (rand() % 1000) * 2);
+  }
+}
+
+}  // namespace
+
+// A prefix set loaded from a mapping uses its blocks in place, or copies them
+// when they aren't aligned, and either way finds all of its prefixes.
+TEST(UrlClassifierPrefixSet, LoadMapped)
+{
+  nsTArray<uint32_t> prefixes;
+  MakeMappedPrefixSetPrefixes(1000, prefixes);
+
+  const uint32_t offsets[][2] = {
+      {0, 0},  // A LookupCacheV2 file.
+      {8, 8},  // After the LookupCacheV4 header.
+      {8, 3},  // Misaligned blocks.
+  };
+  for (const auto& offset : offsets) {
+    nsCOMPtr<nsIFile> file =
+        WriteMappedPrefixSetFile(prefixes, offset[0], offset[1]);
+    RefPtr<nsUrlClassifierPrefixSet> prefixSet =
+        LoadMappedPrefixSetFile(file, offset[0]);
+    ASSERT_TRUE(prefixSet);
+
+    CheckMappedPrefixSet(prefixSet, prefixes);
+
+    FallibleTArray<uint32_t> loaded;
+    ASSERT_EQ(NS_OK, prefixSet->GetPrefixesNative(loaded));
+    ASSERT_EQ(prefixes.Length(), loaded.Length());
+    for (uint32_t i = 0; i < prefixes.Length(); i++) {
+      EXPECT_EQ(prefixes[i], loaded[i]);
+    }
+
+    prefixSet = nullptr;
+    file->Remove(false);
+  }
+}
+
+// The checksum of a mapping isn't verified by loading it, which would read
+// all of it, but once all of the prefixes are read.
+TEST(UrlClassifierPrefixSet, LoadMappedBadChecksum)
+{
+  nsTArray<uint32_t> prefixes;
+  MakeMappedPrefixSetPrefixes(1000, prefixes);
+
+  nsCOMPtr<nsIFile> file = WriteMappedPrefixSetFile(prefixes, 8, 8);
+  RefPtr<nsUrlClassifierPrefixSet> prefixSet =
+      LoadMappedPrefixSetFile(file, 8, /* aBadChecksum */ true);
+  ASSERT_TRUE(prefixSet);
+
+  CheckMappedPrefixSet(prefixSet, prefixes);
+
+  FallibleTArray<uint32_t> loaded;
+  EXPECT_EQ(NS_ERROR_FILE_CORRUPTED, prefixSet->GetPrefixesNative(loaded));
+
+  // Nor is it stored again with a new checksum.
+  nsCOMPtr<nsIStorageStream> storage;
+  ASSERT_EQ(NS_OK,
+            NS_NewStorageStream(4096, UINT32_MAX, getter_AddRefs(storage)));
+  nsCOMPtr<nsIOutputStream> out;
+  ASSERT_EQ(NS_OK, storage->GetOutputStream(0, getter_AddRefs(out)));
+  EXPECT_EQ(NS_ERROR_FILE_CORRUPTED, prefixSet->WritePrefixes(out));
+
+  prefixSet = nullptr;
+  file->Remove(false);
+}
+
+// A mapping too short for the blocks it says it has is rejected.
+TEST(UrlClassifierPrefixSet, LoadMappedTruncated)
+{
+  nsTArray<uint32_t> prefixes;
+  MakeMappedPrefixSetPrefixes(1000, prefixes);
+
+  nsCOMPtr<nsIFile> file = WriteMappedPrefixSetFile(prefixes, 8, 8);
+  int64_t fileSize;
+  ASSERT_EQ(NS_OK, file->GetFileSize(&fileSize));
+  ASSERT_EQ(NS_OK, file->SetFileSize(fileSize - 100));
+
+  RefPtr<PrefixSetFileMap> map;
+  ASSERT_EQ(NS_OK, PrefixSetFileMap::Open(file, getter_AddRefs(map)));
+
+  RefPtr<nsUrlClassifierPrefixSet> prefixSet = new nsUrlClassifierPrefixSet();
+  prefixSet->Init(NS_LITERAL_CSTRING("test"));
+  uint32_t offset = 8;
+  EXPECT_EQ(NS_ERROR_FILE_CORRUPTED, prefixSet->LoadPrefixes(map, &offset));
+
+  bool empty;
+  prefixSet->IsEmpty(&empty);
+  EXPECT_TRUE(empty);
+
+  prefixSet = nullptr;
+  map = nullptr;
+  file->Remove(false);
+}
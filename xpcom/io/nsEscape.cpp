@@ -9,12 +9,18 @@
 #include "mozilla/ArrayUtils.h"
 #include "mozilla/BinarySearch.h"
 #include "mozilla/CheckedInt.h"
+#include "mozilla/MathAlgorithms.h"
+#include "mozilla/SSE.h"
 #include "mozilla/TextUtils.h"
 #include "nsTArray.h"
 #include "nsCRT.h"
 #include "plstr.h"
 #include "nsASCIIMask.h"
 
+#ifdef MOZILLA_PRESUME_SSE2
+#  include <emmintrin.h>
+#endif
+
 static const char hexCharsUpper[] = "0123456789ABCDEF";
 static const char hexCharsUpperLower[] = "0123456789ABCDEFabcdef";
 
@@ -272,6 +278,68 @@ static uint16_t dontNeedEscape(uint16_t aChar, uint32_t aFlags) {
              : 0;
 }
 
+// Alphanumerics and "-_~" don't need escaping in any URL component, and '.'
+// and '/' in most. Returns the length of the run of such characters at the
+// start of |aStr|, which is usually all of it. It is only meaningful when
+// |aFlags| has a component bit or esc_OnlyNonASCII.
+static size_t UnreservedPrefixLength(const char* aStr, size_t aLen,
+                                     uint32_t aFlags) {
+  bool ignoreAscii = !!(aFlags & esc_OnlyNonASCII);
+  // Where they do need escaping, compare with '-' again instead.
+  char dot =
+      (ignoreAscii || dontNeedEscape((unsigned char)'.', aFlags)) ? '.' : '-';
+  char slash =
+      (ignoreAscii || dontNeedEscape((unsigned char)'/', aFlags)) ? '/' : '-';
+
+  size_t i = 0;
+#ifdef MOZILLA_PRESUME_SSE2
+  // Classify 16 bytes at a time. Non-ASCII bytes are negative as signed
+  // chars, so they fall outside every range below.
+  const __m128i caseBit = _mm_set1_epi8(0x20);
+  const __m128i beforeA = _mm_set1_epi8('a' - 1);
+  const __m128i afterZ = _mm_set1_epi8('z' + 1);
+  const __m128i before0 = _mm_set1_epi8('0' - 1);
+  const __m128i after9 = _mm_set1_epi8('9' + 1);
+  const __m128i dash = _mm_set1_epi8('-');
+  const __m128i underscore = _mm_set1_epi8('_');
+  const __m128i tilde = _mm_set1_epi8('~');
+  const __m128i dots = _mm_set1_epi8(dot);
+  const __m128i slashes = _mm_set1_epi8(slash);
+  for (; i + 16 <= aLen; i += 16) {
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aStr + i));
+    __m128i lower = _mm_or_si128(c, caseBit);
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, beforeA),
+                                  _mm_cmplt_epi8(lower, afterZ));
+    __m128i digit =
+        _mm_and_si128(_mm_cmpgt_epi8(c, before0), _mm_cmplt_epi8(c, after9));
+    __m128i punct = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(c, dash), _mm_cmpeq_epi8(c, underscore)),
+        _mm_or_si128(_mm_cmpeq_epi8(c, tilde),
+                     _mm_or_si128(_mm_cmpeq_epi8(c, dots),
+                                  _mm_cmpeq_epi8(c, slashes))));
+    uint32_t unreserved = _mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(alpha, digit), punct));
+    if (unreserved != 0xFFFF) {
+      return i + mozilla::CountTrailingZeroes32(~unreserved);
+    }
+  }
+#endif
+
+  for (; i < aLen; ++i) {
+    char c = aStr[i];
+    if (!mozilla::IsAsciiAlphanumeric(c) && c != '-' && c != '_' &&
+        c != '~' && c != dot && c != slash) {
+      break;
+    }
+  }
+  return i;
+}
+
+static size_t UnreservedPrefixLength(const char16_t* aStr, size_t aLen,
+                                     uint32_t aFlags) {
+  return 0;
+}
+
 //----------------------------------------------------------------------------------------
 
 /**
@@ -312,8 +380,17 @@ static nsresult T_EscapeURL(const typename T::char_type* aPart, size_t aPartLen,
   typename T::char_type tempBuffer[100];
   unsigned int tempBufferPos = 0;
 
+  // Until something needs escaping, nothing is written, so skip straight to
+  // the first character that might.
+  size_t i = 0;
+  if (!writing && !aFilterMask &&
+      ((aFlags & esc_Minimal) || ignoreAscii)) {
+    i = UnreservedPrefixLength(aPart, aPartLen, aFlags);
+    src += i;
+  }
+
   bool previousIsNonASCII = false;
-  for (size_t i = 0; i < aPartLen; ++i) {
+  for (; i < aPartLen; ++i) {
     unsigned_char_type c = *src++;
 
     // If there is a filter, we wish to skip any characters which match it.
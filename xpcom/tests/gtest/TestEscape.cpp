@@ -142,3 +142,102 @@ TEST(Escape, EscapeSpaces)
   EXPECT_EQ(rv, NS_OK);
   EXPECT_STREQ(escaped.BeginReading(), "data:%0D%0A%20spa%20ces%C4%9F");
 }
+
+TEST(Escape, LongUnreservedRuns)
+{
+  // Runs of characters that don't need escaping, longer than what is
+  // classified at once, with a character that does at every position.
+  nsCString run;
+  for (uint32_t i = 0; i < 40; i++) {
+    run.Append("aZ9-_~./"[i % 8]);
+  }
+
+  for (uint32_t pos = 0; pos <= run.Length(); pos++) {
+    nsAutoCString toEscape(run);
+    toEscape.Insert(' ', pos);
+    nsAutoCString expected(run);
+    expected.Insert(NS_LITERAL_CSTRING("%20"), pos);
+
+    nsAutoCString escaped;
+    EXPECT_TRUE(
+        NS_EscapeURL(toEscape.get(), toEscape.Length(), esc_Query, escaped));
+    EXPECT_TRUE(escaped.Equals(expected));
+
+    toEscape.Replace(pos, 1, NS_LITERAL_CSTRING("\xC4\x9F"));
+    expected.Replace(pos, 3, NS_LITERAL_CSTRING("%C4%9F"));
+    escaped.Truncate();
+    EXPECT_TRUE(
+        NS_EscapeURL(toEscape.get(), toEscape.Length(), esc_Query, escaped));
+    EXPECT_TRUE(escaped.Equals(expected));
+  }
+
+  // Nothing to escape in a path.
+  nsAutoCString escaped;
+  EXPECT_FALSE(NS_EscapeURL(run.get(), run.Length(), esc_FilePath, escaped));
+  EXPECT_TRUE(escaped.IsEmpty());
+
+  // '.' and '/' are escaped in user names.
+  nsAutoCString expected;
+  for (uint32_t i = 0; i < run.Length(); i++) {
+    char c = run[i];
+    if (c == '.') {
+      expected.AppendLiteral("%2E");
+    } else if (c == '/') {
+      expected.AppendLiteral("%2F");
+    } else {
+      expected.Append(c);
+    }
+  }
+  EXPECT_TRUE(NS_EscapeURL(run.get(), run.Length(), esc_Username, escaped));
+  EXPECT_TRUE(escaped.Equals(expected));
+}
+
+TEST(Escape, UnreservedRunsMatchFiltered)
+{
+  // A filter mask turns off the fast skipping of unreserved runs, an empty
+  // one filters nothing, so it gives the result of the plain loop.
+  const ASCIIMaskArray kNoFilter = {};
+  const char kChars[] = "aZ9-_~./aZ9-_~./ %:;?#@[]\"<>\x01\x7f\xC4\x9F";
+  const uint32_t kFlags[] = {
+      esc_Scheme,
+      esc_Username,
+      esc_Password,
+      esc_Host,
+      esc_Directory,
+      esc_FileBaseName,
+      esc_FileExtension,
+      esc_FilePath,
+      esc_Param,
+      esc_Query,
+      esc_Ref,
+      esc_Query | esc_Forced,
+      esc_FilePath | esc_Colon | esc_Spaces,
+      esc_Query | esc_OnlyASCII,
+      esc_OnlyNonASCII,
+      esc_OnlyNonASCII | esc_Spaces,
+  };
+
+  uint32_t seed = 1;
+  for (uint32_t n = 0; n < 500; n++) {
+    // Mostly unreserved characters, so that runs cross the 16-byte blocks.
+    nsAutoCString str;
+    uint32_t length = n % 70;
+    for (uint32_t i = 0; i < length; i++) {
+      seed = seed * 1103515245 + 12345;
+      uint32_t r = (seed >> 16) % 64;
+      str.Append(kChars[r < 48 ? r % 16 : r % (sizeof(kChars) - 1)]);
+    }
+
+    for (uint32_t flags : kFlags) {
+      nsAutoCString escaped;
+      ASSERT_EQ(NS_OK, NS_EscapeURL(str, flags, escaped, fallible));
+      nsAutoCString filtered;
+      ASSERT_EQ(NS_OK,
+                NS_EscapeAndFilterURL(str, flags, &kNoFilter, filtered,
+                                      fallible));
+      EXPECT_TRUE(escaped.Equals(filtered))
+          << "flags " << flags << ": " << str.get() << " -> "
+          << escaped.get() << " vs " << filtered.get();
+    }
+  }
+}